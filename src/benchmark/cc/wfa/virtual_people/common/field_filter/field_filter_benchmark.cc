@@ -0,0 +1,350 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks of FieldFilter::IsMatch for each op and tree shape, on a
+// LabelerEvent populated like production traffic.
+//
+// Run with "bazel run -c opt" on the :field_filter_benchmark target.
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "benchmark/benchmark.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
+#include "google/protobuf/text_format.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+#include "wfa/virtual_people/common/model.pb.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::wfa_virtual_people::test::TestProto;
+
+constexpr char kLabelerEvent[] = R"pb(
+  labeler_input {
+    event_id {
+      publisher: "publisher_1"
+      id: "event_1"
+      id_fingerprint: 7420384738117437115
+    }
+    timestamp_usec: 1632960000000000
+    geo { country_id: 840 region_id: 6 city_id: 1234 }
+    profile_info {
+      email_user_info {
+        user_id: "email_user_1"
+        demo {
+          demo_bucket {
+            gender: GENDER_FEMALE
+            age { min_age: 25 max_age: 34 }
+          }
+          confidence: 0.9
+        }
+        home_geo { country_id: 840 region_id: 6 city_id: 1234 }
+      }
+      logged_in_id_user_info {
+        user_id: "logged_in_user_1"
+        demo {
+          demo_bucket {
+            gender: GENDER_FEMALE
+            age { min_age: 25 max_age: 34 }
+          }
+        }
+      }
+    }
+    device_type: "DESKTOP"
+    traffic_info { event_collection_id: "collection_1" }
+  }
+  person_country_code: "US"
+  acting_demo {
+    gender: GENDER_FEMALE
+    age { min_age: 25 max_age: 34 }
+  }
+  acting_fingerprint: 1384735125913583712
+)pb";
+
+LabelerEvent GetLabelerEvent() {
+  LabelerEvent event;
+  google::protobuf::TextFormat::ParseFromString(kLabelerEvent, &event);
+  return event;
+}
+
+FieldFilterProto ParseConfig(const std::string& config_text) {
+  FieldFilterProto config;
+  google::protobuf::TextFormat::ParseFromString(config_text, &config);
+  return config;
+}
+
+// Returns a comma separated list of the integers in [0, @size).
+std::string GetValueList(int size) {
+  std::vector<int> values(size);
+  for (int i = 0; i < size; ++i) {
+    values[i] = i;
+  }
+  return absl::StrJoin(values, ",");
+}
+
+// Measures IsMatch of the filter built from @config on @message.
+void RunIsMatch(benchmark::State& state, const FieldFilterProto& config,
+                const google::protobuf::Message& message,
+                const FieldFilterOptions& options = FieldFilterOptions()) {
+  absl::StatusOr<std::unique_ptr<FieldFilter>> filter =
+      FieldFilter::New(message.GetDescriptor(), config, options);
+  if (!filter.ok()) {
+    state.SkipWithError(filter.status().ToString().c_str());
+    return;
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize((*filter)->IsMatch(message));
+  }
+}
+
+void RunIsMatch(benchmark::State& state, const std::string& config_text) {
+  RunIsMatch(state, ParseConfig(config_text), GetLabelerEvent());
+}
+
+// Returns the options selecting the tree backend when @compiled is 0, and the
+// compiled backend otherwise.
+FieldFilterOptions GetOptions(int64_t compiled) {
+  FieldFilterOptions options;
+  options.compiled = compiled != 0;
+  return options;
+}
+
+void BM_EqualInteger(benchmark::State& state) {
+  RunIsMatch(state, R"pb(name: "labeler_input.geo.country_id"
+                         op: EQUAL
+                         value: "840")pb");
+}
+BENCHMARK(BM_EqualInteger);
+
+void BM_EqualString(benchmark::State& state) {
+  RunIsMatch(state, R"pb(name: "labeler_input.device_type"
+                         op: EQUAL
+                         value: "DESKTOP")pb");
+}
+BENCHMARK(BM_EqualString);
+
+void BM_EqualEnum(benchmark::State& state) {
+  RunIsMatch(state, R"pb(name: "acting_demo.gender"
+                         op: EQUAL
+                         value: "GENDER_FEMALE")pb");
+}
+BENCHMARK(BM_EqualEnum);
+
+// Arg: the size of the set.
+void BM_InInteger(benchmark::State& state) {
+  FieldFilterProto config;
+  config.set_name("labeler_input.geo.city_id");
+  config.set_op(FieldFilterProto::IN);
+  config.set_value(GetValueList(state.range(0)));
+  RunIsMatch(state, config, GetLabelerEvent());
+}
+BENCHMARK(BM_InInteger)->RangeMultiplier(16)->Range(1, 1 << 20);
+
+// Arg: the size of the set.
+void BM_InString(benchmark::State& state) {
+  std::vector<std::string> values;
+  for (int i = 0; i < state.range(0); ++i) {
+    values.push_back(absl::StrCat("publisher_", i));
+  }
+  FieldFilterProto config;
+  config.set_name("labeler_input.event_id.publisher");
+  config.set_op(FieldFilterProto::IN);
+  config.set_value(absl::StrJoin(values, ","));
+  RunIsMatch(state, config, GetLabelerEvent());
+}
+BENCHMARK(BM_InString)->RangeMultiplier(16)->Range(1, 1 << 20);
+
+// Arg: the size of the repeated field. None of the values is in the set, so
+// all of them are checked. LabelerEvent has no repeated scalar field outside
+// repeated messages, so TestProto is used.
+void BM_AnyIn(benchmark::State& state) {
+  TestProto message;
+  for (int i = 0; i < state.range(0); ++i) {
+    message.add_int32_values(-i);
+  }
+  FieldFilterProto config;
+  config.set_name("int32_values");
+  config.set_op(FieldFilterProto::ANY_IN);
+  config.set_value(GetValueList(16));
+  config.mutable_value()->append(",100");
+  RunIsMatch(state, config, message);
+}
+BENCHMARK(BM_AnyIn)->RangeMultiplier(4)->Range(1, 1 << 10);
+
+void BM_Gt(benchmark::State& state) {
+  RunIsMatch(state, R"pb(name: "labeler_input.timestamp_usec"
+                         op: GT
+                         value: "1600000000000000")pb");
+}
+BENCHMARK(BM_Gt);
+
+void BM_Lt(benchmark::State& state) {
+  RunIsMatch(state, R"pb(name: "labeler_input.timestamp_usec"
+                         op: LT
+                         value: "1600000000000000")pb");
+}
+BENCHMARK(BM_Lt);
+
+void BM_Range(benchmark::State& state) {
+  RunIsMatch(state, R"pb(op: AND
+                         sub_filters {
+                           name: "acting_demo.age.min_age"
+                           op: GT
+                           value: "17"
+                         }
+                         sub_filters {
+                           name: "acting_demo.age.min_age"
+                           op: LT
+                           value: "35"
+                         })pb");
+}
+BENCHMARK(BM_Range);
+
+void BM_HasScalar(benchmark::State& state) {
+  RunIsMatch(state, R"pb(name: "labeler_input.device_type" op: HAS)pb");
+}
+BENCHMARK(BM_HasScalar);
+
+void BM_HasMessage(benchmark::State& state) {
+  RunIsMatch(state,
+             R"pb(name: "labeler_input.profile_info.email_user_info"
+                  op: HAS)pb");
+}
+BENCHMARK(BM_HasMessage);
+
+void BM_Regexp(benchmark::State& state) {
+  RunIsMatch(state, R"pb(name: "labeler_input.event_id.publisher"
+                         op: REGEXP
+                         value: "publisher_[0-9]+")pb");
+}
+BENCHMARK(BM_Regexp);
+
+// Arg: the number of nested PARTIAL.
+void BM_PartialDepth(benchmark::State& state) {
+  const std::vector<std::string> path = {
+      "labeler_input", "profile_info", "email_user_info", "demo",
+      "demo_bucket",   "gender"};
+  const int depth = static_cast<int>(state.range(0));
+  FieldFilterProto config;
+  FieldFilterProto* node = &config;
+  for (int i = 0; i < depth; ++i) {
+    node->set_name(path[i]);
+    node->set_op(FieldFilterProto::PARTIAL);
+    node = node->add_sub_filters();
+  }
+  node->set_name(absl::StrJoin(path.begin() + depth, path.end(), "."));
+  node->set_op(FieldFilterProto::EQUAL);
+  node->set_value("GENDER_FEMALE");
+  RunIsMatch(state, config, GetLabelerEvent());
+}
+BENCHMARK(BM_PartialDepth)->DenseRange(0, 5);
+
+// The leaves of AND and OR trees. Each of them reads a different field.
+const std::vector<std::string>& GetLeafNames() {
+  static const std::vector<std::string>* const kLeafNames =
+      new std::vector<std::string>({
+          "labeler_input.timestamp_usec",
+          "labeler_input.geo.country_id",
+          "labeler_input.geo.region_id",
+          "labeler_input.geo.city_id",
+          "labeler_input.event_id.id_fingerprint",
+          "labeler_input.profile_info.email_user_info.home_geo.country_id",
+          "acting_demo.age.min_age",
+          "acting_demo.age.max_age",
+          "acting_fingerprint",
+      });
+  return *kLeafNames;
+}
+
+// Returns a tree of @op with @width leaves, all of which are evaluated: the
+// leaves of AND match, and the leaves of OR do not. All the leaf fields are
+// positive.
+FieldFilterProto GetWideTree(FieldFilterProto::Op op, int width) {
+  FieldFilterProto config;
+  config.set_op(op);
+  for (int i = 0; i < width; ++i) {
+    FieldFilterProto* leaf = config.add_sub_filters();
+    leaf->set_name(GetLeafNames()[i % GetLeafNames().size()]);
+    leaf->set_op(op == FieldFilterProto::AND ? FieldFilterProto::GT
+                                             : FieldFilterProto::LT);
+    leaf->set_value("0");
+  }
+  return config;
+}
+
+// Args: the number of leaves, and whether the compiled backend is used.
+void BM_AndWidth(benchmark::State& state) {
+  RunIsMatch(state,
+             GetWideTree(FieldFilterProto::AND,
+                         static_cast<int>(state.range(0))),
+             GetLabelerEvent(), GetOptions(state.range(1)));
+}
+BENCHMARK(BM_AndWidth)
+    ->ArgsProduct({benchmark::CreateRange(2, 64, 2), {0, 1}});
+
+// Args: the number of leaves, and whether the compiled backend is used.
+void BM_OrWidth(benchmark::State& state) {
+  RunIsMatch(state,
+             GetWideTree(FieldFilterProto::OR,
+                         static_cast<int>(state.range(0))),
+             GetLabelerEvent(), GetOptions(state.range(1)));
+}
+BENCHMARK(BM_OrWidth)->ArgsProduct({benchmark::CreateRange(2, 64, 2), {0, 1}});
+
+// Args: the number of nested AND and OR, and whether the compiled backend is
+// used. Each level is AND(leaf, OR(leaf, next level)), or the other way
+// around, where the leaf never decides the result, so all the levels are
+// evaluated.
+void BM_AndOrDepth(benchmark::State& state) {
+  const int depth = static_cast<int>(state.range(0));
+  FieldFilterProto config;
+  FieldFilterProto* node = &config;
+  for (int i = 0; i < depth; ++i) {
+    const bool is_and = i % 2 == 0;
+    node->set_op(is_and ? FieldFilterProto::AND : FieldFilterProto::OR);
+    FieldFilterProto* leaf = node->add_sub_filters();
+    leaf->set_name(GetLeafNames()[i % GetLeafNames().size()]);
+    leaf->set_op(is_and ? FieldFilterProto::GT : FieldFilterProto::LT);
+    leaf->set_value("0");
+    node = node->add_sub_filters();
+  }
+  node->set_name("labeler_input.device_type");
+  node->set_op(FieldFilterProto::EQUAL);
+  node->set_value("DESKTOP");
+  RunIsMatch(state, config, GetLabelerEvent(), GetOptions(state.range(1)));
+}
+BENCHMARK(BM_AndOrDepth)
+    ->ArgsProduct({benchmark::CreateDenseRange(1, 16, 3), {0, 1}});
+
+void BM_Not(benchmark::State& state) {
+  RunIsMatch(state, R"pb(op: NOT
+                         sub_filters {
+                           name: "labeler_input.device_type"
+                           op: EQUAL
+                           value: "MOBILE"
+                         })pb");
+}
+BENCHMARK(BM_Not);
+
+}  // namespace
+}  // namespace wfa_virtual_people
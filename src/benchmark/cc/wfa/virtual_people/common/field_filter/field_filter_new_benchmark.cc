@@ -0,0 +1,192 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks of building FieldFilters for LabelerEvent, from FieldFilterProto
+// and from filter messages.
+//
+// Run with "bazel run -c opt" on the :field_filter_new_benchmark target.
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "benchmark/benchmark.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/text_format.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/field_filter_cache.h"
+#include "wfa/virtual_people/common/model.pb.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+// A condition of a model node, with the usual mix of ops.
+constexpr char kCondition[] = R"pb(
+  op: AND
+  sub_filters {
+    op: OR
+    sub_filters {
+      name: "labeler_input.geo.country_id"
+      op: EQUAL
+      value: "840"
+    }
+    sub_filters {
+      name: "labeler_input.geo.country_id"
+      op: IN
+      value: "124,484"
+    }
+  }
+  sub_filters {
+    name: "labeler_input.profile_info.email_user_info.demo.demo_bucket"
+    op: PARTIAL
+    sub_filters { name: "gender" op: EQUAL value: "GENDER_FEMALE" }
+    sub_filters { name: "age.min_age" op: GT value: "17" }
+    sub_filters { name: "age.max_age" op: LT value: "35" }
+  }
+  sub_filters {
+    op: NOT
+    sub_filters {
+      name: "labeler_input.device_type"
+      op: REGEXP
+      value: "(MOBILE|TABLET)_.*"
+    }
+  }
+  sub_filters { name: "labeler_input.event_id.publisher" op: HAS }
+)pb";
+
+// A filter message, which FieldFilter::New turns into an AND of EQUAL on each
+// set field.
+constexpr char kFilterMessage[] = R"pb(
+  labeler_input {
+    geo { country_id: 840 region_id: 6 }
+    device_type: "DESKTOP"
+    event_id { publisher: "publisher_1" }
+  }
+  person_country_code: "US"
+  acting_demo {
+    gender: GENDER_FEMALE
+    age { min_age: 25 max_age: 34 }
+  }
+)pb";
+
+FieldFilterProto ParseConfig(const std::string& config_text) {
+  FieldFilterProto config;
+  google::protobuf::TextFormat::ParseFromString(config_text, &config);
+  return config;
+}
+
+// Measures FieldFilter::New from @config for LabelerEvent.
+void RunNew(benchmark::State& state, const FieldFilterProto& config,
+            const FieldFilterOptions& options = FieldFilterOptions()) {
+  const google::protobuf::Descriptor* descriptor =
+      LabelerEvent().GetDescriptor();
+  for (auto _ : state) {
+    absl::StatusOr<std::unique_ptr<FieldFilter>> filter =
+        FieldFilter::New(descriptor, config, options);
+    if (!filter.ok()) {
+      state.SkipWithError(filter.status().ToString().c_str());
+      return;
+    }
+    benchmark::DoNotOptimize(filter);
+  }
+}
+
+void BM_NewEqual(benchmark::State& state) {
+  RunNew(state, ParseConfig(R"pb(name: "labeler_input.geo.country_id"
+                                 op: EQUAL
+                                 value: "840")pb"));
+}
+BENCHMARK(BM_NewEqual);
+
+// Arg: the size of the set.
+void BM_NewIn(benchmark::State& state) {
+  std::vector<int64_t> values;
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    values.push_back(i);
+  }
+  FieldFilterProto config;
+  config.set_name("labeler_input.geo.city_id");
+  config.set_op(FieldFilterProto::IN);
+  config.set_value(absl::StrJoin(values, ","));
+  RunNew(state, config);
+}
+BENCHMARK(BM_NewIn)->RangeMultiplier(16)->Range(1, 1 << 20);
+
+void BM_NewRegexp(benchmark::State& state) {
+  RunNew(state, ParseConfig(R"pb(name: "labeler_input.device_type"
+                                 op: REGEXP
+                                 value: "(MOBILE|TABLET)_.*")pb"));
+}
+BENCHMARK(BM_NewRegexp);
+
+// Arg: whether the compiled backend is used.
+void BM_NewCondition(benchmark::State& state) {
+  FieldFilterOptions options;
+  options.compiled = state.range(0) != 0;
+  RunNew(state, ParseConfig(kCondition), options);
+}
+BENCHMARK(BM_NewCondition)->Arg(0)->Arg(1);
+
+// Arg: the number of conditions, which are copies of the same condition with
+// different values. Measures building the conditions of a model through a
+// FieldFilterCache, where the shared sub filters are built once.
+void BM_NewConditionsWithCache(benchmark::State& state) {
+  std::vector<FieldFilterProto> configs;
+  for (int i = 0; i < state.range(0); ++i) {
+    FieldFilterProto config = ParseConfig(kCondition);
+    config.mutable_sub_filters(0)->mutable_sub_filters(0)->set_value(
+        absl::StrCat(i % 8));
+    configs.push_back(std::move(config));
+  }
+  const google::protobuf::Descriptor* descriptor =
+      LabelerEvent().GetDescriptor();
+  for (auto _ : state) {
+    FieldFilterCache cache;
+    for (const FieldFilterProto& config : configs) {
+      absl::StatusOr<std::shared_ptr<const FieldFilter>> filter =
+          cache.GetOrCreate(descriptor, config);
+      if (!filter.ok()) {
+        state.SkipWithError(filter.status().ToString().c_str());
+        return;
+      }
+      benchmark::DoNotOptimize(filter);
+    }
+  }
+}
+BENCHMARK(BM_NewConditionsWithCache)->RangeMultiplier(8)->Range(1, 512);
+
+void BM_NewFromMessage(benchmark::State& state) {
+  LabelerEvent filter_message;
+  google::protobuf::TextFormat::ParseFromString(kFilterMessage,
+                                                &filter_message);
+  for (auto _ : state) {
+    absl::StatusOr<std::unique_ptr<FieldFilter>> filter =
+        FieldFilter::New(filter_message);
+    if (!filter.ok()) {
+      state.SkipWithError(filter.status().ToString().c_str());
+      return;
+    }
+    benchmark::DoNotOptimize(filter);
+  }
+}
+BENCHMARK(BM_NewFromMessage);
+
+}  // namespace
+}  // namespace wfa_virtual_people
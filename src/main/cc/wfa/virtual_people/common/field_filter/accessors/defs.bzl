@@ -0,0 +1,88 @@
+"""Build rules for the reflection-free accessors of FieldFilter."""
+
+load("@rules_cc//cc:defs.bzl", "cc_binary", "cc_library")
+
+_GENERATOR_MAIN = "//src/main/cc/wfa/virtual_people/common/field_filter/accessors:field_accessor_generator_main"
+
+_FIELD_ACCESSOR = "//src/main/cc/wfa/virtual_people/common/field_filter/utils:field_accessor"
+
+_FIELD_PATH_INTERNER = "//src/main/cc/wfa/virtual_people/common/field_filter/utils:field_path_interner"
+
+_FIELD_UTIL = "//src/main/cc/wfa/virtual_people/common/field_filter/utils:field_util"
+
+def _message_types_source(messages):
+    """Returns the C++ source defining GetFieldAccessorMessageTypes."""
+    includes = sorted({hdr: None for hdr in messages.values()}.keys())
+    lines = ["#include \"%s\"" % hdr for hdr in includes]
+    lines.append("#include <vector>")
+    lines.append("#include \"google/protobuf/descriptor.h\"")
+    lines.append("namespace wfa_virtual_people {")
+    lines.append("std::vector<const google::protobuf::Descriptor*> " +
+                 "GetFieldAccessorMessageTypes() {")
+    lines.append("  return {")
+    for message in messages.keys():
+        lines.append("      ::%s::descriptor()," % message.replace(".", "::"))
+    lines.append("  };")
+    lines.append("}")
+    lines.append("}  // namespace wfa_virtual_people")
+    return "\n".join(lines) + "\n"
+
+def field_accessor_library(name, messages, deps, **kwargs):
+    """Generates and registers the FieldAccessors of the given message types.
+
+    Linking the library makes FieldFilter::New read the fields of @messages
+    with the generated protobuf accessors instead of protobuf reflection.
+
+    Args:
+      name: The name of the cc_library.
+      messages: A dict from the full name of each top level message type to
+        the generated C++ header of the message type, e.g.
+        {"wfa_virtual_people.LabelerEvent":
+         "wfa/virtual_people/common/model.pb.h"}.
+      deps: The cc_proto_library targets of @messages.
+      **kwargs: Passed to the cc_library, e.g. visibility and testonly.
+    """
+    testonly = kwargs.get("testonly", False)
+
+    native.genrule(
+        name = name + "_message_types",
+        outs = [name + "_message_types.cc"],
+        cmd = "cat > $@ <<'EOF'\n%sEOF" % _message_types_source(messages),
+        testonly = testonly,
+        visibility = ["//visibility:private"],
+    )
+
+    cc_binary(
+        name = name + "_generator",
+        srcs = [name + "_message_types.cc"],
+        testonly = testonly,
+        visibility = ["//visibility:private"],
+        deps = deps + [
+            _GENERATOR_MAIN,
+            "@com_google_protobuf//:protobuf",
+        ],
+    )
+
+    native.genrule(
+        name = name + "_srcs",
+        outs = [name + ".cc"],
+        cmd = "$(location :%s_generator) $@" % name,
+        testonly = testonly,
+        tools = [":%s_generator" % name],
+        visibility = ["//visibility:private"],
+    )
+
+    cc_library(
+        name = name,
+        srcs = [name + ".cc"],
+        # The accessors are registered by static initialization, and nothing
+        # refers to the generated symbols directly.
+        alwayslink = True,
+        deps = deps + [
+            _FIELD_ACCESSOR,
+            _FIELD_PATH_INTERNER,
+            _FIELD_UTIL,
+            "@com_google_protobuf//:protobuf",
+        ],
+        **kwargs
+    )
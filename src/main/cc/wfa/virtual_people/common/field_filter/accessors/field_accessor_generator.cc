@@ -0,0 +1,294 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/accessors/field_accessor_generator.h"
+
+#include <cstddef>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_replace.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+#include "absl/strings/substitute.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+using FieldPath = std::vector<const google::protobuf::FieldDescriptor*>;
+
+// The member of FieldAccessor set for a field, and the C++ type returned by
+// the getter.
+struct GetterType {
+  absl::string_view member;
+  absl::string_view value_type;
+};
+
+// Returns the C++ class name of the generated protobuf message, with the
+// leading "::". Nested message types are joined by "_", the same as protoc.
+std::string GetClassName(const google::protobuf::Descriptor* descriptor) {
+  absl::string_view package = descriptor->file()->package();
+  absl::string_view name = descriptor->full_name();
+  std::string class_name = "::";
+  if (!package.empty()) {
+    name = absl::StripPrefix(name, absl::StrCat(package, "."));
+    absl::StrAppend(&class_name, absl::StrReplaceAll(package, {{".", "::"}}),
+                    "::");
+  }
+  absl::StrAppend(&class_name, absl::StrReplaceAll(name, {{".", "_"}}));
+  return class_name;
+}
+
+// Returns the name of the generated protobuf accessor of @field. protoc
+// appends "_" to the names colliding with C++ keywords.
+std::string GetAccessorName(const google::protobuf::FieldDescriptor* field) {
+  // The same as kKeywordList in protobuf's compiler/cpp/helpers.cc.
+  static const auto* const kKeywords = new absl::flat_hash_set<std::string>({
+      "NULL", "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand",
+      "bitor", "bool", "break", "case", "catch", "char", "class", "compl",
+      "const", "constexpr", "const_cast", "continue", "decltype", "default",
+      "delete", "do", "double", "dynamic_cast", "else", "enum", "explicit",
+      "export", "extern", "false", "float", "for", "friend", "goto", "if",
+      "inline", "int", "long", "mutable", "namespace", "new", "noexcept", "not",
+      "not_eq", "nullptr", "operator", "or", "or_eq", "private", "protected",
+      "public", "register", "reinterpret_cast", "return", "short", "signed",
+      "sizeof", "static", "static_assert", "static_cast", "struct", "switch",
+      "template", "this", "thread_local", "throw", "true", "try", "typedef",
+      "typeid", "typename", "union", "unsigned", "using", "virtual", "void",
+      "volatile", "wchar_t", "while", "xor", "xor_eq", "char8_t", "char16_t",
+      "char32_t", "concept", "consteval", "constinit", "co_await", "co_return",
+      "co_yield", "requires",
+  });
+  std::string name = absl::AsciiStrToLower(field->name());
+  if (kKeywords->contains(name)) {
+    absl::StrAppend(&name, "_");
+  }
+  return name;
+}
+
+// Returns the field names of @path joined by ".", which is the name used in
+// FieldFilterProto.
+std::string GetPathName(const FieldPath& path) {
+  return absl::StrJoin(
+      path, ".",
+      [](std::string* out, const google::protobuf::FieldDescriptor* field) {
+        out->append(field->name());
+      });
+}
+
+// Returns the getter type of @field. Returns an empty member if @field is not
+// supported by FieldAccessor.
+GetterType GetGetterType(const google::protobuf::FieldDescriptor* field) {
+  switch (field->cpp_type()) {
+    case google::protobuf::FieldDescriptor::CppType::CPPTYPE_INT32:
+    case google::protobuf::FieldDescriptor::CppType::CPPTYPE_ENUM:
+      return {"get_int32", "int32_t"};
+    case google::protobuf::FieldDescriptor::CppType::CPPTYPE_INT64:
+      return {"get_int64", "int64_t"};
+    case google::protobuf::FieldDescriptor::CppType::CPPTYPE_UINT32:
+      return {"get_uint32", "uint32_t"};
+    case google::protobuf::FieldDescriptor::CppType::CPPTYPE_UINT64:
+      return {"get_uint64", "uint64_t"};
+    case google::protobuf::FieldDescriptor::CppType::CPPTYPE_BOOL:
+      return {"get_bool", "bool"};
+    case google::protobuf::FieldDescriptor::CppType::CPPTYPE_STRING:
+      return {"get_string", "const std::string&"};
+    case google::protobuf::FieldDescriptor::CppType::CPPTYPE_MESSAGE:
+      return {"get_message", "const google::protobuf::Message&"};
+    default:
+      return {"", ""};
+  }
+}
+
+// Collects all the supported field paths in @descriptor into @paths.
+// @path is the path from the root message type to @descriptor, and @visiting
+// is the message types on @path, including @descriptor.
+void CollectFieldPaths(
+    const google::protobuf::Descriptor* descriptor, FieldPath& path,
+    std::vector<const google::protobuf::Descriptor*>& visiting,
+    std::vector<FieldPath>& paths) {
+  for (int i = 0; i < descriptor->field_count(); ++i) {
+    const google::protobuf::FieldDescriptor* field = descriptor->field(i);
+    if (field->is_repeated() || field->options().deprecated() ||
+        GetGetterType(field).member.empty()) {
+      continue;
+    }
+    path.push_back(field);
+    paths.push_back(path);
+    if (field->message_type() != nullptr &&
+        static_cast<int>(path.size()) < kMaxFieldAccessorDepth &&
+        !absl::c_linear_search(visiting, field->message_type())) {
+      visiting.push_back(field->message_type());
+      CollectFieldPaths(field->message_type(), path, visiting, paths);
+      visiting.pop_back();
+    }
+    path.pop_back();
+  }
+}
+
+// Returns the C++ expression of whether @field is set in @parent, which is the
+// same as Reflection::HasField.
+std::string GetHasExpression(absl::string_view parent,
+                             const google::protobuf::FieldDescriptor* field) {
+  std::string accessor = GetAccessorName(field);
+  if (field->has_presence()) {
+    return absl::StrCat(parent, ".has_", accessor, "()");
+  }
+  // Without presence, a field is set if it is not the default value.
+  switch (field->cpp_type()) {
+    case google::protobuf::FieldDescriptor::CppType::CPPTYPE_STRING:
+      return absl::StrCat("!", parent, ".", accessor, "().empty()");
+    case google::protobuf::FieldDescriptor::CppType::CPPTYPE_BOOL:
+      return absl::StrCat(parent, ".", accessor, "()");
+    default:
+      return absl::StrCat(parent, ".", accessor, "() != 0");
+  }
+}
+
+// Appends the accessor functions of @path to @output. The functions are named
+// by @suffix.
+void AppendAccessorFunctions(const google::protobuf::Descriptor* descriptor,
+                             const FieldPath& path, absl::string_view suffix,
+                             std::string& output) {
+  std::string parent = "root";
+  for (size_t i = 0; i + 1 < path.size(); ++i) {
+    absl::StrAppend(&parent, ".", GetAccessorName(path[i]), "()");
+  }
+  const google::protobuf::FieldDescriptor* field = path.back();
+  GetterType getter_type = GetGetterType(field);
+  std::string value = absl::StrCat("parent.", GetAccessorName(field), "()");
+  if (field->cpp_type() ==
+      google::protobuf::FieldDescriptor::CppType::CPPTYPE_ENUM) {
+    value = absl::StrCat("static_cast<int32_t>(", value, ")");
+  }
+  // The value read with protobuf reflection, for messages which are not
+  // instances of the generated class.
+  std::string reflection_value = absl::StrCat(
+      "GetValueFromProto<", getter_type.value_type, ">(message, Path", suffix,
+      "())");
+  if (field->cpp_type() ==
+      google::protobuf::FieldDescriptor::CppType::CPPTYPE_ENUM) {
+    reflection_value = absl::StrCat(
+        "GetValueFromProto<const google::protobuf::EnumValueDescriptor*>("
+        "message, Path",
+        suffix, "())");
+  }
+  absl::SubstituteAndAppend(
+      &output,
+      R"cc(
+// $0: $1
+const FieldPath& Path$2() {
+  static const FieldPath* const path =
+      InternFieldPath($3::descriptor(), "$1").value().get();
+  return *path;
+}
+
+bool Has$2(const google::protobuf::Message& message) {
+  if (message.GetReflection() != $3::GetReflection()) {
+    const google::protobuf::Message& parent =
+        GetParentMessageFromProto(message, Path$2());
+    return parent.GetReflection()->HasField(parent, Path$2().back());
+  }
+  const auto& root = static_cast<const $3&>(message);
+  const auto& parent = $4;
+  return $5;
+}
+
+ProtoFieldValue<$6> Get$2(const google::protobuf::Message& message) {
+  if (message.GetReflection() != $3::GetReflection()) {
+    const auto value = $8;
+    return {value.is_set, $9};
+  }
+  const auto& root = static_cast<const $3&>(message);
+  const auto& parent = $4;
+  return {$5, $7};
+}
+)cc",
+      descriptor->full_name(), GetPathName(path), suffix,
+      GetClassName(descriptor), parent, GetHasExpression("parent", field),
+      getter_type.value_type, value, reflection_value,
+      field->cpp_type() ==
+              google::protobuf::FieldDescriptor::CppType::CPPTYPE_ENUM
+          ? "value.value->number()"
+          : "value.value");
+}
+
+}  // namespace
+
+std::string GenerateFieldAccessors(
+    const std::vector<const google::protobuf::Descriptor*>& descriptors) {
+  std::set<std::string> includes;
+  for (const google::protobuf::Descriptor* descriptor : descriptors) {
+    includes.insert(absl::StrCat(
+        absl::StripSuffix(descriptor->file()->name(), ".proto"), ".pb.h"));
+  }
+
+  std::string output =
+      "// Generated by field_accessor_generator. DO NOT EDIT.\n\n"
+      "#include <cstdint>\n"
+      "#include <string>\n\n"
+      "#include \"google/protobuf/message.h\"\n"
+      "#include "
+      "\"wfa/virtual_people/common/field_filter/utils/field_accessor.h\"\n"
+      "#include "
+      "\"wfa/virtual_people/common/field_filter/utils/field_path_interner.h\"\n"
+      "#include "
+      "\"wfa/virtual_people/common/field_filter/utils/field_util.h\"\n";
+  for (const std::string& include : includes) {
+    absl::StrAppend(&output, "#include \"", include, "\"\n");
+  }
+  absl::StrAppend(&output, "\nnamespace wfa_virtual_people {\nnamespace {\n");
+
+  std::string registrations;
+  for (size_t i = 0; i < descriptors.size(); ++i) {
+    const google::protobuf::Descriptor* descriptor = descriptors[i];
+    FieldPath path;
+    std::vector<const google::protobuf::Descriptor*> visiting = {descriptor};
+    std::vector<FieldPath> paths;
+    CollectFieldPaths(descriptor, path, visiting, paths);
+
+    for (size_t j = 0; j < paths.size(); ++j) {
+      std::string suffix = absl::StrCat("_", i, "_", j);
+      AppendAccessorFunctions(descriptor, paths[j], suffix, output);
+      absl::SubstituteAndAppend(
+          &registrations,
+          "  accessor = FieldAccessor();\n"
+          "  accessor.has = &Has$0;\n"
+          "  accessor.$1 = &Get$0;\n"
+          "  RegisterFieldAccessor($2::descriptor(), \"$3\", accessor);\n",
+          suffix, GetGetterType(paths[j].back()).member,
+          GetClassName(descriptor), GetPathName(paths[j]));
+    }
+  }
+
+  absl::StrAppend(&output,
+                  "\n[[maybe_unused]] const bool kFieldAccessorsRegistered = "
+                  "[] {\n  FieldAccessor accessor;\n",
+                  registrations,
+                  "  return true;\n}();\n\n"
+                  "}  // namespace\n"
+                  "}  // namespace wfa_virtual_people\n");
+  return output;
+}
+
+}  // namespace wfa_virtual_people
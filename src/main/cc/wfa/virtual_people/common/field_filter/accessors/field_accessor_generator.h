@@ -0,0 +1,54 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_ACCESSORS_FIELD_ACCESSOR_GENERATOR_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_ACCESSORS_FIELD_ACCESSOR_GENERATOR_H_
+
+#include <string>
+#include <vector>
+
+#include "google/protobuf/descriptor.h"
+
+namespace wfa_virtual_people {
+
+// The deepest field path the generator emits accessors for. Deeper paths are
+// read with protobuf reflection.
+inline constexpr int kMaxFieldAccessorDepth = 8;
+
+// Generates a C++ source file, which registers a FieldAccessor for every
+// singular field path in each message type of @descriptors.
+//
+// The accessors call the generated protobuf accessors of the message types
+// directly. Repeated fields, floating point fields, deprecated fields, and
+// paths going through a message type already on the path are skipped, and are
+// read with protobuf reflection. The accessors also fall back to protobuf
+// reflection for messages of the same descriptor which are not instances of
+// the generated class, e.g. DynamicMessage.
+//
+// The generated file includes the generated protobuf headers of
+// @descriptors, so it must be compiled with the cc_proto_library of
+// @descriptors.
+std::string GenerateFieldAccessors(
+    const std::vector<const google::protobuf::Descriptor*>& descriptors);
+
+// Returns the message types to generate accessors for.
+//
+// This is defined by the source generated by field_accessor_library, which
+// also links the generated protobuf code of the message types into the
+// generator.
+std::vector<const google::protobuf::Descriptor*> GetFieldAccessorMessageTypes();
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_ACCESSORS_FIELD_ACCESSOR_GENERATOR_H_
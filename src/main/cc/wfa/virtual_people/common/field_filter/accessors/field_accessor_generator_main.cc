@@ -0,0 +1,43 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Writes the FieldAccessor registrations of the message types returned by
+// GetFieldAccessorMessageTypes to the given file.
+//
+// Usage:
+//   field_accessor_generator <output file>
+//
+// Use the field_accessor_library macro in defs.bzl instead of calling this
+// directly.
+
+#include <fstream>
+#include <iostream>
+
+#include "wfa/virtual_people/common/field_filter/accessors/field_accessor_generator.h"
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    std::cerr << "Usage: " << argv[0] << " <output file>" << std::endl;
+    return 1;
+  }
+  std::ofstream output(argv[1]);
+  output << wfa_virtual_people::GenerateFieldAccessors(
+      wfa_virtual_people::GetFieldAccessorMessageTypes());
+  output.close();
+  if (!output) {
+    std::cerr << "Failed to write " << argv[1] << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -20,10 +20,12 @@
 #include <vector>
 
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/message.h"
 #include "wfa/virtual_people/common/field_filter.pb.h"
 #include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/adaptive_order.h"
 
 namespace wfa_virtual_people {
 
@@ -39,10 +41,14 @@ class AndFilter : public FieldFilter {
   //    Any of @config.sub_filters is invalid to create a FieldFilter.
   static absl::StatusOr<std::unique_ptr<AndFilter>> New(
       const google::protobuf::Descriptor* descriptor,
-      const FieldFilterProto& config);
+      const FieldFilterProto& config, const FieldFilterOptions& options);
 
-  explicit AndFilter(std::vector<std::unique_ptr<FieldFilter>>&& sub_filters)
-      : sub_filters_(std::move(sub_filters)) {}
+  // @adaptive_order is nullptr when the sub filters are always applied in
+  // order.
+  AndFilter(std::vector<std::shared_ptr<const FieldFilter>>&& sub_filters,
+            std::unique_ptr<AdaptiveOrder> adaptive_order)
+      : sub_filters_(std::move(sub_filters)),
+        adaptive_order_(std::move(adaptive_order)) {}
 
   AndFilter(const AndFilter&) = delete;
   AndFilter& operator=(const AndFilter&) = delete;
@@ -50,8 +56,21 @@ class AndFilter : public FieldFilter {
   // Returns true when all the sub_filters pass. Otherwise, returns false.
   bool IsMatch(const google::protobuf::Message& message) const override;
 
+  // Sub filters are applied in order, or in the adaptive order when
+  // FieldFilterOptions.adaptive_order is set, and each sub filter is only
+  // applied to the rows that passed all the previous sub filters.
+  void MatchSelected(
+      absl::Span<const google::protobuf::Message* const> messages,
+      absl::Span<const int> selection,
+      std::vector<bool>* matches) const override;
+
+  void AppendReferencedFields(
+      std::vector<ReferencedField>* fields) const override;
+
  private:
-  std::vector<std::unique_ptr<FieldFilter>> sub_filters_;
+  // Shared with other filters when built with FieldFilterOptions.cache.
+  std::vector<std::shared_ptr<const FieldFilter>> sub_filters_;
+  std::unique_ptr<AdaptiveOrder> adaptive_order_;
 };
 
 }  // namespace wfa_virtual_people
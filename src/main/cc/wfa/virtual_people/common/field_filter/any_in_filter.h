@@ -24,6 +24,7 @@
 #include "google/protobuf/message.h"
 #include "wfa/virtual_people/common/field_filter.pb.h"
 #include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
 
 namespace wfa_virtual_people {
 
@@ -40,9 +41,11 @@ class AnyInFilter : public FieldFilter {
   //   @config.name is repeated field.
   // * The last field of the path represented by @config.name is not repeated
   //   field.
-  // * @config.value is not set.
+  // * Both or neither of @config.value and @config.value_file are set.
   // * Any entry in @config.value (split by comma) cannot be casted to the type
   //   of the field represented by @config.name.
+  // * @config.value_file cannot be opened by ExternalValueSet::Open, or its
+  //   values are not of the type of the field represented by @config.name.
   static absl::StatusOr<std::unique_ptr<AnyInFilter>> New(
       const google::protobuf::Descriptor* descriptor,
       const FieldFilterProto& config);
@@ -57,12 +60,14 @@ class AnyInFilter : public FieldFilter {
   // Otherwise, returns false.
   bool IsMatch(const google::protobuf::Message& message) const override = 0;
 
+  void AppendReferencedFields(
+      std::vector<ReferencedField>* fields) const override;
+
  protected:
-  AnyInFilter(
-      std::vector<const google::protobuf::FieldDescriptor*>&& field_descriptors)
-      : field_descriptors_(std::move(field_descriptors)) {}
+  AnyInFilter(std::shared_ptr<const FieldPath> field_path)
+      : field_path_(std::move(field_path)) {}
 
-  std::vector<const google::protobuf::FieldDescriptor*> field_descriptors_;
+  std::shared_ptr<const FieldPath> field_path_;
 };
 
 }  // namespace wfa_virtual_people
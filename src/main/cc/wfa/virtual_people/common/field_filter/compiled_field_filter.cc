@@ -0,0 +1,867 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/compiled_field_filter.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/container/inlined_vector.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "common_cpp/macros/macros.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
+#include "google/protobuf/repeated_field.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/field_filter_normalizer.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_util.h"
+#include "wfa/virtual_people/common/field_filter/utils/regexp_matcher.h"
+#include "wfa/virtual_people/common/field_filter/utils/type_convert_util.h"
+#include "wfa/virtual_people/common/field_filter/utils/value_set.h"
+#include "wfa/virtual_people/common/field_filter/utils/values_parser.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+using CppType = google::protobuf::FieldDescriptor::CppType;
+
+// Parses @values_str as a set of @ValueType, and widens the values to
+// @WideType.
+template <typename ValueType, typename WideType>
+absl::StatusOr<ValueSet<WideType>> ParseWideValues(
+    absl::string_view values_str) {
+  ASSIGN_OR_RETURN(ParsedValues<ValueType> parsed_values,
+                   ParseValues<ValueType>(values_str));
+  return ValueSet<WideType>(absl::flat_hash_set<WideType>(
+      parsed_values.values.begin(), parsed_values.values.end()));
+}
+
+// Gets the value of the singular field, which must be int32, int64, bool or
+// enum, as int64_t.
+int64_t GetSignedValue(const google::protobuf::Message& parent,
+                       const google::protobuf::FieldDescriptor* field,
+                       CppType cpp_type) {
+  const google::protobuf::Reflection* reflection = parent.GetReflection();
+  switch (cpp_type) {
+    case CppType::CPPTYPE_INT32:
+      return reflection->GetInt32(parent, field);
+    case CppType::CPPTYPE_INT64:
+      return reflection->GetInt64(parent, field);
+    case CppType::CPPTYPE_BOOL:
+      return reflection->GetBool(parent, field);
+    case CppType::CPPTYPE_ENUM:
+      return reflection->GetEnumValue(parent, field);
+    default:
+      // This should never happen.
+      return 0;
+  }
+}
+
+// Same as GetSignedValue, but for the entry at @index of the repeated field.
+int64_t GetRepeatedSignedValue(const google::protobuf::Message& parent,
+                               const google::protobuf::FieldDescriptor* field,
+                               CppType cpp_type, int index) {
+  const google::protobuf::Reflection* reflection = parent.GetReflection();
+  switch (cpp_type) {
+    case CppType::CPPTYPE_INT32:
+      return reflection->GetRepeatedInt32(parent, field, index);
+    case CppType::CPPTYPE_INT64:
+      return reflection->GetRepeatedInt64(parent, field, index);
+    case CppType::CPPTYPE_BOOL:
+      return reflection->GetRepeatedBool(parent, field, index);
+    case CppType::CPPTYPE_ENUM:
+      return reflection->GetRepeatedEnumValue(parent, field, index);
+    default:
+      // This should never happen.
+      return 0;
+  }
+}
+
+// Gets the value of the singular field, which must be uint32 or uint64, as
+// uint64_t.
+uint64_t GetUnsignedValue(const google::protobuf::Message& parent,
+                          const google::protobuf::FieldDescriptor* field,
+                          CppType cpp_type) {
+  const google::protobuf::Reflection* reflection = parent.GetReflection();
+  if (cpp_type == CppType::CPPTYPE_UINT32) {
+    return reflection->GetUInt32(parent, field);
+  }
+  return reflection->GetUInt64(parent, field);
+}
+
+// Same as GetUnsignedValue, but for the entry at @index of the repeated field.
+uint64_t GetRepeatedUnsignedValue(
+    const google::protobuf::Message& parent,
+    const google::protobuf::FieldDescriptor* field, CppType cpp_type,
+    int index) {
+  const google::protobuf::Reflection* reflection = parent.GetReflection();
+  if (cpp_type == CppType::CPPTYPE_UINT32) {
+    return reflection->GetRepeatedUInt32(parent, field, index);
+  }
+  return reflection->GetRepeatedUInt64(parent, field, index);
+}
+
+// Returns 1 if @a is greater than @b, -1 if @a is less than @b, and 0 if they
+// are equal.
+template <typename ValueType>
+int ThreeWayCompare(ValueType a, ValueType b) {
+  return (a > b) - (a < b);
+}
+
+}  // namespace
+
+// Lowers a FieldFilterProto into the instructions of a CompiledFieldFilter.
+class FieldFilterCompiler {
+ public:
+  explicit FieldFilterCompiler(CompiledFieldFilter& program)
+      : program_(program) {}
+
+  // Appends the instructions of @config to the program. @depth is the number
+  // of PARTIAL filters containing @config.
+  absl::Status Compile(const google::protobuf::Descriptor* descriptor,
+                       const FieldFilterProto& config, int depth);
+
+ private:
+  using Instruction = CompiledFieldFilter::Instruction;
+  using Opcode = CompiledFieldFilter::Opcode;
+  using ValueKind = CompiledFieldFilter::ValueKind;
+
+  // Appends the instructions of the AND (when @jump_opcode is JUMP_IF_FALSE)
+  // or the OR (when @jump_opcode is JUMP_IF_TRUE) of @sub_filters.
+  absl::Status CompileJunction(
+      const google::protobuf::Descriptor* descriptor,
+      const google::protobuf::RepeatedPtrField<FieldFilterProto>& sub_filters,
+      Opcode jump_opcode, int depth);
+
+  // Appends the instruction of EQUAL, GT or LT.
+  absl::Status CompileCompare(const google::protobuf::Descriptor* descriptor,
+                              const FieldFilterProto& config, Opcode opcode);
+
+  // Appends the instruction of IN or ANY_IN.
+  absl::Status CompileIn(const google::protobuf::Descriptor* descriptor,
+                         const FieldFilterProto& config, Opcode opcode);
+
+  // Appends the instruction of REGEXP.
+  absl::Status CompileRegexp(const google::protobuf::Descriptor* descriptor,
+                             const FieldFilterProto& config);
+
+  // Returns an instruction with the field path represented by @name.
+  absl::StatusOr<Instruction> NewInstruction(
+      Opcode opcode, const google::protobuf::Descriptor* descriptor,
+      absl::string_view name, bool allow_repeated);
+
+  int Emit(const Instruction& instruction) {
+    program_.instruction_storage_.push_back(instruction);
+    return static_cast<int>(program_.instruction_storage_.size()) - 1;
+  }
+
+  int NextIndex() const {
+    return static_cast<int>(program_.instruction_storage_.size());
+  }
+
+  CompiledFieldFilter& program_;
+};
+
+absl::StatusOr<CompiledFieldFilter::Instruction>
+FieldFilterCompiler::NewInstruction(
+    Opcode opcode, const google::protobuf::Descriptor* descriptor,
+    absl::string_view name, bool allow_repeated) {
+  ASSIGN_OR_RETURN(std::shared_ptr<const FieldPath> field_path,
+                   GetFieldPathFromProto(descriptor, name, allow_repeated));
+  Instruction instruction;
+  instruction.opcode = opcode;
+  instruction.value_kind = ValueKind::NONE;
+  instruction.cpp_type = field_path->back()->cpp_type();
+  instruction.path_begin =
+      static_cast<int32_t>(program_.field_descriptors_.size());
+  instruction.path_size = static_cast<int32_t>(field_path->size());
+  instruction.operand = -1;
+  instruction.jump_target = -1;
+  program_.field_descriptors_.insert(program_.field_descriptors_.end(),
+                                     field_path->begin(), field_path->end());
+  return instruction;
+}
+
+absl::Status FieldFilterCompiler::CompileJunction(
+    const google::protobuf::Descriptor* descriptor,
+    const google::protobuf::RepeatedPtrField<FieldFilterProto>& sub_filters,
+    Opcode jump_opcode, int depth) {
+  // The result of the last sub filter is the result of the junction, so no
+  // jump is needed after it.
+  std::vector<int> jumps;
+  for (int i = 0; i < sub_filters.size(); ++i) {
+    RETURN_IF_ERROR(Compile(descriptor, sub_filters.Get(i), depth));
+    if (i + 1 < sub_filters.size()) {
+      Instruction jump = {};
+      jump.opcode = jump_opcode;
+      jumps.push_back(Emit(jump));
+    }
+  }
+  for (int jump : jumps) {
+    program_.instruction_storage_[jump].jump_target = NextIndex();
+  }
+  return absl::OkStatus();
+}
+
+absl::Status FieldFilterCompiler::CompileCompare(
+    const google::protobuf::Descriptor* descriptor,
+    const FieldFilterProto& config, Opcode opcode) {
+  ASSIGN_OR_RETURN(Instruction instruction,
+                   NewInstruction(opcode, descriptor, config.name(),
+                                  /* allow_repeated = */ false));
+  const google::protobuf::FieldDescriptor* field =
+      program_.field_descriptors_.back();
+  bool is_integer = false;
+  absl::Status status = absl::OkStatus();
+  switch (instruction.cpp_type) {
+    case CppType::CPPTYPE_INT32: {
+      is_integer = true;
+      absl::StatusOr<int32_t> value = ConvertToNumeric<int32_t>(config.value());
+      status = value.status();
+      if (value.ok()) program_.signed_values_.push_back(*value);
+      instruction.value_kind = ValueKind::SIGNED;
+      break;
+    }
+    case CppType::CPPTYPE_INT64: {
+      is_integer = true;
+      absl::StatusOr<int64_t> value = ConvertToNumeric<int64_t>(config.value());
+      status = value.status();
+      if (value.ok()) program_.signed_values_.push_back(*value);
+      instruction.value_kind = ValueKind::SIGNED;
+      break;
+    }
+    case CppType::CPPTYPE_UINT32: {
+      is_integer = true;
+      absl::StatusOr<uint32_t> value =
+          ConvertToNumeric<uint32_t>(config.value());
+      status = value.status();
+      if (value.ok()) program_.unsigned_values_.push_back(*value);
+      instruction.value_kind = ValueKind::UNSIGNED;
+      break;
+    }
+    case CppType::CPPTYPE_UINT64: {
+      is_integer = true;
+      absl::StatusOr<uint64_t> value =
+          ConvertToNumeric<uint64_t>(config.value());
+      status = value.status();
+      if (value.ok()) program_.unsigned_values_.push_back(*value);
+      instruction.value_kind = ValueKind::UNSIGNED;
+      break;
+    }
+    case CppType::CPPTYPE_BOOL: {
+      absl::StatusOr<bool> value = ConvertToNumeric<bool>(config.value());
+      status = value.status();
+      if (value.ok()) program_.signed_values_.push_back(*value);
+      instruction.value_kind = ValueKind::SIGNED;
+      break;
+    }
+    case CppType::CPPTYPE_ENUM: {
+      absl::StatusOr<const google::protobuf::EnumValueDescriptor*> value =
+          ConvertToEnum(field->enum_type(), config.value());
+      status = value.status();
+      if (value.ok()) program_.signed_values_.push_back((*value)->number());
+      instruction.value_kind = ValueKind::SIGNED;
+      break;
+    }
+    case CppType::CPPTYPE_STRING: {
+      program_.string_values_.push_back(config.value());
+      instruction.value_kind = ValueKind::STRING;
+      break;
+    }
+    default:
+      break;
+  }
+
+  if (opcode == Opcode::EQUAL) {
+    if (instruction.value_kind == ValueKind::NONE) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Unsupported field type for EQUAL filter. Input FieldFilterProto: ",
+          config.DebugString()));
+    }
+    if (!status.ok()) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Value type does not match name. Input FieldFilterProto: ",
+          config.DebugString()));
+    }
+  } else {
+    // GT and LT only support integers.
+    if (!is_integer) {
+      return absl::InvalidArgumentError(
+          "The given field is not integer when building IntegerComparator.");
+    }
+    RETURN_IF_ERROR(status);
+  }
+
+  switch (instruction.value_kind) {
+    case ValueKind::SIGNED:
+      instruction.operand =
+          static_cast<int32_t>(program_.signed_values_.size()) - 1;
+      break;
+    case ValueKind::UNSIGNED:
+      instruction.operand =
+          static_cast<int32_t>(program_.unsigned_values_.size()) - 1;
+      break;
+    case ValueKind::STRING:
+      instruction.operand =
+          static_cast<int32_t>(program_.string_values_.size()) - 1;
+      break;
+    case ValueKind::NONE:
+      break;
+  }
+  Emit(instruction);
+  return absl::OkStatus();
+}
+
+absl::Status FieldFilterCompiler::CompileIn(
+    const google::protobuf::Descriptor* descriptor,
+    const FieldFilterProto& config, Opcode opcode) {
+  const bool any_in = opcode == Opcode::ANY_IN;
+  ASSIGN_OR_RETURN(Instruction instruction,
+                   NewInstruction(opcode, descriptor, config.name(),
+                                  /* allow_repeated = */ any_in));
+  const google::protobuf::FieldDescriptor* field =
+      program_.field_descriptors_.back();
+  if (any_in && !field->is_repeated()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Name must represent a repeated field. Input FieldFilterProto: ",
+        config.DebugString()));
+  }
+
+  if (config.has_value_file()) {
+    // The values of the file are 64 bits wide, like the operand tables.
+    switch (instruction.cpp_type) {
+      case CppType::CPPTYPE_INT32:
+      case CppType::CPPTYPE_INT64:
+      case CppType::CPPTYPE_BOOL:
+      case CppType::CPPTYPE_ENUM: {
+        ASSIGN_OR_RETURN(program_.signed_sets_.emplace_back(),
+                         OpenValueSetFile<int64_t>(config.value_file()));
+        instruction.value_kind = ValueKind::SIGNED;
+        break;
+      }
+      case CppType::CPPTYPE_UINT32:
+      case CppType::CPPTYPE_UINT64: {
+        ASSIGN_OR_RETURN(program_.unsigned_sets_.emplace_back(),
+                         OpenValueSetFile<uint64_t>(config.value_file()));
+        instruction.value_kind = ValueKind::UNSIGNED;
+        break;
+      }
+      case CppType::CPPTYPE_STRING: {
+        ASSIGN_OR_RETURN(
+            program_.string_sets_.emplace_back(),
+            OpenValueSetFile<const std::string&>(config.value_file()));
+        instruction.value_kind = ValueKind::STRING;
+        break;
+      }
+      default:
+        return absl::InvalidArgumentError(absl::StrCat(
+            "Unsupported field type for ", any_in ? "ANY_IN" : "IN",
+            " filter. Input FieldFilterProto: ", config.DebugString()));
+    }
+  } else {
+    switch (instruction.cpp_type) {
+      case CppType::CPPTYPE_INT32: {
+        ASSIGN_OR_RETURN(program_.signed_sets_.emplace_back(),
+                         (ParseWideValues<int32_t, int64_t>(config.value())));
+        instruction.value_kind = ValueKind::SIGNED;
+        break;
+      }
+      case CppType::CPPTYPE_INT64: {
+        ASSIGN_OR_RETURN(program_.signed_sets_.emplace_back(),
+                         (ParseWideValues<int64_t, int64_t>(config.value())));
+        instruction.value_kind = ValueKind::SIGNED;
+        break;
+      }
+      case CppType::CPPTYPE_UINT32: {
+        ASSIGN_OR_RETURN(program_.unsigned_sets_.emplace_back(),
+                         (ParseWideValues<uint32_t, uint64_t>(config.value())));
+        instruction.value_kind = ValueKind::UNSIGNED;
+        break;
+      }
+      case CppType::CPPTYPE_UINT64: {
+        ASSIGN_OR_RETURN(program_.unsigned_sets_.emplace_back(),
+                         (ParseWideValues<uint64_t, uint64_t>(config.value())));
+        instruction.value_kind = ValueKind::UNSIGNED;
+        break;
+      }
+      case CppType::CPPTYPE_BOOL: {
+        ASSIGN_OR_RETURN(program_.signed_sets_.emplace_back(),
+                         (ParseWideValues<bool, int64_t>(config.value())));
+        instruction.value_kind = ValueKind::SIGNED;
+        break;
+      }
+      case CppType::CPPTYPE_ENUM: {
+        ASSIGN_OR_RETURN(
+            ParsedValues<const google::protobuf::EnumValueDescriptor*>
+                parsed_values,
+            ParseEnumValues(field->enum_type(), config.value()));
+        program_.signed_sets_.emplace_back(absl::flat_hash_set<int64_t>(
+            parsed_values.values.begin(), parsed_values.values.end()));
+        instruction.value_kind = ValueKind::SIGNED;
+        break;
+      }
+      case CppType::CPPTYPE_STRING: {
+        ASSIGN_OR_RETURN(ParsedValues<const std::string&> parsed_values,
+                         ParseValues<const std::string&>(config.value()));
+        program_.string_sets_.emplace_back(std::move(parsed_values.values));
+        instruction.value_kind = ValueKind::STRING;
+        break;
+      }
+      default:
+        return absl::InvalidArgumentError(absl::StrCat(
+            "Unsupported field type for ", any_in ? "ANY_IN" : "IN",
+            " filter. Input FieldFilterProto: ", config.DebugString()));
+    }
+  }
+
+  switch (instruction.value_kind) {
+    case ValueKind::SIGNED:
+      instruction.operand =
+          static_cast<int32_t>(program_.signed_sets_.size()) - 1;
+      break;
+    case ValueKind::UNSIGNED:
+      instruction.operand =
+          static_cast<int32_t>(program_.unsigned_sets_.size()) - 1;
+      break;
+    case ValueKind::STRING:
+      instruction.operand =
+          static_cast<int32_t>(program_.string_sets_.size()) - 1;
+      break;
+    case ValueKind::NONE:
+      break;
+  }
+  Emit(instruction);
+  return absl::OkStatus();
+}
+
+absl::Status FieldFilterCompiler::CompileRegexp(
+    const google::protobuf::Descriptor* descriptor,
+    const FieldFilterProto& config) {
+  ASSIGN_OR_RETURN(Instruction instruction,
+                   NewInstruction(Opcode::REGEXP, descriptor, config.name(),
+                                  /* allow_repeated = */ true));
+  if (instruction.cpp_type != CppType::CPPTYPE_STRING) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Unsupported field type for REGEXP filter. Input FieldFilterProto: ",
+        config.DebugString()));
+  }
+  ASSIGN_OR_RETURN(program_.regexps_.emplace_back(),
+                   RegexpMatcher::New(config.value()));
+  instruction.value_kind = ValueKind::STRING;
+  instruction.operand = static_cast<int32_t>(program_.regexps_.size()) - 1;
+  Emit(instruction);
+  return absl::OkStatus();
+}
+
+absl::Status FieldFilterCompiler::Compile(
+    const google::protobuf::Descriptor* descriptor,
+    const FieldFilterProto& config, int depth) {
+  switch (config.op()) {
+    case FieldFilterProto::HAS: {
+      if (!config.has_name()) {
+        return absl::InvalidArgumentError(absl::StrCat(
+            "Name must be set. Input FieldFilterProto: ",
+            config.DebugString()));
+      }
+      ASSIGN_OR_RETURN(Instruction instruction,
+                       NewInstruction(Opcode::HAS, descriptor, config.name(),
+                                      /* allow_repeated = */ true));
+      Emit(instruction);
+      return absl::OkStatus();
+    }
+    case FieldFilterProto::EQUAL:
+    case FieldFilterProto::GT:
+    case FieldFilterProto::LT:
+    case FieldFilterProto::IN:
+    case FieldFilterProto::REGEXP:
+    case FieldFilterProto::ANY_IN: {
+      if (!config.has_name()) {
+        return absl::InvalidArgumentError(absl::StrCat(
+            "Name must be set. Input FieldFilterProto: ",
+            config.DebugString()));
+      }
+      if (config.op() == FieldFilterProto::IN ||
+          config.op() == FieldFilterProto::ANY_IN) {
+        if (config.has_value() == config.has_value_file()) {
+          return absl::InvalidArgumentError(absl::StrCat(
+              "Exactly one of value and value_file must be set. Input "
+              "FieldFilterProto: ",
+              config.DebugString()));
+        }
+      } else if (!config.has_value()) {
+        return absl::InvalidArgumentError(absl::StrCat(
+            "Value must be set. Input FieldFilterProto: ",
+            config.DebugString()));
+      }
+      switch (config.op()) {
+        case FieldFilterProto::EQUAL:
+          return CompileCompare(descriptor, config, Opcode::EQUAL);
+        case FieldFilterProto::GT:
+          return CompileCompare(descriptor, config, Opcode::GT);
+        case FieldFilterProto::LT:
+          return CompileCompare(descriptor, config, Opcode::LT);
+        case FieldFilterProto::IN:
+          return CompileIn(descriptor, config, Opcode::IN);
+        case FieldFilterProto::REGEXP:
+          return CompileRegexp(descriptor, config);
+        default:
+          return CompileIn(descriptor, config, Opcode::ANY_IN);
+      }
+    }
+    case FieldFilterProto::OR:
+    case FieldFilterProto::AND:
+    case FieldFilterProto::NOT: {
+      if (config.sub_filters_size() == 0) {
+        return absl::InvalidArgumentError(absl::StrCat(
+            "sub_filters must be set when op is ",
+            FieldFilterProto::Op_Name(config.op()),
+            ". Input FieldFilterProto: ", config.DebugString()));
+      }
+      if (config.op() == FieldFilterProto::OR) {
+        return CompileJunction(descriptor, config.sub_filters(),
+                               Opcode::JUMP_IF_TRUE, depth);
+      }
+      RETURN_IF_ERROR(CompileJunction(descriptor, config.sub_filters(),
+                                      Opcode::JUMP_IF_FALSE, depth));
+      if (config.op() == FieldFilterProto::NOT) {
+        Instruction instruction = {};
+        instruction.opcode = Opcode::NOT;
+        Emit(instruction);
+      }
+      return absl::OkStatus();
+    }
+    case FieldFilterProto::PARTIAL: {
+      if (!config.has_name()) {
+        return absl::InvalidArgumentError(absl::StrCat(
+            "Name must be set. Input FieldFilterProto: ",
+            config.DebugString()));
+      }
+      if (config.sub_filters_size() == 0) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("sub_filters must be set when op is PARTIAL. Input "
+                         "FieldFilterProto: ",
+                         config.DebugString()));
+      }
+      ASSIGN_OR_RETURN(Instruction enter,
+                       NewInstruction(Opcode::ENTER, descriptor, config.name(),
+                                      /* allow_repeated = */ false));
+      if (enter.cpp_type != CppType::CPPTYPE_MESSAGE) {
+        return absl::InvalidArgumentError(absl::StrCat(
+            "Name must refer to a message type field. Input FieldFilterProto: ",
+            config.DebugString()));
+      }
+      const google::protobuf::Descriptor* sub_descriptor =
+          program_.field_descriptors_.back()->message_type();
+      int enter_index = Emit(enter);
+      if (depth + 1 > program_.max_depth_) {
+        program_.max_depth_ = depth + 1;
+      }
+      RETURN_IF_ERROR(CompileJunction(sub_descriptor, config.sub_filters(),
+                                      Opcode::JUMP_IF_FALSE, depth + 1));
+      Instruction leave = {};
+      leave.opcode = Opcode::LEAVE;
+      Emit(leave);
+      // When the sub message is not set, LEAVE is skipped together with the
+      // sub filters.
+      program_.instruction_storage_[enter_index].jump_target = NextIndex();
+      return absl::OkStatus();
+    }
+    case FieldFilterProto::TRUE: {
+      if (config.has_name()) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Name should not be set. Input FieldFilterProto: ",
+                         config.DebugString()));
+      }
+      if (config.has_value()) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Value should not be set. Input FieldFilterProto: ",
+                         config.DebugString()));
+      }
+      if (config.has_value_file()) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("value_file should not be set. Input FieldFilterProto: ",
+                         config.DebugString()));
+      }
+      if (config.sub_filters_size() > 0) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("sub_filters must be empty. Input FieldFilterProto: ",
+                         config.DebugString()));
+      }
+      Instruction instruction = {};
+      instruction.opcode = Opcode::TRUE;
+      Emit(instruction);
+      return absl::OkStatus();
+    }
+    default:
+      return absl::InvalidArgumentError("Invalid op in field filter.");
+  }
+}
+
+absl::StatusOr<std::unique_ptr<CompiledFieldFilter>> CompiledFieldFilter::New(
+    const google::protobuf::Descriptor* descriptor,
+    const FieldFilterProto& config) {
+  return NewWithoutNormalization(descriptor,
+                                 NormalizeFieldFilterProto(descriptor, config));
+}
+
+absl::StatusOr<std::unique_ptr<CompiledFieldFilter>>
+CompiledFieldFilter::NewWithoutNormalization(
+    const google::protobuf::Descriptor* descriptor,
+    const FieldFilterProto& config) {
+  auto program = absl::WrapUnique(new CompiledFieldFilter());
+  FieldFilterCompiler compiler(*program);
+  RETURN_IF_ERROR(compiler.Compile(descriptor, config, /* depth = */ 0));
+  program->instruction_storage_.shrink_to_fit();
+  program->instructions_ = program->instruction_storage_;
+  program->field_descriptors_.shrink_to_fit();
+  return program;
+}
+
+bool CompiledFieldFilter::IsMatch(
+    const google::protobuf::Message& message) const {
+  // The messages entered by PARTIAL. The back is the current message.
+  absl::InlinedVector<const google::protobuf::Message*, 8> scopes;
+  scopes.reserve(max_depth_ + 1);
+  scopes.push_back(&message);
+  // Passed to GetStringReference, which only uses it for string fields not
+  // stored as std::string. Constructed once per evaluation instead of once
+  // per string read.
+  std::string scratch;
+
+  const Instruction* instructions = instructions_.data();
+  const int size = static_cast<int>(instructions_.size());
+  bool result = true;
+  int pc = 0;
+  while (pc < size) {
+    const Instruction& instruction = instructions[pc];
+    if (instruction.opcode == Opcode::JUMP_IF_FALSE ||
+        instruction.opcode == Opcode::JUMP_IF_TRUE) {
+      if (result == (instruction.opcode == Opcode::JUMP_IF_TRUE)) {
+        pc = instruction.jump_target;
+      } else {
+        ++pc;
+      }
+      continue;
+    }
+
+    switch (instruction.opcode) {
+      case Opcode::TRUE:
+        result = true;
+        ++pc;
+        continue;
+      case Opcode::NOT:
+        result = !result;
+        ++pc;
+        continue;
+      case Opcode::LEAVE:
+        scopes.pop_back();
+        ++pc;
+        continue;
+      default:
+        break;
+    }
+
+    // The rest of the instructions read the field path.
+    const google::protobuf::Message* parent = scopes.back();
+    const google::protobuf::FieldDescriptor* const* path =
+        field_descriptors_.data() + instruction.path_begin;
+    for (int i = 0; i < instruction.path_size - 1; ++i) {
+      parent = &parent->GetReflection()->GetMessage(*parent, path[i]);
+    }
+    const google::protobuf::FieldDescriptor* field =
+        path[instruction.path_size - 1];
+    const google::protobuf::Reflection* reflection = parent->GetReflection();
+
+    switch (instruction.opcode) {
+      case Opcode::HAS:
+        result = field->is_repeated()
+                     ? reflection->FieldSize(*parent, field) > 0
+                     : reflection->HasField(*parent, field);
+        break;
+      case Opcode::EQUAL:
+      case Opcode::GT:
+      case Opcode::LT: {
+        if (!reflection->HasField(*parent, field)) {
+          result = false;
+          break;
+        }
+        int comparison;
+        switch (instruction.value_kind) {
+          case ValueKind::SIGNED:
+            comparison = ThreeWayCompare<int64_t>(
+                GetSignedValue(*parent, field, instruction.cpp_type),
+                signed_values_[instruction.operand]);
+            break;
+          case ValueKind::UNSIGNED:
+            comparison = ThreeWayCompare<uint64_t>(
+                GetUnsignedValue(*parent, field, instruction.cpp_type),
+                unsigned_values_[instruction.operand]);
+            break;
+          default:
+            // Strings are only compared for equality.
+            comparison =
+                MatchesStringLiteral(
+                    string_values_[instruction.operand],
+                    reflection->GetStringReference(*parent, field, &scratch))
+                    ? 0
+                    : 1;
+            break;
+        }
+        if (instruction.opcode == Opcode::GT) {
+          result = comparison > 0;
+        } else if (instruction.opcode == Opcode::LT) {
+          result = comparison < 0;
+        } else {
+          result = comparison == 0;
+        }
+        break;
+      }
+      case Opcode::IN:
+        if (!reflection->HasField(*parent, field)) {
+          result = false;
+          break;
+        }
+        switch (instruction.value_kind) {
+          case ValueKind::SIGNED:
+            result = signed_sets_[instruction.operand].contains(
+                GetSignedValue(*parent, field, instruction.cpp_type));
+            break;
+          case ValueKind::UNSIGNED:
+            result = unsigned_sets_[instruction.operand].contains(
+                GetUnsignedValue(*parent, field, instruction.cpp_type));
+            break;
+          default:
+            result = string_sets_[instruction.operand].contains(
+                reflection->GetStringReference(*parent, field, &scratch));
+            break;
+        }
+        break;
+      case Opcode::ANY_IN: {
+        int field_size = reflection->FieldSize(*parent, field);
+        result = false;
+        for (int i = 0; i < field_size && !result; ++i) {
+          switch (instruction.value_kind) {
+            case ValueKind::SIGNED:
+              result = signed_sets_[instruction.operand].contains(
+                  GetRepeatedSignedValue(*parent, field, instruction.cpp_type,
+                                         i));
+              break;
+            case ValueKind::UNSIGNED:
+              result = unsigned_sets_[instruction.operand].contains(
+                  GetRepeatedUnsignedValue(*parent, field,
+                                           instruction.cpp_type, i));
+              break;
+            default:
+              result = string_sets_[instruction.operand].contains(
+                  reflection->GetRepeatedStringReference(*parent, field, i,
+                                                         &scratch));
+              break;
+          }
+        }
+        break;
+      }
+      case Opcode::REGEXP: {
+        const RegexpMatcher& matcher = *regexps_[instruction.operand];
+        if (!field->is_repeated()) {
+          result =
+              reflection->HasField(*parent, field) &&
+              matcher.Matches(
+                  reflection->GetStringReference(*parent, field, &scratch));
+          break;
+        }
+        int field_size = reflection->FieldSize(*parent, field);
+        result = false;
+        for (int i = 0; i < field_size && !result; ++i) {
+          result = matcher.Matches(
+              reflection->GetRepeatedStringReference(*parent, field, i,
+                                                     &scratch));
+        }
+        break;
+      }
+      case Opcode::ENTER:
+        if (!reflection->HasField(*parent, field)) {
+          result = false;
+          pc = instruction.jump_target;
+          continue;
+        }
+        scopes.push_back(&reflection->GetMessage(*parent, field));
+        break;
+      default:
+        break;
+    }
+    ++pc;
+  }
+  return result;
+}
+
+void CompiledFieldFilter::MatchSelected(
+    absl::Span<const google::protobuf::Message* const> messages,
+    absl::Span<const int> selection, std::vector<bool>* matches) const {
+  for (int i : selection) {
+    (*matches)[i] = CompiledFieldFilter::IsMatch(*messages[i]);
+  }
+}
+
+void CompiledFieldFilter::AppendReferencedFields(
+    std::vector<ReferencedField>* fields) const {
+  // The path from the root message to the message entered by each enclosing
+  // PARTIAL. ENTER and LEAVE are emitted in nesting order, so the instructions
+  // can be scanned linearly.
+  std::vector<FieldPath> scopes(1);
+  for (const Instruction& instruction : instructions_) {
+    switch (instruction.opcode) {
+      case Opcode::HAS:
+      case Opcode::EQUAL:
+      case Opcode::GT:
+      case Opcode::LT:
+      case Opcode::IN:
+      case Opcode::ANY_IN:
+      case Opcode::REGEXP:
+      case Opcode::ENTER: {
+        FieldPath field_path = scopes.back();
+        field_path.insert(
+            field_path.end(),
+            field_descriptors_.begin() + instruction.path_begin,
+            field_descriptors_.begin() + instruction.path_begin +
+                instruction.path_size);
+        fields->push_back({InternFieldPath(field_path),
+                           instruction.opcode != Opcode::HAS &&
+                               instruction.opcode != Opcode::ENTER});
+        if (instruction.opcode == Opcode::ENTER) {
+          scopes.push_back(std::move(field_path));
+        }
+        break;
+      }
+      case Opcode::LEAVE:
+        scopes.pop_back();
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+}  // namespace wfa_virtual_people
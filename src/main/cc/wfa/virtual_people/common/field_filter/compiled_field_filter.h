@@ -0,0 +1,166 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_COMPILED_FIELD_FILTER_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_COMPILED_FIELD_FILTER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/regexp_matcher.h"
+#include "wfa/virtual_people/common/field_filter/utils/value_set.h"
+
+namespace wfa_virtual_people {
+
+// An alternative implementation of FieldFilterProto, which lowers the whole
+// filter tree into a contiguous array of instructions, and evaluates it with a
+// switch dispatched interpreter instead of virtual calls on a tree of
+// FieldFilter nodes.
+//
+// The semantics, including the errors returned when building, are the same as
+// the FieldFilter returned by FieldFilter::New, so the two can be used
+// interchangeably. @config is normalized by NormalizeFieldFilterProto before
+// lowering. FieldFilter::New returns a CompiledFieldFilter when
+// FieldFilterOptions::compiled is set, so callers only holding a FieldFilter
+// can switch to it without code changes.
+//
+// AND, OR and NOT are lowered to conditional jumps, which keeps the short
+// circuit behavior of AndFilter and OrFilter. PARTIAL enters the sub message
+// for its sub filters, and leaves it when they are done.
+class CompiledFieldFilter : public FieldFilter {
+ public:
+  // Returns error status if @config is invalid to create a FieldFilter with
+  // FieldFilter::New.
+  static absl::StatusOr<std::unique_ptr<CompiledFieldFilter>> New(
+      const google::protobuf::Descriptor* descriptor,
+      const FieldFilterProto& config);
+
+  // Same as New, except that @config is lowered as is, without normalization.
+  static absl::StatusOr<std::unique_ptr<CompiledFieldFilter>>
+  NewWithoutNormalization(const google::protobuf::Descriptor* descriptor,
+                          const FieldFilterProto& config);
+
+  CompiledFieldFilter(const CompiledFieldFilter&) = delete;
+  CompiledFieldFilter& operator=(const CompiledFieldFilter&) = delete;
+
+  // Returns true if the @message satisfies the condition given by the @config.
+  bool IsMatch(const google::protobuf::Message& message) const override;
+
+  void MatchSelected(
+      absl::Span<const google::protobuf::Message* const> messages,
+      absl::Span<const int> selection,
+      std::vector<bool>* matches) const override;
+
+  void AppendReferencedFields(
+      std::vector<ReferencedField>* fields) const override;
+
+ private:
+  friend class CompiledFilterSnapshot;
+  friend class FieldExtractionPlan;
+  friend class FieldExtractionPlanBuilder;
+  friend class FieldFilterCompiler;
+
+  // The instruction set of the interpreter.
+  enum class Opcode : uint8_t {
+    // Sets the result to whether the field is set, or the repeated field is
+    // not empty.
+    HAS,
+    // Sets the result to whether the field is set and equals to the operand.
+    EQUAL,
+    // Sets the result to whether the field is set and is greater than the
+    // operand.
+    GT,
+    // Sets the result to whether the field is set and is less than the
+    // operand.
+    LT,
+    // Sets the result to whether the field is set and is in the operand set.
+    IN,
+    // Sets the result to whether any value of the repeated field is in the
+    // operand set.
+    ANY_IN,
+    // Sets the result to whether the field is set and matches the operand
+    // regular expression, or any value of the repeated field matches it.
+    REGEXP,
+    // Sets the result to true.
+    TRUE,
+    // Negates the result.
+    NOT,
+    // Jumps to the target if the result is false.
+    JUMP_IF_FALSE,
+    // Jumps to the target if the result is true.
+    JUMP_IF_TRUE,
+    // Enters the sub message represented by the field path. If the sub message
+    // is not set, sets the result to false and jumps to the target.
+    ENTER,
+    // Leaves the sub message entered by the matching ENTER.
+    LEAVE,
+  };
+
+  // The kind of values an instruction compares. Integers, bools and enums are
+  // widened to 64 bits.
+  enum class ValueKind : uint8_t {
+    NONE,
+    SIGNED,
+    UNSIGNED,
+    STRING,
+  };
+
+  struct Instruction {
+    Opcode opcode;
+    ValueKind value_kind;
+    // The C++ type of the last field of the path.
+    google::protobuf::FieldDescriptor::CppType cpp_type;
+    // The field path is field_descriptors_[path_begin, path_begin + path_size).
+    int32_t path_begin;
+    int32_t path_size;
+    // The index to the operand table of @value_kind. The tables of single
+    // values are used by EQUAL, GT and LT. The tables of sets are used by IN
+    // and ANY_IN. REGEXP uses @regexps_.
+    int32_t operand;
+    // The index of the next instruction to execute when jumping.
+    int32_t jump_target;
+  };
+
+  CompiledFieldFilter() = default;
+
+  // The instructions, in @instruction_storage_, or in the snapshot the filter
+  // is loaded from, which @snapshot_ keeps alive.
+  absl::Span<const Instruction> instructions_;
+  std::vector<Instruction> instruction_storage_;
+  std::shared_ptr<const void> snapshot_;
+  // The field paths of all the instructions, stored contiguously.
+  std::vector<const google::protobuf::FieldDescriptor*> field_descriptors_;
+  // The deepest nesting of PARTIAL.
+  int max_depth_ = 0;
+
+  std::vector<int64_t> signed_values_;
+  std::vector<uint64_t> unsigned_values_;
+  std::vector<std::string> string_values_;
+  std::vector<ValueSet<int64_t>> signed_sets_;
+  std::vector<ValueSet<uint64_t>> unsigned_sets_;
+  std::vector<ValueSet<std::string>> string_sets_;
+  std::vector<std::unique_ptr<RegexpMatcher>> regexps_;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_COMPILED_FIELD_FILTER_H_
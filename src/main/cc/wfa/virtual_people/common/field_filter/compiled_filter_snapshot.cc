@@ -0,0 +1,866 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/compiled_filter_snapshot.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "common_cpp/macros/macros.h"
+#include "google/protobuf/descriptor.h"
+#include "wfa/virtual_people/common/field_filter/compiled_field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/external_value_set.h"
+#include "wfa/virtual_people/common/field_filter/utils/regexp_matcher.h"
+#include "wfa/virtual_people/common/field_filter/utils/value_set.h"
+#include "wfa/virtual_people/common/field_filter/utils/values_parser.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+// The first bytes of a snapshot. Read as another value on machines with the
+// other byte order.
+constexpr uint64_t kMagic = 0x3150414E53464657;  // "WFFSNAP1"
+constexpr uint32_t kVersion = 3;
+
+// Sets of at most kMaxCopiedSetSize values are stored as their values, and
+// built into their in-memory representation when loading. Larger sets are
+// stored in the format of ExternalValueSet, and searched in place.
+constexpr size_t kMaxCopiedSetSize = 64;
+
+// The Bloom filter of the sets searched in place. See ExternalValueSetOptions.
+constexpr int kBloomBitsPerValue = 10;
+
+// How a set is stored in the snapshot.
+enum class SetStorage : uint8_t {
+  // The values, copied when loading.
+  kValues,
+  // The absolute path of an ExternalValueSet file, opened when loading.
+  kFile,
+  // The contents of an ExternalValueSet, searched in place.
+  kEmbedded,
+};
+
+// The values of ValueSet<T>, as returned by GetValues.
+template <typename T>
+using SetValue =
+    std::conditional_t<std::is_same_v<T, std::string>, absl::string_view, T>;
+
+// The ValueType of OpenValueSetFile for ValueSet<T>.
+template <typename T>
+using FileValueType =
+    std::conditional_t<std::is_same_v<T, std::string>, const std::string&, T>;
+
+template <typename T>
+constexpr ExternalValueKind GetExternalValueKind() {
+  if constexpr (std::is_same_v<T, std::string>) {
+    return ExternalValueKind::kString;
+  } else if constexpr (std::is_signed_v<T>) {
+    return ExternalValueKind::kSigned;
+  } else {
+    return ExternalValueKind::kUnsigned;
+  }
+}
+
+template <typename T>
+void WriteRaw(T value, std::string& snapshot) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  snapshot.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void WriteString(absl::string_view value, std::string& snapshot) {
+  WriteRaw<uint32_t>(value.size(), snapshot);
+  snapshot.append(value.data(), value.size());
+}
+
+template <typename T>
+void WriteArray(absl::Span<const T> values, std::string& snapshot) {
+  WriteRaw<uint32_t>(values.size(), snapshot);
+  snapshot.append(reinterpret_cast<const char*>(values.data()),
+                  values.size() * sizeof(T));
+}
+
+// Pads @snapshot to a multiple of 8 bytes, so that the array written next is
+// aligned when the snapshot is.
+void WritePadding(std::string& snapshot) {
+  snapshot.append((8 - snapshot.size() % 8) % 8, '\0');
+}
+
+absl::Status TruncatedError() {
+  return absl::InvalidArgumentError("The snapshot is truncated.");
+}
+
+// Reads a T at the beginning of @data, and removes it from @data.
+template <typename T>
+absl::StatusOr<T> ReadRaw(absl::string_view& data) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  if (data.size() < sizeof(T)) {
+    return TruncatedError();
+  }
+  T value;
+  std::memcpy(&value, data.data(), sizeof(T));
+  data.remove_prefix(sizeof(T));
+  return value;
+}
+
+// Reads the size of an array of elements of @element_size bytes. Returns error
+// status if @data is too short for the array.
+absl::StatusOr<uint32_t> ReadSize(absl::string_view& data, int element_size) {
+  ASSIGN_OR_RETURN(uint32_t size, ReadRaw<uint32_t>(data));
+  if (size > data.size() / element_size) {
+    return TruncatedError();
+  }
+  return size;
+}
+
+// Skips the padding written by WritePadding. The snapshot is aligned to 8
+// bytes, so the padding ends at the next aligned address.
+absl::Status ReadPadding(absl::string_view& data) {
+  size_t padding = (8 - reinterpret_cast<std::uintptr_t>(data.data()) % 8) % 8;
+  if (data.size() < padding) {
+    return TruncatedError();
+  }
+  data.remove_prefix(padding);
+  return absl::OkStatus();
+}
+
+absl::StatusOr<absl::string_view> ReadString(absl::string_view& data) {
+  ASSIGN_OR_RETURN(uint32_t size, ReadSize(data, 1));
+  absl::string_view value = data.substr(0, size);
+  data.remove_prefix(size);
+  return value;
+}
+
+template <typename T>
+absl::StatusOr<std::vector<T>> ReadArray(absl::string_view& data) {
+  ASSIGN_OR_RETURN(uint32_t size, ReadSize(data, sizeof(T)));
+  // Only written for small arrays, which are not padded to be read in place.
+  std::vector<T> values(size);
+  std::memcpy(values.data(), data.data(), size * sizeof(T));
+  data.remove_prefix(size * sizeof(T));
+  return values;
+}
+
+absl::StatusOr<std::vector<absl::string_view>> ReadStrings(
+    absl::string_view& data) {
+  ASSIGN_OR_RETURN(uint32_t size, ReadSize(data, sizeof(uint32_t)));
+  std::vector<absl::string_view> values(size);
+  for (absl::string_view& value : values) {
+    ASSIGN_OR_RETURN(value, ReadString(data));
+  }
+  return values;
+}
+
+void WriteStrings(absl::Span<const absl::string_view> values,
+                  std::string& snapshot) {
+  WriteRaw<uint32_t>(values.size(), snapshot);
+  for (absl::string_view value : values) {
+    WriteString(value, snapshot);
+  }
+}
+
+// Returns true if @values are in strictly ascending order, as required by the
+// constructors of ValueSet.
+template <typename T>
+bool IsStrictlyAscending(absl::Span<const T> values) {
+  return std::adjacent_find(values.begin(), values.end(),
+                            [](const T& a, const T& b) { return a >= b; }) ==
+         values.end();
+}
+
+template <typename T>
+void WriteValues(absl::Span<const T> values, std::string& snapshot) {
+  WriteArray<T>(values, snapshot);
+}
+
+void WriteValues(absl::Span<const absl::string_view> values,
+                 std::string& snapshot) {
+  WriteStrings(values, snapshot);
+}
+
+template <typename T>
+absl::StatusOr<std::vector<T>> ReadValues(absl::string_view& data) {
+  if constexpr (std::is_same_v<T, absl::string_view>) {
+    return ReadStrings(data);
+  } else {
+    return ReadArray<T>(data);
+  }
+}
+
+// Writes each set as its SetStorage, followed by its values, the path of its
+// file, or its contents in the format of ExternalValueSet. The path is
+// absolute, so that the snapshot can be loaded from another working directory.
+template <typename T>
+absl::Status WriteSets(const std::vector<ValueSet<T>>& sets,
+                       std::string& snapshot) {
+  WriteRaw<uint32_t>(sets.size(), snapshot);
+  for (const ValueSet<T>& set : sets) {
+    const std::shared_ptr<const ExternalValueSet>& external = set.external();
+    if (external != nullptr && !external->absolute_path().empty()) {
+      WriteRaw(SetStorage::kFile, snapshot);
+      WriteString(external->absolute_path(), snapshot);
+      continue;
+    }
+    // The contents of a set loaded from a snapshot are written as is.
+    absl::string_view contents;
+    std::string serialized;
+    if (external != nullptr) {
+      contents = external->data();
+    } else {
+      std::vector<SetValue<T>> values = set.GetValues();
+      if (values.size() <= kMaxCopiedSetSize) {
+        WriteRaw(SetStorage::kValues, snapshot);
+        WriteValues(absl::MakeConstSpan(values), snapshot);
+        continue;
+      }
+      ExternalValueSetOptions options;
+      options.bloom_bits_per_value = kBloomBitsPerValue;
+      ASSIGN_OR_RETURN(serialized, ExternalValueSet::Serialize(
+                                       absl::MakeConstSpan(values), options));
+      contents = serialized;
+    }
+    WriteRaw(SetStorage::kEmbedded, snapshot);
+    WriteRaw<uint64_t>(contents.size(), snapshot);
+    WritePadding(snapshot);
+    snapshot.append(contents.data(), contents.size());
+  }
+  return absl::OkStatus();
+}
+
+// Reads the sets written by WriteSets. The embedded sets are searched in
+// place, and keep @owner alive.
+template <typename T>
+absl::Status ReadSets(absl::string_view& data,
+                      const std::shared_ptr<const void>& owner,
+                      std::vector<ValueSet<T>>& sets) {
+  ASSIGN_OR_RETURN(uint32_t size,
+                   ReadSize(data, sizeof(SetStorage) + sizeof(uint32_t)));
+  sets.reserve(size);
+  for (uint32_t i = 0; i < size; ++i) {
+    ASSIGN_OR_RETURN(SetStorage storage, ReadRaw<SetStorage>(data));
+    switch (storage) {
+      case SetStorage::kValues: {
+        ASSIGN_OR_RETURN(std::vector<SetValue<T>> values,
+                         ReadValues<SetValue<T>>(data));
+        if (!IsStrictlyAscending<SetValue<T>>(values)) {
+          return absl::InvalidArgumentError(
+              "The values of a set in the snapshot are not sorted.");
+        }
+        sets.emplace_back(absl::MakeConstSpan(values));
+        break;
+      }
+      case SetStorage::kFile: {
+        ASSIGN_OR_RETURN(absl::string_view path, ReadString(data));
+        ASSIGN_OR_RETURN(sets.emplace_back(),
+                         OpenValueSetFile<FileValueType<T>>(std::string(path)));
+        break;
+      }
+      case SetStorage::kEmbedded: {
+        ASSIGN_OR_RETURN(uint64_t contents_size, ReadRaw<uint64_t>(data));
+        RETURN_IF_ERROR(ReadPadding(data));
+        if (contents_size > data.size()) {
+          return TruncatedError();
+        }
+        ASSIGN_OR_RETURN(
+            std::shared_ptr<const ExternalValueSet> external,
+            ExternalValueSet::FromMemory(data.substr(0, contents_size), owner));
+        data.remove_prefix(contents_size);
+        if (external->kind() != GetExternalValueKind<T>()) {
+          return absl::InvalidArgumentError(
+              "The kind of a set in the snapshot does not match its values.");
+        }
+        sets.emplace_back(std::move(external));
+        break;
+      }
+      default:
+        return absl::InvalidArgumentError(
+            "A set in the snapshot has an unknown storage.");
+    }
+  }
+  return absl::OkStatus();
+}
+
+// FNV-1a, which is stable across builds and platforms, unlike absl::Hash.
+class Fingerprint {
+ public:
+  void Add(absl::string_view value) {
+    Add(static_cast<uint64_t>(value.size()));
+    for (char c : value) {
+      AddByte(static_cast<uint8_t>(c));
+    }
+  }
+
+  void Add(uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+      AddByte(static_cast<uint8_t>(value >> (8 * i)));
+    }
+  }
+
+  uint64_t value() const { return value_; }
+
+ private:
+  void AddByte(uint8_t byte) {
+    value_ ^= byte;
+    value_ *= 0x100000001b3;
+  }
+
+  uint64_t value_ = 0xcbf29ce484222325;
+};
+
+// Returns the fingerprint of the fields read by a snapshot for @descriptor.
+uint64_t GetFingerprint(
+    const google::protobuf::Descriptor* descriptor,
+    absl::Span<const google::protobuf::FieldDescriptor* const> fields) {
+  Fingerprint fingerprint;
+  fingerprint.Add(descriptor->full_name());
+  for (const google::protobuf::FieldDescriptor* field : fields) {
+    fingerprint.Add(field->containing_type()->full_name());
+    fingerprint.Add(field->name());
+    fingerprint.Add(static_cast<uint64_t>(field->number()));
+    fingerprint.Add(static_cast<uint64_t>(field->type()));
+    fingerprint.Add(static_cast<uint64_t>(field->is_repeated()));
+    if (field->message_type() != nullptr) {
+      fingerprint.Add(field->message_type()->full_name());
+    }
+    if (field->enum_type() != nullptr) {
+      fingerprint.Add(field->enum_type()->full_name());
+    }
+  }
+  return fingerprint.value();
+}
+
+// Closes the file descriptor and unmaps the memory of a snapshot file when
+// destroyed. The filters loaded from the file share its ownership, since they
+// read the snapshot in place.
+class MappedFile {
+ public:
+  MappedFile() = default;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() {
+    if (data_ != nullptr) {
+      munmap(data_, size_);
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  absl::Status Open(const std::string& path) {
+    fd_ = open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+      return ErrnoError("Failed to open ", path);
+    }
+    struct stat file_stat;
+    if (fstat(fd_, &file_stat) != 0) {
+      return ErrnoError("Failed to stat ", path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    if (size_ == 0) {
+      // mmap fails on empty files. An empty snapshot is truncated anyway.
+      return absl::OkStatus();
+    }
+    // Shared, so that the processes loading the same snapshot share the
+    // pages read in place.
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED) {
+      return ErrnoError("Failed to map ", path);
+    }
+    data_ = data;
+    return absl::OkStatus();
+  }
+
+  absl::string_view contents() const {
+    return data_ == nullptr
+               ? absl::string_view()
+               : absl::string_view(static_cast<const char*>(data_), size_);
+  }
+
+ private:
+  static absl::Status ErrnoError(absl::string_view message,
+                                 const std::string& path) {
+    int error = errno;
+    return absl::Status(absl::ErrnoToStatusCode(error),
+                        absl::StrCat(message, path, ": ",
+                                     std::strerror(error)));
+  }
+
+  int fd_ = -1;
+  void* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+}  // namespace
+
+absl::StatusOr<std::string> CompiledFilterSnapshot::Serialize(
+    const google::protobuf::Descriptor* descriptor,
+    absl::Span<const CompiledFieldFilter* const> filters) {
+  // All the fields read by @filters, in the order they are first read.
+  std::vector<const google::protobuf::FieldDescriptor*> fields;
+  FieldIndexes field_indexes;
+  for (const CompiledFieldFilter* filter : filters) {
+    if (filter == nullptr) {
+      return absl::InvalidArgumentError("The filters must not be null.");
+    }
+    int max_depth;
+    RETURN_IF_ERROR(Validate(descriptor, *filter, max_depth));
+    for (const google::protobuf::FieldDescriptor* field :
+         filter->field_descriptors_) {
+      if (field_indexes.emplace(field, fields.size()).second) {
+        fields.push_back(field);
+      }
+    }
+  }
+
+  // The message types containing the fields.
+  std::vector<absl::string_view> type_names;
+  absl::flat_hash_map<const google::protobuf::Descriptor*, int> type_indexes;
+  for (const google::protobuf::FieldDescriptor* field : fields) {
+    if (type_indexes.emplace(field->containing_type(), type_names.size())
+            .second) {
+      type_names.push_back(field->containing_type()->full_name());
+    }
+  }
+
+  std::string snapshot;
+  WriteRaw(kMagic, snapshot);
+  WriteRaw(kVersion, snapshot);
+  WriteRaw(GetFingerprint(descriptor, fields), snapshot);
+  WriteString(descriptor->full_name(), snapshot);
+  WriteStrings(type_names, snapshot);
+  WriteRaw<uint32_t>(fields.size(), snapshot);
+  for (const google::protobuf::FieldDescriptor* field : fields) {
+    WriteRaw<uint32_t>(type_indexes.at(field->containing_type()), snapshot);
+    WriteRaw<int32_t>(field->number(), snapshot);
+  }
+  WriteRaw<uint32_t>(filters.size(), snapshot);
+  for (const CompiledFieldFilter* filter : filters) {
+    RETURN_IF_ERROR(WriteFilter(*filter, field_indexes, snapshot));
+  }
+  return snapshot;
+}
+
+absl::StatusOr<std::vector<std::unique_ptr<CompiledFieldFilter>>>
+CompiledFilterSnapshot::Deserialize(
+    const google::protobuf::Descriptor* descriptor,
+    absl::string_view snapshot) {
+  // Copied to memory aligned to 8 bytes, which the filters read in place.
+  auto words = std::make_shared<std::vector<uint64_t>>(
+      (snapshot.size() + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+  if (!snapshot.empty()) {
+    std::memcpy(words->data(), snapshot.data(), snapshot.size());
+  }
+  return Read(descriptor,
+              absl::string_view(reinterpret_cast<const char*>(words->data()),
+                                snapshot.size()),
+              words);
+}
+
+absl::StatusOr<std::vector<std::unique_ptr<CompiledFieldFilter>>>
+CompiledFilterSnapshot::Load(const google::protobuf::Descriptor* descriptor,
+                             const std::string& path) {
+  auto file = std::make_shared<MappedFile>();
+  RETURN_IF_ERROR(file->Open(path));
+  // The mapping is page aligned.
+  return Read(descriptor, file->contents(), file);
+}
+
+absl::StatusOr<std::vector<std::unique_ptr<CompiledFieldFilter>>>
+CompiledFilterSnapshot::Read(const google::protobuf::Descriptor* descriptor,
+                             absl::string_view snapshot,
+                             const std::shared_ptr<const void>& owner) {
+  ASSIGN_OR_RETURN(uint64_t magic, ReadRaw<uint64_t>(snapshot));
+  if (magic != kMagic) {
+    return absl::InvalidArgumentError(
+        "Not a snapshot, or a snapshot written with another byte order.");
+  }
+  ASSIGN_OR_RETURN(uint32_t version, ReadRaw<uint32_t>(snapshot));
+  if (version != kVersion) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Unsupported snapshot version: ", version));
+  }
+  ASSIGN_OR_RETURN(uint64_t fingerprint, ReadRaw<uint64_t>(snapshot));
+  ASSIGN_OR_RETURN(absl::string_view root_name, ReadString(snapshot));
+  if (root_name != descriptor->full_name()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("The snapshot is built for ", root_name, " instead of ",
+                     descriptor->full_name()));
+  }
+
+  ASSIGN_OR_RETURN(std::vector<absl::string_view> type_names,
+                   ReadStrings(snapshot));
+  std::vector<const google::protobuf::Descriptor*> types;
+  types.reserve(type_names.size());
+  for (absl::string_view type_name : type_names) {
+    const google::protobuf::Descriptor* type =
+        descriptor->file()->pool()->FindMessageTypeByName(
+            std::string(type_name));
+    if (type == nullptr) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("The message type read by the snapshot is not found: ",
+                       type_name));
+    }
+    types.push_back(type);
+  }
+
+  ASSIGN_OR_RETURN(uint32_t field_count,
+                   ReadSize(snapshot, sizeof(uint32_t) + sizeof(int32_t)));
+  std::vector<const google::protobuf::FieldDescriptor*> fields;
+  fields.reserve(field_count);
+  for (uint32_t i = 0; i < field_count; ++i) {
+    ASSIGN_OR_RETURN(uint32_t type_index, ReadRaw<uint32_t>(snapshot));
+    ASSIGN_OR_RETURN(int32_t number, ReadRaw<int32_t>(snapshot));
+    if (type_index >= types.size()) {
+      return absl::InvalidArgumentError(
+          "A field in the snapshot has an invalid message type.");
+    }
+    const google::protobuf::FieldDescriptor* field =
+        types[type_index]->FindFieldByNumber(number);
+    if (field == nullptr) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("The field read by the snapshot is not found: ",
+                       types[type_index]->full_name(), " ", number));
+    }
+    fields.push_back(field);
+  }
+  if (GetFingerprint(descriptor, fields) != fingerprint) {
+    return absl::FailedPreconditionError(
+        "The fields read by the snapshot changed since it was written.");
+  }
+
+  ASSIGN_OR_RETURN(uint32_t filter_count,
+                   ReadSize(snapshot, sizeof(uint32_t)));
+  std::vector<std::unique_ptr<CompiledFieldFilter>> filters;
+  filters.reserve(filter_count);
+  for (uint32_t i = 0; i < filter_count; ++i) {
+    auto filter = absl::WrapUnique(new CompiledFieldFilter());
+    RETURN_IF_ERROR(ReadFilter(fields, owner, snapshot, *filter));
+    RETURN_IF_ERROR(Validate(descriptor, *filter, filter->max_depth_));
+    filters.push_back(std::move(filter));
+  }
+  if (!snapshot.empty()) {
+    return absl::InvalidArgumentError(
+        "The snapshot has extra bytes after the filters.");
+  }
+  return filters;
+}
+
+absl::Status CompiledFilterSnapshot::WriteFilter(
+    const CompiledFieldFilter& filter, const FieldIndexes& field_indexes,
+    std::string& snapshot) {
+  using Instruction = CompiledFieldFilter::Instruction;
+  // The instructions are read in place, so their layout is part of the
+  // snapshot format.
+  static_assert(std::is_trivially_copyable_v<Instruction>);
+  static_assert(sizeof(Instruction) == 24 && alignof(Instruction) <= 8);
+  static_assert(offsetof(Instruction, value_kind) == 1 &&
+                offsetof(Instruction, cpp_type) == 4 &&
+                offsetof(Instruction, path_begin) == 8 &&
+                offsetof(Instruction, jump_target) == 20);
+  WriteRaw<uint32_t>(filter.instructions_.size(), snapshot);
+  WritePadding(snapshot);
+  for (const Instruction& instruction : filter.instructions_) {
+    // Copied field by field, so that the padding is written as zeros.
+    Instruction copy;
+    std::memset(&copy, 0, sizeof(copy));
+    copy.opcode = instruction.opcode;
+    copy.value_kind = instruction.value_kind;
+    copy.cpp_type = instruction.cpp_type;
+    copy.path_begin = instruction.path_begin;
+    copy.path_size = instruction.path_size;
+    copy.operand = instruction.operand;
+    copy.jump_target = instruction.jump_target;
+    WriteRaw(copy, snapshot);
+  }
+
+  WriteRaw<uint32_t>(filter.field_descriptors_.size(), snapshot);
+  for (const google::protobuf::FieldDescriptor* field :
+       filter.field_descriptors_) {
+    WriteRaw<uint32_t>(field_indexes.at(field), snapshot);
+  }
+
+  WriteArray<int64_t>(filter.signed_values_, snapshot);
+  WriteArray<uint64_t>(filter.unsigned_values_, snapshot);
+  WriteStrings(std::vector<absl::string_view>(filter.string_values_.begin(),
+                                              filter.string_values_.end()),
+               snapshot);
+
+  RETURN_IF_ERROR(WriteSets(filter.signed_sets_, snapshot));
+  RETURN_IF_ERROR(WriteSets(filter.unsigned_sets_, snapshot));
+  RETURN_IF_ERROR(WriteSets(filter.string_sets_, snapshot));
+
+  WriteRaw<uint32_t>(filter.regexps_.size(), snapshot);
+  for (const std::unique_ptr<RegexpMatcher>& regexp : filter.regexps_) {
+    WriteString(regexp->pattern(), snapshot);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status CompiledFilterSnapshot::ReadFilter(
+    absl::Span<const google::protobuf::FieldDescriptor* const> fields,
+    const std::shared_ptr<const void>& owner, absl::string_view& snapshot,
+    CompiledFieldFilter& filter) {
+  using Instruction = CompiledFieldFilter::Instruction;
+  ASSIGN_OR_RETURN(uint32_t instruction_count,
+                   ReadSize(snapshot, sizeof(Instruction)));
+  RETURN_IF_ERROR(ReadPadding(snapshot));
+  if (instruction_count > snapshot.size() / sizeof(Instruction)) {
+    return TruncatedError();
+  }
+  // Read in place. The ranges of the enums are checked by Validate.
+  filter.instructions_ = absl::MakeConstSpan(
+      reinterpret_cast<const Instruction*>(snapshot.data()),
+      instruction_count);
+  filter.snapshot_ = owner;
+  snapshot.remove_prefix(instruction_count * sizeof(Instruction));
+
+  ASSIGN_OR_RETURN(std::vector<uint32_t> field_indexes,
+                   ReadArray<uint32_t>(snapshot));
+  filter.field_descriptors_.reserve(field_indexes.size());
+  for (uint32_t field_index : field_indexes) {
+    if (field_index >= fields.size()) {
+      return absl::InvalidArgumentError(
+          "A field path in the snapshot has an invalid field.");
+    }
+    filter.field_descriptors_.push_back(fields[field_index]);
+  }
+
+  ASSIGN_OR_RETURN(filter.signed_values_, ReadArray<int64_t>(snapshot));
+  ASSIGN_OR_RETURN(filter.unsigned_values_, ReadArray<uint64_t>(snapshot));
+  ASSIGN_OR_RETURN(std::vector<absl::string_view> string_values,
+                   ReadStrings(snapshot));
+  filter.string_values_.reserve(string_values.size());
+  for (absl::string_view value : string_values) {
+    filter.string_values_.emplace_back(value);
+  }
+
+  RETURN_IF_ERROR(ReadSets(snapshot, owner, filter.signed_sets_));
+  RETURN_IF_ERROR(ReadSets(snapshot, owner, filter.unsigned_sets_));
+  RETURN_IF_ERROR(ReadSets(snapshot, owner, filter.string_sets_));
+
+  ASSIGN_OR_RETURN(uint32_t regexp_count,
+                   ReadSize(snapshot, sizeof(uint32_t)));
+  filter.regexps_.reserve(regexp_count);
+  for (uint32_t i = 0; i < regexp_count; ++i) {
+    ASSIGN_OR_RETURN(absl::string_view pattern, ReadString(snapshot));
+    ASSIGN_OR_RETURN(std::unique_ptr<RegexpMatcher> regexp,
+                     RegexpMatcher::New(pattern));
+    filter.regexps_.push_back(std::move(regexp));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status CompiledFilterSnapshot::Validate(
+    const google::protobuf::Descriptor* descriptor,
+    const CompiledFieldFilter& filter, int& max_depth) {
+  using Opcode = CompiledFieldFilter::Opcode;
+  using ValueKind = CompiledFieldFilter::ValueKind;
+  using CppType = google::protobuf::FieldDescriptor::CppType;
+
+  absl::Span<const CompiledFieldFilter::Instruction> instructions =
+      filter.instructions_;
+  const int size = static_cast<int>(instructions.size());
+  const int path_table_size =
+      static_cast<int>(filter.field_descriptors_.size());
+  // The message types entered, and the ENTER instructions entering them.
+  std::vector<const google::protobuf::Descriptor*> scopes = {descriptor};
+  std::vector<int> enters;
+  // The ENTER of the innermost scope before executing each instruction, or
+  // -1 for the top level. A jump must stay in the same scope.
+  std::vector<int> scope_of(size + 1, -1);
+  max_depth = 0;
+
+  auto invalid = [](int pc, absl::string_view message) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid instruction ", pc, ": ", message));
+  };
+
+  for (int pc = 0; pc < size; ++pc) {
+    const CompiledFieldFilter::Instruction& instruction = instructions[pc];
+    scope_of[pc] = enters.empty() ? -1 : enters.back();
+    switch (instruction.opcode) {
+      case Opcode::TRUE:
+      case Opcode::NOT:
+        continue;
+      case Opcode::JUMP_IF_FALSE:
+      case Opcode::JUMP_IF_TRUE:
+        if (instruction.jump_target <= pc || instruction.jump_target > size) {
+          return invalid(pc, "jump target out of range.");
+        }
+        continue;
+      case Opcode::LEAVE:
+        if (enters.empty()) {
+          return invalid(pc, "LEAVE without ENTER.");
+        }
+        if (instructions[enters.back()].jump_target != pc + 1) {
+          return invalid(pc, "ENTER does not jump after its LEAVE.");
+        }
+        enters.pop_back();
+        scopes.pop_back();
+        continue;
+      case Opcode::HAS:
+      case Opcode::EQUAL:
+      case Opcode::GT:
+      case Opcode::LT:
+      case Opcode::IN:
+      case Opcode::ANY_IN:
+      case Opcode::REGEXP:
+      case Opcode::ENTER:
+        break;
+      default:
+        return invalid(pc, "unknown opcode.");
+    }
+
+    // The field path must start from the current scope, and only go through
+    // singular message fields.
+    if (instruction.path_size <= 0 || instruction.path_begin < 0 ||
+        instruction.path_begin > path_table_size - instruction.path_size) {
+      return invalid(pc, "field path out of range.");
+    }
+    const google::protobuf::Descriptor* parent = scopes.back();
+    const google::protobuf::FieldDescriptor* field = nullptr;
+    for (int i = 0; i < instruction.path_size; ++i) {
+      if (field != nullptr) {
+        if (field->cpp_type() != CppType::CPPTYPE_MESSAGE ||
+            field->is_repeated()) {
+          return invalid(pc, "field path through a non message field.");
+        }
+        parent = field->message_type();
+      }
+      field = filter.field_descriptors_[instruction.path_begin + i];
+      if (field->containing_type() != parent) {
+        return invalid(pc, "field path not in the current message.");
+      }
+    }
+    if (instruction.cpp_type != field->cpp_type()) {
+      return invalid(pc, "wrong field type.");
+    }
+
+    ValueKind value_kind = ValueKind::NONE;
+    switch (field->cpp_type()) {
+      case CppType::CPPTYPE_INT32:
+      case CppType::CPPTYPE_INT64:
+      case CppType::CPPTYPE_BOOL:
+      case CppType::CPPTYPE_ENUM:
+        value_kind = ValueKind::SIGNED;
+        break;
+      case CppType::CPPTYPE_UINT32:
+      case CppType::CPPTYPE_UINT64:
+        value_kind = ValueKind::UNSIGNED;
+        break;
+      case CppType::CPPTYPE_STRING:
+        value_kind = ValueKind::STRING;
+        break;
+      default:
+        break;
+    }
+
+    // The size of the operand table of the instruction, or -1 if the operand
+    // is not used.
+    int operand_table_size = -1;
+    switch (instruction.opcode) {
+      case Opcode::EQUAL:
+      case Opcode::GT:
+      case Opcode::LT:
+        if (field->is_repeated() || value_kind == ValueKind::NONE ||
+            (instruction.opcode != Opcode::EQUAL &&
+             value_kind == ValueKind::STRING)) {
+          return invalid(pc, "unsupported field for comparison.");
+        }
+        operand_table_size =
+            value_kind == ValueKind::SIGNED
+                ? filter.signed_values_.size()
+                : value_kind == ValueKind::UNSIGNED
+                      ? filter.unsigned_values_.size()
+                      : filter.string_values_.size();
+        break;
+      case Opcode::IN:
+      case Opcode::ANY_IN:
+        if (field->is_repeated() != (instruction.opcode == Opcode::ANY_IN) ||
+            value_kind == ValueKind::NONE) {
+          return invalid(pc, "unsupported field for a set.");
+        }
+        operand_table_size =
+            value_kind == ValueKind::SIGNED
+                ? filter.signed_sets_.size()
+                : value_kind == ValueKind::UNSIGNED
+                      ? filter.unsigned_sets_.size()
+                      : filter.string_sets_.size();
+        break;
+      case Opcode::REGEXP:
+        if (value_kind != ValueKind::STRING) {
+          return invalid(pc, "REGEXP on a non string field.");
+        }
+        operand_table_size = filter.regexps_.size();
+        break;
+      case Opcode::ENTER:
+        if (field->cpp_type() != CppType::CPPTYPE_MESSAGE ||
+            field->is_repeated()) {
+          return invalid(pc, "ENTER a non message field.");
+        }
+        // Checked when reaching the matching LEAVE.
+        enters.push_back(pc);
+        scopes.push_back(field->message_type());
+        max_depth = std::max(max_depth, static_cast<int>(enters.size()));
+        break;
+      default:
+        break;
+    }
+    if (operand_table_size >= 0) {
+      if (instruction.value_kind != value_kind) {
+        return invalid(pc, "wrong value kind.");
+      }
+      if (instruction.operand < 0 ||
+          instruction.operand >= operand_table_size) {
+        return invalid(pc, "operand out of range.");
+      }
+    }
+  }
+  if (!enters.empty()) {
+    return invalid(enters.back(), "ENTER without LEAVE.");
+  }
+
+  for (int pc = 0; pc < size; ++pc) {
+    const CompiledFieldFilter::Instruction& instruction = instructions[pc];
+    if ((instruction.opcode == Opcode::JUMP_IF_FALSE ||
+         instruction.opcode == Opcode::JUMP_IF_TRUE) &&
+        scope_of[instruction.jump_target] != scope_of[pc]) {
+      return invalid(pc, "jump out of the current message.");
+    }
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace wfa_virtual_people
@@ -0,0 +1,131 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_COMPILED_FILTER_SNAPSHOT_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_COMPILED_FILTER_SNAPSHOT_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "google/protobuf/descriptor.h"
+#include "wfa/virtual_people/common/field_filter/compiled_field_filter.h"
+
+namespace wfa_virtual_people {
+
+// Saves CompiledFieldFilters to a binary snapshot, and loads them back without
+// going through FieldFilterProto.
+//
+// Building a filter parses the values of IN filters from comma separated
+// strings, resolves the field paths by name, and normalizes the config. A
+// snapshot stores the result instead: the instructions, the field paths as
+// field numbers, and the operands as raw values.
+//
+// Load maps the snapshot file, and the loaded filters read their instructions
+// and their large sets in place from the mapping, which they keep alive. Sets
+// of more than 64 values are stored in the format of ExternalValueSet, as
+// sorted arrays with a Bloom filter, and are not read when loading. The other
+// parts are still built when loading: the fields are looked up by number, the
+// single values and the small sets are copied, and the regular expressions
+// are compiled. So the time to load grows with the size of the filters, but
+// not with the values of their large sets. The mapping is shared, so the
+// processes loading the same snapshot share the pages of the large sets.
+// Sets from FieldFilterProto.value_file are stored as the absolute path of
+// the file, which is opened again when loading.
+//
+// The snapshot stores a fingerprint of the fields it reads: their names,
+// numbers and types. Loading fails if any of these fields changed in the
+// message types the snapshot is loaded for, so a snapshot is only used with
+// the same schema it was built for. Loading checks the header, the bounds of
+// every table and the instructions, so an invalid snapshot returns error
+// status instead of crashing in IsMatch. The values of the sets read in place
+// are not checked to be sorted: a snapshot whose values are modified may
+// match wrongly, but does not read out of the snapshot.
+//
+// The snapshot uses the byte order of the machine writing it, and is rejected
+// on machines with the other byte order.
+//
+// Example:
+//   std::vector<const CompiledFieldFilter*> filters = ...;
+//   ASSIGN_OR_RETURN(std::string snapshot,
+//                    CompiledFilterSnapshot::Serialize(descriptor, filters));
+//   ...
+//   ASSIGN_OR_RETURN(std::vector<std::unique_ptr<CompiledFieldFilter>> loaded,
+//                    CompiledFilterSnapshot::Load(descriptor, path));
+class CompiledFilterSnapshot {
+ public:
+  // Returns the snapshot of @filters, which are built for @descriptor.
+  //
+  // Returns error status if any of @filters is not built for @descriptor.
+  static absl::StatusOr<std::string> Serialize(
+      const google::protobuf::Descriptor* descriptor,
+      absl::Span<const CompiledFieldFilter* const> filters);
+
+  // Returns the filters stored in @snapshot, in the order they were passed to
+  // Serialize. @snapshot is copied once, into memory shared by the filters,
+  // which read it in place like Load.
+  //
+  // Returns error status if any of the following happens:
+  //   @snapshot is not a valid snapshot.
+  //   @snapshot is built for another message type than @descriptor.
+  //   Any field read by the filters is missing or changed.
+  static absl::StatusOr<std::vector<std::unique_ptr<CompiledFieldFilter>>>
+  Deserialize(const google::protobuf::Descriptor* descriptor,
+              absl::string_view snapshot);
+
+  // Same as Deserialize, with the snapshot in the file at @path, which is
+  // memory mapped and read in place instead of copied.
+  static absl::StatusOr<std::vector<std::unique_ptr<CompiledFieldFilter>>>
+  Load(const google::protobuf::Descriptor* descriptor, const std::string& path);
+
+ private:
+  using FieldIndexes =
+      absl::flat_hash_map<const google::protobuf::FieldDescriptor*, int>;
+
+  // Returns the filters stored in @snapshot, which is aligned to 8 bytes and
+  // stays valid while @owner is alive. The filters keep @owner alive.
+  static absl::StatusOr<std::vector<std::unique_ptr<CompiledFieldFilter>>>
+  Read(const google::protobuf::Descriptor* descriptor,
+       absl::string_view snapshot, const std::shared_ptr<const void>& owner);
+
+  // Appends @filter to @snapshot. The fields are written as their indexes in
+  // @field_indexes.
+  static absl::Status WriteFilter(const CompiledFieldFilter& filter,
+                                  const FieldIndexes& field_indexes,
+                                  std::string& snapshot);
+
+  // Reads the filter at the beginning of @snapshot into @filter, and removes
+  // it from @snapshot. The fields are looked up in @fields. The instructions
+  // and the large sets are read in place, and keep @owner alive.
+  static absl::Status ReadFilter(
+      absl::Span<const google::protobuf::FieldDescriptor* const> fields,
+      const std::shared_ptr<const void>& owner, absl::string_view& snapshot,
+      CompiledFieldFilter& filter);
+
+  // Returns error status if the instructions of @filter are not valid for
+  // @descriptor, like a field path not starting from the message entered, or
+  // an operand out of range. Sets @max_depth to the deepest nesting of ENTER.
+  static absl::Status Validate(const google::protobuf::Descriptor* descriptor,
+                               const CompiledFieldFilter& filter,
+                               int& max_depth);
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_COMPILED_FILTER_SNAPSHOT_H_
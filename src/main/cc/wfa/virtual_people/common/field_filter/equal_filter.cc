@@ -22,18 +22,22 @@
 #include "absl/memory/memory.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
 #include "common_cpp/macros/macros.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/message.h"
 #include "wfa/virtual_people/common/field_filter.pb.h"
 #include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_accessor.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
 #include "wfa/virtual_people/common/field_filter/utils/field_util.h"
 #include "wfa/virtual_people/common/field_filter/utils/type_convert_util.h"
+#include "wfa/virtual_people/common/field_filter/utils/value_set.h"
 
 namespace wfa_virtual_people {
 
 // The implementation of EqualFilter based on the type of field represented by
-// @field_descriptors. The supported ValueTypes are
+// @field_path. The supported ValueTypes are
 //   int32_t
 //   int64_t
 //   uint32_t
@@ -45,14 +49,25 @@ template <typename ValueType>
 class EqualFilterImpl : public EqualFilter {
  public:
   explicit EqualFilterImpl(
-      std::vector<const google::protobuf::FieldDescriptor*>&& field_descriptors,
-      ValueType value)
-      : field_descriptors_(std::move(field_descriptors)), value_(value) {}
+      std::shared_ptr<const FieldPath> field_path, ValueType value)
+      : field_path_(std::move(field_path)),
+        getter_(GetFieldGetter<AccessorValueType<ValueType>>(
+            FindFieldAccessor(*field_path_))),
+        value_(value) {}
 
   bool IsMatch(const google::protobuf::Message& message) const override;
 
+  void MatchSelected(
+      absl::Span<const google::protobuf::Message* const> messages,
+      absl::Span<const int> selection,
+      std::vector<bool>* matches) const override;
+
+  void AppendReferencedFields(
+      std::vector<ReferencedField>* fields) const override;
+
  private:
-  std::vector<const google::protobuf::FieldDescriptor*> field_descriptors_;
+  std::shared_ptr<const FieldPath> field_path_;
+  FieldGetter<AccessorValueType<ValueType>> getter_;
   ValueType value_;
 };
 
@@ -60,14 +75,25 @@ template <>
 class EqualFilterImpl<std::string> : public EqualFilter {
  public:
   explicit EqualFilterImpl(
-      std::vector<const google::protobuf::FieldDescriptor*>&& field_descriptors,
-      absl::string_view value)
-      : field_descriptors_(std::move(field_descriptors)), value_(value) {}
+      std::shared_ptr<const FieldPath> field_path, absl::string_view value)
+      : field_path_(std::move(field_path)),
+        getter_(GetFieldGetter<const std::string&>(
+            FindFieldAccessor(*field_path_))),
+        value_(value) {}
 
   bool IsMatch(const google::protobuf::Message& message) const override;
 
+  void MatchSelected(
+      absl::Span<const google::protobuf::Message* const> messages,
+      absl::Span<const int> selection,
+      std::vector<bool>* matches) const override;
+
+  void AppendReferencedFields(
+      std::vector<ReferencedField>* fields) const override;
+
  private:
-  std::vector<const google::protobuf::FieldDescriptor*> field_descriptors_;
+  std::shared_ptr<const FieldPath> field_path_;
+  FieldGetter<const std::string&> getter_;
   std::string value_;
 };
 
@@ -75,17 +101,22 @@ template <typename ValueType>
 bool EqualFilterImpl<ValueType>::IsMatch(
     const google::protobuf::Message& message) const {
   ProtoFieldValue<ValueType> proto_field_value =
-      GetValueFromProto<ValueType>(message, field_descriptors_);
+      GetValueFromProto<ValueType>(message, *field_path_, getter_);
   return proto_field_value.is_set && value_ == proto_field_value.value;
 }
 
 template <>
 bool EqualFilterImpl<const google::protobuf::EnumValueDescriptor*>::IsMatch(
     const google::protobuf::Message& message) const {
+  if (getter_ != nullptr) {
+    ProtoFieldValue<int32_t> proto_field_value = getter_(message);
+    return proto_field_value.is_set &&
+           value_->number() == proto_field_value.value;
+  }
   ProtoFieldValue<const google::protobuf::EnumValueDescriptor*>
       proto_field_value =
           GetValueFromProto<const google::protobuf::EnumValueDescriptor*>(
-              message, field_descriptors_);
+              message, *field_path_);
   return (proto_field_value.is_set &&
           value_->number() == proto_field_value.value->number());
 }
@@ -93,8 +124,59 @@ bool EqualFilterImpl<const google::protobuf::EnumValueDescriptor*>::IsMatch(
 bool EqualFilterImpl<std::string>::IsMatch(
     const google::protobuf::Message& message) const {
   ProtoFieldValue<const std::string&> proto_field_value =
-      GetValueFromProto<const std::string&>(message, field_descriptors_);
-  return proto_field_value.is_set && value_ == proto_field_value.value;
+      GetValueFromProto<const std::string&>(message, *field_path_,
+                                            getter_);
+  return proto_field_value.is_set &&
+         MatchesStringLiteral(value_, proto_field_value.value);
+}
+
+template <typename ValueType>
+void EqualFilterImpl<ValueType>::MatchSelected(
+    absl::Span<const google::protobuf::Message* const> messages,
+    absl::Span<const int> selection, std::vector<bool>* matches) const {
+  MatchSelectedValues<ValueType>(
+      messages, selection, *field_path_, getter_,
+      [this](const ProtoFieldValue<ValueType>& field_value) {
+        return field_value.is_set && value_ == field_value.value;
+      },
+      matches);
+}
+
+template <>
+void EqualFilterImpl<const google::protobuf::EnumValueDescriptor*>::
+    MatchSelected(absl::Span<const google::protobuf::Message* const> messages,
+                  absl::Span<const int> selection,
+                  std::vector<bool>* matches) const {
+  MatchSelectedValues<const google::protobuf::EnumValueDescriptor*>(
+      messages, selection, *field_path_, getter_,
+      [this](const auto& field_value) {
+        return field_value.is_set &&
+               value_->number() == GetEnumNumber(field_value.value);
+      },
+      matches);
+}
+
+void EqualFilterImpl<std::string>::MatchSelected(
+    absl::Span<const google::protobuf::Message* const> messages,
+    absl::Span<const int> selection, std::vector<bool>* matches) const {
+  MatchSelectedValues<const std::string&>(
+      messages, selection, *field_path_, getter_,
+      [this](const ProtoFieldValue<const std::string&>& field_value) {
+        return field_value.is_set &&
+               MatchesStringLiteral(value_, field_value.value);
+      },
+      matches);
+}
+
+template <typename ValueType>
+void EqualFilterImpl<ValueType>::AppendReferencedFields(
+    std::vector<ReferencedField>* fields) const {
+  fields->push_back({field_path_, /*reads_value=*/true});
+}
+
+void EqualFilterImpl<std::string>::AppendReferencedFields(
+    std::vector<ReferencedField>* fields) const {
+  fields->push_back({field_path_, /*reads_value=*/true});
 }
 
 // NumericType can be
@@ -106,7 +188,7 @@ bool EqualFilterImpl<std::string>::IsMatch(
 template <typename NumericType>
 absl::StatusOr<std::unique_ptr<EqualFilterImpl<NumericType>>> CreateFilter(
     const FieldFilterProto& config,
-    std::vector<const google::protobuf::FieldDescriptor*>&& field_descriptors) {
+    std::shared_ptr<const FieldPath> field_path) {
   absl::StatusOr<NumericType> value =
       ConvertToNumeric<NumericType>(config.value());
   if (!value.ok()) {
@@ -115,7 +197,7 @@ absl::StatusOr<std::unique_ptr<EqualFilterImpl<NumericType>>> CreateFilter(
                      config.DebugString()));
   }
   return absl::make_unique<EqualFilterImpl<NumericType>>(
-      std::move(field_descriptors), *value);
+      std::move(field_path), *value);
 }
 
 absl::StatusOr<std::unique_ptr<EqualFilter>> EqualFilter::New(
@@ -133,24 +215,23 @@ absl::StatusOr<std::unique_ptr<EqualFilter>> EqualFilter::New(
     return absl::InvalidArgumentError(absl::StrCat(
         "Value must be set. Input FieldFilterProto: ", config.DebugString()));
   }
-  ASSIGN_OR_RETURN(
-      std::vector<const google::protobuf::FieldDescriptor*> field_descriptors,
-      GetFieldFromProto(descriptor, config.name()));
+  ASSIGN_OR_RETURN(std::shared_ptr<const FieldPath> field_path,
+                   GetFieldPathFromProto(descriptor, config.name()));
 
-  switch (field_descriptors.back()->cpp_type()) {
+  switch (field_path->back()->cpp_type()) {
     case google::protobuf::FieldDescriptor::CppType::CPPTYPE_INT32:
-      return CreateFilter<int32_t>(config, std::move(field_descriptors));
+      return CreateFilter<int32_t>(config, std::move(field_path));
     case google::protobuf::FieldDescriptor::CppType::CPPTYPE_INT64:
-      return CreateFilter<int64_t>(config, std::move(field_descriptors));
+      return CreateFilter<int64_t>(config, std::move(field_path));
     case google::protobuf::FieldDescriptor::CppType::CPPTYPE_UINT32:
-      return CreateFilter<uint32_t>(config, std::move(field_descriptors));
+      return CreateFilter<uint32_t>(config, std::move(field_path));
     case google::protobuf::FieldDescriptor::CppType::CPPTYPE_UINT64:
-      return CreateFilter<uint64_t>(config, std::move(field_descriptors));
+      return CreateFilter<uint64_t>(config, std::move(field_path));
     case google::protobuf::FieldDescriptor::CppType::CPPTYPE_BOOL:
-      return CreateFilter<bool>(config, std::move(field_descriptors));
+      return CreateFilter<bool>(config, std::move(field_path));
     case google::protobuf::FieldDescriptor::CppType::CPPTYPE_ENUM: {
       absl::StatusOr<const google::protobuf::EnumValueDescriptor*> value =
-          ConvertToEnum(field_descriptors.back()->enum_type(), config.value());
+          ConvertToEnum(field_path->back()->enum_type(), config.value());
       if (!value.ok()) {
         return absl::InvalidArgumentError(absl::StrCat(
             "Value type does not match name. Input FieldFilterProto: ",
@@ -158,14 +239,14 @@ absl::StatusOr<std::unique_ptr<EqualFilter>> EqualFilter::New(
       }
       return absl::make_unique<
           EqualFilterImpl<const google::protobuf::EnumValueDescriptor*>>(
-          std::move(field_descriptors), *value);
+          std::move(field_path), *value);
     }
     case google::protobuf::FieldDescriptor::CppType::CPPTYPE_STRING: {
       // ValueType must be "std::string" rather than "const std::string&".
       // Otherwise, value_ would be a reference to config.value(), and when
       // config is out of scope, value_ would refer to nothing.
       return absl::make_unique<EqualFilterImpl<std::string>>(
-          std::move(field_descriptors), config.value());
+          std::move(field_path), config.value());
     }
     default:
       return absl::InvalidArgumentError(absl::StrCat(
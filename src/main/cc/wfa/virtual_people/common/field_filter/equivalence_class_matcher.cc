@@ -0,0 +1,300 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/equivalence_class_matcher.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/hash/hash.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+// The cache is only split into shards of at least this many keys, so that
+// small caches keep an exact LRU order.
+constexpr int kMinShardCapacity = 256;
+constexpr int kMaxShardCount = 16;
+
+template <typename ValueType>
+void AppendRaw(ValueType value, std::string& key) {
+  key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void AppendString(absl::string_view value, std::string& key) {
+  AppendRaw(static_cast<uint32_t>(value.size()), key);
+  key.append(value.data(), value.size());
+}
+
+// Appends the value of the singular @field in @message to @key.
+void AppendValue(const google::protobuf::Message& message,
+                 const google::protobuf::FieldDescriptor* field,
+                 std::string& scratch, std::string& key) {
+  const google::protobuf::Reflection* reflection = message.GetReflection();
+  switch (field->cpp_type()) {
+    case google::protobuf::FieldDescriptor::CPPTYPE_INT32:
+      AppendRaw(reflection->GetInt32(message, field), key);
+      break;
+    case google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+      AppendRaw(reflection->GetInt64(message, field), key);
+      break;
+    case google::protobuf::FieldDescriptor::CPPTYPE_UINT32:
+      AppendRaw(reflection->GetUInt32(message, field), key);
+      break;
+    case google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+      AppendRaw(reflection->GetUInt64(message, field), key);
+      break;
+    case google::protobuf::FieldDescriptor::CPPTYPE_FLOAT:
+      AppendRaw(reflection->GetFloat(message, field), key);
+      break;
+    case google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE:
+      AppendRaw(reflection->GetDouble(message, field), key);
+      break;
+    case google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+      AppendRaw(reflection->GetBool(message, field), key);
+      break;
+    case google::protobuf::FieldDescriptor::CPPTYPE_ENUM:
+      AppendRaw(reflection->GetEnumValue(message, field), key);
+      break;
+    case google::protobuf::FieldDescriptor::CPPTYPE_STRING:
+      AppendString(reflection->GetStringReference(message, field, &scratch),
+                   key);
+      break;
+    case google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE:
+      AppendString(
+          reflection->GetMessage(message, field).SerializePartialAsString(),
+          key);
+      break;
+  }
+}
+
+// Appends the value at @index of the repeated @field in @message to @key.
+void AppendRepeatedValue(const google::protobuf::Message& message,
+                         const google::protobuf::FieldDescriptor* field,
+                         int index, std::string& scratch, std::string& key) {
+  const google::protobuf::Reflection* reflection = message.GetReflection();
+  switch (field->cpp_type()) {
+    case google::protobuf::FieldDescriptor::CPPTYPE_INT32:
+      AppendRaw(reflection->GetRepeatedInt32(message, field, index), key);
+      break;
+    case google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+      AppendRaw(reflection->GetRepeatedInt64(message, field, index), key);
+      break;
+    case google::protobuf::FieldDescriptor::CPPTYPE_UINT32:
+      AppendRaw(reflection->GetRepeatedUInt32(message, field, index), key);
+      break;
+    case google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+      AppendRaw(reflection->GetRepeatedUInt64(message, field, index), key);
+      break;
+    case google::protobuf::FieldDescriptor::CPPTYPE_FLOAT:
+      AppendRaw(reflection->GetRepeatedFloat(message, field, index), key);
+      break;
+    case google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE:
+      AppendRaw(reflection->GetRepeatedDouble(message, field, index), key);
+      break;
+    case google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+      AppendRaw(reflection->GetRepeatedBool(message, field, index), key);
+      break;
+    case google::protobuf::FieldDescriptor::CPPTYPE_ENUM:
+      AppendRaw(reflection->GetRepeatedEnumValue(message, field, index), key);
+      break;
+    case google::protobuf::FieldDescriptor::CPPTYPE_STRING:
+      AppendString(reflection->GetRepeatedStringReference(message, field,
+                                                          index, &scratch),
+                   key);
+      break;
+    case google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE:
+      AppendString(reflection->GetRepeatedMessage(message, field, index)
+                       .SerializePartialAsString(),
+                   key);
+      break;
+  }
+}
+
+// Appends the presence of the field represented by @field_path in @message to
+// @key, followed by its value if @reads_value is true. An unset parent message
+// is the same as an unset field.
+void AppendField(const google::protobuf::Message& message,
+                 const FieldPath& field_path, bool reads_value,
+                 std::string& scratch, std::string& key) {
+  const google::protobuf::Message* parent = &message;
+  for (int i = 0; i < static_cast<int>(field_path.size()) - 1; ++i) {
+    if (!parent->GetReflection()->HasField(*parent, field_path[i])) {
+      key.push_back(0);
+      return;
+    }
+    parent = &parent->GetReflection()->GetMessage(*parent, field_path[i]);
+  }
+  const google::protobuf::FieldDescriptor* field = field_path.back();
+  const google::protobuf::Reflection* reflection = parent->GetReflection();
+  if (!field->is_repeated()) {
+    if (!reflection->HasField(*parent, field)) {
+      key.push_back(0);
+      return;
+    }
+    key.push_back(1);
+    if (reads_value) {
+      AppendValue(*parent, field, scratch, key);
+    }
+    return;
+  }
+  const int size = reflection->FieldSize(*parent, field);
+  if (!reads_value) {
+    key.push_back(size > 0 ? 1 : 0);
+    return;
+  }
+  AppendRaw(size, key);
+  for (int i = 0; i < size; ++i) {
+    AppendRepeatedValue(*parent, field, i, scratch, key);
+  }
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<EquivalenceClassMatcher>>
+EquivalenceClassMatcher::New(std::shared_ptr<const FieldFilter> filter,
+                             int cache_capacity) {
+  if (!filter) {
+    return absl::InvalidArgumentError("The filter must not be null.");
+  }
+  if (cache_capacity < 0) {
+    return absl::InvalidArgumentError(
+        "The cache capacity must not be negative.");
+  }
+  return absl::WrapUnique(
+      new EquivalenceClassMatcher(std::move(filter), cache_capacity));
+}
+
+EquivalenceClassMatcher::EquivalenceClassMatcher(
+    std::shared_ptr<const FieldFilter> filter, int cache_capacity)
+    : filter_(std::move(filter)),
+      fields_(filter_->GetReferencedFields()),
+      cache_capacity_(cache_capacity),
+      shard_count_(std::clamp(cache_capacity / kMinShardCapacity, 1,
+                              kMaxShardCount)),
+      shard_capacity_((cache_capacity + shard_count_ - 1) / shard_count_),
+      shards_(new CacheShard[shard_count_]) {}
+
+void EquivalenceClassMatcher::GetKey(const google::protobuf::Message& message,
+                                     std::string& key) const {
+  key.clear();
+  // Passed to GetStringReference, which only uses it for string fields not
+  // stored as std::string.
+  std::string scratch;
+  for (const ReferencedField& field : fields_) {
+    // Each field is prefixed by the size of its encoding, so that the fields
+    // of different tuples never line up into the same key.
+    const size_t size_offset = key.size();
+    AppendRaw(uint32_t{0}, key);
+    AppendField(message, *field.field_path, field.reads_value, scratch, key);
+    const uint32_t size =
+        static_cast<uint32_t>(key.size() - size_offset - sizeof(uint32_t));
+    std::memcpy(&key[size_offset], &size, sizeof(size));
+  }
+}
+
+bool EquivalenceClassMatcher::IsMatch(
+    const google::protobuf::Message& message) const {
+  if (cache_capacity_ == 0) {
+    return filter_->IsMatch(message);
+  }
+  std::string key;
+  GetKey(message, key);
+  // The shard is picked from the high bits of the hash, since the index of
+  // the shard hashes the key again, and takes its H2 from the low bits, which
+  // would otherwise be the same for all the keys of a shard.
+  const uint64_t hash = absl::HashOf(absl::string_view(key));
+  CacheShard& shard = shards_[((hash >> 32) * shard_count_) >> 32];
+  {
+    absl::MutexLock lock(&shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+      shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+      return it->second->result;
+    }
+  }
+
+  // The filter is evaluated without holding the lock.
+  const bool result = filter_->IsMatch(message);
+  absl::MutexLock lock(&shard.mutex);
+  if (shard.index.contains(key)) {
+    // Added by another thread in the meantime.
+    return result;
+  }
+  shard.entries.push_front({std::move(key), result});
+  shard.index.emplace(shard.entries.front().key, shard.entries.begin());
+  if (static_cast<int>(shard.entries.size()) > shard_capacity_) {
+    shard.index.erase(shard.entries.back().key);
+    shard.entries.pop_back();
+  }
+  return result;
+}
+
+int EquivalenceClassMatcher::MatchBatch(
+    absl::Span<const google::protobuf::Message* const> messages,
+    std::vector<bool>* matches) const {
+  // Maps each key to the index of its first message in @representatives.
+  absl::flat_hash_map<std::string, int> classes;
+  std::vector<const google::protobuf::Message*> representatives;
+  std::vector<int> class_indexes;
+  class_indexes.reserve(messages.size());
+  std::string key;
+  for (const google::protobuf::Message* message : messages) {
+    GetKey(*message, key);
+    auto [it, inserted] =
+        classes.try_emplace(key, static_cast<int>(representatives.size()));
+    if (inserted) {
+      representatives.push_back(message);
+    }
+    class_indexes.push_back(it->second);
+  }
+
+  std::vector<bool> class_matches;
+  filter_->MatchBatch(representatives, &class_matches);
+  matches->resize(messages.size());
+  for (int i = 0; i < static_cast<int>(messages.size()); ++i) {
+    (*matches)[i] = class_matches[class_indexes[i]];
+  }
+  return static_cast<int>(representatives.size());
+}
+
+int EquivalenceClassMatcher::cache_size() const {
+  int size = 0;
+  for (int i = 0; i < shard_count_; ++i) {
+    absl::MutexLock lock(&shards_[i].mutex);
+    size += static_cast<int>(shards_[i].entries.size());
+  }
+  return size;
+}
+
+}  // namespace wfa_virtual_people
@@ -0,0 +1,126 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_EQUIVALENCE_CLASS_MATCHER_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_EQUIVALENCE_CLASS_MATCHER_H_
+
+#include <list>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "google/protobuf/message.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+
+namespace wfa_virtual_people {
+
+// Evaluates a FieldFilter once per distinct tuple of the fields it reads,
+// instead of once per message.
+//
+// The result of a filter only depends on the fields returned by
+// FieldFilter::GetReferencedFields. On real traffic, these fields, like gender,
+// age bucket and country, take few distinct values across many events. Each
+// message is mapped to a compact key encoding these fields, and messages with
+// the same key share one evaluation of the filter.
+//
+// MatchBatch deduplicates the messages of one batch. IsMatch looks up single
+// messages in a bounded LRU cache of the most recent keys, for streaming use.
+// Large caches are split into shards by the hash of the key, each with its own
+// lock and LRU order, so that concurrent IsMatch calls rarely contend.
+//
+// Example:
+//   ASSIGN_OR_RETURN(std::unique_ptr<EquivalenceClassMatcher> matcher,
+//                    EquivalenceClassMatcher::New(filter));
+//   std::vector<bool> matches;
+//   matcher->MatchBatch(events, &matches);
+//
+// This class is thread-safe.
+class EquivalenceClassMatcher {
+ public:
+  // The default number of keys kept in the LRU cache of IsMatch.
+  static constexpr int kDefaultCacheCapacity = 4096;
+
+  // Returns a matcher of @filter. Up to about @cache_capacity keys are kept in
+  // the LRU cache of IsMatch. When @cache_capacity is 0, IsMatch evaluates
+  // @filter directly.
+  //
+  // Returns error status if @filter is nullptr or @cache_capacity is negative.
+  static absl::StatusOr<std::unique_ptr<EquivalenceClassMatcher>> New(
+      std::shared_ptr<const FieldFilter> filter,
+      int cache_capacity = kDefaultCacheCapacity);
+
+  EquivalenceClassMatcher(const EquivalenceClassMatcher&) = delete;
+  EquivalenceClassMatcher& operator=(const EquivalenceClassMatcher&) = delete;
+
+  // Returns the same as the filter IsMatch(@message). The result is reused
+  // from the LRU cache when a message with the same key has been evaluated
+  // recently.
+  bool IsMatch(const google::protobuf::Message& message) const;
+
+  // Same as the filter MatchBatch(@messages, @matches), except that the
+  // filter is evaluated once per distinct key among @messages.
+  //
+  // Returns the number of distinct keys, which is the number of messages the
+  // filter is evaluated on.
+  int MatchBatch(absl::Span<const google::protobuf::Message* const> messages,
+                 std::vector<bool>* matches) const;
+
+  // Returns the number of keys in the LRU cache of IsMatch.
+  int cache_size() const;
+
+ private:
+  struct CacheEntry {
+    std::string key;
+    bool result;
+  };
+
+  // A part of the LRU cache, holding the keys with the same hash modulo the
+  // number of shards.
+  struct CacheShard {
+    absl::Mutex mutex;
+    // The cached keys, from the most recently used to the least recently used.
+    std::list<CacheEntry> entries ABSL_GUARDED_BY(mutex);
+    // Maps the keys in @entries, which own the memory, to their entries.
+    absl::flat_hash_map<absl::string_view, std::list<CacheEntry>::iterator>
+        index ABSL_GUARDED_BY(mutex);
+  };
+
+  EquivalenceClassMatcher(std::shared_ptr<const FieldFilter> filter,
+                          int cache_capacity);
+
+  // Writes the key of @message to @key. Two messages have the same key only
+  // if all the fields read by the filter are the same.
+  void GetKey(const google::protobuf::Message& message,
+              std::string& key) const;
+
+  std::shared_ptr<const FieldFilter> filter_;
+  std::vector<ReferencedField> fields_;
+  int cache_capacity_;
+
+  int shard_count_;
+  // The capacity of each of the shards.
+  int shard_capacity_;
+  std::unique_ptr<CacheShard[]> shards_;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_EQUIVALENCE_CLASS_MATCHER_H_
@@ -0,0 +1,101 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/eval_context.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+// Returns true if @a is a prefix of @b, or @b is a prefix of @a. Modifying a
+// field changes the presence of the messages containing it, and the values of
+// the fields inside it.
+bool IsOverlapping(const FieldPath& a, const FieldPath& b) {
+  const size_t size = std::min(a.size(), b.size());
+  return std::equal(a.begin(), a.begin() + size, b.begin());
+}
+
+}  // namespace
+
+void EvalContext::Reset() { reset_epoch_ = ++epoch_; }
+
+bool EvalContext::IsMatch(const FieldFilter& filter,
+                          const google::protobuf::Message& message) {
+  auto [it, inserted] = filter_indexes_.try_emplace(
+      &filter, static_cast<int>(filters_.size()));
+  if (inserted) {
+    FilterEntry& entry = filters_.emplace_back();
+    for (const ReferencedField& field : filter.GetReferencedFields()) {
+      entry.fields.push_back(AddField(*field.field_path));
+    }
+  }
+  FilterEntry& entry = filters_[it->second];
+
+  bool is_valid = entry.evaluated_epoch >= reset_epoch_;
+  for (int i = 0; is_valid && i < static_cast<int>(entry.fields.size()); ++i) {
+    is_valid = modified_epochs_[entry.fields[i]] <= entry.evaluated_epoch;
+  }
+  if (!is_valid) {
+    ++evaluation_count_;
+    entry.result = filter.IsMatch(message);
+    entry.evaluated_epoch = epoch_;
+  }
+  return entry.result;
+}
+
+void EvalContext::MarkModified(
+    absl::Span<const google::protobuf::FieldDescriptor* const>
+        field_descriptors) {
+  ++epoch_;
+  for (int field :
+       GetAffectedFields(FieldPath(field_descriptors.begin(),
+                                   field_descriptors.end()))) {
+    modified_epochs_[field] = epoch_;
+  }
+}
+
+int EvalContext::AddField(const FieldPath& field_path) {
+  auto [it, inserted] = field_indexes_.try_emplace(
+      field_path, static_cast<int>(field_paths_.size()));
+  if (inserted) {
+    field_paths_.push_back(field_path);
+    modified_epochs_.push_back(0);
+    affected_fields_.clear();
+  }
+  return it->second;
+}
+
+const std::vector<int>& EvalContext::GetAffectedFields(
+    const FieldPath& field_path) {
+  auto [it, inserted] = affected_fields_.try_emplace(field_path);
+  if (inserted) {
+    for (int i = 0; i < static_cast<int>(field_paths_.size()); ++i) {
+      if (IsOverlapping(field_path, field_paths_[i])) {
+        it->second.push_back(i);
+      }
+    }
+  }
+  return it->second;
+}
+
+}  // namespace wfa_virtual_people
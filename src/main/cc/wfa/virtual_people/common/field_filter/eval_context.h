@@ -0,0 +1,138 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_EVAL_CONTEXT_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_EVAL_CONTEXT_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/types/span.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_util.h"
+#include "wfa/virtual_people/common/field_filter/utils/template_util.h"
+
+namespace wfa_virtual_people {
+
+// Memoizes the results of FieldFilters on one event, while the event is
+// traversed through a model and updated along the way.
+//
+// The same condition is often checked several times on an event which has not
+// changed in between. With a context, a filter is evaluated again only if a
+// field it reads, as returned by FieldFilter::GetReferencedFields, has been
+// modified since its last evaluation. Results are keyed by the filter object,
+// so identical conditions share their results when the filters are shared
+// through FieldFilterCache.
+//
+// Invalidation uses epoch counters, so starting a new event and marking a
+// field modified cost no more than the number of fields affected. The fields
+// read by each filter are resolved once per context, so a context should be
+// reused across events.
+//
+// Example:
+//   EvalContext context;
+//   for (LabelerEvent& event : events) {
+//     context.Reset();
+//     if (filter_1->IsMatch(event, context)) {
+//       SetValueToProto(event, field_path, value, context);
+//     }
+//     if (filter_2->IsMatch(event, context)) {
+//       ...
+//     }
+//   }
+//
+// All the filters used with a context must outlive it. This class is not
+// thread-safe.
+class EvalContext {
+ public:
+  EvalContext() = default;
+
+  EvalContext(const EvalContext&) = delete;
+  EvalContext& operator=(const EvalContext&) = delete;
+
+  // Drops all the memoized results. Must be called before evaluating filters
+  // on another event, or on the same event after it is modified without
+  // MarkModified.
+  void Reset();
+
+  // Returns @filter.IsMatch(@message), evaluating @filter only if there is no
+  // valid memoized result. @message must be the event of the context since
+  // the last Reset.
+  bool IsMatch(const FieldFilter& filter,
+               const google::protobuf::Message& message);
+
+  // Invalidates the memoized results of the filters reading the field
+  // represented by @field_descriptors, the fields inside it, or the messages
+  // containing it. Must be called each time the event is modified.
+  void MarkModified(absl::Span<const google::protobuf::FieldDescriptor* const>
+                        field_descriptors);
+
+  // Returns the number of times a filter has been evaluated, instead of the
+  // result being reused, since the context was created.
+  int64_t evaluation_count() const { return evaluation_count_; }
+
+ private:
+  struct FilterEntry {
+    // The indexes of the fields read by the filter in @field_paths_.
+    std::vector<int> fields;
+    // The epoch of the last evaluation of the filter, or 0 if never.
+    uint64_t evaluated_epoch = 0;
+    bool result = false;
+  };
+
+  // Returns the index of @field_path in @field_paths_, adding it if it is not
+  // there yet.
+  int AddField(const FieldPath& field_path);
+
+  // Returns the indexes of the fields in @field_paths_ invalidated by
+  // modifying @field_path.
+  const std::vector<int>& GetAffectedFields(const FieldPath& field_path);
+
+  // Incremented by each Reset and each MarkModified.
+  uint64_t epoch_ = 1;
+  // The epoch of the last Reset. Results evaluated before it are dropped.
+  uint64_t reset_epoch_ = 1;
+  int64_t evaluation_count_ = 0;
+
+  absl::flat_hash_map<const FieldFilter*, int> filter_indexes_;
+  std::vector<FilterEntry> filters_;
+
+  absl::flat_hash_map<FieldPath, int> field_indexes_;
+  std::vector<FieldPath> field_paths_;
+  // The epoch of the last modification of each field in @field_paths_.
+  std::vector<uint64_t> modified_epochs_;
+  // The result of GetAffectedFields for each modified path. Cleared when a
+  // field is added.
+  absl::flat_hash_map<FieldPath, std::vector<int>> affected_fields_;
+};
+
+// Same as SetValueToProto without @context, and then marks the field modified
+// in @context.
+template <typename ValueType, EnableIfProtoValueType<ValueType> = true>
+void SetValueToProto(
+    google::protobuf::Message& message,
+    absl::Span<const google::protobuf::FieldDescriptor* const>
+        field_descriptors,
+    ValueType value, EvalContext& context) {
+  SetValueToProto<ValueType>(message, field_descriptors, value);
+  context.MarkModified(field_descriptors);
+}
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_EVAL_CONTEXT_H_
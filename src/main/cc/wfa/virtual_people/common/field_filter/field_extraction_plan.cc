@@ -0,0 +1,883 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/field_extraction_plan.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "common_cpp/macros/macros.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/message.h"
+#include "google/protobuf/wire_format_lite.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/compiled_field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_accessor.h"
+#include "wfa/virtual_people/common/field_filter/utils/regexp_matcher.h"
+#include "wfa/virtual_people/common/field_filter/utils/value_set.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+using CppType = google::protobuf::FieldDescriptor::CppType;
+using ::google::protobuf::internal::WireFormatLite;
+
+// Returns @reference as a string_view. If @reference is @scratch, which
+// happens when the string is not stored as std::string in the message, it is
+// moved to @storage first, so that the returned view outlives @scratch.
+absl::string_view KeepString(const std::string& reference,
+                             std::string& scratch,
+                             std::deque<std::string>& storage) {
+  if (&reference != &scratch) {
+    return reference;
+  }
+  storage.push_back(std::move(scratch));
+  return storage.back();
+}
+
+// Reads a length delimited value from @input, whose buffer starts at @data,
+// into @value. @value points into @data.
+bool ReadLengthDelimited(const char* data,
+                         google::protobuf::io::CodedInputStream& input,
+                         absl::string_view& value) {
+  uint32_t length;
+  if (!input.ReadVarint32(&length) ||
+      length > static_cast<uint32_t>(std::numeric_limits<int>::max())) {
+    return false;
+  }
+  const int begin = input.CurrentPosition();
+  if (!input.Skip(static_cast<int>(length))) {
+    return false;
+  }
+  value = absl::string_view(data + begin, length);
+  return true;
+}
+
+// A scalar value read from the wire. Integers, bools and enums are widened to
+// 64 bits, the same as ExtractedFields. Floating point values are kept as
+// their bits in @unsigned_value, which is only used to check the default.
+struct WireScalar {
+  int64_t signed_value = 0;
+  uint64_t unsigned_value = 0;
+  absl::string_view string_value;
+
+  bool IsDefault() const {
+    return signed_value == 0 && unsigned_value == 0 && string_value.empty();
+  }
+};
+
+template <typename CType, WireFormatLite::FieldType kType, typename ValueType>
+bool ReadPrimitive(google::protobuf::io::CodedInputStream& input,
+                   ValueType& value) {
+  CType primitive;
+  if (!WireFormatLite::ReadPrimitive<CType, kType>(&input, &primitive)) {
+    return false;
+  }
+  value = static_cast<ValueType>(primitive);
+  return true;
+}
+
+// Reads a value of @field_descriptor from @input, whose buffer starts at
+// @data, into @value.
+bool ReadWireScalar(const char* data,
+                    google::protobuf::io::CodedInputStream& input,
+                    const google::protobuf::FieldDescriptor* field_descriptor,
+                    WireScalar& value) {
+  using FieldDescriptor = google::protobuf::FieldDescriptor;
+  switch (field_descriptor->type()) {
+    case FieldDescriptor::TYPE_INT32:
+      return ReadPrimitive<int32_t, WireFormatLite::TYPE_INT32>(
+          input, value.signed_value);
+    case FieldDescriptor::TYPE_SINT32:
+      return ReadPrimitive<int32_t, WireFormatLite::TYPE_SINT32>(
+          input, value.signed_value);
+    case FieldDescriptor::TYPE_SFIXED32:
+      return ReadPrimitive<int32_t, WireFormatLite::TYPE_SFIXED32>(
+          input, value.signed_value);
+    case FieldDescriptor::TYPE_INT64:
+      return ReadPrimitive<int64_t, WireFormatLite::TYPE_INT64>(
+          input, value.signed_value);
+    case FieldDescriptor::TYPE_SINT64:
+      return ReadPrimitive<int64_t, WireFormatLite::TYPE_SINT64>(
+          input, value.signed_value);
+    case FieldDescriptor::TYPE_SFIXED64:
+      return ReadPrimitive<int64_t, WireFormatLite::TYPE_SFIXED64>(
+          input, value.signed_value);
+    case FieldDescriptor::TYPE_BOOL:
+      return ReadPrimitive<bool, WireFormatLite::TYPE_BOOL>(
+          input, value.signed_value);
+    case FieldDescriptor::TYPE_ENUM:
+      // Unknown numbers of closed enums are not set in the parsed message, so
+      // they are left to the parser.
+      return ReadPrimitive<int, WireFormatLite::TYPE_ENUM>(
+                 input, value.signed_value) &&
+             field_descriptor->enum_type()->FindValueByNumber(
+                 static_cast<int>(value.signed_value)) != nullptr;
+    case FieldDescriptor::TYPE_UINT32:
+      return ReadPrimitive<uint32_t, WireFormatLite::TYPE_UINT32>(
+          input, value.unsigned_value);
+    case FieldDescriptor::TYPE_FIXED32:
+    case FieldDescriptor::TYPE_FLOAT:
+      return ReadPrimitive<uint32_t, WireFormatLite::TYPE_FIXED32>(
+          input, value.unsigned_value);
+    case FieldDescriptor::TYPE_UINT64:
+      return ReadPrimitive<uint64_t, WireFormatLite::TYPE_UINT64>(
+          input, value.unsigned_value);
+    case FieldDescriptor::TYPE_FIXED64:
+    case FieldDescriptor::TYPE_DOUBLE:
+      return ReadPrimitive<uint64_t, WireFormatLite::TYPE_FIXED64>(
+          input, value.unsigned_value);
+    case FieldDescriptor::TYPE_STRING:
+    case FieldDescriptor::TYPE_BYTES:
+      return ReadLengthDelimited(data, input, value.string_value);
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+// Collects the fields read by the lowered filters into a FieldExtractionPlan.
+class FieldExtractionPlanBuilder {
+ public:
+  explicit FieldExtractionPlanBuilder(FieldExtractionPlan& plan)
+      : plan_(plan) {}
+
+  // Adds @filter to the plan, and assigns the fields read by its
+  // instructions.
+  void AddProgram(std::unique_ptr<CompiledFieldFilter> filter);
+
+  // Maps the paths of all the fields of the plan to the message types of the
+  // serialized bytes. Called after all the programs are added.
+  void AddWireFields();
+
+ private:
+  using Field = FieldExtractionPlan::Field;
+  using Opcode = CompiledFieldFilter::Opcode;
+  using ValueKind = CompiledFieldFilter::ValueKind;
+  using WireField = FieldExtractionPlan::WireField;
+
+  // Returns the entry of @field_descriptor in
+  // plan_.wire_messages_[@wire_message], adding it when it is not there yet.
+  // When @field_descriptor is in a oneof, all the members of the oneof are
+  // added, so that reading any of them is tracked.
+  WireField& AddWireField(
+      int wire_message,
+      const google::protobuf::FieldDescriptor* field_descriptor);
+
+  // Returns the index of the field represented by @path, adding it when it is
+  // not in the plan yet.
+  int AddField(const std::vector<const google::protobuf::FieldDescriptor*>&
+                   path);
+
+  FieldExtractionPlan& plan_;
+  absl::flat_hash_map<std::vector<const google::protobuf::FieldDescriptor*>,
+                      int>
+      field_indexes_;
+};
+
+int FieldExtractionPlanBuilder::AddField(
+    const std::vector<const google::protobuf::FieldDescriptor*>& path) {
+  auto [it, inserted] = field_indexes_.try_emplace(
+      path, static_cast<int>(plan_.fields_.size()));
+  if (!inserted) {
+    return it->second;
+  }
+  const google::protobuf::FieldDescriptor* field_descriptor = path.back();
+  Field field;
+  field.path_begin = static_cast<int32_t>(plan_.field_descriptors_.size());
+  field.path_size = static_cast<int32_t>(path.size());
+  field.cpp_type = field_descriptor->cpp_type();
+  field.is_repeated = field_descriptor->is_repeated();
+  field.accessor = field.is_repeated ? nullptr : FindFieldAccessor(path);
+  int32_t* count = nullptr;
+  switch (field.cpp_type) {
+    case CppType::CPPTYPE_INT32:
+    case CppType::CPPTYPE_INT64:
+    case CppType::CPPTYPE_BOOL:
+    case CppType::CPPTYPE_ENUM:
+      field.value_kind = ValueKind::SIGNED;
+      count = &plan_.signed_count_;
+      break;
+    case CppType::CPPTYPE_UINT32:
+    case CppType::CPPTYPE_UINT64:
+      field.value_kind = ValueKind::UNSIGNED;
+      count = &plan_.unsigned_count_;
+      break;
+    case CppType::CPPTYPE_STRING:
+      field.value_kind = ValueKind::STRING;
+      count = &plan_.string_count_;
+      break;
+    default:
+      field.value_kind = ValueKind::NONE;
+      break;
+  }
+  if (field.is_repeated) {
+    field.value_index = plan_.repeated_count_++;
+  } else if (count != nullptr) {
+    field.value_index = (*count)++;
+  } else {
+    field.value_index = -1;
+  }
+  plan_.field_descriptors_.insert(plan_.field_descriptors_.end(),
+                                  path.begin(), path.end());
+  plan_.fields_.push_back(field);
+  return it->second;
+}
+
+void FieldExtractionPlanBuilder::AddProgram(
+    std::unique_ptr<CompiledFieldFilter> filter) {
+  FieldExtractionPlan::Program program;
+  program.instruction_fields.reserve(filter->instructions_.size());
+  // The path from the root message to the message entered by each enclosing
+  // PARTIAL. ENTER and LEAVE are emitted in nesting order, so the instructions
+  // can be scanned linearly.
+  std::vector<std::vector<const google::protobuf::FieldDescriptor*>> scopes(
+      1);
+  for (const CompiledFieldFilter::Instruction& instruction :
+       filter->instructions_) {
+    switch (instruction.opcode) {
+      case Opcode::HAS:
+      case Opcode::EQUAL:
+      case Opcode::GT:
+      case Opcode::LT:
+      case Opcode::IN:
+      case Opcode::ANY_IN:
+      case Opcode::REGEXP:
+      case Opcode::ENTER: {
+        std::vector<const google::protobuf::FieldDescriptor*> path =
+            scopes.back();
+        auto begin =
+            filter->field_descriptors_.begin() + instruction.path_begin;
+        path.insert(path.end(), begin, begin + instruction.path_size);
+        program.instruction_fields.push_back(AddField(path));
+        if (instruction.opcode == Opcode::ENTER) {
+          scopes.push_back(std::move(path));
+        }
+        break;
+      }
+      case Opcode::LEAVE:
+        scopes.pop_back();
+        program.instruction_fields.push_back(-1);
+        break;
+      default:
+        program.instruction_fields.push_back(-1);
+        break;
+    }
+  }
+  program.filter = std::move(filter);
+  plan_.programs_.push_back(std::move(program));
+}
+
+FieldExtractionPlan::WireField& FieldExtractionPlanBuilder::AddWireField(
+    int wire_message,
+    const google::protobuf::FieldDescriptor* field_descriptor) {
+  FieldExtractionPlan::WireMessage& fields =
+      plan_.wire_messages_[wire_message];
+  const google::protobuf::OneofDescriptor* oneof =
+      field_descriptor->real_containing_oneof();
+  if (oneof != nullptr && !fields.contains(field_descriptor->number())) {
+    int32_t oneof_index = plan_.wire_oneof_count_++;
+    for (int i = 0; i < oneof->field_count(); ++i) {
+      WireField member;
+      member.descriptor = oneof->field(i);
+      member.oneof = oneof_index;
+      fields.try_emplace(member.descriptor->number(), member);
+    }
+  }
+  WireField wire_field;
+  wire_field.descriptor = field_descriptor;
+  return fields.try_emplace(field_descriptor->number(), wire_field)
+      .first->second;
+}
+
+void FieldExtractionPlanBuilder::AddWireFields() {
+  plan_.wire_messages_.resize(1);
+  for (int i = 0; i < static_cast<int>(plan_.fields_.size()); ++i) {
+    const Field& field = plan_.fields_[i];
+    int wire_message = 0;
+    for (int j = 0; j < field.path_size; ++j) {
+      const google::protobuf::FieldDescriptor* field_descriptor =
+          plan_.field_descriptors_[field.path_begin + j];
+      if (j == field.path_size - 1) {
+        AddWireField(wire_message, field_descriptor).field = i;
+        break;
+      }
+      int32_t message = AddWireField(wire_message, field_descriptor).message;
+      if (message < 0) {
+        // Adding a message type can move the entries of the existing ones.
+        message = static_cast<int32_t>(plan_.wire_messages_.size());
+        plan_.wire_messages_.emplace_back();
+        AddWireField(wire_message, field_descriptor).message = message;
+      }
+      wire_message = message;
+    }
+  }
+}
+
+absl::StatusOr<std::unique_ptr<FieldExtractionPlan>> FieldExtractionPlan::New(
+    const google::protobuf::Descriptor* descriptor,
+    absl::Span<const FieldFilterProto> configs) {
+  auto plan = absl::WrapUnique(new FieldExtractionPlan());
+  plan->programs_.reserve(configs.size());
+  FieldExtractionPlanBuilder builder(*plan);
+  for (const FieldFilterProto& config : configs) {
+    ASSIGN_OR_RETURN(std::unique_ptr<CompiledFieldFilter> filter,
+                     CompiledFieldFilter::New(descriptor, config));
+    builder.AddProgram(std::move(filter));
+  }
+  builder.AddWireFields();
+  plan->fields_.shrink_to_fit();
+  plan->field_descriptors_.shrink_to_fit();
+
+  if (descriptor->file()->pool() ==
+      google::protobuf::DescriptorPool::generated_pool()) {
+    plan->prototype_ =
+        google::protobuf::MessageFactory::generated_factory()->GetPrototype(
+            descriptor);
+  }
+  if (plan->prototype_ == nullptr) {
+    plan->message_factory_ =
+        std::make_unique<google::protobuf::DynamicMessageFactory>();
+    plan->prototype_ = plan->message_factory_->GetPrototype(descriptor);
+  }
+  return plan;
+}
+
+void FieldExtractionPlan::ResetFields(ExtractedFields& fields) const {
+  fields.presence_.assign((fields_.size() + 63) / 64, 0);
+  fields.signed_values_.resize(signed_count_);
+  fields.unsigned_values_.resize(unsigned_count_);
+  fields.string_values_.resize(string_count_);
+  fields.repeated_ranges_.assign(repeated_count_, {0, 0});
+  fields.string_storage_.clear();
+}
+
+void FieldExtractionPlan::Extract(const google::protobuf::Message& message,
+                                  ExtractedFields* fields) const {
+  ResetFields(*fields);
+  for (int i = 0; i < static_cast<int>(fields_.size()); ++i) {
+    ExtractField(message, i, *fields);
+  }
+}
+
+absl::Status FieldExtractionPlan::ExtractSerialized(
+    absl::string_view serialized, ExtractedFields* fields) const {
+  ResetFields(*fields);
+  fields->wire_signed_values_.clear();
+  fields->wire_unsigned_values_.clear();
+  fields->wire_string_values_.clear();
+  fields->wire_oneof_cases_.assign(wire_oneof_count_, 0);
+  if (ReadWireMessage(serialized, 0, *fields)) {
+    GroupWireRepeatedValues(*fields);
+    return absl::OkStatus();
+  }
+
+  if (fields->message_ == nullptr ||
+      fields->message_->GetDescriptor() != prototype_->GetDescriptor()) {
+    fields->message_.reset(prototype_->New());
+  }
+  if (!fields->message_->ParsePartialFromArray(
+          serialized.data(), static_cast<int>(serialized.size()))) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("The serialized bytes are not a valid ",
+                     prototype_->GetDescriptor()->full_name()));
+  }
+  Extract(*fields->message_, fields);
+  return absl::OkStatus();
+}
+
+bool FieldExtractionPlan::ReadWireMessage(absl::string_view serialized,
+                                          int wire_message,
+                                          ExtractedFields& fields) const {
+  const WireMessage& wire_fields = wire_messages_[wire_message];
+  google::protobuf::io::CodedInputStream input(
+      reinterpret_cast<const uint8_t*>(serialized.data()),
+      static_cast<int>(serialized.size()));
+  while (true) {
+    const uint32_t tag = input.ReadTag();
+    if (tag == 0) {
+      // 0 is returned at the end of the input, and for invalid tags.
+      return input.CurrentPosition() == static_cast<int>(serialized.size());
+    }
+    const int number = WireFormatLite::GetTagFieldNumber(tag);
+    auto it = wire_fields.find(number);
+    if (it == wire_fields.end()) {
+      if (!WireFormatLite::SkipField(&input, tag)) {
+        return false;
+      }
+      continue;
+    }
+    const WireField& wire_field = it->second;
+    if (wire_field.oneof >= 0) {
+      // Reading another member of a oneof clears the member read before,
+      // including the fields read inside it.
+      int& oneof_case = fields.wire_oneof_cases_[wire_field.oneof];
+      if (oneof_case != 0 && oneof_case != number) {
+        return false;
+      }
+      oneof_case = number;
+    }
+    if (wire_field.field < 0 && wire_field.message < 0) {
+      if (!WireFormatLite::SkipField(&input, tag)) {
+        return false;
+      }
+      continue;
+    }
+    if (!ReadWireValue(serialized.data(), input,
+                       WireFormatLite::GetTagWireType(tag), wire_field,
+                       fields)) {
+      return false;
+    }
+  }
+}
+
+bool FieldExtractionPlan::ReadWireValue(
+    const char* data, google::protobuf::io::CodedInputStream& input,
+    int wire_type, const WireField& wire_field,
+    ExtractedFields& fields) const {
+  const google::protobuf::FieldDescriptor* field_descriptor =
+      wire_field.descriptor;
+  if (field_descriptor->cpp_type() == CppType::CPPTYPE_MESSAGE) {
+    absl::string_view value;
+    if (wire_type != WireFormatLite::WIRETYPE_LENGTH_DELIMITED ||
+        !ReadLengthDelimited(data, input, value)) {
+      return false;
+    }
+    if (wire_field.field >= 0) {
+      fields.SetPresence(wire_field.field, true);
+    }
+    return wire_field.message < 0 ||
+           ReadWireMessage(value, wire_field.message, fields);
+  }
+
+  const auto type =
+      static_cast<WireFormatLite::FieldType>(field_descriptor->type());
+  if (wire_type == WireFormatLite::WireTypeForFieldType(type)) {
+    return ReadScalar(data, input, wire_field.field, fields);
+  }
+  if (wire_type != WireFormatLite::WIRETYPE_LENGTH_DELIMITED ||
+      !field_descriptor->is_packable()) {
+    return false;
+  }
+  // Packed repeated values.
+  uint32_t length;
+  if (!input.ReadVarint32(&length)) {
+    return false;
+  }
+  google::protobuf::io::CodedInputStream::Limit limit =
+      input.PushLimit(static_cast<int>(length));
+  while (input.BytesUntilLimit() > 0) {
+    if (!ReadScalar(data, input, wire_field.field, fields)) {
+      return false;
+    }
+  }
+  input.PopLimit(limit);
+  return true;
+}
+
+bool FieldExtractionPlan::ReadScalar(
+    const char* data, google::protobuf::io::CodedInputStream& input,
+    int index, ExtractedFields& fields) const {
+  const Field& field = fields_[index];
+  const google::protobuf::FieldDescriptor* field_descriptor =
+      field_descriptors_[field.path_begin + field.path_size - 1];
+  WireScalar value;
+  if (!ReadWireScalar(data, input, field_descriptor, value)) {
+    return false;
+  }
+  if (field.is_repeated) {
+    fields.SetPresence(index, true);
+    switch (field.value_kind) {
+      case ValueKind::SIGNED:
+        fields.wire_signed_values_.emplace_back(field.value_index,
+                                                value.signed_value);
+        break;
+      case ValueKind::UNSIGNED:
+        fields.wire_unsigned_values_.emplace_back(field.value_index,
+                                                  value.unsigned_value);
+        break;
+      case ValueKind::STRING:
+        fields.wire_string_values_.emplace_back(field.value_index,
+                                                value.string_value);
+        break;
+      case ValueKind::NONE:
+        break;
+    }
+    return true;
+  }
+
+  // Without presence, a field is set if it is not the default value. The
+  // last value read wins.
+  const bool is_set = field_descriptor->has_presence() || !value.IsDefault();
+  fields.SetPresence(index, is_set);
+  if (!is_set) {
+    return true;
+  }
+  switch (field.value_kind) {
+    case ValueKind::SIGNED:
+      fields.signed_values_[field.value_index] = value.signed_value;
+      break;
+    case ValueKind::UNSIGNED:
+      fields.unsigned_values_[field.value_index] = value.unsigned_value;
+      break;
+    case ValueKind::STRING:
+      fields.string_values_[field.value_index] = value.string_value;
+      break;
+    case ValueKind::NONE:
+      break;
+  }
+  return true;
+}
+
+void FieldExtractionPlan::GroupWireRepeatedValues(
+    ExtractedFields& fields) const {
+  auto group = [&fields](auto& wire_values, auto& values) {
+    std::stable_sort(
+        wire_values.begin(), wire_values.end(),
+        [](const auto& a, const auto& b) { return a.first < b.first; });
+    for (int i = 0; i < static_cast<int>(wire_values.size()); ++i) {
+      std::pair<int32_t, int32_t>& range =
+          fields.repeated_ranges_[wire_values[i].first];
+      if (i == 0 || wire_values[i - 1].first != wire_values[i].first) {
+        range.first = static_cast<int32_t>(values.size());
+      }
+      values.push_back(wire_values[i].second);
+      range.second = static_cast<int32_t>(values.size());
+    }
+  };
+  group(fields.wire_signed_values_, fields.signed_values_);
+  group(fields.wire_unsigned_values_, fields.unsigned_values_);
+  group(fields.wire_string_values_, fields.string_values_);
+}
+
+void FieldExtractionPlan::ExtractField(const google::protobuf::Message& message,
+                                       int index,
+                                       ExtractedFields& fields) const {
+  const Field& field = fields_[index];
+  bool is_set = false;
+
+  if (field.accessor != nullptr) {
+    const FieldAccessor& accessor = *field.accessor;
+    is_set = accessor.has(message);
+    if (is_set) {
+      switch (field.cpp_type) {
+        case CppType::CPPTYPE_INT32:
+        case CppType::CPPTYPE_ENUM:
+          fields.signed_values_[field.value_index] =
+              accessor.get_int32(message).value;
+          break;
+        case CppType::CPPTYPE_INT64:
+          fields.signed_values_[field.value_index] =
+              accessor.get_int64(message).value;
+          break;
+        case CppType::CPPTYPE_BOOL:
+          fields.signed_values_[field.value_index] =
+              accessor.get_bool(message).value;
+          break;
+        case CppType::CPPTYPE_UINT32:
+          fields.unsigned_values_[field.value_index] =
+              accessor.get_uint32(message).value;
+          break;
+        case CppType::CPPTYPE_UINT64:
+          fields.unsigned_values_[field.value_index] =
+              accessor.get_uint64(message).value;
+          break;
+        case CppType::CPPTYPE_STRING:
+          fields.string_values_[field.value_index] =
+              accessor.get_string(message).value;
+          break;
+        default:
+          break;
+      }
+    }
+    fields.presence_[index / 64] |= static_cast<uint64_t>(is_set)
+                                    << (index % 64);
+    return;
+  }
+
+  const google::protobuf::FieldDescriptor* const* path =
+      field_descriptors_.data() + field.path_begin;
+  const google::protobuf::Message* parent = &message;
+  for (int i = 0; i < field.path_size - 1; ++i) {
+    parent = &parent->GetReflection()->GetMessage(*parent, path[i]);
+  }
+  const google::protobuf::FieldDescriptor* field_descriptor =
+      path[field.path_size - 1];
+  const google::protobuf::Reflection* reflection = parent->GetReflection();
+
+  if (field.is_repeated) {
+    int size = reflection->FieldSize(*parent, field_descriptor);
+    is_set = size > 0;
+    int32_t begin = 0;
+    for (int i = 0; i < size; ++i) {
+      switch (field.cpp_type) {
+        case CppType::CPPTYPE_INT32:
+          fields.signed_values_.push_back(
+              reflection->GetRepeatedInt32(*parent, field_descriptor, i));
+          break;
+        case CppType::CPPTYPE_INT64:
+          fields.signed_values_.push_back(
+              reflection->GetRepeatedInt64(*parent, field_descriptor, i));
+          break;
+        case CppType::CPPTYPE_BOOL:
+          fields.signed_values_.push_back(
+              reflection->GetRepeatedBool(*parent, field_descriptor, i));
+          break;
+        case CppType::CPPTYPE_ENUM:
+          fields.signed_values_.push_back(
+              reflection->GetRepeatedEnumValue(*parent, field_descriptor, i));
+          break;
+        case CppType::CPPTYPE_UINT32:
+          fields.unsigned_values_.push_back(
+              reflection->GetRepeatedUInt32(*parent, field_descriptor, i));
+          break;
+        case CppType::CPPTYPE_UINT64:
+          fields.unsigned_values_.push_back(
+              reflection->GetRepeatedUInt64(*parent, field_descriptor, i));
+          break;
+        case CppType::CPPTYPE_STRING: {
+          std::string scratch;
+          fields.string_values_.push_back(
+              KeepString(reflection->GetRepeatedStringReference(
+                             *parent, field_descriptor, i, &scratch),
+                         scratch, fields.string_storage_));
+          break;
+        }
+        default:
+          break;
+      }
+    }
+    switch (field.value_kind) {
+      case ValueKind::SIGNED:
+        begin = static_cast<int32_t>(fields.signed_values_.size()) - size;
+        break;
+      case ValueKind::UNSIGNED:
+        begin = static_cast<int32_t>(fields.unsigned_values_.size()) - size;
+        break;
+      case ValueKind::STRING:
+        begin = static_cast<int32_t>(fields.string_values_.size()) - size;
+        break;
+      case ValueKind::NONE:
+        // Only the size of repeated message and floating point fields is
+        // read.
+        size = 0;
+        break;
+    }
+    fields.repeated_ranges_[field.value_index] = {begin, begin + size};
+  } else {
+    is_set = reflection->HasField(*parent, field_descriptor);
+    if (is_set) {
+      switch (field.cpp_type) {
+        case CppType::CPPTYPE_INT32:
+          fields.signed_values_[field.value_index] =
+              reflection->GetInt32(*parent, field_descriptor);
+          break;
+        case CppType::CPPTYPE_INT64:
+          fields.signed_values_[field.value_index] =
+              reflection->GetInt64(*parent, field_descriptor);
+          break;
+        case CppType::CPPTYPE_BOOL:
+          fields.signed_values_[field.value_index] =
+              reflection->GetBool(*parent, field_descriptor);
+          break;
+        case CppType::CPPTYPE_ENUM:
+          fields.signed_values_[field.value_index] =
+              reflection->GetEnumValue(*parent, field_descriptor);
+          break;
+        case CppType::CPPTYPE_UINT32:
+          fields.unsigned_values_[field.value_index] =
+              reflection->GetUInt32(*parent, field_descriptor);
+          break;
+        case CppType::CPPTYPE_UINT64:
+          fields.unsigned_values_[field.value_index] =
+              reflection->GetUInt64(*parent, field_descriptor);
+          break;
+        case CppType::CPPTYPE_STRING: {
+          std::string scratch;
+          fields.string_values_[field.value_index] = KeepString(
+              reflection->GetStringReference(*parent, field_descriptor,
+                                             &scratch),
+              scratch, fields.string_storage_);
+          break;
+        }
+        default:
+          break;
+      }
+    }
+  }
+  fields.presence_[index / 64] |= static_cast<uint64_t>(is_set)
+                                  << (index % 64);
+}
+
+bool FieldExtractionPlan::IsMatch(int index,
+                                  const ExtractedFields& fields) const {
+  const Program& program = programs_[index];
+  const CompiledFieldFilter& filter = *program.filter;
+  const int size = static_cast<int>(filter.instructions_.size());
+  bool result = true;
+  int pc = 0;
+  while (pc < size) {
+    const Instruction& instruction = filter.instructions_[pc];
+    const int field_index = program.instruction_fields[pc];
+    switch (instruction.opcode) {
+      case Opcode::JUMP_IF_FALSE:
+      case Opcode::JUMP_IF_TRUE:
+        if (result == (instruction.opcode == Opcode::JUMP_IF_TRUE)) {
+          pc = instruction.jump_target;
+          continue;
+        }
+        break;
+      case Opcode::TRUE:
+        result = true;
+        break;
+      case Opcode::NOT:
+        result = !result;
+        break;
+      case Opcode::LEAVE:
+        break;
+      case Opcode::ENTER:
+        // The paths of the fields inside PARTIAL start from the root message,
+        // so entering only checks that the sub message is set.
+        if (!fields.IsSet(field_index)) {
+          result = false;
+          pc = instruction.jump_target;
+          continue;
+        }
+        break;
+      case Opcode::HAS:
+        result = fields.IsSet(field_index);
+        break;
+      case Opcode::EQUAL:
+      case Opcode::GT:
+      case Opcode::LT: {
+        if (!fields.IsSet(field_index)) {
+          result = false;
+          break;
+        }
+        const int value_index = fields_[field_index].value_index;
+        int comparison;
+        switch (instruction.value_kind) {
+          case ValueKind::SIGNED: {
+            int64_t value = fields.signed_values_[value_index];
+            int64_t operand = filter.signed_values_[instruction.operand];
+            comparison = (value > operand) - (value < operand);
+            break;
+          }
+          case ValueKind::UNSIGNED: {
+            uint64_t value = fields.unsigned_values_[value_index];
+            uint64_t operand = filter.unsigned_values_[instruction.operand];
+            comparison = (value > operand) - (value < operand);
+            break;
+          }
+          default:
+            // Strings are only compared for equality.
+            comparison =
+                MatchesStringLiteral(filter.string_values_[instruction.operand],
+                                     fields.string_values_[value_index])
+                    ? 0
+                    : 1;
+            break;
+        }
+        if (instruction.opcode == Opcode::GT) {
+          result = comparison > 0;
+        } else if (instruction.opcode == Opcode::LT) {
+          result = comparison < 0;
+        } else {
+          result = comparison == 0;
+        }
+        break;
+      }
+      case Opcode::IN: {
+        if (!fields.IsSet(field_index)) {
+          result = false;
+          break;
+        }
+        const int value_index = fields_[field_index].value_index;
+        switch (instruction.value_kind) {
+          case ValueKind::SIGNED:
+            result = filter.signed_sets_[instruction.operand].contains(
+                fields.signed_values_[value_index]);
+            break;
+          case ValueKind::UNSIGNED:
+            result = filter.unsigned_sets_[instruction.operand].contains(
+                fields.unsigned_values_[value_index]);
+            break;
+          default:
+            result = filter.string_sets_[instruction.operand].contains(
+                fields.string_values_[value_index]);
+            break;
+        }
+        break;
+      }
+      case Opcode::ANY_IN: {
+        auto [begin, end] =
+            fields.repeated_ranges_[fields_[field_index].value_index];
+        result = false;
+        for (int i = begin; i < end && !result; ++i) {
+          switch (instruction.value_kind) {
+            case ValueKind::SIGNED:
+              result = filter.signed_sets_[instruction.operand].contains(
+                  fields.signed_values_[i]);
+              break;
+            case ValueKind::UNSIGNED:
+              result = filter.unsigned_sets_[instruction.operand].contains(
+                  fields.unsigned_values_[i]);
+              break;
+            default:
+              result = filter.string_sets_[instruction.operand].contains(
+                  fields.string_values_[i]);
+              break;
+          }
+        }
+        break;
+      }
+      case Opcode::REGEXP: {
+        const RegexpMatcher& matcher = *filter.regexps_[instruction.operand];
+        const Field& field = fields_[field_index];
+        if (!field.is_repeated) {
+          result = fields.IsSet(field_index) &&
+                   matcher.Matches(fields.string_values_[field.value_index]);
+          break;
+        }
+        auto [begin, end] = fields.repeated_ranges_[field.value_index];
+        result = false;
+        for (int i = begin; i < end && !result; ++i) {
+          result = matcher.Matches(fields.string_values_[i]);
+        }
+        break;
+      }
+    }
+    ++pc;
+  }
+  return result;
+}
+
+}  // namespace wfa_virtual_people
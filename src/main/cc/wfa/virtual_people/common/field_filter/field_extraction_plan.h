@@ -0,0 +1,278 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_FIELD_EXTRACTION_PLAN_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_FIELD_EXTRACTION_PLAN_H_
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/message.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/compiled_field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_accessor.h"
+
+namespace wfa_virtual_people {
+
+// The fields of one message extracted by FieldExtractionPlan::Extract.
+//
+// String values are not copied: they point into the message or the serialized
+// bytes the fields are extracted from, which must outlive the use of this
+// object.
+//
+// Reuse the same object for all the messages, so that the storage is only
+// allocated once.
+class ExtractedFields {
+ public:
+  ExtractedFields() = default;
+
+  ExtractedFields(const ExtractedFields&) = delete;
+  ExtractedFields& operator=(const ExtractedFields&) = delete;
+
+ private:
+  friend class FieldExtractionPlan;
+
+  bool IsSet(int field) const {
+    return (presence_[field / 64] >> (field % 64)) & 1;
+  }
+
+  void SetPresence(int field, bool is_set) {
+    uint64_t bit = uint64_t{1} << (field % 64);
+    presence_[field / 64] = is_set ? presence_[field / 64] | bit
+                                   : presence_[field / 64] & ~bit;
+  }
+
+  // One bit for each field of the plan, set when the field is set, or the
+  // repeated field is not empty.
+  std::vector<uint64_t> presence_;
+  // Integers, bools and enums are widened to 64 bits. The values of singular
+  // fields come first, at the indexes assigned by the plan. The values of
+  // repeated fields are appended after them.
+  std::vector<int64_t> signed_values_;
+  std::vector<uint64_t> unsigned_values_;
+  std::vector<absl::string_view> string_values_;
+  // The [begin, end) indexes of the values of each repeated field, in the
+  // value array of its type.
+  std::vector<std::pair<int32_t, int32_t>> repeated_ranges_;
+  // The strings not stored as std::string in the message, which are copied.
+  std::deque<std::string> string_storage_;
+
+  // The values of repeated fields read from serialized bytes, with the index
+  // of the field in repeated_ranges_. They are grouped by field into the
+  // value arrays after the whole message is read.
+  std::vector<std::pair<int32_t, int64_t>> wire_signed_values_;
+  std::vector<std::pair<int32_t, uint64_t>> wire_unsigned_values_;
+  std::vector<std::pair<int32_t, absl::string_view>> wire_string_values_;
+  // The number of the oneof member last read from serialized bytes, for each
+  // oneof tracked by the plan. 0 if no member is read.
+  std::vector<int> wire_oneof_cases_;
+  // The message the serialized bytes are parsed into, when they cannot be
+  // read directly.
+  std::unique_ptr<google::protobuf::Message> message_;
+};
+
+// Evaluates a set of FieldFilterProto against the same messages, reading each
+// referenced field once per message instead of once per filter.
+//
+// The filters are lowered with CompiledFieldFilter. The plan collects the
+// union of the field paths read by all the filters, with the paths inside
+// PARTIAL resolved from the root message. Extract reads these fields into a
+// compact typed row with presence bits, and IsMatch evaluates a filter
+// against the row, without protobuf reflection.
+//
+// Example:
+//   ASSIGN_OR_RETURN(std::unique_ptr<FieldExtractionPlan> plan,
+//                    FieldExtractionPlan::New(descriptor, conditions));
+//   ExtractedFields fields;
+//   for (const LabelerEvent& event : events) {
+//     plan->Extract(event, &fields);
+//     for (int i = 0; i < plan->filter_count(); ++i) {
+//       bool matched = plan->IsMatch(i, fields);
+//       ...
+//     }
+//   }
+//
+// Serialized messages can be evaluated without parsing them, with
+// ExtractSerialized in place of Extract:
+//   for (absl::string_view serialized_event : serialized_events) {
+//     RETURN_IF_ERROR(plan->ExtractSerialized(serialized_event, &fields));
+//     bool matched = plan->IsMatch(0, fields);
+//     ...
+//   }
+//
+// Extract, ExtractSerialized and IsMatch are thread-safe, as long as each
+// thread uses its own ExtractedFields.
+class FieldExtractionPlan {
+ public:
+  // Returns error status if any of @configs is invalid to create a
+  // FieldFilter with FieldFilter::New.
+  static absl::StatusOr<std::unique_ptr<FieldExtractionPlan>> New(
+      const google::protobuf::Descriptor* descriptor,
+      absl::Span<const FieldFilterProto> configs);
+
+  FieldExtractionPlan(const FieldExtractionPlan&) = delete;
+  FieldExtractionPlan& operator=(const FieldExtractionPlan&) = delete;
+
+  // The number of filters, which is the size of the configs used to build the
+  // plan.
+  int filter_count() const { return static_cast<int>(programs_.size()); }
+
+  // The number of distinct fields read by all the filters.
+  int field_count() const { return static_cast<int>(fields_.size()); }
+
+  // Reads all the fields of the plan from @message into @fields. The type of
+  // @message must match the descriptor used to build the plan.
+  void Extract(const google::protobuf::Message& message,
+               ExtractedFields* fields) const;
+
+  // Equivalent to calling Extract on the message parsed from @serialized with
+  // ParsePartialFromString, without parsing the message.
+  //
+  // The wire format of @serialized is walked once. Only the tags of the
+  // fields of the plan, and of the messages containing them, are decoded. All
+  // the other fields, including the sub messages not containing any field of
+  // the plan, are skipped without being decoded.
+  //
+  // Wire data which does not map to a single value, like a closed enum field
+  // set to an unknown number, or two members of the same oneof, is rare. For
+  // such data, @serialized is parsed into a message, which is then extracted
+  // with Extract. UTF-8 of string fields is not validated.
+  //
+  // Returns error status if @serialized cannot be parsed as the message type
+  // of the plan.
+  absl::Status ExtractSerialized(absl::string_view serialized,
+                                 ExtractedFields* fields) const;
+
+  // Returns true if the message @fields is extracted from satisfies the
+  // filter at @index of the configs used to build the plan. The result is the
+  // same as FieldFilter::IsMatch.
+  bool IsMatch(int index, const ExtractedFields& fields) const;
+
+ private:
+  friend class FieldExtractionPlanBuilder;
+
+  using CppType = google::protobuf::FieldDescriptor::CppType;
+  using Instruction = CompiledFieldFilter::Instruction;
+  using Opcode = CompiledFieldFilter::Opcode;
+  using ValueKind = CompiledFieldFilter::ValueKind;
+
+  // A field read by the filters.
+  struct Field {
+    // The path from the root message is
+    // field_descriptors_[path_begin, path_begin + path_size).
+    int32_t path_begin;
+    int32_t path_size;
+    CppType cpp_type;
+    // The value array the field is read into. NONE when only the presence is
+    // read, which is the case for message and floating point fields.
+    ValueKind value_kind;
+    bool is_repeated;
+    // For singular fields, the index in the value array of @value_kind. For
+    // repeated fields, the index in ExtractedFields::repeated_ranges_.
+    int32_t value_index;
+    // Reads the singular field without reflection when not nullptr.
+    const FieldAccessor* accessor;
+  };
+
+  // A lowered filter, and the field read by each of its instructions. The
+  // field is -1 for the instructions not reading any field.
+  struct Program {
+    std::unique_ptr<CompiledFieldFilter> filter;
+    std::vector<int32_t> instruction_fields;
+  };
+
+  // A field of a message type in the serialized bytes, which is either read
+  // by the plan, contains fields read by the plan, or is a member of a oneof
+  // containing such a field.
+  struct WireField {
+    const google::protobuf::FieldDescriptor* descriptor;
+    // The field of the plan at this path. -1 if the path is not read.
+    int32_t field = -1;
+    // The index in wire_messages_ of the fields read inside this message
+    // field. -1 if no field is read inside it.
+    int32_t message = -1;
+    // The index in ExtractedFields::wire_oneof_cases_ of the oneof containing
+    // this field. -1 if the field is not in a oneof.
+    int32_t oneof = -1;
+  };
+
+  // The fields of a message type in the serialized bytes, by field number.
+  using WireMessage = absl::flat_hash_map<int, WireField>;
+
+  FieldExtractionPlan() = default;
+
+  // Clears @fields and sizes it for the fields of the plan.
+  void ResetFields(ExtractedFields& fields) const;
+
+  void ExtractField(const google::protobuf::Message& message, int index,
+                    ExtractedFields& fields) const;
+
+  // Reads the fields of wire_messages_[@wire_message] from @serialized into
+  // @fields. Returns false if @serialized is malformed, or cannot be read
+  // without parsing it.
+  bool ReadWireMessage(absl::string_view serialized, int wire_message,
+                       ExtractedFields& fields) const;
+
+  // Reads a value of @wire_field from @input, whose tag is already read with
+  // @wire_type. Returns false the same as ReadWireMessage.
+  bool ReadWireValue(const char* data,
+                     google::protobuf::io::CodedInputStream& input,
+                     int wire_type, const WireField& wire_field,
+                     ExtractedFields& fields) const;
+
+  // Reads a value of fields_[@index], which is a scalar field, from @input.
+  // Returns false the same as ReadWireMessage.
+  bool ReadScalar(const char* data,
+                  google::protobuf::io::CodedInputStream& input, int index,
+                  ExtractedFields& fields) const;
+
+  // Moves the repeated field values read from the wire into the value arrays
+  // of @fields, grouped by field.
+  void GroupWireRepeatedValues(ExtractedFields& fields) const;
+
+  std::vector<Program> programs_;
+  std::vector<Field> fields_;
+  // The field paths of all the fields, stored contiguously.
+  std::vector<const google::protobuf::FieldDescriptor*> field_descriptors_;
+  // The number of singular fields read into each value array.
+  int32_t signed_count_ = 0;
+  int32_t unsigned_count_ = 0;
+  int32_t string_count_ = 0;
+  int32_t repeated_count_ = 0;
+
+  // The message types of the serialized bytes, starting from the root message
+  // type, with the fields read or traversed by ExtractSerialized.
+  std::vector<WireMessage> wire_messages_;
+  int32_t wire_oneof_count_ = 0;
+  // The message type of the plan, used to parse serialized bytes which cannot
+  // be read directly.
+  const google::protobuf::Message* prototype_ = nullptr;
+  std::unique_ptr<google::protobuf::DynamicMessageFactory> message_factory_;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_FIELD_EXTRACTION_PLAN_H_
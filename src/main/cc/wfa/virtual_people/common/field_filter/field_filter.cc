@@ -14,16 +14,30 @@
 
 #include "wfa/virtual_people/common/field_filter/field_filter.h"
 
+#include <algorithm>
 #include <memory>
+#include <numeric>
+#include <utility>
+#include <vector>
 
+#include "absl/algorithm/container.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
 #include "common_cpp/macros/macros.h"
 #include "google/protobuf/descriptor.h"
+#include "google/protobuf/field_mask.pb.h"
+#include "google/protobuf/message.h"
 #include "wfa/virtual_people/common/field_filter.pb.h"
 #include "wfa/virtual_people/common/field_filter/and_filter.h"
 #include "wfa/virtual_people/common/field_filter/any_in_filter.h"
+#include "wfa/virtual_people/common/field_filter/compiled_field_filter.h"
 #include "wfa/virtual_people/common/field_filter/equal_filter.h"
+#include "wfa/virtual_people/common/field_filter/eval_context.h"
+#include "wfa/virtual_people/common/field_filter/field_filter_cache.h"
+#include "wfa/virtual_people/common/field_filter/field_filter_normalizer.h"
+#include "wfa/virtual_people/common/field_filter/field_filter_stats.h"
 #include "wfa/virtual_people/common/field_filter/gt_filter.h"
 #include "wfa/virtual_people/common/field_filter/has_filter.h"
 #include "wfa/virtual_people/common/field_filter/in_filter.h"
@@ -31,14 +45,23 @@
 #include "wfa/virtual_people/common/field_filter/not_filter.h"
 #include "wfa/virtual_people/common/field_filter/or_filter.h"
 #include "wfa/virtual_people/common/field_filter/partial_filter.h"
+#include "wfa/virtual_people/common/field_filter/range_filter.h"
+#include "wfa/virtual_people/common/field_filter/regexp_filter.h"
 #include "wfa/virtual_people/common/field_filter/true_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
 #include "wfa/virtual_people/common/field_filter/utils/message_filter_util.h"
 
 namespace wfa_virtual_people {
 
-absl::StatusOr<std::unique_ptr<FieldFilter>> FieldFilter::New(
+namespace {
+
+// Builds the node of @config, with its sub filters.
+absl::StatusOr<std::unique_ptr<FieldFilter>> NewNode(
     const google::protobuf::Descriptor* descriptor,
-    const FieldFilterProto& config) {
+    const FieldFilterProto& config, const FieldFilterOptions& options) {
+  if (options.compiled) {
+    return CompiledFieldFilter::NewWithoutNormalization(descriptor, config);
+  }
   switch (config.op()) {
     case FieldFilterProto::HAS:
       return HasFilter::New(descriptor, config);
@@ -51,16 +74,18 @@ absl::StatusOr<std::unique_ptr<FieldFilter>> FieldFilter::New(
     case FieldFilterProto::IN:
       return InFilter::New(descriptor, config);
     case FieldFilterProto::REGEXP:
-      return absl::UnimplementedError(
-          "REGEXP field filter is not implemented.");
+      return RegexpFilter::New(descriptor, config);
     case FieldFilterProto::OR:
-      return OrFilter::New(descriptor, config);
+      return OrFilter::New(descriptor, config, options);
     case FieldFilterProto::AND:
-      return AndFilter::New(descriptor, config);
+      if (RangeFilter::IsRange(config)) {
+        return RangeFilter::New(descriptor, config);
+      }
+      return AndFilter::New(descriptor, config, options);
     case FieldFilterProto::NOT:
-      return NotFilter::New(descriptor, config);
+      return NotFilter::New(descriptor, config, options);
     case FieldFilterProto::PARTIAL:
-      return PartialFilter::New(descriptor, config);
+      return PartialFilter::New(descriptor, config, options);
     case FieldFilterProto::TRUE:
       return TrueFilter::New(config);
     case FieldFilterProto::ANY_IN:
@@ -70,10 +95,119 @@ absl::StatusOr<std::unique_ptr<FieldFilter>> FieldFilter::New(
   }
 }
 
+// Returns error status if @options.cache is set, and the other options are not
+// the ones the cache builds its filters with. Otherwise the root would be
+// built with @options and the shared sub filters with the options of the
+// cache.
+absl::Status CheckCacheOptions(const FieldFilterOptions& options) {
+  if (options.cache == nullptr) {
+    return absl::OkStatus();
+  }
+  const FieldFilterOptions& cache_options = options.cache->options();
+  if (options.adaptive_order != cache_options.adaptive_order ||
+      options.compiled != cache_options.compiled ||
+      options.stats != cache_options.stats) {
+    return absl::InvalidArgumentError(
+        "The options differ from the options of the cache in fields other "
+        "than cache.");
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<FieldFilter>> FieldFilter::New(
+    const google::protobuf::Descriptor* descriptor,
+    const FieldFilterProto& config) {
+  return New(descriptor, config, FieldFilterOptions());
+}
+
+absl::StatusOr<std::unique_ptr<FieldFilter>> FieldFilter::New(
+    const google::protobuf::Descriptor* descriptor,
+    const FieldFilterProto& config, const FieldFilterOptions& options) {
+  if (IsFieldFilterProtoNormalized(config)) {
+    // Avoids copying @config, e.g. all the values of a large IN.
+    return NewWithoutNormalization(descriptor, config, options);
+  }
+  return NewWithoutNormalization(
+      descriptor, NormalizeFieldFilterProto(descriptor, config), options);
+}
+
+absl::StatusOr<std::unique_ptr<FieldFilter>>
+FieldFilter::NewWithoutNormalization(
+    const google::protobuf::Descriptor* descriptor,
+    const FieldFilterProto& config) {
+  return NewWithoutNormalization(descriptor, config, FieldFilterOptions());
+}
+
+absl::StatusOr<std::unique_ptr<FieldFilter>>
+FieldFilter::NewWithoutNormalization(
+    const google::protobuf::Descriptor* descriptor,
+    const FieldFilterProto& config, const FieldFilterOptions& options) {
+  RETURN_IF_ERROR(CheckCacheOptions(options));
+  if (options.stats != nullptr) {
+    return options.stats->Instrument(
+        config, [&]() { return NewNode(descriptor, config, options); });
+  }
+  return NewNode(descriptor, config, options);
+}
+
 absl::StatusOr<std::unique_ptr<FieldFilter>> FieldFilter::New(
     const google::protobuf::Message& message) {
   ASSIGN_OR_RETURN(FieldFilterProto config, ConvertMessageToFilter(message));
   return FieldFilter::New(message.GetDescriptor(), config);
 }
 
+void FieldFilter::MatchBatch(
+    absl::Span<const google::protobuf::Message* const> messages,
+    std::vector<bool>* matches) const {
+  matches->assign(messages.size(), false);
+  std::vector<int> selection(messages.size());
+  std::iota(selection.begin(), selection.end(), 0);
+  MatchSelected(messages, selection, matches);
+}
+
+bool FieldFilter::IsMatch(const google::protobuf::Message& message,
+                          EvalContext& context) const {
+  return context.IsMatch(*this, message);
+}
+
+std::vector<ReferencedField> FieldFilter::GetReferencedFields() const {
+  std::vector<ReferencedField> all_fields;
+  AppendReferencedFields(&all_fields);
+  // Paths are interned, so the same field has the same path object, except
+  // for message types outside the generated pool.
+  absl::flat_hash_map<FieldPath, int> indexes;
+  std::vector<ReferencedField> fields;
+  for (ReferencedField& field : all_fields) {
+    auto [it, inserted] =
+        indexes.try_emplace(*field.field_path, static_cast<int>(fields.size()));
+    if (inserted) {
+      fields.push_back(std::move(field));
+    } else {
+      fields[it->second].reads_value |= field.reads_value;
+    }
+  }
+  return fields;
+}
+
+google::protobuf::FieldMask FieldFilter::GetReferencedFieldMask() const {
+  std::vector<ReferencedField> fields = GetReferencedFields();
+  google::protobuf::FieldMask field_mask;
+  for (const ReferencedField& field : fields) {
+    const FieldPath& path = *field.field_path;
+    bool is_implied =
+        !field.reads_value &&
+        absl::c_any_of(fields, [&path](const ReferencedField& other) {
+          const FieldPath& other_path = *other.field_path;
+          return other_path.size() > path.size() &&
+                 std::equal(path.begin(), path.end(), other_path.begin());
+        });
+    if (!is_implied) {
+      field_mask.add_paths(GetFieldPathName(path));
+    }
+  }
+  return field_mask;
+}
+
 }  // namespace wfa_virtual_people
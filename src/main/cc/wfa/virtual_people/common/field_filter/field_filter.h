@@ -16,29 +16,95 @@
 #define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_FIELD_FILTER_H_
 
 #include <memory>
+#include <vector>
 
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
 #include "google/protobuf/descriptor.h"
+#include "google/protobuf/field_mask.pb.h"
 #include "google/protobuf/message.h"
 #include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
 
 namespace wfa_virtual_people {
 
+class EvalContext;
+class FieldFilterCache;
+class FieldFilterStats;
+
+// The options to build a FieldFilter.
+struct FieldFilterOptions {
+  // When true, AND and OR filters sample the pass rates and the costs of their
+  // sub filters, and periodically reorder the sub filters, so that the ones
+  // most likely to decide the result at the lowest cost are evaluated first.
+  // See AdaptiveOrder.
+  bool adaptive_order = false;
+
+  // When not nullptr, the sub filters of AND, OR, NOT and PARTIAL filters are
+  // looked up in and added to @cache, so that identical sub filters are built
+  // once and shared. See FieldFilterCache.
+  //
+  // The cached sub filters are built with the options of @cache, so all the
+  // other options must be the same as the ones @cache is constructed with.
+  // Otherwise FieldFilter::New returns error status.
+  FieldFilterCache* cache = nullptr;
+
+  // When true, the whole filter is lowered into a CompiledFieldFilter, which
+  // stores the nodes as instructions in one contiguous array and evaluates
+  // them with a switch instead of virtual calls on a tree of heap allocated
+  // nodes. The results are the same. @adaptive_order and @cache are ignored,
+  // since there are no sub filter objects to reorder or share.
+  bool compiled = false;
+
+  // When not nullptr, each node of the filter counts its evaluations, matches
+  // and short circuits in @stats. See FieldFilterStats. @cache is not used for
+  // the sub filters, so that each node has its own counters. With @compiled,
+  // only the whole filter is counted.
+  FieldFilterStats* stats = nullptr;
+};
+
+// A field read by a FieldFilter.
+struct ReferencedField {
+  // The path of the field, from the message type the filter is built for.
+  std::shared_ptr<const FieldPath> field_path;
+  // True if the value of the field is read. False if only whether the field is
+  // set is read, like by HAS, or by PARTIAL on the message field.
+  bool reads_value;
+};
+
 // This is the C++ implementation of FieldFilterProto.
 // @descriptor defines the target protobuf message type this FieldFilter checks.
 // @config defines the checks that will be performed when calling IsMatch.
 //
-// This is the interface for all FieldFilter classes. Never add any behavior
-// here.
+// This is the interface for all FieldFilter classes. The non-virtual member
+// functions, like MatchBatch and GetReferencedFields, are only built on the
+// virtual ones. Never add behavior specific to an op here.
 class FieldFilter {
  public:
   // Always use FieldFilter::New to get a FieldFilter object.
   // Users should never call the factory functions or the constructors of the
   // derived classes.
+  //
+  // The filter is built from NormalizeFieldFilterProto(@descriptor, @config).
   static absl::StatusOr<std::unique_ptr<FieldFilter>> New(
       const google::protobuf::Descriptor* descriptor,
       const FieldFilterProto& config);
 
+  // Same as above, with the non-default @options.
+  static absl::StatusOr<std::unique_ptr<FieldFilter>> New(
+      const google::protobuf::Descriptor* descriptor,
+      const FieldFilterProto& config, const FieldFilterOptions& options);
+
+  // Same as New, except that @config is built as is, without normalization.
+  // Composite filters use this to build their sub filters, which are already
+  // normalized.
+  static absl::StatusOr<std::unique_ptr<FieldFilter>> NewWithoutNormalization(
+      const google::protobuf::Descriptor* descriptor,
+      const FieldFilterProto& config);
+  static absl::StatusOr<std::unique_ptr<FieldFilter>> NewWithoutNormalization(
+      const google::protobuf::Descriptor* descriptor,
+      const FieldFilterProto& config, const FieldFilterOptions& options);
+
   // Creates a FieldFilter, which checks the equality of all the fields set in
   // the input @message, including nested fields.
   //
@@ -57,6 +123,48 @@ class FieldFilter {
   // @descriptor.
   virtual bool IsMatch(const google::protobuf::Message& message) const = 0;
 
+  // Same as IsMatch, except that the result is memoized in @context, and
+  // reused until a field read by the filter is marked modified in @context.
+  // See EvalContext.
+  bool IsMatch(const google::protobuf::Message& message,
+               EvalContext& context) const;
+
+  // Evaluates the filter against all the @messages in one call.
+  // @matches is resized to the size of @messages, and (*matches)[i] is set to
+  // the result of IsMatch(*messages[i]).
+  void MatchBatch(absl::Span<const google::protobuf::Message* const> messages,
+                  std::vector<bool>* matches) const;
+
+  // Evaluates the filter against the @messages whose indexes are listed in
+  // @selection. For each i in @selection, (*matches)[i] is set to the result of
+  // IsMatch(*messages[i]). Other entries in @matches are left untouched.
+  //
+  // The size of @matches must be at least the size of @messages.
+  // Composite filters use this to only evaluate the rows which are not decided
+  // yet. Users should call MatchBatch.
+  virtual void MatchSelected(
+      absl::Span<const google::protobuf::Message* const> messages,
+      absl::Span<const int> selection, std::vector<bool>* matches) const = 0;
+
+  // Returns the fields read by the filter, in the order they are first read in
+  // the filter tree. Each field is listed once, and @reads_value is true if
+  // any node reads the value of the field.
+  //
+  // A message which differs from another one only in fields not listed here
+  // gets the same result from IsMatch.
+  std::vector<ReferencedField> GetReferencedFields() const;
+
+  // Returns the paths of GetReferencedFields as a FieldMask. Since the paths
+  // of a FieldMask imply their parent messages, a message field which is only
+  // checked to be set is omitted when a field inside it is also read.
+  google::protobuf::FieldMask GetReferencedFieldMask() const;
+
+  // Appends the fields read by the filter to @fields, with duplicates.
+  // Composite filters use this to collect the fields of their sub filters.
+  // Users should call GetReferencedFields.
+  virtual void AppendReferencedFields(
+      std::vector<ReferencedField>* fields) const = 0;
+
  protected:
   FieldFilter() = default;
 };
@@ -0,0 +1,103 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/field_filter_cache.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "common_cpp/macros/macros.h"
+#include "google/protobuf/descriptor.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/field_filter_normalizer.h"
+
+namespace wfa_virtual_people {
+
+FieldFilterCache::FieldFilterCache(const FieldFilterOptions& options)
+    : options_(options) {
+  options_.cache = this;
+}
+
+absl::StatusOr<std::shared_ptr<const FieldFilter>>
+FieldFilterCache::GetOrCreate(const google::protobuf::Descriptor* descriptor,
+                              const FieldFilterProto& config) {
+  // FieldFilterProto has no map fields, so the serialization is deterministic.
+  Key key(descriptor, config.SerializeAsString());
+  {
+    absl::MutexLock lock(&mutex_);
+    auto it = filters_by_config_.find(key);
+    if (it != filters_by_config_.end()) {
+      return it->second;
+    }
+  }
+
+  // Only normalized on a miss. Different configs normalized to the same one
+  // still share the filter.
+  ASSIGN_OR_RETURN(
+      std::shared_ptr<const FieldFilter> filter,
+      GetOrCreateWithoutNormalization(
+          descriptor, NormalizeFieldFilterProto(descriptor, config)));
+
+  absl::MutexLock lock(&mutex_);
+  return filters_by_config_.try_emplace(std::move(key), std::move(filter))
+      .first->second;
+}
+
+absl::StatusOr<std::shared_ptr<const FieldFilter>>
+FieldFilterCache::GetOrCreateWithoutNormalization(
+    const google::protobuf::Descriptor* descriptor,
+    const FieldFilterProto& config) {
+  // FieldFilterProto has no map fields, so the serialization is deterministic.
+  Key key(descriptor, config.SerializeAsString());
+  {
+    absl::MutexLock lock(&mutex_);
+    auto it = filters_.find(key);
+    if (it != filters_.end()) {
+      return it->second;
+    }
+  }
+
+  // The lock is not held while building, as the sub filters are looked up in
+  // the cache recursively.
+  ASSIGN_OR_RETURN(
+      std::unique_ptr<FieldFilter> filter,
+      FieldFilter::NewWithoutNormalization(descriptor, config, options_));
+
+  absl::MutexLock lock(&mutex_);
+  // Another thread may have built the same filter in the meantime, in which
+  // case that one is kept.
+  return filters_.try_emplace(std::move(key), std::move(filter))
+      .first->second;
+}
+
+int FieldFilterCache::size() const {
+  absl::MutexLock lock(&mutex_);
+  return static_cast<int>(filters_.size());
+}
+
+absl::StatusOr<std::shared_ptr<const FieldFilter>> NewSubFilter(
+    const google::protobuf::Descriptor* descriptor,
+    const FieldFilterProto& config, const FieldFilterOptions& options) {
+  // Instrumented nodes are not shared, so that each has its own counters.
+  if (options.cache != nullptr && options.stats == nullptr) {
+    return options.cache->GetOrCreateWithoutNormalization(descriptor, config);
+  }
+  return FieldFilter::NewWithoutNormalization(descriptor, config, options);
+}
+
+}  // namespace wfa_virtual_people
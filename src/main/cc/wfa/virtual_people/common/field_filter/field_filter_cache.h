@@ -0,0 +1,109 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_FIELD_FILTER_CACHE_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_FIELD_FILTER_CACHE_H_
+
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "google/protobuf/descriptor.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+
+namespace wfa_virtual_people {
+
+// Shares FieldFilter objects between identical FieldFilterProto, so that the
+// memory and the time to build the filters of a model scale with the number of
+// distinct conditions, instead of the number of times they are used.
+//
+// A filter is keyed by the message type and the serialized normalized
+// FieldFilterProto. The sub filters of AND, OR, NOT and PARTIAL filters are
+// also built through the cache, so identical sub trees are shared across
+// different filters. GetOrCreate also keys the filters by the serialized
+// FieldFilterProto as passed in, so that a repeated config is found without
+// being normalized again.
+//
+// FieldFilter objects are immutable once built, and safe to be shared. The
+// filters returned keep their sub filters alive after the cache is destroyed.
+//
+// Example:
+//   FieldFilterCache cache;
+//   for (const Branch& branch : branches) {
+//     ASSIGN_OR_RETURN(std::shared_ptr<const FieldFilter> filter,
+//                      cache.GetOrCreate(descriptor, branch.condition()));
+//     ...
+//   }
+//
+// This class is thread-safe.
+class FieldFilterCache {
+ public:
+  // The filters are built with @options. @options.cache is ignored.
+  explicit FieldFilterCache(
+      const FieldFilterOptions& options = FieldFilterOptions());
+
+  FieldFilterCache(const FieldFilterCache&) = delete;
+  FieldFilterCache& operator=(const FieldFilterCache&) = delete;
+
+  // Returns the filter built by FieldFilter::New(@descriptor, @config), which
+  // is shared by all the calls with the same @descriptor and the same
+  // normalized @config.
+  //
+  // Returns error status if @config is invalid to create a FieldFilter. Errors
+  // are not cached.
+  absl::StatusOr<std::shared_ptr<const FieldFilter>> GetOrCreate(
+      const google::protobuf::Descriptor* descriptor,
+      const FieldFilterProto& config);
+
+  // Same as GetOrCreate, except that @config is already normalized.
+  absl::StatusOr<std::shared_ptr<const FieldFilter>>
+  GetOrCreateWithoutNormalization(
+      const google::protobuf::Descriptor* descriptor,
+      const FieldFilterProto& config);
+
+  // Returns the number of distinct filters built, including the sub filters.
+  int size() const;
+
+  // Returns the options the filters are built with. Their cache is this
+  // object.
+  const FieldFilterOptions& options() const { return options_; }
+
+ private:
+  using Key = std::pair<const google::protobuf::Descriptor*, std::string>;
+
+  FieldFilterOptions options_;
+  mutable absl::Mutex mutex_;
+  // Keyed by the normalized configs.
+  absl::flat_hash_map<Key, std::shared_ptr<const FieldFilter>> filters_
+      ABSL_GUARDED_BY(mutex_);
+  // Keyed by the configs passed to GetOrCreate, before normalization.
+  absl::flat_hash_map<Key, std::shared_ptr<const FieldFilter>>
+      filters_by_config_ ABSL_GUARDED_BY(mutex_);
+};
+
+// Builds the sub filter of a composite filter from @config, which is already
+// normalized. The sub filter is shared through @options.cache when it is not
+// nullptr.
+absl::StatusOr<std::shared_ptr<const FieldFilter>> NewSubFilter(
+    const google::protobuf::Descriptor* descriptor,
+    const FieldFilterProto& config, const FieldFilterOptions& options);
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_FIELD_FILTER_CACHE_H_
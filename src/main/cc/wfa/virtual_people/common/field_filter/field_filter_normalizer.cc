@@ -0,0 +1,802 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/field_filter_normalizer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/repeated_field.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/range_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_util.h"
+#include "wfa/virtual_people/common/field_filter/utils/regexp_matcher.h"
+#include "wfa/virtual_people/common/field_filter/utils/type_convert_util.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+using CppType = google::protobuf::FieldDescriptor::CppType;
+using SubFilters = google::protobuf::RepeatedPtrField<FieldFilterProto>;
+
+bool IsValid(const google::protobuf::Descriptor* descriptor,
+             const FieldFilterProto& config);
+
+// Returns the field @name refers to in @descriptor, or nullptr if @name is not
+// a valid field path.
+const google::protobuf::FieldDescriptor* FindField(
+    const google::protobuf::Descriptor* descriptor, absl::string_view name,
+    bool allow_repeated = false) {
+  absl::StatusOr<std::shared_ptr<const FieldPath>> field_path =
+      GetFieldPathFromProto(descriptor, name, allow_repeated);
+  return field_path.ok() ? (*field_path)->back() : nullptr;
+}
+
+bool IsInteger(const google::protobuf::FieldDescriptor* field) {
+  switch (field->cpp_type()) {
+    case CppType::CPPTYPE_INT32:
+    case CppType::CPPTYPE_INT64:
+    case CppType::CPPTYPE_UINT32:
+    case CppType::CPPTYPE_UINT64:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Returns true if @value can be compared with @field by EQUAL, or be an entry
+// of IN and ANY_IN.
+bool IsValidValue(const google::protobuf::FieldDescriptor* field,
+                  absl::string_view value) {
+  switch (field->cpp_type()) {
+    case CppType::CPPTYPE_INT32:
+      return ConvertToNumeric<int32_t>(value).ok();
+    case CppType::CPPTYPE_INT64:
+      return ConvertToNumeric<int64_t>(value).ok();
+    case CppType::CPPTYPE_UINT32:
+      return ConvertToNumeric<uint32_t>(value).ok();
+    case CppType::CPPTYPE_UINT64:
+      return ConvertToNumeric<uint64_t>(value).ok();
+    case CppType::CPPTYPE_BOOL:
+      return ConvertToNumeric<bool>(value).ok();
+    case CppType::CPPTYPE_ENUM:
+      return ConvertToEnum(field->enum_type(), value).ok();
+    case CppType::CPPTYPE_STRING:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Same as IsValidValue, for each of the comma separated @values.
+bool AreValidValues(const google::protobuf::FieldDescriptor* field,
+                    absl::string_view values) {
+  return absl::c_all_of(absl::StrSplit(values, ','),
+                        [field](absl::string_view value) {
+                          return IsValidValue(field, value);
+                        });
+}
+
+// Returns true if an ExternalValueSet file can hold the values of @field. The
+// file is not opened: a file that cannot be opened is reported when building
+// the filter, and the normalized config keeps every value_file, see FinishOr.
+bool IsValidValueFileField(const google::protobuf::FieldDescriptor* field) {
+  switch (field->cpp_type()) {
+    case CppType::CPPTYPE_INT32:
+    case CppType::CPPTYPE_INT64:
+    case CppType::CPPTYPE_BOOL:
+    case CppType::CPPTYPE_ENUM:
+    case CppType::CPPTYPE_UINT32:
+    case CppType::CPPTYPE_UINT64:
+    case CppType::CPPTYPE_STRING:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Returns true if @config has sub filters, and all of them are valid.
+bool AreValidSubFilters(const google::protobuf::Descriptor* descriptor,
+                        const FieldFilterProto& config) {
+  return config.sub_filters_size() > 0 &&
+         absl::c_all_of(config.sub_filters(),
+                        [descriptor](const FieldFilterProto& sub_filter) {
+                          return IsValid(descriptor, sub_filter);
+                        });
+}
+
+// Returns true if building @config on @descriptor succeeds. The field paths
+// are resolved and the values are parsed, but no filter is built.
+bool IsValid(const google::protobuf::Descriptor* descriptor,
+             const FieldFilterProto& config) {
+  switch (config.op()) {
+    case FieldFilterProto::HAS:
+      return config.has_name() &&
+             FindField(descriptor, config.name(),
+                       /* allow_repeated = */ true) != nullptr;
+    case FieldFilterProto::EQUAL: {
+      if (!config.has_name() || !config.has_value()) {
+        return false;
+      }
+      const google::protobuf::FieldDescriptor* field =
+          FindField(descriptor, config.name());
+      return field != nullptr && IsValidValue(field, config.value());
+    }
+    case FieldFilterProto::GT:
+    case FieldFilterProto::LT: {
+      if (!config.has_name() || !config.has_value()) {
+        return false;
+      }
+      const google::protobuf::FieldDescriptor* field =
+          FindField(descriptor, config.name());
+      return field != nullptr && IsInteger(field) &&
+             IsValidValue(field, config.value());
+    }
+    case FieldFilterProto::IN:
+    case FieldFilterProto::ANY_IN: {
+      if (!config.has_name() || config.has_value() == config.has_value_file()) {
+        return false;
+      }
+      // Only ANY_IN is on a repeated field.
+      const bool any_in = config.op() == FieldFilterProto::ANY_IN;
+      const google::protobuf::FieldDescriptor* field =
+          FindField(descriptor, config.name(), any_in);
+      if (field == nullptr || field->is_repeated() != any_in) {
+        return false;
+      }
+      return config.has_value_file()
+                 ? IsValidValueFileField(field)
+                 : AreValidValues(field, config.value());
+    }
+    case FieldFilterProto::REGEXP: {
+      if (!config.has_name() || !config.has_value()) {
+        return false;
+      }
+      const google::protobuf::FieldDescriptor* field = FindField(
+          descriptor, config.name(), /* allow_repeated = */ true);
+      return field != nullptr &&
+             field->cpp_type() == CppType::CPPTYPE_STRING &&
+             RegexpMatcher::New(config.value()).ok();
+    }
+    case FieldFilterProto::TRUE:
+      return !config.has_name() && !config.has_value() &&
+             !config.has_value_file() && config.sub_filters_size() == 0;
+    case FieldFilterProto::AND:
+      if (RangeFilter::IsRange(config)) {
+        return IsValid(descriptor, config.sub_filters(0)) &&
+               IsValid(descriptor, config.sub_filters(1));
+      }
+      return AreValidSubFilters(descriptor, config);
+    case FieldFilterProto::OR:
+    case FieldFilterProto::NOT:
+      return AreValidSubFilters(descriptor, config);
+    case FieldFilterProto::PARTIAL: {
+      if (!config.has_name()) {
+        return false;
+      }
+      const google::protobuf::FieldDescriptor* field =
+          FindField(descriptor, config.name());
+      return field != nullptr &&
+             field->cpp_type() == CppType::CPPTYPE_MESSAGE &&
+             AreValidSubFilters(field->message_type(), config);
+    }
+    default:
+      return false;
+  }
+}
+
+bool IsTrue(const FieldFilterProto& config) {
+  return config.op() == FieldFilterProto::TRUE;
+}
+
+bool HasValueFile(const FieldFilterProto& config) {
+  return config.has_value_file() ||
+         absl::c_any_of(config.sub_filters(), HasValueFile);
+}
+
+int CountNodes(const FieldFilterProto& config) {
+  int count = 1;
+  for (const FieldFilterProto& sub_filter : config.sub_filters()) {
+    count += CountNodes(sub_filter);
+  }
+  return count;
+}
+
+// Returns CountNodes of the negation of @config, see NegateNormalized.
+int CountNegatedNodes(const FieldFilterProto& config) {
+  if (config.op() != FieldFilterProto::NOT) {
+    return CountNodes(config) + 1;
+  }
+  // NOT of a single sub filter is replaced by the sub filter, and NOT of
+  // several sub filters by AND of them.
+  return config.sub_filters_size() == 1 ? CountNodes(config) - 1
+                                        : CountNodes(config);
+}
+
+FieldFilterProto NewTrue() {
+  FieldFilterProto config;
+  config.set_op(FieldFilterProto::TRUE);
+  return config;
+}
+
+FieldFilterProto NewComposite(FieldFilterProto::Op op,
+                              std::vector<FieldFilterProto>&& sub_filters) {
+  FieldFilterProto config;
+  config.set_op(op);
+  for (FieldFilterProto& sub_filter : sub_filters) {
+    *config.add_sub_filters() = std::move(sub_filter);
+  }
+  return config;
+}
+
+std::vector<FieldFilterProto> TakeSubFilters(FieldFilterProto& config) {
+  std::vector<FieldFilterProto> sub_filters;
+  sub_filters.reserve(config.sub_filters_size());
+  for (FieldFilterProto& sub_filter : *config.mutable_sub_filters()) {
+    sub_filters.push_back(std::move(sub_filter));
+  }
+  config.clear_sub_filters();
+  return sub_filters;
+}
+
+// The following functions take sub filters which are already normalized, and
+// combine them without normalizing them again, so that each node of the input
+// is normalized once.
+
+std::vector<FieldFilterProto> CombineConjunction(
+    const google::protobuf::Descriptor* descriptor,
+    std::vector<FieldFilterProto>&& sub_filters);
+
+FieldFilterProto FinishAnd(std::vector<FieldFilterProto>&& sub_filters) {
+  if (sub_filters.empty()) {
+    return NewTrue();
+  }
+  if (sub_filters.size() == 1) {
+    return std::move(sub_filters.front());
+  }
+  return NewComposite(FieldFilterProto::AND, std::move(sub_filters));
+}
+
+FieldFilterProto FinishOr(std::vector<FieldFilterProto>&& sub_filters) {
+  if (absl::c_any_of(sub_filters, IsTrue)) {
+    // The sub filters with value files are kept, since the files are not
+    // checked before building, and building must fail when one cannot be
+    // opened.
+    std::vector<FieldFilterProto> kept = {NewTrue()};
+    for (FieldFilterProto& sub_filter : sub_filters) {
+      if (HasValueFile(sub_filter)) {
+        kept.push_back(std::move(sub_filter));
+      }
+    }
+    sub_filters = std::move(kept);
+  }
+  if (sub_filters.size() == 1) {
+    return std::move(sub_filters.front());
+  }
+  return NewComposite(FieldFilterProto::OR, std::move(sub_filters));
+}
+
+FieldFilterProto FinishPartial(const std::string& name,
+                               std::vector<FieldFilterProto>&& sub_filters) {
+  FieldFilterProto config;
+  if (sub_filters.empty()) {
+    // The sub message is set is all that is checked.
+    config.set_op(FieldFilterProto::HAS);
+  } else {
+    config = NewComposite(FieldFilterProto::PARTIAL, std::move(sub_filters));
+  }
+  config.set_name(name);
+  return config;
+}
+
+// Groups the first GT and the first LT on the same field in @sub_filters into
+// an AND of the two, at the position of the earlier one.
+void GroupRanges(std::vector<FieldFilterProto>& sub_filters) {
+  for (size_t i = 0; i < sub_filters.size(); ++i) {
+    FieldFilterProto::Op op = sub_filters[i].op();
+    if ((op != FieldFilterProto::GT && op != FieldFilterProto::LT) ||
+        !sub_filters[i].has_name()) {
+      continue;
+    }
+    FieldFilterProto::Op other_op = op == FieldFilterProto::GT
+                                         ? FieldFilterProto::LT
+                                         : FieldFilterProto::GT;
+    for (size_t j = i + 1; j < sub_filters.size(); ++j) {
+      if (sub_filters[j].op() != other_op ||
+          sub_filters[j].name() != sub_filters[i].name()) {
+        continue;
+      }
+      FieldFilterProto range;
+      range.set_op(FieldFilterProto::AND);
+      *range.add_sub_filters() =
+          std::move(sub_filters[op == FieldFilterProto::GT ? i : j]);
+      *range.add_sub_filters() =
+          std::move(sub_filters[op == FieldFilterProto::GT ? j : i]);
+      sub_filters[i] = std::move(range);
+      sub_filters.erase(sub_filters.begin() + j);
+      break;
+    }
+  }
+}
+
+// Returns the name of the deepest message @config is evaluated within, if
+// @config never matches when that message is not set. This is the parent
+// message of the field for a leaf filter or range, and the message named by a
+// PARTIAL. Otherwise, returns empty.
+std::string GetParentName(const FieldFilterProto& config) {
+  std::string name;
+  switch (config.op()) {
+    case FieldFilterProto::HAS:
+    case FieldFilterProto::EQUAL:
+    case FieldFilterProto::GT:
+    case FieldFilterProto::LT:
+    case FieldFilterProto::IN:
+    case FieldFilterProto::REGEXP:
+    case FieldFilterProto::ANY_IN:
+      name = config.name();
+      break;
+    case FieldFilterProto::AND:
+      if (!RangeFilter::IsRange(config)) {
+        return "";
+      }
+      name = config.sub_filters(0).name();
+      break;
+    case FieldFilterProto::PARTIAL:
+      // Ends with "." so that the whole name is kept below.
+      name = absl::StrCat(config.name(), ".");
+      break;
+    default:
+      return "";
+  }
+  std::string::size_type last_dot = name.rfind('.');
+  if (last_dot == std::string::npos || last_dot == 0) {
+    return "";
+  }
+  return name.substr(0, last_dot);
+}
+
+// Rewrites @config, which @parent_name is returned by GetParentName for, to be
+// evaluated within the message named by @prefix, which is @parent_name or a
+// parent message of it.
+void StripFieldPrefix(absl::string_view prefix, FieldFilterProto& config) {
+  if (config.op() == FieldFilterProto::AND) {
+    for (FieldFilterProto& sub_filter : *config.mutable_sub_filters()) {
+      StripFieldPrefix(prefix, sub_filter);
+    }
+    return;
+  }
+  if (config.op() == FieldFilterProto::PARTIAL && config.name() == prefix) {
+    // Already within the message named by @prefix.
+    config.clear_name();
+    config.set_op(FieldFilterProto::AND);
+    return;
+  }
+  config.set_name(std::string(
+      absl::StripPrefix(config.name(), absl::StrCat(prefix, "."))));
+}
+
+// Returns the longest common prefix of @names, on the boundaries of field
+// names, e.g. "a.b" for {"a.b.c", "a.b", "a.b.d.e"}.
+std::string GetCommonPrefix(const std::vector<std::string>& names) {
+  std::vector<absl::string_view> common = absl::StrSplit(names.front(), '.');
+  for (const std::string& name : names) {
+    std::vector<absl::string_view> parts = absl::StrSplit(name, '.');
+    size_t size = 0;
+    while (size < common.size() && size < parts.size() &&
+           common[size] == parts[size]) {
+      ++size;
+    }
+    common.resize(size);
+  }
+  return absl::StrJoin(common, ".");
+}
+
+std::vector<FieldFilterProto> CombineDisjunction(
+    const google::protobuf::Descriptor* descriptor,
+    std::vector<FieldFilterProto>&& sub_filters);
+
+// Groups the sub filters in @sub_filters evaluated within the same message,
+// see GetParentName, into a PARTIAL on the message, at the position of the
+// first one. The message is then resolved once, instead of once per sub
+// filter.
+// @op is how @sub_filters are combined, which is either AND or OR. The grouped
+// sub filters never match when the message is not set, so
+//   AND(p.a, p.b) = PARTIAL p (a, b)
+//   OR(p.a, p.b) = PARTIAL p (OR(a, b))
+void GroupSharedParents(const google::protobuf::Descriptor* descriptor,
+                        FieldFilterProto::Op op,
+                        std::vector<FieldFilterProto>& sub_filters) {
+  // The sub filters grouped by the first field of the parent names, in order.
+  std::vector<std::string> first_fields;
+  absl::flat_hash_map<std::string, std::vector<int>> indexes_by_first_field;
+  std::vector<std::string> parent_names(sub_filters.size());
+  for (int i = 0; i < static_cast<int>(sub_filters.size()); ++i) {
+    parent_names[i] = GetParentName(sub_filters[i]);
+    if (parent_names[i].empty()) {
+      continue;
+    }
+    std::string first_field =
+        parent_names[i].substr(0, parent_names[i].find('.'));
+    std::vector<int>& indexes = indexes_by_first_field[first_field];
+    if (indexes.empty()) {
+      first_fields.push_back(first_field);
+    }
+    indexes.push_back(i);
+  }
+
+  std::vector<bool> removed(sub_filters.size(), false);
+  for (const std::string& first_field : first_fields) {
+    const std::vector<int>& indexes = indexes_by_first_field[first_field];
+    if (indexes.size() < 2) {
+      continue;
+    }
+    std::vector<std::string> group_parent_names;
+    for (int i : indexes) {
+      group_parent_names.push_back(parent_names[i]);
+    }
+    std::string prefix = GetCommonPrefix(group_parent_names);
+    const google::protobuf::FieldDescriptor* field =
+        FindField(descriptor, prefix);
+    if (field == nullptr || field->cpp_type() != CppType::CPPTYPE_MESSAGE) {
+      continue;
+    }
+
+    // The grouped sub filters are normalized within @descriptor, and stay
+    // normalized within the message, except that a PARTIAL on the message
+    // becomes an AND. Only the combining is done again, which also groups the
+    // sub filters sharing deeper messages.
+    std::vector<FieldFilterProto> grouped;
+    for (int i : indexes) {
+      StripFieldPrefix(prefix, sub_filters[i]);
+      grouped.push_back(std::move(sub_filters[i]));
+      removed[i] = true;
+    }
+    const google::protobuf::Descriptor* sub_descriptor = field->message_type();
+    std::vector<FieldFilterProto> partial_sub_filters;
+    if (op == FieldFilterProto::OR) {
+      for (FieldFilterProto& sub_filter : grouped) {
+        if (sub_filter.op() == FieldFilterProto::AND &&
+            !RangeFilter::IsRange(sub_filter)) {
+          sub_filter = FinishAnd(TakeSubFilters(sub_filter));
+        }
+      }
+      partial_sub_filters.push_back(
+          FinishOr(CombineDisjunction(sub_descriptor, std::move(grouped))));
+      partial_sub_filters =
+          CombineConjunction(sub_descriptor, std::move(partial_sub_filters));
+    } else {
+      partial_sub_filters =
+          CombineConjunction(sub_descriptor, std::move(grouped));
+    }
+    sub_filters[indexes.front()] =
+        FinishPartial(prefix, std::move(partial_sub_filters));
+    removed[indexes.front()] = false;
+  }
+
+  int size = 0;
+  for (size_t i = 0; i < sub_filters.size(); ++i) {
+    if (!removed[i]) {
+      sub_filters[size++] = std::move(sub_filters[i]);
+    }
+  }
+  sub_filters.resize(size);
+}
+
+// Combines @sub_filters with AND, as in AND, NOT and PARTIAL. Nested AND is
+// flattened, and TRUE is removed.
+std::vector<FieldFilterProto> CombineConjunction(
+    const google::protobuf::Descriptor* descriptor,
+    std::vector<FieldFilterProto>&& sub_filters) {
+  std::vector<FieldFilterProto> output;
+  for (FieldFilterProto& sub_filter : sub_filters) {
+    if (sub_filter.op() == FieldFilterProto::AND &&
+        sub_filter.sub_filters_size() > 0 &&
+        !RangeFilter::IsRange(sub_filter)) {
+      for (FieldFilterProto& nested : *sub_filter.mutable_sub_filters()) {
+        output.push_back(std::move(nested));
+      }
+    } else if (!IsTrue(sub_filter)) {
+      output.push_back(std::move(sub_filter));
+    }
+  }
+  GroupRanges(output);
+  GroupSharedParents(descriptor, FieldFilterProto::AND, output);
+  return output;
+}
+
+// Returns true if @config is an EQUAL or IN on @descriptor, which can be
+// merged with the others on the same field into a single IN.
+bool IsMergeableMembershipTest(const google::protobuf::Descriptor* descriptor,
+                               const FieldFilterProto& config) {
+  // An EQUAL value with comma cannot be a single entry of IN. The values of
+  // IN in a file are not merged.
+  if (config.op() == FieldFilterProto::EQUAL) {
+    if (absl::StrContains(config.value(), ',')) {
+      return false;
+    }
+  } else if (config.op() != FieldFilterProto::IN || config.has_value_file()) {
+    return false;
+  }
+  const google::protobuf::FieldDescriptor* field =
+      FindField(descriptor, config.name());
+  if (field == nullptr) {
+    return false;
+  }
+  switch (field->cpp_type()) {
+    case CppType::CPPTYPE_INT32:
+    case CppType::CPPTYPE_INT64:
+    case CppType::CPPTYPE_UINT32:
+    case CppType::CPPTYPE_UINT64:
+    case CppType::CPPTYPE_BOOL:
+    case CppType::CPPTYPE_ENUM:
+    case CppType::CPPTYPE_STRING:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Merges the EQUAL and IN on the same field in @sub_filters, which are
+// combined with OR, into a single IN at the position of the first one.
+void MergeMembershipTests(const google::protobuf::Descriptor* descriptor,
+                          std::vector<FieldFilterProto>& sub_filters) {
+  absl::flat_hash_map<std::string, std::vector<int>> indexes_by_name;
+  for (int i = 0; i < static_cast<int>(sub_filters.size()); ++i) {
+    if (IsMergeableMembershipTest(descriptor, sub_filters[i])) {
+      indexes_by_name[sub_filters[i].name()].push_back(i);
+    }
+  }
+
+  std::vector<bool> removed(sub_filters.size(), false);
+  for (auto& [name, indexes] : indexes_by_name) {
+    if (indexes.size() < 2) {
+      continue;
+    }
+    std::vector<absl::string_view> values;
+    for (int i : indexes) {
+      values.push_back(sub_filters[i].value());
+    }
+    std::string merged_value = absl::StrJoin(values, ",");
+    FieldFilterProto& merged = sub_filters[indexes.front()];
+    merged.set_op(FieldFilterProto::IN);
+    merged.set_value(std::move(merged_value));
+    for (size_t k = 1; k < indexes.size(); ++k) {
+      removed[indexes[k]] = true;
+    }
+  }
+
+  int size = 0;
+  for (size_t i = 0; i < sub_filters.size(); ++i) {
+    if (!removed[i]) {
+      sub_filters[size++] = std::move(sub_filters[i]);
+    }
+  }
+  sub_filters.resize(size);
+}
+
+// Combines @sub_filters with OR. Nested OR is flattened.
+std::vector<FieldFilterProto> CombineDisjunction(
+    const google::protobuf::Descriptor* descriptor,
+    std::vector<FieldFilterProto>&& sub_filters) {
+  std::vector<FieldFilterProto> output;
+  for (FieldFilterProto& sub_filter : sub_filters) {
+    if (sub_filter.op() == FieldFilterProto::OR &&
+        sub_filter.sub_filters_size() > 0) {
+      for (FieldFilterProto& nested : *sub_filter.mutable_sub_filters()) {
+        output.push_back(std::move(nested));
+      }
+    } else {
+      output.push_back(std::move(sub_filter));
+    }
+  }
+  MergeMembershipTests(descriptor, output);
+  GroupSharedParents(descriptor, FieldFilterProto::OR, output);
+  return output;
+}
+
+FieldFilterProto NegateNormalized(
+    const google::protobuf::Descriptor* descriptor, FieldFilterProto&& config);
+
+// Returns NOT of @sub_filters, which are combined by CombineConjunction.
+//
+// NOT is pushed down with De Morgan's laws when it removes nodes, which also
+// guarantees termination:
+//   NOT(OR(a, b)) = AND(NOT a, NOT b)
+//   NOT(a, b) = NOT(AND(a, b)) = OR(NOT a, NOT b)
+FieldFilterProto CombineNegation(const google::protobuf::Descriptor* descriptor,
+                                 std::vector<FieldFilterProto>&& sub_filters) {
+  if (sub_filters.empty()) {
+    sub_filters.push_back(NewTrue());
+  }
+  const bool negate_or = sub_filters.size() == 1 &&
+                         sub_filters.front().op() == FieldFilterProto::OR;
+  int not_count = 1;
+  int pushed_count = 1;
+  for (const FieldFilterProto& sub_filter : sub_filters) {
+    not_count += CountNodes(sub_filter);
+    if (!negate_or) {
+      pushed_count += CountNegatedNodes(sub_filter);
+    }
+  }
+  if (negate_or) {
+    for (const FieldFilterProto& sub_filter :
+         sub_filters.front().sub_filters()) {
+      pushed_count += CountNegatedNodes(sub_filter);
+    }
+  }
+  if (pushed_count >= not_count) {
+    return NewComposite(FieldFilterProto::NOT, std::move(sub_filters));
+  }
+
+  std::vector<FieldFilterProto> to_negate =
+      negate_or ? TakeSubFilters(sub_filters.front()) : std::move(sub_filters);
+  std::vector<FieldFilterProto> negated;
+  for (FieldFilterProto& sub_filter : to_negate) {
+    negated.push_back(NegateNormalized(descriptor, std::move(sub_filter)));
+  }
+  if (negate_or) {
+    return FinishAnd(CombineConjunction(descriptor, std::move(negated)));
+  }
+  return FinishOr(CombineDisjunction(descriptor, std::move(negated)));
+}
+
+// Returns the normalized negation of @config, which is normalized.
+FieldFilterProto NegateNormalized(
+    const google::protobuf::Descriptor* descriptor, FieldFilterProto&& config) {
+  if (config.op() == FieldFilterProto::NOT) {
+    return FinishAnd(CombineConjunction(descriptor, TakeSubFilters(config)));
+  }
+  std::vector<FieldFilterProto> sub_filters;
+  sub_filters.push_back(std::move(config));
+  return CombineNegation(
+      descriptor, CombineConjunction(descriptor, std::move(sub_filters)));
+}
+
+FieldFilterProto Normalize(const google::protobuf::Descriptor* descriptor,
+                           const FieldFilterProto& config);
+
+std::vector<FieldFilterProto> NormalizeSubFilters(
+    const google::protobuf::Descriptor* descriptor,
+    const SubFilters& sub_filters) {
+  std::vector<FieldFilterProto> output;
+  output.reserve(sub_filters.size());
+  for (const FieldFilterProto& sub_filter : sub_filters) {
+    output.push_back(Normalize(descriptor, sub_filter));
+  }
+  return output;
+}
+
+// Normalizes @config, which is valid.
+FieldFilterProto Normalize(const google::protobuf::Descriptor* descriptor,
+                           const FieldFilterProto& config) {
+  switch (config.op()) {
+    case FieldFilterProto::AND:
+      return FinishAnd(CombineConjunction(
+          descriptor, NormalizeSubFilters(descriptor, config.sub_filters())));
+    case FieldFilterProto::OR:
+      return FinishOr(CombineDisjunction(
+          descriptor, NormalizeSubFilters(descriptor, config.sub_filters())));
+    case FieldFilterProto::NOT:
+      return CombineNegation(
+          descriptor,
+          CombineConjunction(
+              descriptor,
+              NormalizeSubFilters(descriptor, config.sub_filters())));
+    case FieldFilterProto::PARTIAL: {
+      const google::protobuf::Descriptor* sub_descriptor =
+          FindField(descriptor, config.name())->message_type();
+      return FinishPartial(
+          config.name(),
+          CombineConjunction(sub_descriptor,
+                             NormalizeSubFilters(sub_descriptor,
+                                                 config.sub_filters())));
+    }
+    default:
+      return config;
+  }
+}
+
+}  // namespace
+
+bool IsFieldFilterProtoNormalized(const FieldFilterProto& config) {
+  const FieldFilterProto::Op op = config.op();
+  if (op != FieldFilterProto::AND && op != FieldFilterProto::OR &&
+      op != FieldFilterProto::NOT && op != FieldFilterProto::PARTIAL) {
+    // Leaf filters are never rewritten.
+    return true;
+  }
+  if (config.sub_filters_size() == 0 ||
+      (config.sub_filters_size() == 1 &&
+       (op == FieldFilterProto::AND || op == FieldFilterProto::OR))) {
+    return false;
+  }
+  absl::flat_hash_set<std::string> first_fields;
+  absl::flat_hash_set<std::string> gt_names;
+  absl::flat_hash_set<std::string> lt_names;
+  absl::flat_hash_set<std::string> membership_names;
+  for (const FieldFilterProto& sub_filter : config.sub_filters()) {
+    const FieldFilterProto::Op sub_op = sub_filter.op();
+    if (IsTrue(sub_filter) || !IsFieldFilterProtoNormalized(sub_filter)) {
+      return false;
+    }
+    if (op == FieldFilterProto::OR) {
+      // Nested OR is flattened, and EQUAL and IN on the same field merged.
+      if (sub_op == FieldFilterProto::OR ||
+          ((sub_op == FieldFilterProto::EQUAL ||
+            sub_op == FieldFilterProto::IN) &&
+           !membership_names.insert(sub_filter.name()).second)) {
+        return false;
+      }
+    } else {
+      // Nested AND is flattened, and GT and LT on the same field grouped.
+      if (sub_op == FieldFilterProto::AND ||
+          (sub_op == FieldFilterProto::GT &&
+           lt_names.contains(sub_filter.name())) ||
+          (sub_op == FieldFilterProto::LT &&
+           gt_names.contains(sub_filter.name()))) {
+        return false;
+      }
+      if (sub_op == FieldFilterProto::GT) {
+        gt_names.insert(sub_filter.name());
+      } else if (sub_op == FieldFilterProto::LT) {
+        lt_names.insert(sub_filter.name());
+      }
+    }
+    // NOT might be pushed down into a composite sub filter.
+    if (op == FieldFilterProto::NOT && sub_filter.sub_filters_size() > 0) {
+      return false;
+    }
+    // Sub filters within the same message are grouped into a PARTIAL.
+    std::string parent_name = GetParentName(sub_filter);
+    if (!parent_name.empty() &&
+        !first_fields.insert(parent_name.substr(0, parent_name.find('.')))
+             .second) {
+      return false;
+    }
+  }
+  return true;
+}
+
+FieldFilterProto NormalizeFieldFilterProto(
+    const google::protobuf::Descriptor* descriptor,
+    const FieldFilterProto& config) {
+  // A @config with nothing to rewrite is returned without validating it,
+  // which would parse all its values.
+  // An invalid @config is kept as is, so building it returns the same error.
+  // All the sub filters of a valid @config are valid, so the rewrites never
+  // need to check whether a sub filter is valid before removing it.
+  if (IsFieldFilterProtoNormalized(config) || !IsValid(descriptor, config)) {
+    return config;
+  }
+  return Normalize(descriptor, config);
+}
+
+}  // namespace wfa_virtual_people
@@ -0,0 +1,60 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_FIELD_FILTER_NORMALIZER_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_FIELD_FILTER_NORMALIZER_H_
+
+#include "google/protobuf/descriptor.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+
+namespace wfa_virtual_people {
+
+// Rewrites @config into an equivalent FieldFilterProto with fewer nodes.
+// FieldFilter::New builds the filter from the output of this function, so
+// this is mostly useful to see what is actually built from @config.
+//
+// The following rewrites are applied bottom up:
+// * Nested AND in AND, NOT or PARTIAL, and nested OR in OR, are flattened.
+// * TRUE is removed from AND, NOT and PARTIAL. AND of only TRUE becomes TRUE,
+//   and PARTIAL of only TRUE becomes HAS. OR with TRUE becomes TRUE.
+// * AND, OR of a single sub filter becomes the sub filter.
+// * EQUAL and IN on the same field in OR are merged into a single IN.
+// * The first GT and the first LT on the same field in AND, NOT or PARTIAL are
+//   grouped into an AND of the two, which is built as a RangeFilter.
+// * NOT is pushed down with De Morgan's laws when the result has fewer nodes,
+//   e.g. NOT(OR(NOT a, NOT b)) becomes AND(a, b).
+// * Leaf filters on fields of the same parent message in AND, OR, NOT or
+//   PARTIAL are grouped into a PARTIAL on the parent message, so that the
+//   parent message is resolved once, e.g. AND(p.q.a, p.q.b, c) becomes
+//   AND(PARTIAL p.q (a, b), c), and OR(p.a, p.b) becomes PARTIAL p (OR(a, b)).
+//
+// The output matches the same messages as @config. When building @config
+// returns an error, @config is returned as is, so building the output returns
+// the same error. This is checked once for the whole @config, by resolving the
+// field paths and parsing the values, without building any filter. Value files
+// are not opened; instead every filter with a value_file is kept in the
+// output, so a file that cannot be opened fails building the output too.
+FieldFilterProto NormalizeFieldFilterProto(
+    const google::protobuf::Descriptor* descriptor,
+    const FieldFilterProto& config);
+
+// Returns true if NormalizeFieldFilterProto returns @config as is, because
+// none of the rewrites applies to it, e.g. for any leaf filter. This only
+// looks at the ops and names of the nodes, and might return false for some
+// configs that are not rewritten either.
+bool IsFieldFilterProtoNormalized(const FieldFilterProto& config);
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_FIELD_FILTER_NORMALIZER_H_
@@ -0,0 +1,226 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/field_filter_stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/functional/function_ref.h"
+#include "absl/memory/memory.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "google/protobuf/message.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+// The indexes of the nodes built so far by the Instrument calls in progress
+// in this thread, one entry per call, from the outermost. The nodes built
+// while an Instrument call is in progress are its sub filters.
+std::vector<std::vector<int>>& GetBuildingChildren() {
+  thread_local std::vector<std::vector<int>> building_children;
+  return building_children;
+}
+
+// Returns the slot used by this thread. Threads are assigned the slots in
+// turn.
+int GetSlotIndex(int slot_count) {
+  static std::atomic<int> next_slot_index(0);
+  thread_local int slot_index =
+      next_slot_index.fetch_add(1, std::memory_order_relaxed);
+  return slot_index % slot_count;
+}
+
+int64_t GetNanosSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+}  // namespace
+
+// Counts the evaluations of the wrapped @filter in the slots of @node.
+class InstrumentedFilter : public FieldFilter {
+ public:
+  InstrumentedFilter(std::unique_ptr<FieldFilter> filter,
+                     FieldFilterStats::Node* node, int latency_sampling_period)
+      : filter_(std::move(filter)),
+        node_(node),
+        latency_sampling_period_(latency_sampling_period) {}
+
+  InstrumentedFilter(const InstrumentedFilter&) = delete;
+  InstrumentedFilter& operator=(const InstrumentedFilter&) = delete;
+
+  bool IsMatch(const google::protobuf::Message& message) const override {
+    FieldFilterStats::Slot& slot =
+        node_->slots[GetSlotIndex(FieldFilterStats::kSlotCount)];
+    const int64_t evaluations =
+        slot.evaluations.fetch_add(1, std::memory_order_relaxed);
+    bool result;
+    if (IsSampled(evaluations, 1)) {
+      std::chrono::steady_clock::time_point start =
+          std::chrono::steady_clock::now();
+      result = filter_->IsMatch(message);
+      slot.sampled_nanos.fetch_add(GetNanosSince(start),
+                                   std::memory_order_relaxed);
+      slot.sampled_evaluations.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      result = filter_->IsMatch(message);
+    }
+    if (result) {
+      slot.matches.fetch_add(1, std::memory_order_relaxed);
+    }
+    return result;
+  }
+
+  void MatchSelected(
+      absl::Span<const google::protobuf::Message* const> messages,
+      absl::Span<const int> selection,
+      std::vector<bool>* matches) const override {
+    FieldFilterStats::Slot& slot =
+        node_->slots[GetSlotIndex(FieldFilterStats::kSlotCount)];
+    const int64_t size = static_cast<int64_t>(selection.size());
+    const int64_t evaluations =
+        slot.evaluations.fetch_add(size, std::memory_order_relaxed);
+    if (IsSampled(evaluations, size)) {
+      std::chrono::steady_clock::time_point start =
+          std::chrono::steady_clock::now();
+      filter_->MatchSelected(messages, selection, matches);
+      slot.sampled_nanos.fetch_add(GetNanosSince(start),
+                                   std::memory_order_relaxed);
+      slot.sampled_evaluations.fetch_add(size, std::memory_order_relaxed);
+    } else {
+      filter_->MatchSelected(messages, selection, matches);
+    }
+    int64_t match_count = 0;
+    for (int i : selection) {
+      match_count += (*matches)[i];
+    }
+    slot.matches.fetch_add(match_count, std::memory_order_relaxed);
+  }
+
+  void AppendReferencedFields(
+      std::vector<ReferencedField>* fields) const override {
+    filter_->AppendReferencedFields(fields);
+  }
+
+ private:
+  // Returns true if the @count evaluations following the first @evaluations
+  // of the slot include one out of every @latency_sampling_period_.
+  bool IsSampled(int64_t evaluations, int64_t count) const {
+    return latency_sampling_period_ > 0 && count > 0 &&
+           (evaluations % latency_sampling_period_ == 0 ||
+            evaluations / latency_sampling_period_ !=
+                (evaluations + count - 1) / latency_sampling_period_);
+  }
+
+  std::unique_ptr<FieldFilter> filter_;
+  FieldFilterStats::Node* node_;
+  int latency_sampling_period_;
+};
+
+absl::StatusOr<std::unique_ptr<FieldFilter>> FieldFilterStats::Instrument(
+    const FieldFilterProto& config,
+    absl::FunctionRef<absl::StatusOr<std::unique_ptr<FieldFilter>>()> build) {
+  std::vector<std::vector<int>>& building_children = GetBuildingChildren();
+  building_children.emplace_back();
+  absl::StatusOr<std::unique_ptr<FieldFilter>> filter = build();
+  std::vector<int> children = std::move(building_children.back());
+  building_children.pop_back();
+  if (!filter.ok()) {
+    return filter.status();
+  }
+
+  Node* node;
+  int index;
+  {
+    absl::MutexLock lock(&mutex_);
+    index = static_cast<int>(nodes_.size());
+    node = &nodes_.emplace_back();
+    node->op = config.op();
+    node->name = config.name();
+    node->children = std::move(children);
+    if (building_children.empty()) {
+      roots_.push_back(index);
+    }
+  }
+  if (!building_children.empty()) {
+    building_children.back().push_back(index);
+  }
+  return absl::make_unique<InstrumentedFilter>(*std::move(filter), node,
+                                               latency_sampling_period_);
+}
+
+FieldFilterStatsProto FieldFilterStats::Export() const {
+  FieldFilterStatsProto stats_proto;
+  absl::ReaderMutexLock lock(&mutex_);
+  for (int i = 0; i < static_cast<int>(roots_.size()); ++i) {
+    ExportNode(roots_[i], absl::StrCat(i), -1, stats_proto);
+  }
+  return stats_proto;
+}
+
+void FieldFilterStats::ExportNode(int index, const std::string& path,
+                                  int64_t parent_evaluations,
+                                  FieldFilterStatsProto& stats_proto) const {
+  const Node& node = nodes_[index];
+  FieldFilterStatsProto::NodeStats node_stats;
+  node_stats.set_op(node.op);
+  if (!node.name.empty()) {
+    node_stats.set_name(node.name);
+  }
+  int64_t evaluations = 0;
+  int64_t matches = 0;
+  int64_t sampled_evaluations = 0;
+  int64_t sampled_nanos = 0;
+  for (const Slot& slot : node.slots) {
+    evaluations += slot.evaluations.load(std::memory_order_relaxed);
+    matches += slot.matches.load(std::memory_order_relaxed);
+    sampled_evaluations +=
+        slot.sampled_evaluations.load(std::memory_order_relaxed);
+    sampled_nanos += slot.sampled_nanos.load(std::memory_order_relaxed);
+  }
+  node_stats.set_evaluations(evaluations);
+  node_stats.set_matches(matches);
+  if (latency_sampling_period_ > 0) {
+    node_stats.set_sampled_evaluations(sampled_evaluations);
+    node_stats.set_sampled_nanos(sampled_nanos);
+  }
+  if (parent_evaluations >= 0) {
+    // The counters are read while the filters may be evaluated, so the node
+    // may include evaluations counted after the parent was read.
+    node_stats.set_short_circuits(
+        std::max<int64_t>(0, parent_evaluations - evaluations));
+  }
+  (*stats_proto.mutable_nodes())[path] = std::move(node_stats);
+
+  for (int i = 0; i < static_cast<int>(node.children.size()); ++i) {
+    ExportNode(node.children[i], absl::StrCat(path, ".", i), evaluations,
+               stats_proto);
+  }
+}
+
+}  // namespace wfa_virtual_people
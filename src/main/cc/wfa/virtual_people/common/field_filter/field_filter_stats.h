@@ -0,0 +1,131 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_FIELD_FILTER_STATS_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_FIELD_FILTER_STATS_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/functional/function_ref.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+
+namespace wfa_virtual_people {
+
+class InstrumentedFilter;
+
+// Counts the evaluations of each node of the FieldFilters built with
+// FieldFilterOptions.stats pointing to this object, to find the conditions
+// which are hot, always true or never matching.
+//
+// Each node built is wrapped in a filter which counts its evaluations and
+// matches, and times one out of every @latency_sampling_period evaluations of
+// each thread. The filters built without FieldFilterOptions.stats are not
+// wrapped, and have no overhead.
+//
+// The counters of a node are spread over cache line aligned slots, and each
+// thread adds to its own slot, so that threads evaluating the same filter do
+// not contend on the same cache line.
+//
+// Example:
+//   FieldFilterStats stats;
+//   FieldFilterOptions options;
+//   options.stats = &stats;
+//   ASSIGN_OR_RETURN(std::unique_ptr<FieldFilter> filter,
+//                    FieldFilter::New(descriptor, config, options));
+//   ...
+//   FieldFilterStatsProto stats_proto = stats.Export();
+//
+// This class is thread-safe. It must outlive the filters built with it.
+class FieldFilterStats {
+ public:
+  // Evaluations are not timed when @latency_sampling_period is 0.
+  explicit FieldFilterStats(int latency_sampling_period = 0)
+      : latency_sampling_period_(latency_sampling_period) {}
+
+  FieldFilterStats(const FieldFilterStats&) = delete;
+  FieldFilterStats& operator=(const FieldFilterStats&) = delete;
+
+  // Returns the counters of all the nodes built so far, keyed by node path.
+  // See FieldFilterStatsProto.
+  //
+  // FieldFilter::New normalizes the config before building it, so the paths
+  // refer to the nodes of the normalized config (see
+  // NormalizeFieldFilterProto), not to the sub_filters of the config passed
+  // in. Use the op and the name of a node to identify it.
+  FieldFilterStatsProto Export() const;
+
+  // Returns the filter built by @build from @config, wrapped to count its
+  // evaluations. The nodes built recursively by @build are registered as the
+  // sub filters of this node.
+  //
+  // FieldFilter::NewWithoutNormalization uses this to build each node when
+  // FieldFilterOptions.stats is set. Users should never call it directly.
+  absl::StatusOr<std::unique_ptr<FieldFilter>> Instrument(
+      const FieldFilterProto& config,
+      absl::FunctionRef<absl::StatusOr<std::unique_ptr<FieldFilter>>()> build);
+
+ private:
+  friend class InstrumentedFilter;
+
+  // The counters of one node, shared by the threads mapped to the same slot.
+  struct alignas(64) Slot {
+    std::atomic<int64_t> evaluations{0};
+    std::atomic<int64_t> matches{0};
+    std::atomic<int64_t> sampled_evaluations{0};
+    std::atomic<int64_t> sampled_nanos{0};
+  };
+
+  // The number of slots of each node.
+  static constexpr int kSlotCount = 8;
+
+  struct Node {
+    FieldFilterProto::Op op;
+    std::string name;
+    // The indexes in @nodes_ of the sub filters, in the order they are built.
+    std::vector<int> children;
+    std::array<Slot, kSlotCount> slots;
+  };
+
+  // Adds the counters of the node at @index and its sub filters to
+  // @stats_proto, under @path. @parent_evaluations is the number of
+  // evaluations of the parent node, or -1 for a root.
+  void ExportNode(int index, const std::string& path,
+                  int64_t parent_evaluations,
+                  FieldFilterStatsProto& stats_proto) const
+      ABSL_SHARED_LOCKS_REQUIRED(mutex_);
+
+  const int latency_sampling_period_;
+
+  mutable absl::Mutex mutex_;
+  // A deque, so that the nodes are never moved, and the filters keep pointers
+  // to their nodes.
+  std::deque<Node> nodes_ ABSL_GUARDED_BY(mutex_);
+  // The indexes in @nodes_ of the nodes which are not sub filters of other
+  // nodes, in the order they are built.
+  std::vector<int> roots_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_FIELD_FILTER_STATS_H_
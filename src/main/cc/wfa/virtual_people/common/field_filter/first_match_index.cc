@@ -0,0 +1,421 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/first_match_index.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "common_cpp/macros/macros.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/field_filter_normalizer.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_accessor.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_util.h"
+#include "wfa/virtual_people/common/field_filter/utils/type_convert_util.h"
+#include "wfa/virtual_people/common/field_filter/utils/values_parser.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+using CppType = google::protobuf::FieldDescriptor::CppType;
+
+// A leaf of a condition, which must be satisfied for the condition to match.
+struct Constraint {
+  std::shared_ptr<const FieldPath> field_path;
+  // An EQUAL or IN filter on the field at @field_path.
+  const FieldFilterProto* leaf;
+};
+
+// Returns whether the values of @field can be used as keys of the index.
+bool IsIndexable(const google::protobuf::FieldDescriptor* field) {
+  if (field->is_repeated()) {
+    return false;
+  }
+  switch (field->cpp_type()) {
+    case CppType::CPPTYPE_INT32:
+    case CppType::CPPTYPE_INT64:
+    case CppType::CPPTYPE_UINT32:
+    case CppType::CPPTYPE_UINT64:
+    case CppType::CPPTYPE_BOOL:
+    case CppType::CPPTYPE_ENUM:
+    case CppType::CPPTYPE_STRING:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Appends the EQUAL and IN leaves required by @config to @constraints. Only
+// the leaves reached through AND and PARTIAL are required. @prefix is the path
+// of the message @config applies to, from the root message type
+// @descriptor, followed by ".", or empty for the root message.
+void CollectConstraints(const google::protobuf::Descriptor* descriptor,
+                        const FieldFilterProto& config,
+                        absl::string_view prefix,
+                        std::vector<Constraint>& constraints) {
+  switch (config.op()) {
+    case FieldFilterProto::EQUAL:
+    case FieldFilterProto::IN: {
+      if (config.has_value_file()) {
+        // Indexing every value of a file would copy it.
+        return;
+      }
+      absl::StatusOr<std::shared_ptr<const FieldPath>> field_path =
+          GetFieldPathFromProto(descriptor,
+                                absl::StrCat(prefix, config.name()));
+      if (field_path.ok() && IsIndexable((*field_path)->back())) {
+        constraints.push_back({*std::move(field_path), &config});
+      }
+      return;
+    }
+    case FieldFilterProto::AND:
+      for (const FieldFilterProto& sub_filter : config.sub_filters()) {
+        CollectConstraints(descriptor, sub_filter, prefix, constraints);
+      }
+      return;
+    case FieldFilterProto::PARTIAL: {
+      std::string sub_prefix = absl::StrCat(prefix, config.name(), ".");
+      for (const FieldFilterProto& sub_filter : config.sub_filters()) {
+        CollectConstraints(descriptor, sub_filter, sub_prefix, constraints);
+      }
+      return;
+    }
+    default:
+      return;
+  }
+}
+
+// Parses the values matched by @leaf, which is an EQUAL or IN filter, into
+// @output. The values are parsed as @ValueType, and widened to @KeyType.
+template <typename ValueType, typename KeyType>
+absl::Status ParseNumericKeys(const FieldFilterProto& leaf,
+                              std::vector<KeyType>& output) {
+  if (leaf.op() == FieldFilterProto::EQUAL) {
+    ASSIGN_OR_RETURN(ValueType value,
+                     ConvertToNumeric<ValueType>(leaf.value()));
+    output.push_back(static_cast<KeyType>(value));
+    return absl::OkStatus();
+  }
+  ASSIGN_OR_RETURN(ParsedValues<ValueType> parsed_values,
+                   ParseValues<ValueType>(leaf.value()));
+  for (ValueType value : parsed_values.values) {
+    output.push_back(static_cast<KeyType>(value));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ParseEnumKeys(const google::protobuf::FieldDescriptor* field,
+                           const FieldFilterProto& leaf,
+                           std::vector<int64_t>& output) {
+  if (leaf.op() == FieldFilterProto::EQUAL) {
+    ASSIGN_OR_RETURN(const google::protobuf::EnumValueDescriptor* value,
+                     ConvertToEnum(field->enum_type(), leaf.value()));
+    output.push_back(value->number());
+    return absl::OkStatus();
+  }
+  ASSIGN_OR_RETURN(
+      ParsedValues<const google::protobuf::EnumValueDescriptor*> parsed_values,
+      ParseEnumValues(field->enum_type(), leaf.value()));
+  output.insert(output.end(), parsed_values.values.begin(),
+                parsed_values.values.end());
+  return absl::OkStatus();
+}
+
+absl::Status ParseSignedKeys(const google::protobuf::FieldDescriptor* field,
+                             const FieldFilterProto& leaf,
+                             std::vector<int64_t>& output) {
+  switch (field->cpp_type()) {
+    case CppType::CPPTYPE_INT32:
+      return ParseNumericKeys<int32_t>(leaf, output);
+    case CppType::CPPTYPE_INT64:
+      return ParseNumericKeys<int64_t>(leaf, output);
+    case CppType::CPPTYPE_BOOL:
+      return ParseNumericKeys<bool>(leaf, output);
+    default:
+      return ParseEnumKeys(field, leaf, output);
+  }
+}
+
+absl::Status ParseUnsignedKeys(const google::protobuf::FieldDescriptor* field,
+                               const FieldFilterProto& leaf,
+                               std::vector<uint64_t>& output) {
+  if (field->cpp_type() == CppType::CPPTYPE_UINT32) {
+    return ParseNumericKeys<uint32_t>(leaf, output);
+  }
+  return ParseNumericKeys<uint64_t>(leaf, output);
+}
+
+absl::Status ParseStringKeys(const FieldFilterProto& leaf,
+                             std::vector<std::string>& output) {
+  if (leaf.op() == FieldFilterProto::EQUAL) {
+    output.push_back(leaf.value());
+    return absl::OkStatus();
+  }
+  ASSIGN_OR_RETURN(ParsedValues<const std::string&> parsed_values,
+                   ParseValues<const std::string&>(leaf.value()));
+  output.insert(output.end(), parsed_values.values.begin(),
+                parsed_values.values.end());
+  return absl::OkStatus();
+}
+
+// Maps each of @keys to @condition in @index. The conditions are added in
+// ascending order, so each list stays sorted.
+template <typename KeyType>
+void AddKeys(const std::vector<KeyType>& keys, int condition,
+             absl::flat_hash_map<KeyType, std::vector<int>>& index) {
+  for (const KeyType& key : keys) {
+    std::vector<int>& conditions = index[key];
+    if (conditions.empty() || conditions.back() != condition) {
+      conditions.push_back(condition);
+    }
+  }
+}
+
+}  // namespace
+
+// Picks the indexed field of a FirstMatchIndex, and maps its values to the
+// conditions.
+class FirstMatchIndexBuilder {
+ public:
+  FirstMatchIndexBuilder(const google::protobuf::Descriptor* descriptor,
+                         FirstMatchIndex& index)
+      : descriptor_(descriptor), index_(index) {}
+
+  // Builds the index of @conditions, which are already normalized, and
+  // validated by building them into FieldFilters.
+  //
+  // Normalization only rewrites a condition into an equivalent one, so the
+  // constraints found in the normalized conditions are constraints of the
+  // original ones. It also merges OR of EQUAL on the same field into IN,
+  // which can be indexed.
+  void Build(absl::Span<const FieldFilterProto> conditions);
+
+ private:
+  // Adds the keys matched by @leaf as the keys of @condition. Returns false if
+  // the value of @leaf cannot be parsed, in which case the condition is not
+  // indexed.
+  bool AddLeaf(const FieldFilterProto& leaf, int condition);
+
+  const google::protobuf::Descriptor* descriptor_;
+  FirstMatchIndex& index_;
+};
+
+void FirstMatchIndexBuilder::Build(
+    absl::Span<const FieldFilterProto> conditions) {
+  std::vector<std::vector<Constraint>> constraints(conditions.size());
+  // The number of conditions constrained by each field, and the order the
+  // fields are first seen in to break ties.
+  absl::flat_hash_map<const FieldPath*, int> condition_counts;
+  std::vector<std::shared_ptr<const FieldPath>> seen_paths;
+  for (int i = 0; i < static_cast<int>(conditions.size()); ++i) {
+    CollectConstraints(descriptor_, conditions[i], "", constraints[i]);
+    absl::flat_hash_set<const FieldPath*> counted;
+    for (const Constraint& constraint : constraints[i]) {
+      const FieldPath* path = constraint.field_path.get();
+      if (!counted.insert(path).second) {
+        continue;
+      }
+      if (condition_counts[path]++ == 0) {
+        seen_paths.push_back(constraint.field_path);
+      }
+    }
+  }
+
+  for (const std::shared_ptr<const FieldPath>& path : seen_paths) {
+    if (index_.field_path_ == nullptr ||
+        condition_counts[path.get()] >
+            condition_counts[index_.field_path_.get()]) {
+      index_.field_path_ = path;
+    }
+  }
+
+  for (int i = 0; i < static_cast<int>(conditions.size()); ++i) {
+    const FieldFilterProto* leaf = nullptr;
+    for (const Constraint& constraint : constraints[i]) {
+      if (constraint.field_path == index_.field_path_) {
+        leaf = constraint.leaf;
+        break;
+      }
+    }
+    if (leaf == nullptr || !AddLeaf(*leaf, i)) {
+      index_.unindexed_.push_back(i);
+    }
+  }
+  if (index_.unindexed_.size() == conditions.size()) {
+    index_.field_path_ = nullptr;
+    return;
+  }
+  index_.accessor_ = FindFieldAccessor(*index_.field_path_);
+}
+
+bool FirstMatchIndexBuilder::AddLeaf(const FieldFilterProto& leaf,
+                                     int condition) {
+  const google::protobuf::FieldDescriptor* field = index_.field_path_->back();
+  switch (field->cpp_type()) {
+    case CppType::CPPTYPE_UINT32:
+    case CppType::CPPTYPE_UINT64: {
+      std::vector<uint64_t> keys;
+      if (!ParseUnsignedKeys(field, leaf, keys).ok()) {
+        return false;
+      }
+      AddKeys(keys, condition, index_.unsigned_index_);
+      return true;
+    }
+    case CppType::CPPTYPE_STRING: {
+      std::vector<std::string> keys;
+      if (!ParseStringKeys(leaf, keys).ok()) {
+        return false;
+      }
+      AddKeys(keys, condition, index_.string_index_);
+      return true;
+    }
+    default: {
+      std::vector<int64_t> keys;
+      if (!ParseSignedKeys(field, leaf, keys).ok()) {
+        return false;
+      }
+      AddKeys(keys, condition, index_.signed_index_);
+      return true;
+    }
+  }
+}
+
+absl::StatusOr<std::unique_ptr<FirstMatchIndex>> FirstMatchIndex::New(
+    const google::protobuf::Descriptor* descriptor,
+    absl::Span<const FieldFilterProto> conditions,
+    const FieldFilterOptions& options) {
+  auto index = absl::WrapUnique(new FirstMatchIndex());
+  index->filters_.reserve(conditions.size());
+  // Each condition is normalized once, for both the filter and the index.
+  std::vector<FieldFilterProto> normalized;
+  normalized.reserve(conditions.size());
+  for (const FieldFilterProto& condition : conditions) {
+    normalized.push_back(NormalizeFieldFilterProto(descriptor, condition));
+    ASSIGN_OR_RETURN(std::unique_ptr<FieldFilter> filter,
+                     FieldFilter::NewWithoutNormalization(
+                         descriptor, normalized.back(), options));
+    index->filters_.push_back(std::move(filter));
+  }
+  FirstMatchIndexBuilder(descriptor, *index).Build(normalized);
+  return index;
+}
+
+const std::vector<int>* FirstMatchIndex::FindCandidates(
+    const google::protobuf::Message& message) const {
+  const FieldPath& path = *field_path_;
+  auto find = [](const auto& index,
+                 const auto& key) -> const std::vector<int>* {
+    auto it = index.find(key);
+    return it == index.end() ? nullptr : &it->second;
+  };
+  switch (path.back()->cpp_type()) {
+    case CppType::CPPTYPE_INT32: {
+      ProtoFieldValue<int32_t> value = GetValueFromProto<int32_t>(
+          message, path, GetFieldGetter<int32_t>(accessor_));
+      return value.is_set ? find(signed_index_, value.value) : nullptr;
+    }
+    case CppType::CPPTYPE_INT64: {
+      ProtoFieldValue<int64_t> value = GetValueFromProto<int64_t>(
+          message, path, GetFieldGetter<int64_t>(accessor_));
+      return value.is_set ? find(signed_index_, value.value) : nullptr;
+    }
+    case CppType::CPPTYPE_BOOL: {
+      ProtoFieldValue<bool> value = GetValueFromProto<bool>(
+          message, path, GetFieldGetter<bool>(accessor_));
+      return value.is_set ? find(signed_index_, int64_t{value.value})
+                          : nullptr;
+    }
+    case CppType::CPPTYPE_ENUM: {
+      if (accessor_ != nullptr) {
+        ProtoFieldValue<int32_t> value = accessor_->get_int32(message);
+        return value.is_set ? find(signed_index_, int64_t{value.value})
+                            : nullptr;
+      }
+      ProtoFieldValue<const google::protobuf::EnumValueDescriptor*> value =
+          GetValueFromProto<const google::protobuf::EnumValueDescriptor*>(
+              message, path);
+      return value.is_set
+                 ? find(signed_index_, int64_t{value.value->number()})
+                 : nullptr;
+    }
+    case CppType::CPPTYPE_UINT32: {
+      ProtoFieldValue<uint32_t> value = GetValueFromProto<uint32_t>(
+          message, path, GetFieldGetter<uint32_t>(accessor_));
+      return value.is_set ? find(unsigned_index_, uint64_t{value.value})
+                          : nullptr;
+    }
+    case CppType::CPPTYPE_UINT64: {
+      ProtoFieldValue<uint64_t> value = GetValueFromProto<uint64_t>(
+          message, path, GetFieldGetter<uint64_t>(accessor_));
+      return value.is_set ? find(unsigned_index_, value.value) : nullptr;
+    }
+    default: {
+      ProtoFieldValue<const std::string&> value =
+          GetValueFromProto<const std::string&>(
+              message, path, GetFieldGetter<const std::string&>(accessor_));
+      return value.is_set ? find(string_index_, value.value) : nullptr;
+    }
+  }
+}
+
+int FirstMatchIndex::FirstMatch(
+    const google::protobuf::Message& message) const {
+  if (field_path_ == nullptr) {
+    for (int i = 0; i < static_cast<int>(filters_.size()); ++i) {
+      if (filters_[i]->IsMatch(message)) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  // Merges the candidates of the field value with the unindexed conditions,
+  // so that the conditions are checked in the original order.
+  const std::vector<int>* candidates = FindCandidates(message);
+  auto candidate = candidates == nullptr ? unindexed_.end()
+                                         : candidates->begin();
+  auto candidate_end =
+      candidates == nullptr ? unindexed_.end() : candidates->end();
+  auto unindexed = unindexed_.begin();
+  while (candidate != candidate_end || unindexed != unindexed_.end()) {
+    int i;
+    if (unindexed == unindexed_.end() ||
+        (candidate != candidate_end && *candidate < *unindexed)) {
+      i = *candidate++;
+    } else {
+      i = *unindexed++;
+    }
+    if (filters_[i]->IsMatch(message)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+}  // namespace wfa_virtual_people
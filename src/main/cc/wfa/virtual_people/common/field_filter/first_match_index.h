@@ -0,0 +1,109 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_FIRST_MATCH_INDEX_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_FIRST_MATCH_INDEX_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_accessor.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
+
+namespace wfa_virtual_people {
+
+// Finds the first condition in an ordered list matching a message, which is
+// how ConditionalMerge nodes and the conditions of BranchNode branches are
+// selected, without evaluating every condition before the match.
+//
+// Many conditions of such lists require a value of the same field, like
+//   name: "acting_demo.gender" op: EQUAL value: "FEMALE"
+// alone or as a sub filter of AND, or of PARTIAL on a parent of the field.
+// The index picks the field required by the most conditions, and maps each
+// of its values to the conditions requiring it. A message is only checked
+// against the conditions mapped to the value of its field, and the conditions
+// not requiring any value of the field, in the original order. The conditions
+// skipped cannot match, so the result is always the same as checking the
+// conditions one by one.
+//
+// Example:
+//   ASSIGN_OR_RETURN(std::unique_ptr<FirstMatchIndex> index,
+//                    FirstMatchIndex::New(descriptor, conditions));
+//   int selected = index->FirstMatch(event);
+//
+// This class is thread-safe.
+class FirstMatchIndex {
+ public:
+  // Returns error status if any of @conditions is invalid to create a
+  // FieldFilter with FieldFilter::New. The conditions are built with
+  // @options.
+  static absl::StatusOr<std::unique_ptr<FirstMatchIndex>> New(
+      const google::protobuf::Descriptor* descriptor,
+      absl::Span<const FieldFilterProto> conditions,
+      const FieldFilterOptions& options = FieldFilterOptions());
+
+  FirstMatchIndex(const FirstMatchIndex&) = delete;
+  FirstMatchIndex& operator=(const FirstMatchIndex&) = delete;
+
+  // Returns the index of the first condition matching @message, or -1 if no
+  // condition matches.
+  int FirstMatch(const google::protobuf::Message& message) const;
+
+  // The number of conditions mapped by the values of the indexed field. The
+  // others are checked for every message. Returns 0 if no field is indexed.
+  int indexed_count() const {
+    return static_cast<int>(filters_.size() - unindexed_.size());
+  }
+
+ private:
+  friend class FirstMatchIndexBuilder;
+
+  FirstMatchIndex() = default;
+
+  // Returns the conditions mapped to the value of the indexed field in
+  // @message. Returns nullptr if the field is not set, or no condition is
+  // mapped to the value.
+  const std::vector<int>* FindCandidates(
+      const google::protobuf::Message& message) const;
+
+  std::vector<std::unique_ptr<FieldFilter>> filters_;
+  // The indexes of the conditions not requiring any value of the indexed
+  // field, in ascending order.
+  std::vector<int> unindexed_;
+
+  // The indexed field. nullptr when no field is indexed.
+  std::shared_ptr<const FieldPath> field_path_;
+  // Reads the indexed field without reflection when not nullptr.
+  const FieldAccessor* accessor_ = nullptr;
+
+  // The conditions requiring each value of the indexed field, in ascending
+  // order. Integers, bools and enums are widened to 64 bits. Only the map of
+  // the type of the indexed field is used.
+  absl::flat_hash_map<int64_t, std::vector<int>> signed_index_;
+  absl::flat_hash_map<uint64_t, std::vector<int>> unsigned_index_;
+  absl::flat_hash_map<std::string, std::vector<int>> string_index_;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_FIRST_MATCH_INDEX_H_
@@ -22,11 +22,13 @@
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
 #include "common_cpp/macros/macros.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/message.h"
 #include "wfa/virtual_people/common/field_filter.pb.h"
 #include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
 #include "wfa/virtual_people/common/field_filter/utils/field_util.h"
 #include "wfa/virtual_people/common/field_filter/utils/integer_comparator.h"
 
@@ -47,12 +49,11 @@ absl::StatusOr<std::unique_ptr<GtFilter>> GtFilter::New(
     return absl::InvalidArgumentError(absl::StrCat(
         "Value must be set. Input FieldFilterProto: ", config.DebugString()));
   }
-  ASSIGN_OR_RETURN(
-      std::vector<const google::protobuf::FieldDescriptor*> field_descriptors,
-      GetFieldFromProto(descriptor, config.name()));
+  ASSIGN_OR_RETURN(std::shared_ptr<const FieldPath> field_path,
+                   GetFieldPathFromProto(descriptor, config.name()));
   ASSIGN_OR_RETURN(
       std::unique_ptr<IntegerComparator> comparator,
-      IntegerComparator::New(std::move(field_descriptors), config.value()));
+      IntegerComparator::New(std::move(field_path), config.value()));
   return absl::make_unique<GtFilter>(std::move(comparator));
 }
 
@@ -60,4 +61,16 @@ bool GtFilter::IsMatch(const google::protobuf::Message& message) const {
   return comparator_->Compare(message) == IntegerCompareResult::GREATER_THAN;
 }
 
+void GtFilter::MatchSelected(
+    absl::Span<const google::protobuf::Message* const> messages,
+    absl::Span<const int> selection, std::vector<bool>* matches) const {
+  comparator_->CompareSelected(messages, selection,
+                               IntegerCompareResult::GREATER_THAN, matches);
+}
+
+void GtFilter::AppendReferencedFields(
+    std::vector<ReferencedField>* fields) const {
+  fields->push_back({comparator_->field_path(), /*reads_value=*/true});
+}
+
 }  // namespace wfa_virtual_people
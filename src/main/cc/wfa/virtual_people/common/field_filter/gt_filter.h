@@ -17,8 +17,10 @@
 
 #include <memory>
 #include <utility>
+#include <vector>
 
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/message.h"
 #include "wfa/virtual_people/common/field_filter.pb.h"
@@ -57,6 +59,14 @@ class GtFilter : public FieldFilter {
   // Returns false if the field is not set.
   bool IsMatch(const google::protobuf::Message& message) const override;
 
+  void MatchSelected(
+      absl::Span<const google::protobuf::Message* const> messages,
+      absl::Span<const int> selection,
+      std::vector<bool>* matches) const override;
+
+  void AppendReferencedFields(
+      std::vector<ReferencedField>* fields) const override;
+
  private:
   std::unique_ptr<IntegerComparator> comparator_;
 };
@@ -21,11 +21,13 @@
 #include "absl/memory/memory.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
 #include "common_cpp/macros/macros.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/message.h"
 #include "wfa/virtual_people/common/field_filter.pb.h"
 #include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
 #include "wfa/virtual_people/common/field_filter/utils/field_util.h"
 
 namespace wfa_virtual_people {
@@ -42,21 +44,36 @@ absl::StatusOr<std::unique_ptr<HasFilter>> HasFilter::New(
         "Name must be set. Input FieldFilterProto: ", config.DebugString()));
   }
 
-  ASSIGN_OR_RETURN(
-      std::vector<const google::protobuf::FieldDescriptor*> field_descriptors,
-      GetFieldFromProto(descriptor, config.name(),
-                        /* allow_repeated = */ true));
-  return absl::make_unique<HasFilter>(std::move(field_descriptors));
+  ASSIGN_OR_RETURN(std::shared_ptr<const FieldPath> field_path,
+                   GetFieldPathFromProto(descriptor, config.name(),
+                                         /* allow_repeated = */ true));
+  return absl::make_unique<HasFilter>(std::move(field_path));
 }
 
 bool HasFilter::IsMatch(const google::protobuf::Message& message) const {
+  if (has_ != nullptr) {
+    return has_(message);
+  }
   const google::protobuf::Message& parent =
-      GetParentMessageFromProto(message, field_descriptors_);
-  const google::protobuf::FieldDescriptor* field = field_descriptors_.back();
+      GetParentMessageFromProto(message, *field_path_);
+  const google::protobuf::FieldDescriptor* field = field_path_->back();
   if (field->is_repeated()) {
     return parent.GetReflection()->FieldSize(parent, field) > 0;
   }
   return parent.GetReflection()->HasField(parent, field);
 }
 
+void HasFilter::MatchSelected(
+    absl::Span<const google::protobuf::Message* const> messages,
+    absl::Span<const int> selection, std::vector<bool>* matches) const {
+  for (int i : selection) {
+    (*matches)[i] = HasFilter::IsMatch(*messages[i]);
+  }
+}
+
+void HasFilter::AppendReferencedFields(
+    std::vector<ReferencedField>* fields) const {
+  fields->push_back({field_path_, /*reads_value=*/false});
+}
+
 }  // namespace wfa_virtual_people
@@ -20,10 +20,13 @@
 #include <vector>
 
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/message.h"
 #include "wfa/virtual_people/common/field_filter.pb.h"
 #include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_accessor.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
 
 namespace wfa_virtual_people {
 
@@ -42,9 +45,11 @@ class HasFilter : public FieldFilter {
       const google::protobuf::Descriptor* descriptor,
       const FieldFilterProto& config);
 
-  explicit HasFilter(
-      std::vector<const google::protobuf::FieldDescriptor*>&& field_descriptors)
-      : field_descriptors_(std::move(field_descriptors)) {}
+  explicit HasFilter(std::shared_ptr<const FieldPath> field_path)
+      : field_path_(std::move(field_path)) {
+    const FieldAccessor* accessor = FindFieldAccessor(*field_path_);
+    has_ = accessor == nullptr ? nullptr : accessor->has;
+  }
 
   HasFilter(const HasFilter&) = delete;
   HasFilter& operator=(const HasFilter&) = delete;
@@ -54,8 +59,18 @@ class HasFilter : public FieldFilter {
   // * The field is repeated, and is not empty in @message.
   bool IsMatch(const google::protobuf::Message& message) const override;
 
+  void MatchSelected(
+      absl::Span<const google::protobuf::Message* const> messages,
+      absl::Span<const int> selection,
+      std::vector<bool>* matches) const override;
+
+  void AppendReferencedFields(
+      std::vector<ReferencedField>* fields) const override;
+
  private:
-  std::vector<const google::protobuf::FieldDescriptor*> field_descriptors_;
+  std::shared_ptr<const FieldPath> field_path_;
+  // Reads the field without protobuf reflection when not nullptr.
+  bool (*has_)(const google::protobuf::Message& message);
 };
 
 }  // namespace wfa_virtual_people
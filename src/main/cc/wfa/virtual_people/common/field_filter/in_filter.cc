@@ -19,18 +19,21 @@
 #include <utility>
 #include <vector>
 
-#include "absl/container/flat_hash_set.h"
 #include "absl/memory/memory.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "common_cpp/macros/macros.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/message.h"
 #include "wfa/virtual_people/common/field_filter.pb.h"
 #include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_accessor.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
 #include "wfa/virtual_people/common/field_filter/utils/field_util.h"
+#include "wfa/virtual_people/common/field_filter/utils/value_set.h"
 #include "wfa/virtual_people/common/field_filter/utils/values_parser.h"
 
 namespace wfa_virtual_people {
@@ -38,7 +41,7 @@ namespace wfa_virtual_people {
 namespace {
 
 // The implementation of InFilter based on the type of field represented by
-// @field_descriptors. The supported ValueTypes are
+// @field_path. The supported ValueTypes are
 //   int32_t
 //   int64_t
 //   uint32_t
@@ -50,61 +53,87 @@ template <typename ValueType>
 class InFilterImpl : public InFilter {
  public:
   explicit InFilterImpl(
-      std::vector<const google::protobuf::FieldDescriptor*>&& field_descriptors,
-      ParsedValues<ValueType>&& parsed_values)
-      : InFilter(std::move(field_descriptors)),
-        parsed_values_(std::move(parsed_values)) {}
+      std::shared_ptr<const FieldPath> field_path,
+      ParsedValueSet<ValueType> values)
+      : InFilter(std::move(field_path)),
+        values_(std::move(values)),
+        getter_(GetFieldGetter<AccessorValueType<ValueType>>(
+            FindFieldAccessor(*field_path_))) {}
 
   bool IsMatch(const google::protobuf::Message& message) const override;
 
+  void MatchSelected(
+      absl::Span<const google::protobuf::Message* const> messages,
+      absl::Span<const int> selection,
+      std::vector<bool>* matches) const override;
+
  private:
-  ParsedValues<ValueType> parsed_values_;
+  // The representation is picked from the size and the density of the
+  // values.
+  ParsedValueSet<ValueType> values_;
+  FieldGetter<AccessorValueType<ValueType>> getter_;
 };
 
 template <typename ValueType>
 bool InFilterImpl<ValueType>::IsMatch(
     const google::protobuf::Message& message) const {
   ProtoFieldValue<ValueType> proto_field_value =
-      GetValueFromProto<ValueType>(message, field_descriptors_);
-  return (proto_field_value.is_set &&
-          parsed_values_.values.find(proto_field_value.value) !=
-              parsed_values_.values.end());
+      GetValueFromProto<ValueType>(message, *field_path_, getter_);
+  return proto_field_value.is_set && values_.contains(proto_field_value.value);
 }
 
 template <>
 bool InFilterImpl<const google::protobuf::EnumValueDescriptor*>::IsMatch(
     const google::protobuf::Message& message) const {
+  if (getter_ != nullptr) {
+    ProtoFieldValue<int32_t> proto_field_value = getter_(message);
+    return proto_field_value.is_set &&
+           values_.contains(proto_field_value.value);
+  }
   ProtoFieldValue<const google::protobuf::EnumValueDescriptor*>
       proto_field_value =
           GetValueFromProto<const google::protobuf::EnumValueDescriptor*>(
-              message, field_descriptors_);
-  return (proto_field_value.is_set &&
-          parsed_values_.values.find(proto_field_value.value->number()) !=
-              parsed_values_.values.end());
+              message, *field_path_);
+  return proto_field_value.is_set &&
+         values_.contains(proto_field_value.value->number());
 }
 
 template <typename ValueType>
-absl::StatusOr<std::unique_ptr<InFilterImpl<ValueType>>> CreateFilter(
-    std::vector<const google::protobuf::FieldDescriptor*>&& field_descriptors,
-    absl::string_view values_str) {
-  ASSIGN_OR_RETURN(ParsedValues<ValueType> parsed_values,
-                   ParseValues<ValueType>(values_str));
-  return absl::make_unique<InFilterImpl<ValueType>>(
-      std::move(field_descriptors), std::move(parsed_values));
+void InFilterImpl<ValueType>::MatchSelected(
+    absl::Span<const google::protobuf::Message* const> messages,
+    absl::Span<const int> selection, std::vector<bool>* matches) const {
+  MatchSelectedValues<ValueType>(
+      messages, selection, *field_path_, getter_,
+      [this](const ProtoFieldValue<ValueType>& field_value) {
+        return field_value.is_set && values_.contains(field_value.value);
+      },
+      matches);
 }
 
 template <>
-absl::StatusOr<
-    std::unique_ptr<InFilterImpl<const google::protobuf::EnumValueDescriptor*>>>
-CreateFilter(
-    std::vector<const google::protobuf::FieldDescriptor*>&& field_descriptors,
-    absl::string_view values_str) {
+void InFilterImpl<const google::protobuf::EnumValueDescriptor*>::MatchSelected(
+    absl::Span<const google::protobuf::Message* const> messages,
+    absl::Span<const int> selection, std::vector<bool>* matches) const {
+  MatchSelectedValues<const google::protobuf::EnumValueDescriptor*>(
+      messages, selection, *field_path_, getter_,
+      [this](const auto& field_value) {
+        return field_value.is_set &&
+               values_.contains(GetEnumNumber(field_value.value));
+      },
+      matches);
+}
+
+template <typename ValueType>
+absl::StatusOr<std::unique_ptr<InFilterImpl<ValueType>>> CreateFilter(
+    std::shared_ptr<const FieldPath> field_path,
+    const FieldFilterProto& config) {
   ASSIGN_OR_RETURN(
-      ParsedValues<const google::protobuf::EnumValueDescriptor*> parsed_values,
-      ParseEnumValues(field_descriptors.back()->enum_type(), values_str));
-  return absl::make_unique<
-      InFilterImpl<const google::protobuf::EnumValueDescriptor*>>(
-      std::move(field_descriptors), std::move(parsed_values));
+      ParsedValueSet<ValueType> values,
+      config.has_value_file()
+          ? OpenValueSetFile<ValueType>(config.value_file())
+          : ParseValueSet<ValueType>(field_path->back(), config.value()));
+  return absl::make_unique<InFilterImpl<ValueType>>(std::move(field_path),
+                                                    std::move(values));
 }
 
 }  // namespace
@@ -120,35 +149,31 @@ absl::StatusOr<std::unique_ptr<InFilter>> InFilter::New(
     return absl::InvalidArgumentError(absl::StrCat(
         "Name must be set. Input FieldFilterProto: ", config.DebugString()));
   }
-  if (!config.has_value()) {
-    return absl::InvalidArgumentError(absl::StrCat(
-        "Value must be set. Input FieldFilterProto: ", config.DebugString()));
+  if (config.has_value() == config.has_value_file()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Exactly one of value and value_file must be set. Input "
+                     "FieldFilterProto: ",
+                     config.DebugString()));
   }
-  ASSIGN_OR_RETURN(
-      std::vector<const google::protobuf::FieldDescriptor*> field_descriptors,
-      GetFieldFromProto(descriptor, config.name()));
+  ASSIGN_OR_RETURN(std::shared_ptr<const FieldPath> field_path,
+                   GetFieldPathFromProto(descriptor, config.name()));
 
-  switch (field_descriptors.back()->cpp_type()) {
+  switch (field_path->back()->cpp_type()) {
     case google::protobuf::FieldDescriptor::CppType::CPPTYPE_INT32:
-      return CreateFilter<int32_t>(std::move(field_descriptors),
-                                   config.value());
+      return CreateFilter<int32_t>(std::move(field_path), config);
     case google::protobuf::FieldDescriptor::CppType::CPPTYPE_INT64:
-      return CreateFilter<int64_t>(std::move(field_descriptors),
-                                   config.value());
+      return CreateFilter<int64_t>(std::move(field_path), config);
     case google::protobuf::FieldDescriptor::CppType::CPPTYPE_UINT32:
-      return CreateFilter<uint32_t>(std::move(field_descriptors),
-                                    config.value());
+      return CreateFilter<uint32_t>(std::move(field_path), config);
     case google::protobuf::FieldDescriptor::CppType::CPPTYPE_UINT64:
-      return CreateFilter<uint64_t>(std::move(field_descriptors),
-                                    config.value());
+      return CreateFilter<uint64_t>(std::move(field_path), config);
     case google::protobuf::FieldDescriptor::CppType::CPPTYPE_BOOL:
-      return CreateFilter<bool>(std::move(field_descriptors), config.value());
+      return CreateFilter<bool>(std::move(field_path), config);
     case google::protobuf::FieldDescriptor::CppType::CPPTYPE_ENUM:
       return CreateFilter<const google::protobuf::EnumValueDescriptor*>(
-          std::move(field_descriptors), config.value());
+          std::move(field_path), config);
     case google::protobuf::FieldDescriptor::CppType::CPPTYPE_STRING:
-      return CreateFilter<const std::string&>(std::move(field_descriptors),
-                                              config.value());
+      return CreateFilter<const std::string&>(std::move(field_path), config);
     default:
       return absl::InvalidArgumentError(absl::StrCat(
           "Unsupported field type for IN filter. Input FieldFilterProto: ",
@@ -156,4 +181,9 @@ absl::StatusOr<std::unique_ptr<InFilter>> InFilter::New(
   }
 }
 
+void InFilter::AppendReferencedFields(
+    std::vector<ReferencedField>* fields) const {
+  fields->push_back({field_path_, /*reads_value=*/true});
+}
+
 }  // namespace wfa_virtual_people
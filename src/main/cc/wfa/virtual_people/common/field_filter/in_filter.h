@@ -24,6 +24,7 @@
 #include "google/protobuf/message.h"
 #include "wfa/virtual_people/common/field_filter.pb.h"
 #include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
 
 namespace wfa_virtual_people {
 
@@ -37,9 +38,11 @@ class InFilter : public FieldFilter {
   // * @config.op is not IN.
   // * @config.name is not set.
   // * Any field of the path represented by @config.name is repeated field.
-  // * @config.value is not set.
+  // * Both or neither of @config.value and @config.value_file are set.
   // * Any entry in @config.value (split by comma) cannot be casted to the type
   //   of the field represented by @config.name.
+  // * @config.value_file cannot be opened by ExternalValueSet::Open, or its
+  //   values are not of the type of the field represented by @config.name.
   static absl::StatusOr<std::unique_ptr<InFilter>> New(
       const google::protobuf::Descriptor* descriptor,
       const FieldFilterProto& config);
@@ -55,12 +58,14 @@ class InFilter : public FieldFilter {
   // Returns false if the field is not set.
   bool IsMatch(const google::protobuf::Message& message) const override = 0;
 
+  void AppendReferencedFields(
+      std::vector<ReferencedField>* fields) const override;
+
  protected:
-  InFilter(
-      std::vector<const google::protobuf::FieldDescriptor*>&& field_descriptors)
-      : field_descriptors_(std::move(field_descriptors)) {}
+  InFilter(std::shared_ptr<const FieldPath> field_path)
+      : field_path_(std::move(field_path)) {}
 
-  std::vector<const google::protobuf::FieldDescriptor*> field_descriptors_;
+  std::shared_ptr<const FieldPath> field_path_;
 };
 
 }  // namespace wfa_virtual_people
@@ -16,20 +16,23 @@
 
 #include <memory>
 #include <utility>
+#include <vector>
 
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
 #include "common_cpp/macros/macros.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/message.h"
 #include "wfa/virtual_people/common/field_filter.pb.h"
 #include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/field_filter_cache.h"
 
 namespace wfa_virtual_people {
 
 absl::StatusOr<std::unique_ptr<NotFilter>> NotFilter::New(
     const google::protobuf::Descriptor* descriptor,
-    const FieldFilterProto& config) {
+    const FieldFilterProto& config, const FieldFilterOptions& options) {
   if (config.op() != FieldFilterProto::NOT) {
     return absl::InvalidArgumentError(absl::StrCat(
         "Op must be NOT. Input FieldFilterProto: ", config.DebugString()));
@@ -42,8 +45,8 @@ absl::StatusOr<std::unique_ptr<NotFilter>> NotFilter::New(
 
   FieldFilterProto and_filter_config = config;
   and_filter_config.set_op(FieldFilterProto::AND);
-  ASSIGN_OR_RETURN(std::unique_ptr<FieldFilter> and_filter,
-                   FieldFilter::New(descriptor, and_filter_config));
+  ASSIGN_OR_RETURN(std::shared_ptr<const FieldFilter> and_filter,
+                   NewSubFilter(descriptor, and_filter_config, options));
 
   return absl::make_unique<NotFilter>(std::move(and_filter));
 }
@@ -52,4 +55,18 @@ bool NotFilter::IsMatch(const google::protobuf::Message& message) const {
   return !and_filter_->IsMatch(message);
 }
 
+void NotFilter::MatchSelected(
+    absl::Span<const google::protobuf::Message* const> messages,
+    absl::Span<const int> selection, std::vector<bool>* matches) const {
+  and_filter_->MatchSelected(messages, selection, matches);
+  for (int i : selection) {
+    (*matches)[i] = !(*matches)[i];
+  }
+}
+
+void NotFilter::AppendReferencedFields(
+    std::vector<ReferencedField>* fields) const {
+  and_filter_->AppendReferencedFields(fields);
+}
+
 }  // namespace wfa_virtual_people
@@ -17,8 +17,10 @@
 
 #include <memory>
 #include <utility>
+#include <vector>
 
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/message.h"
 #include "wfa/virtual_people/common/field_filter.pb.h"
@@ -38,9 +40,9 @@ class NotFilter : public FieldFilter {
   //    Any of @config.sub_filters is invalid to create a FieldFilter.
   static absl::StatusOr<std::unique_ptr<NotFilter>> New(
       const google::protobuf::Descriptor* descriptor,
-      const FieldFilterProto& config);
+      const FieldFilterProto& config, const FieldFilterOptions& options);
 
-  explicit NotFilter(std::unique_ptr<FieldFilter> and_filter)
+  explicit NotFilter(std::shared_ptr<const FieldFilter> and_filter)
       : and_filter_(std::move(and_filter)) {}
 
   NotFilter(const NotFilter&) = delete;
@@ -50,11 +52,20 @@ class NotFilter : public FieldFilter {
   // Otherwise, returns true.
   bool IsMatch(const google::protobuf::Message& message) const override;
 
+  void MatchSelected(
+      absl::Span<const google::protobuf::Message* const> messages,
+      absl::Span<const int> selection,
+      std::vector<bool>* matches) const override;
+
+  void AppendReferencedFields(
+      std::vector<ReferencedField>* fields) const override;
+
  private:
   // A field filter represents the AND of all the sub_filters.
   // The output of this NotFilter should be the reverse of the output of
   // and_filter_.
-  std::unique_ptr<FieldFilter> and_filter_;
+  // Shared with other filters when built with FieldFilterOptions.cache.
+  std::shared_ptr<const FieldFilter> and_filter_;
 };
 
 }  // namespace wfa_virtual_people
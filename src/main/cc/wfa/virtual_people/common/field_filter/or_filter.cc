@@ -14,23 +14,27 @@
 
 #include "wfa/virtual_people/common/field_filter/or_filter.h"
 
+#include <algorithm>
 #include <memory>
 #include <utility>
 #include <vector>
 
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
 #include "common_cpp/macros/macros.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/message.h"
 #include "wfa/virtual_people/common/field_filter.pb.h"
 #include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/field_filter_cache.h"
+#include "wfa/virtual_people/common/field_filter/utils/adaptive_order.h"
 
 namespace wfa_virtual_people {
 
 absl::StatusOr<std::unique_ptr<OrFilter>> OrFilter::New(
     const google::protobuf::Descriptor* descriptor,
-    const FieldFilterProto& config) {
+    const FieldFilterProto& config, const FieldFilterOptions& options) {
   if (config.op() != FieldFilterProto::OR) {
     return absl::InvalidArgumentError(absl::StrCat(
         "Op must be OR. Input FieldFilterProto: ", config.DebugString()));
@@ -41,17 +45,27 @@ absl::StatusOr<std::unique_ptr<OrFilter>> OrFilter::New(
         config.DebugString()));
   }
 
-  std::vector<std::unique_ptr<FieldFilter>> sub_filters;
+  std::vector<std::shared_ptr<const FieldFilter>> sub_filters;
   for (const FieldFilterProto& sub_filter_proto : config.sub_filters()) {
     sub_filters.emplace_back();
     ASSIGN_OR_RETURN(sub_filters.back(),
-                     FieldFilter::New(descriptor, sub_filter_proto));
+                     NewSubFilter(descriptor, sub_filter_proto, options));
   }
 
-  return absl::make_unique<OrFilter>(std::move(sub_filters));
+  std::unique_ptr<AdaptiveOrder> adaptive_order;
+  if (options.adaptive_order) {
+    adaptive_order = absl::make_unique<AdaptiveOrder>(
+        sub_filters.size(), /* decisive_result = */ true);
+  }
+  return absl::make_unique<OrFilter>(std::move(sub_filters),
+                                     std::move(adaptive_order));
 }
 
 bool OrFilter::IsMatch(const google::protobuf::Message& message) const {
+  if (adaptive_order_ != nullptr) {
+    return adaptive_order_->Evaluate(
+        [this, &message](int i) { return sub_filters_[i]->IsMatch(message); });
+  }
   for (auto& filter : sub_filters_) {
     if (filter->IsMatch(message)) {
       return true;
@@ -60,4 +74,36 @@ bool OrFilter::IsMatch(const google::protobuf::Message& message) const {
   return false;
 }
 
+void OrFilter::MatchSelected(
+    absl::Span<const google::protobuf::Message* const> messages,
+    absl::Span<const int> selection, std::vector<bool>* matches) const {
+  if (adaptive_order_ != nullptr) {
+    adaptive_order_->EvaluateSelected(
+        selection, matches,
+        [this, messages](int i, absl::Span<const int> rows,
+                         std::vector<bool>* sub_matches) {
+          sub_filters_[i]->MatchSelected(messages, rows, sub_matches);
+        });
+    return;
+  }
+  // The rows that failed all the sub filters applied so far.
+  std::vector<int> undecided(selection.begin(), selection.end());
+  for (auto& filter : sub_filters_) {
+    filter->MatchSelected(messages, undecided, matches);
+    undecided.erase(std::remove_if(undecided.begin(), undecided.end(),
+                                   [matches](int i) { return (*matches)[i]; }),
+                    undecided.end());
+    if (undecided.empty()) {
+      return;
+    }
+  }
+}
+
+void OrFilter::AppendReferencedFields(
+    std::vector<ReferencedField>* fields) const {
+  for (const auto& filter : sub_filters_) {
+    filter->AppendReferencedFields(fields);
+  }
+}
+
 }  // namespace wfa_virtual_people
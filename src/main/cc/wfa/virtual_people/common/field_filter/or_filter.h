@@ -20,10 +20,12 @@
 #include <vector>
 
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/message.h"
 #include "wfa/virtual_people/common/field_filter.pb.h"
 #include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/adaptive_order.h"
 
 namespace wfa_virtual_people {
 
@@ -39,10 +41,14 @@ class OrFilter : public FieldFilter {
   //    Any of @config.sub_filters is invalid to create a FieldFilter.
   static absl::StatusOr<std::unique_ptr<OrFilter>> New(
       const google::protobuf::Descriptor* descriptor,
-      const FieldFilterProto& config);
+      const FieldFilterProto& config, const FieldFilterOptions& options);
 
-  explicit OrFilter(std::vector<std::unique_ptr<FieldFilter>>&& sub_filters)
-      : sub_filters_(std::move(sub_filters)) {}
+  // @adaptive_order is nullptr when the sub filters are always applied in
+  // order.
+  OrFilter(std::vector<std::shared_ptr<const FieldFilter>>&& sub_filters,
+           std::unique_ptr<AdaptiveOrder> adaptive_order)
+      : sub_filters_(std::move(sub_filters)),
+        adaptive_order_(std::move(adaptive_order)) {}
 
   OrFilter(const OrFilter&) = delete;
   OrFilter& operator=(const OrFilter&) = delete;
@@ -50,8 +56,21 @@ class OrFilter : public FieldFilter {
   // Returns true when any of the sub_filters passes. Otherwise, returns false.
   bool IsMatch(const google::protobuf::Message& message) const override;
 
+  // Sub filters are applied in order, or in the adaptive order when
+  // FieldFilterOptions.adaptive_order is set, and each sub filter is only
+  // applied to the rows that failed all the previous sub filters.
+  void MatchSelected(
+      absl::Span<const google::protobuf::Message* const> messages,
+      absl::Span<const int> selection,
+      std::vector<bool>* matches) const override;
+
+  void AppendReferencedFields(
+      std::vector<ReferencedField>* fields) const override;
+
  private:
-  std::vector<std::unique_ptr<FieldFilter>> sub_filters_;
+  // Shared with other filters when built with FieldFilterOptions.cache.
+  std::vector<std::shared_ptr<const FieldFilter>> sub_filters_;
+  std::unique_ptr<AdaptiveOrder> adaptive_order_;
 };
 
 }  // namespace wfa_virtual_people
@@ -0,0 +1,124 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/parallel_filter_runner.h"
+
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "google/protobuf/message.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+
+namespace wfa_virtual_people {
+
+absl::StatusOr<std::unique_ptr<ParallelFilterRunner>> ParallelFilterRunner::New(
+    std::vector<std::shared_ptr<const FieldFilter>> filters,
+    const ParallelFilterRunnerOptions& options) {
+  if (filters.empty()) {
+    return absl::InvalidArgumentError("At least one filter must be set.");
+  }
+  if (std::find(filters.begin(), filters.end(), nullptr) != filters.end()) {
+    return absl::InvalidArgumentError("The filters must not be null.");
+  }
+  if (options.thread_count < 0) {
+    return absl::InvalidArgumentError(
+        "The thread count must not be negative.");
+  }
+  if (options.chunk_size <= 0) {
+    return absl::InvalidArgumentError("The chunk size must be positive.");
+  }
+  int thread_count = options.thread_count;
+  if (thread_count == 0) {
+    // hardware_concurrency returns 0 when it is not known.
+    thread_count = std::max(1u, std::thread::hardware_concurrency());
+  }
+  return absl::WrapUnique(new ParallelFilterRunner(
+      std::move(filters), thread_count, options.chunk_size));
+}
+
+void ParallelFilterRunner::MatchBatch(
+    absl::Span<const google::protobuf::Message* const> messages,
+    std::vector<std::vector<bool>>* matches) const {
+  const int message_count = static_cast<int>(messages.size());
+  // The results of each chunk, which are written by one thread.
+  std::vector<std::vector<std::vector<bool>>> chunk_matches(
+      GetChunkCount(message_count),
+      std::vector<std::vector<bool>>(filters_.size()));
+  pool_->Run(chunk_matches.size(), [&](int chunk_index) {
+    absl::Span<const google::protobuf::Message* const> chunk =
+        messages.subspan(chunk_index * chunk_size_, chunk_size_);
+    for (int i = 0; i < static_cast<int>(filters_.size()); ++i) {
+      filters_[i]->MatchBatch(chunk, &chunk_matches[chunk_index][i]);
+    }
+  });
+
+  matches->resize(filters_.size());
+  for (int i = 0; i < static_cast<int>(filters_.size()); ++i) {
+    std::vector<bool>& filter_matches = (*matches)[i];
+    filter_matches.clear();
+    filter_matches.reserve(message_count);
+    for (const std::vector<std::vector<bool>>& chunk : chunk_matches) {
+      filter_matches.insert(filter_matches.end(), chunk[i].begin(),
+                            chunk[i].end());
+    }
+  }
+}
+
+std::vector<int> ParallelFilterRunner::Select(
+    absl::Span<const google::protobuf::Message* const> messages) const {
+  const int message_count = static_cast<int>(messages.size());
+  // The indexes of the messages selected in each chunk.
+  std::vector<std::vector<int>> chunk_selections(GetChunkCount(message_count));
+  pool_->Run(chunk_selections.size(), [&](int chunk_index) {
+    const int begin = chunk_index * chunk_size_;
+    absl::Span<const google::protobuf::Message* const> chunk =
+        messages.subspan(begin, chunk_size_);
+    std::vector<bool> matched(chunk.size(), false);
+    // The messages of the chunk not matched by any filter so far.
+    std::vector<int> undecided(chunk.size());
+    std::iota(undecided.begin(), undecided.end(), 0);
+    for (const std::shared_ptr<const FieldFilter>& filter : filters_) {
+      filter->MatchSelected(chunk, undecided, &matched);
+      undecided.erase(
+          std::remove_if(undecided.begin(), undecided.end(),
+                         [&matched](int index) { return matched[index]; }),
+          undecided.end());
+      if (undecided.empty()) {
+        break;
+      }
+    }
+    for (int i = 0; i < static_cast<int>(chunk.size()); ++i) {
+      if (matched[i]) {
+        chunk_selections[chunk_index].push_back(begin + i);
+      }
+    }
+  });
+
+  std::vector<int> selection;
+  for (const std::vector<int>& chunk_selection : chunk_selections) {
+    selection.insert(selection.end(), chunk_selection.begin(),
+                     chunk_selection.end());
+  }
+  return selection;
+}
+
+}  // namespace wfa_virtual_people
@@ -0,0 +1,104 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_PARALLEL_FILTER_RUNNER_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_PARALLEL_FILTER_RUNNER_H_
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "google/protobuf/message.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/work_stealing_pool.h"
+
+namespace wfa_virtual_people {
+
+// The options to build a ParallelFilterRunner.
+struct ParallelFilterRunnerOptions {
+  // The number of threads evaluating the filters, including the thread
+  // calling the runner. When 0, the number of hardware threads is used.
+  int thread_count = 0;
+
+  // The number of consecutive messages in one task. Each task evaluates the
+  // filters on its messages with FieldFilter::MatchBatch.
+  int chunk_size = 1024;
+};
+
+// Evaluates FieldFilters on large batches of messages with a pool of threads.
+//
+// The messages are split into chunks of consecutive messages, which are run
+// by the threads of a WorkStealingPool. The results are written in the order
+// of the messages, so they are the same as evaluating the filters one message
+// at a time, whatever the number of threads.
+//
+// Example:
+//   ParallelFilterRunnerOptions options;
+//   options.thread_count = 64;
+//   ASSIGN_OR_RETURN(std::unique_ptr<ParallelFilterRunner> runner,
+//                    ParallelFilterRunner::New({filter}, options));
+//   std::vector<int> selected = runner->Select(events);
+//
+// This class is thread-safe. Concurrent calls share the threads.
+class ParallelFilterRunner {
+ public:
+  // Returns error status if any of the following happens:
+  //   @filters is empty, or any of @filters is nullptr.
+  //   @options.thread_count is negative.
+  //   @options.chunk_size is not positive.
+  static absl::StatusOr<std::unique_ptr<ParallelFilterRunner>> New(
+      std::vector<std::shared_ptr<const FieldFilter>> filters,
+      const ParallelFilterRunnerOptions& options =
+          ParallelFilterRunnerOptions());
+
+  ParallelFilterRunner(const ParallelFilterRunner&) = delete;
+  ParallelFilterRunner& operator=(const ParallelFilterRunner&) = delete;
+
+  // Evaluates all the filters against all the @messages. @matches is resized
+  // to the number of filters, and (*matches)[f][i] is set to the result of
+  // IsMatch(*messages[i]) of the filter at index f.
+  void MatchBatch(absl::Span<const google::protobuf::Message* const> messages,
+                  std::vector<std::vector<bool>>* matches) const;
+
+  // Returns the indexes of the @messages matching any of the filters, in
+  // ascending order. The filters after the first match of a message are not
+  // evaluated on it.
+  std::vector<int> Select(
+      absl::Span<const google::protobuf::Message* const> messages) const;
+
+  // The number of threads evaluating the filters.
+  int thread_count() const { return pool_->thread_count(); }
+
+ private:
+  ParallelFilterRunner(std::vector<std::shared_ptr<const FieldFilter>> filters,
+                       int thread_count, int chunk_size)
+      : filters_(std::move(filters)),
+        chunk_size_(chunk_size),
+        pool_(std::make_unique<WorkStealingPool>(thread_count)) {}
+
+  // Returns the number of chunks of @message_count messages.
+  int GetChunkCount(int message_count) const {
+    return (message_count + chunk_size_ - 1) / chunk_size_;
+  }
+
+  std::vector<std::shared_ptr<const FieldFilter>> filters_;
+  int chunk_size_;
+  std::unique_ptr<WorkStealingPool> pool_;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_PARALLEL_FILTER_RUNNER_H_
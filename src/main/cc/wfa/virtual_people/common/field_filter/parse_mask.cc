@@ -0,0 +1,328 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/parse_mask.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/container/inlined_vector.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "common_cpp/macros/macros.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/field_mask.pb.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/message.h"
+#include "google/protobuf/unknown_field_set.h"
+#include "google/protobuf/wire_format_lite.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+using ::google::protobuf::internal::WireFormatLite;
+
+void AppendVarint32(uint32_t value, std::string& output) {
+  while (value >= 0x80) {
+    output.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  output.push_back(static_cast<char>(value));
+}
+
+}  // namespace
+
+ParseMask::ParseMask(const google::protobuf::Descriptor* descriptor)
+    : descriptor_(descriptor), nodes_(1) {
+  prototype_ =
+      google::protobuf::MessageFactory::generated_factory()->GetPrototype(
+          descriptor);
+  if (prototype_ == nullptr) {
+    prototype_ = dynamic_factory_.GetPrototype(descriptor);
+  }
+}
+
+absl::StatusOr<std::unique_ptr<ParseMask>> ParseMask::New(
+    const google::protobuf::Descriptor* descriptor,
+    absl::Span<const FieldFilterProto> configs) {
+  auto mask = absl::WrapUnique(new ParseMask(descriptor));
+  for (const FieldFilterProto& config : configs) {
+    ASSIGN_OR_RETURN(std::unique_ptr<FieldFilter> filter,
+                     FieldFilter::New(descriptor, config));
+    // Message fields only checked to be set, like the ones entered by
+    // PARTIAL, are kept with only the sub fields in the mask.
+    for (const ReferencedField& field : filter->GetReferencedFields()) {
+      mask->AddPath(*field.field_path,
+                    field.reads_value ||
+                        field.field_path->back()->cpp_type() !=
+                            google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE);
+    }
+  }
+  mask->FindMergedFields(0, descriptor);
+  return mask;
+}
+
+absl::StatusOr<std::unique_ptr<ParseMask>> ParseMask::New(
+    const google::protobuf::Descriptor* descriptor,
+    const google::protobuf::FieldMask& field_mask) {
+  auto mask = absl::WrapUnique(new ParseMask(descriptor));
+  for (const std::string& path : field_mask.paths()) {
+    ASSIGN_OR_RETURN(std::shared_ptr<const FieldPath> field_path,
+                     InternFieldPath(descriptor, path));
+    mask->AddPath(*field_path, /*whole=*/true);
+  }
+  mask->FindMergedFields(0, descriptor);
+  return mask;
+}
+
+void ParseMask::AddPath(const FieldPath& field_path, bool whole) {
+  int node = 0;
+  for (int i = 0; i < static_cast<int>(field_path.size()); ++i) {
+    const int number = field_path[i]->number();
+    const google::protobuf::OneofDescriptor* oneof =
+        field_path[i]->real_containing_oneof();
+    if (oneof != nullptr) {
+      for (int j = 0; j < oneof->field_count(); ++j) {
+        nodes_[node].oneofs[oneof->field(j)->number()] = oneof->index();
+      }
+    }
+    auto it = nodes_[node].fields.find(number);
+    if (it != nodes_[node].fields.end() && it->second == kWholeField) {
+      return;
+    }
+    if (whole && i == static_cast<int>(field_path.size()) - 1) {
+      nodes_[node].fields[number] = kWholeField;
+      return;
+    }
+    if (it != nodes_[node].fields.end()) {
+      node = it->second;
+      continue;
+    }
+    const int32_t child = static_cast<int32_t>(nodes_.size());
+    nodes_[node].fields[number] = child;
+    nodes_.emplace_back();
+    node = child;
+  }
+}
+
+bool ParseMask::FindMergedFields(
+    int node, const google::protobuf::Descriptor* descriptor) {
+  bool has_oneofs = !nodes_[node].oneofs.empty();
+  for (const auto& [number, child] : nodes_[node].fields) {
+    if (child == kWholeField) {
+      continue;
+    }
+    const google::protobuf::FieldDescriptor* field =
+        descriptor->FindFieldByNumber(number);
+    if (!FindMergedFields(child, field->message_type())) {
+      continue;
+    }
+    has_oneofs = true;
+    // The elements of repeated fields are never merged.
+    if (!field->is_repeated()) {
+      nodes_[node].merged_fields.insert(number);
+    }
+  }
+  return has_oneofs;
+}
+
+absl::Status ParseMask::Parse(absl::string_view serialized,
+                              google::protobuf::Message* message) const {
+  // Reused by the calls in each thread, so that the filtered bytes are not
+  // allocated for each message.
+  thread_local std::string filtered;
+  filtered.clear();
+  bool full_parse = false;
+  bool ok = FilterMessage(serialized, 0, filtered, full_parse);
+  if (ok && full_parse) {
+    ok = message->ParsePartialFromArray(serialized.data(),
+                                        static_cast<int>(serialized.size()));
+    if (ok) {
+      ClearUnmaskedFields(0, *message);
+    }
+  } else if (ok) {
+    ok = message->ParsePartialFromArray(filtered.data(),
+                                        static_cast<int>(filtered.size()));
+  }
+  if (!ok) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "The serialized bytes are not a valid ", descriptor_->full_name()));
+  }
+  return absl::OkStatus();
+}
+
+bool ParseMask::Filter(absl::string_view serialized,
+                       std::string* output) const {
+  output->clear();
+  bool full_parse = false;
+  if (!FilterMessage(serialized, 0, *output, full_parse)) {
+    return false;
+  }
+  if (!full_parse) {
+    return true;
+  }
+  std::unique_ptr<google::protobuf::Message> message(prototype_->New());
+  if (!message->ParsePartialFromArray(serialized.data(),
+                                      static_cast<int>(serialized.size()))) {
+    return false;
+  }
+  ClearUnmaskedFields(0, *message);
+  output->clear();
+  return message->SerializePartialToString(output);
+}
+
+void ParseMask::ClearUnmaskedFields(int node,
+                                    google::protobuf::Message& message) const {
+  const Node& mask = nodes_[node];
+  const google::protobuf::Reflection* reflection = message.GetReflection();
+  std::vector<const google::protobuf::FieldDescriptor*> fields;
+  reflection->ListFields(message, &fields);
+  for (const google::protobuf::FieldDescriptor* field : fields) {
+    auto it = mask.fields.find(field->number());
+    if (field->is_extension() || it == mask.fields.end()) {
+      reflection->ClearField(&message, field);
+    } else if (it->second == kWholeField) {
+      continue;
+    } else if (field->is_repeated()) {
+      for (int i = 0; i < reflection->FieldSize(message, field); ++i) {
+        ClearUnmaskedFields(
+            it->second, *reflection->MutableRepeatedMessage(&message, field, i));
+      }
+    } else {
+      ClearUnmaskedFields(it->second,
+                          *reflection->MutableMessage(&message, field));
+    }
+  }
+  reflection->MutableUnknownFields(&message)->Clear();
+}
+
+bool ParseMask::FilterMessage(absl::string_view serialized, int node,
+                              std::string& output, bool& full_parse) const {
+  const Node& mask = nodes_[node];
+  // The fields written to @output which are members of a oneof.
+  struct OneofMember {
+    int oneof;
+    size_t begin;
+    size_t end;
+    bool cleared;
+  };
+  absl::InlinedVector<OneofMember, 4> oneof_members;
+  // The fields in @mask.merged_fields read so far.
+  absl::InlinedVector<int, 4> merged_fields;
+  google::protobuf::io::CodedInputStream input(
+      reinterpret_cast<const uint8_t*>(serialized.data()),
+      static_cast<int>(serialized.size()));
+  while (true) {
+    const int begin = input.CurrentPosition();
+    const uint32_t tag = input.ReadTag();
+    if (tag == 0) {
+      // 0 is returned at the end of the input, and for invalid tags.
+      if (input.CurrentPosition() != static_cast<int>(serialized.size())) {
+        return false;
+      }
+      break;
+    }
+    const int number = WireFormatLite::GetTagFieldNumber(tag);
+    auto oneof_it = mask.oneofs.find(number);
+    const size_t output_begin = output.size();
+    auto it = mask.fields.find(number);
+    if (it == mask.fields.end() || it->second == kWholeField ||
+        WireFormatLite::GetTagWireType(tag) !=
+            WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      if (!WireFormatLite::SkipField(&input, tag)) {
+        return false;
+      }
+      // Fields kept as a whole are copied without being decoded. The parser
+      // rejects messages with the wrong wire type, the same as without the
+      // mask.
+      if (it != mask.fields.end()) {
+        output.append(serialized.data() + begin,
+                      input.CurrentPosition() - begin);
+      }
+    } else {
+      // A message containing fields of the mask, which is filtered
+      // recursively into @output, after its tag. The length is inserted
+      // before it once known.
+      if (mask.merged_fields.contains(number)) {
+        if (absl::c_linear_search(merged_fields, number)) {
+          full_parse = true;
+          return true;
+        }
+        merged_fields.push_back(number);
+      }
+      const int tag_end = input.CurrentPosition();
+      uint32_t length;
+      if (!input.ReadVarint32(&length) ||
+          length > static_cast<uint32_t>(std::numeric_limits<int>::max())) {
+        return false;
+      }
+      const int value_begin = input.CurrentPosition();
+      if (!input.Skip(static_cast<int>(length))) {
+        return false;
+      }
+      output.append(serialized.data() + begin, tag_end - begin);
+      const size_t sub_message_begin = output.size();
+      if (!FilterMessage(serialized.substr(value_begin, length), it->second,
+                         output, full_parse)) {
+        return false;
+      }
+      if (full_parse) {
+        return true;
+      }
+      std::string length_bytes;
+      AppendVarint32(static_cast<uint32_t>(output.size() - sub_message_begin),
+                     length_bytes);
+      output.insert(sub_message_begin, length_bytes);
+    }
+
+    if (oneof_it == mask.oneofs.end()) {
+      continue;
+    }
+    if (it != mask.fields.end()) {
+      oneof_members.push_back(
+          {oneof_it->second, output_begin, output.size(), false});
+      continue;
+    }
+    // A member not in the mask clears the members of the same oneof before
+    // it, so they are removed from @output.
+    for (OneofMember& member : oneof_members) {
+      member.cleared |= member.oneof == oneof_it->second;
+    }
+  }
+
+  // The members are in the order of @output, so the later ones are removed
+  // first.
+  for (auto member = oneof_members.rbegin(); member != oneof_members.rend();
+       ++member) {
+    if (member->cleared) {
+      output.erase(member->begin, member->end - member->begin);
+    }
+  }
+  return true;
+}
+
+}  // namespace wfa_virtual_people
@@ -0,0 +1,152 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_PARSE_MASK_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_PARSE_MASK_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/field_mask.pb.h"
+#include "google/protobuf/message.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
+
+namespace wfa_virtual_people {
+
+// A set of field paths in a message type, used to parse only these fields out
+// of serialized messages.
+//
+// Pre-filtering stages only read the fields referenced by their filters, like
+// labeler_input.geo and acting_demo of a large LabelerEvent. Parsing with the
+// mask of these fields materializes only them, and skips all the other fields
+// without allocating them.
+//
+// Example:
+//   ASSIGN_OR_RETURN(std::unique_ptr<ParseMask> mask,
+//                    ParseMask::New(LabelerEvent().GetDescriptor(), filters));
+//   LabelerEvent event;
+//   RETURN_IF_ERROR(mask->Parse(serialized_event, &event));
+//
+// This class is thread-safe.
+class ParseMask {
+ public:
+  // Returns the mask of all the fields referenced by @configs, including the
+  // fields inside PARTIAL. Evaluating any of @configs on a message parsed with
+  // the mask gives the same result as on the fully parsed message.
+  //
+  // Returns error status if any of @configs is invalid to create a
+  // FieldFilter with FieldFilter::New.
+  static absl::StatusOr<std::unique_ptr<ParseMask>> New(
+      const google::protobuf::Descriptor* descriptor,
+      absl::Span<const FieldFilterProto> configs);
+
+  // Returns the mask of the paths in @field_mask. A path can go through
+  // repeated message fields, in which case the sub fields are kept in each
+  // element.
+  //
+  // Returns error status if any path in @field_mask does not refer to a field
+  // in @descriptor.
+  static absl::StatusOr<std::unique_ptr<ParseMask>> New(
+      const google::protobuf::Descriptor* descriptor,
+      const google::protobuf::FieldMask& field_mask);
+
+  ParseMask(const ParseMask&) = delete;
+  ParseMask& operator=(const ParseMask&) = delete;
+
+  // Parses the fields of the mask in @serialized into @message. All the other
+  // fields of @message are cleared. The type of @message must be the
+  // descriptor used to build the mask.
+  //
+  // The result is the same as parsing @serialized with ParsePartialFromString,
+  // and then clearing the fields not in the mask.
+  //
+  // Returns error status if @serialized cannot be parsed as the message type.
+  // The fields not in the mask are skipped without being parsed, so errors
+  // inside them are not detected.
+  absl::Status Parse(absl::string_view serialized,
+                     google::protobuf::Message* message) const;
+
+  // Writes the fields of the mask in @serialized to @output, which is a
+  // serialized message of the same type. The fields are kept in the wire
+  // format, so no field is decoded except the messages containing fields of
+  // the mask.
+  //
+  // Returns false if @serialized is malformed.
+  bool Filter(absl::string_view serialized, std::string* output) const;
+
+ private:
+  // A node of the mask for a message type.
+  struct Node {
+    // Each field of the message type in the mask is mapped to the index of
+    // the node of its sub fields in the mask, or kWholeField if the whole
+    // field is in the mask.
+    absl::flat_hash_map<int, int32_t> fields;
+    // Maps each member of the oneofs with a member in the mask to the index
+    // of its oneof in the message type, since reading a member clears the
+    // other members read before, even when it is not in the mask.
+    absl::flat_hash_map<int, int> oneofs;
+    // The singular message fields in @fields, not kept as a whole, with oneof
+    // members in the mask under them. The parser merges all the occurrences
+    // of such a field, so a member in one occurrence can clear a member in
+    // another one, which filtering each occurrence separately does not see.
+    absl::flat_hash_set<int> merged_fields;
+  };
+
+  static constexpr int32_t kWholeField = -1;
+
+  explicit ParseMask(const google::protobuf::Descriptor* descriptor);
+
+  // Adds @field_path, starting from the message type of the mask, to the
+  // mask. If @whole is false, the field is a message which is kept with only
+  // the sub fields in the mask. Sub fields of a field already in the mask as
+  // a whole are ignored.
+  void AddPath(const FieldPath& field_path, bool whole);
+
+  // Fills Node::merged_fields of @node and the nodes under it. @descriptor is
+  // the message type of @node. Returns whether @node or any node under it has
+  // oneof members.
+  bool FindMergedFields(int node,
+                        const google::protobuf::Descriptor* descriptor);
+
+  // Appends the fields of @node in @serialized to @output. Sets @full_parse,
+  // and stops, if a field in Node::merged_fields occurs more than once, in
+  // which case @serialized must be fully parsed instead.
+  bool FilterMessage(absl::string_view serialized, int node,
+                     std::string& output, bool& full_parse) const;
+
+  // Clears the fields of @message not in @node, including unknown fields.
+  void ClearUnmaskedFields(int node, google::protobuf::Message& message) const;
+
+  const google::protobuf::Descriptor* descriptor_;
+  std::vector<Node> nodes_;
+  // Creates the messages fully parsed by Filter when @descriptor_ is not in
+  // the generated pool.
+  google::protobuf::DynamicMessageFactory dynamic_factory_;
+  const google::protobuf::Message* prototype_;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_PARSE_MASK_H_
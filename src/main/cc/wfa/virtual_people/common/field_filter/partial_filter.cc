@@ -14,25 +14,30 @@
 
 #include "wfa/virtual_people/common/field_filter/partial_filter.h"
 
+#include <algorithm>
 #include <memory>
+#include <numeric>
 #include <utility>
 #include <vector>
 
 #include "absl/memory/memory.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
 #include "common_cpp/macros/macros.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/message.h"
 #include "wfa/virtual_people/common/field_filter.pb.h"
 #include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/field_filter_cache.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
 #include "wfa/virtual_people/common/field_filter/utils/field_util.h"
 
 namespace wfa_virtual_people {
 
 absl::StatusOr<std::unique_ptr<PartialFilter>> PartialFilter::New(
     const google::protobuf::Descriptor* descriptor,
-    const FieldFilterProto& config) {
+    const FieldFilterProto& config, const FieldFilterOptions& options) {
   if (config.op() != FieldFilterProto::PARTIAL) {
     return absl::InvalidArgumentError(absl::StrCat(
         "Op must be PARTIAL. Input FieldFilterProto: ", config.DebugString()));
@@ -48,10 +53,9 @@ absl::StatusOr<std::unique_ptr<PartialFilter>> PartialFilter::New(
   }
 
   // Get the FieldDescriptors to the field represented by @config.name.
-  ASSIGN_OR_RETURN(
-      std::vector<const google::protobuf::FieldDescriptor*> field_descriptors,
-      GetFieldFromProto(descriptor, config.name()));
-  if (field_descriptors.back()->cpp_type() !=
+  ASSIGN_OR_RETURN(std::shared_ptr<const FieldPath> field_path,
+                   GetFieldPathFromProto(descriptor, config.name()));
+  if (field_path->back()->cpp_type() !=
       google::protobuf::FieldDescriptor::CppType::CPPTYPE_MESSAGE) {
     return absl::InvalidArgumentError(absl::StrCat(
         "Name must refer to a message type field. Input FieldFilterProto: ",
@@ -60,22 +64,22 @@ absl::StatusOr<std::unique_ptr<PartialFilter>> PartialFilter::New(
 
   // Build all the sub filters.
   const google::protobuf::Descriptor* sub_descriptor =
-      field_descriptors.back()->message_type();
-  std::vector<std::unique_ptr<FieldFilter>> sub_filters;
+      field_path->back()->message_type();
+  std::vector<std::shared_ptr<const FieldFilter>> sub_filters;
   for (const FieldFilterProto& sub_filter_proto : config.sub_filters()) {
     sub_filters.emplace_back();
     ASSIGN_OR_RETURN(sub_filters.back(),
-                     FieldFilter::New(sub_descriptor, sub_filter_proto));
+                     NewSubFilter(sub_descriptor, sub_filter_proto, options));
   }
 
-  return absl::make_unique<PartialFilter>(std::move(field_descriptors),
+  return absl::make_unique<PartialFilter>(std::move(field_path),
                                           std::move(sub_filters));
 }
 
 bool PartialFilter::IsMatch(const google::protobuf::Message& message) const {
   ProtoFieldValue<const google::protobuf::Message&> sub_message =
-      GetValueFromProto<const google::protobuf::Message&>(message,
-                                                          field_descriptors_);
+      GetValueFromProto<const google::protobuf::Message&>(
+          message, *field_path_, getter_);
   for (auto& filter : sub_filters_) {
     if (!sub_message.is_set || !filter->IsMatch(sub_message.value)) {
       return false;
@@ -84,4 +88,60 @@ bool PartialFilter::IsMatch(const google::protobuf::Message& message) const {
   return true;
 }
 
+void PartialFilter::MatchSelected(
+    absl::Span<const google::protobuf::Message* const> messages,
+    absl::Span<const int> selection, std::vector<bool>* matches) const {
+  // Resolve the sub message of each selected row once. The rows with the sub
+  // message not set are decided as false. The sub filters are applied to the
+  // other rows by their indexes in @sub_messages, so that the buffers are
+  // sized to the selection, not to @messages.
+  std::vector<const google::protobuf::Message*> sub_messages;
+  sub_messages.reserve(selection.size());
+  std::vector<int> rows;
+  rows.reserve(selection.size());
+  for (int i : selection) {
+    ProtoFieldValue<const google::protobuf::Message&> sub_message =
+        GetValueFromProto<const google::protobuf::Message&>(
+            *messages[i], *field_path_, getter_);
+    if (!sub_message.is_set) {
+      (*matches)[i] = false;
+      continue;
+    }
+    sub_messages.push_back(&sub_message.value);
+    rows.push_back(i);
+  }
+  std::vector<int> undecided(sub_messages.size());
+  std::iota(undecided.begin(), undecided.end(), 0);
+  std::vector<bool> sub_matches(sub_messages.size());
+  for (auto& filter : sub_filters_) {
+    if (undecided.empty()) {
+      break;
+    }
+    filter->MatchSelected(sub_messages, undecided, &sub_matches);
+    undecided.erase(
+        std::remove_if(undecided.begin(), undecided.end(),
+                       [&sub_matches](int j) { return !sub_matches[j]; }),
+        undecided.end());
+  }
+  for (int j = 0; j < static_cast<int>(rows.size()); ++j) {
+    (*matches)[rows[j]] = sub_matches[j];
+  }
+}
+
+void PartialFilter::AppendReferencedFields(
+    std::vector<ReferencedField>* fields) const {
+  fields->push_back({field_path_, /*reads_value=*/false});
+  // The paths of the sub filters start from the sub message.
+  std::vector<ReferencedField> sub_fields;
+  for (const auto& filter : sub_filters_) {
+    filter->AppendReferencedFields(&sub_fields);
+  }
+  for (const ReferencedField& sub_field : sub_fields) {
+    FieldPath field_path = *field_path_;
+    field_path.insert(field_path.end(), sub_field.field_path->begin(),
+                      sub_field.field_path->end());
+    fields->push_back({InternFieldPath(field_path), sub_field.reads_value});
+  }
+}
+
 }  // namespace wfa_virtual_people
@@ -20,10 +20,13 @@
 #include <vector>
 
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/message.h"
 #include "wfa/virtual_people/common/field_filter.pb.h"
 #include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_accessor.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
 
 namespace wfa_virtual_people {
 
@@ -42,12 +45,14 @@ class PartialFilter : public FieldFilter {
   // * Any of @config.sub_filters is invalid to create a FieldFilter.
   static absl::StatusOr<std::unique_ptr<PartialFilter>> New(
       const google::protobuf::Descriptor* descriptor,
-      const FieldFilterProto& config);
+      const FieldFilterProto& config, const FieldFilterOptions& options);
 
   explicit PartialFilter(
-      std::vector<const google::protobuf::FieldDescriptor*>&& field_descriptors,
-      std::vector<std::unique_ptr<FieldFilter>>&& sub_filters)
-      : field_descriptors_(std::move(field_descriptors)),
+      std::shared_ptr<const FieldPath> field_path,
+      std::vector<std::shared_ptr<const FieldFilter>>&& sub_filters)
+      : field_path_(std::move(field_path)),
+        getter_(GetFieldGetter<const google::protobuf::Message&>(
+            FindFieldAccessor(*field_path_))),
         sub_filters_(std::move(sub_filters)) {}
 
   PartialFilter(const PartialFilter&) = delete;
@@ -60,9 +65,22 @@ class PartialFilter : public FieldFilter {
   // Returns false if the message object is not set.
   bool IsMatch(const google::protobuf::Message& message) const override;
 
+  // The sub messages are resolved once per row. Each sub filter is only
+  // applied to the rows that passed all the previous sub filters.
+  void MatchSelected(
+      absl::Span<const google::protobuf::Message* const> messages,
+      absl::Span<const int> selection,
+      std::vector<bool>* matches) const override;
+
+  void AppendReferencedFields(
+      std::vector<ReferencedField>* fields) const override;
+
  private:
-  std::vector<const google::protobuf::FieldDescriptor*> field_descriptors_;
-  std::vector<std::unique_ptr<FieldFilter>> sub_filters_;
+  std::shared_ptr<const FieldPath> field_path_;
+  // Reads the sub message without protobuf reflection when not nullptr.
+  FieldGetter<const google::protobuf::Message&> getter_;
+  // Shared with other filters when built with FieldFilterOptions.cache.
+  std::vector<std::shared_ptr<const FieldFilter>> sub_filters_;
 };
 
 }  // namespace wfa_virtual_people
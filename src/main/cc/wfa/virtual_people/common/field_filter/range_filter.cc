@@ -0,0 +1,152 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/range_filter.h"
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "common_cpp/macros/macros.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_accessor.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_util.h"
+#include "wfa/virtual_people/common/field_filter/utils/type_convert_util.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+// The implementation of RangeFilter based on the type of field represented by
+// @field_path. The supported IntegerTypes are
+//   int32_t
+//   int64_t
+//   uint32_t
+//   uint64_t
+template <typename IntegerType>
+class RangeFilterImpl : public RangeFilter {
+ public:
+  RangeFilterImpl(std::shared_ptr<const FieldPath> field_path,
+                  IntegerType lower, IntegerType upper)
+      : RangeFilter(std::move(field_path)),
+        getter_(GetFieldGetter<IntegerType>(FindFieldAccessor(*field_path_))),
+        lower_(lower),
+        upper_(upper) {}
+
+  bool IsMatch(const google::protobuf::Message& message) const override {
+    ProtoFieldValue<IntegerType> field_value =
+        GetValueFromProto<IntegerType>(message, *field_path_, getter_);
+    return field_value.is_set && field_value.value > lower_ &&
+           field_value.value < upper_;
+  }
+
+  void MatchSelected(
+      absl::Span<const google::protobuf::Message* const> messages,
+      absl::Span<const int> selection,
+      std::vector<bool>* matches) const override {
+    MatchSelectedValues<IntegerType>(
+        messages, selection, *field_path_, getter_,
+        [this](const ProtoFieldValue<IntegerType>& field_value) {
+          return field_value.is_set && field_value.value > lower_ &&
+                 field_value.value < upper_;
+        },
+        matches);
+  }
+
+ private:
+  FieldGetter<IntegerType> getter_;
+  // The exclusive bounds.
+  IntegerType lower_;
+  IntegerType upper_;
+};
+
+template <typename IntegerType>
+absl::StatusOr<std::unique_ptr<RangeFilterImpl<IntegerType>>> CreateFilter(
+    std::shared_ptr<const FieldPath> field_path,
+    const FieldFilterProto& config) {
+  ASSIGN_OR_RETURN(
+      IntegerType lower,
+      ConvertToNumeric<IntegerType>(config.sub_filters(0).value()));
+  ASSIGN_OR_RETURN(
+      IntegerType upper,
+      ConvertToNumeric<IntegerType>(config.sub_filters(1).value()));
+  return absl::make_unique<RangeFilterImpl<IntegerType>>(
+      std::move(field_path), lower, upper);
+}
+
+}  // namespace
+
+bool RangeFilter::IsRange(const FieldFilterProto& config) {
+  return config.op() == FieldFilterProto::AND &&
+         config.sub_filters_size() == 2 &&
+         config.sub_filters(0).op() == FieldFilterProto::GT &&
+         config.sub_filters(1).op() == FieldFilterProto::LT &&
+         config.sub_filters(0).name() == config.sub_filters(1).name();
+}
+
+absl::StatusOr<std::unique_ptr<RangeFilter>> RangeFilter::New(
+    const google::protobuf::Descriptor* descriptor,
+    const FieldFilterProto& config) {
+  if (!IsRange(config)) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Must be an AND of a GT and a LT on the same field. Input "
+        "FieldFilterProto: ",
+        config.DebugString()));
+  }
+  for (const FieldFilterProto& bound : config.sub_filters()) {
+    if (!bound.has_name()) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Name must be set. Input FieldFilterProto: ", config.DebugString()));
+    }
+    if (!bound.has_value()) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Value must be set. Input FieldFilterProto: ", config.DebugString()));
+    }
+  }
+
+  ASSIGN_OR_RETURN(
+      std::shared_ptr<const FieldPath> field_path,
+      GetFieldPathFromProto(descriptor, config.sub_filters(0).name()));
+  switch (field_path->back()->cpp_type()) {
+    case google::protobuf::FieldDescriptor::CppType::CPPTYPE_INT32:
+      return CreateFilter<int32_t>(std::move(field_path), config);
+    case google::protobuf::FieldDescriptor::CppType::CPPTYPE_INT64:
+      return CreateFilter<int64_t>(std::move(field_path), config);
+    case google::protobuf::FieldDescriptor::CppType::CPPTYPE_UINT32:
+      return CreateFilter<uint32_t>(std::move(field_path), config);
+    case google::protobuf::FieldDescriptor::CppType::CPPTYPE_UINT64:
+      return CreateFilter<uint64_t>(std::move(field_path), config);
+    default:
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Unsupported field type for range filter. Input FieldFilterProto: ",
+          config.DebugString()));
+  }
+}
+
+void RangeFilter::AppendReferencedFields(
+    std::vector<ReferencedField>* fields) const {
+  fields->push_back({field_path_, /*reads_value=*/true});
+}
+
+}  // namespace wfa_virtual_people
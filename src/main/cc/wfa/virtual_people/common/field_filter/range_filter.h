@@ -0,0 +1,76 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_RANGE_FILTER_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_RANGE_FILTER_H_
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
+
+namespace wfa_virtual_people {
+
+// The implementation of field filter when @config is an AND of a GT and a LT
+// on the same field, in this order. The field is read once, and compared with
+// both bounds.
+//
+// NormalizeFieldFilterProto groups the GT and LT on the same field into this
+// form.
+class RangeFilter : public FieldFilter {
+ public:
+  // Always use FieldFilter::New.
+  // Users should never call RangeFilter::New or any constructor directly.
+  //
+  // Returns error status if any of the following happens:
+  // * @config is not a range, see IsRange.
+  // * The name or the value of any sub filter is not set.
+  // * The field is not a non-repeated integer field.
+  // * Any value cannot be converted to the type of the field.
+  static absl::StatusOr<std::unique_ptr<RangeFilter>> New(
+      const google::protobuf::Descriptor* descriptor,
+      const FieldFilterProto& config);
+
+  // Returns true if @config.op is AND, and @config.sub_filters are a GT and a
+  // LT on the same field, in this order.
+  static bool IsRange(const FieldFilterProto& config);
+
+  RangeFilter(const RangeFilter&) = delete;
+  RangeFilter& operator=(const RangeFilter&) = delete;
+
+  virtual ~RangeFilter() = default;
+
+  // Returns true when the field is set, and is greater than the value of the
+  // GT and less than the value of the LT.
+  bool IsMatch(const google::protobuf::Message& message) const override = 0;
+
+  void AppendReferencedFields(
+      std::vector<ReferencedField>* fields) const override;
+
+ protected:
+  explicit RangeFilter(std::shared_ptr<const FieldPath> field_path)
+      : field_path_(std::move(field_path)) {}
+
+  std::shared_ptr<const FieldPath> field_path_;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_RANGE_FILTER_H_
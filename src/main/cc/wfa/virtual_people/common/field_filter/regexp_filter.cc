@@ -0,0 +1,100 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/regexp_filter.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "common_cpp/macros/macros.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_accessor.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_util.h"
+#include "wfa/virtual_people/common/field_filter/utils/regexp_matcher.h"
+
+namespace wfa_virtual_people {
+
+absl::StatusOr<std::unique_ptr<RegexpFilter>> RegexpFilter::New(
+    const google::protobuf::Descriptor* descriptor,
+    const FieldFilterProto& config) {
+  if (config.op() != FieldFilterProto::REGEXP) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Op must be REGEXP. Input FieldFilterProto: ", config.DebugString()));
+  }
+  if (!config.has_name()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Name must be set. Input FieldFilterProto: ", config.DebugString()));
+  }
+  if (!config.has_value()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Value must be set. Input FieldFilterProto: ", config.DebugString()));
+  }
+  ASSIGN_OR_RETURN(std::shared_ptr<const FieldPath> field_path,
+                   GetFieldPathFromProto(descriptor, config.name(),
+                                         /* allow_repeated = */ true));
+  if (field_path->back()->cpp_type() !=
+      google::protobuf::FieldDescriptor::CppType::CPPTYPE_STRING) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Unsupported field type for REGEXP filter. Input FieldFilterProto: ",
+        config.DebugString()));
+  }
+  ASSIGN_OR_RETURN(std::unique_ptr<RegexpMatcher> matcher,
+                   RegexpMatcher::New(config.value()));
+  return absl::make_unique<RegexpFilter>(std::move(field_path),
+                                         std::move(matcher));
+}
+
+bool RegexpFilter::IsMatch(const google::protobuf::Message& message) const {
+  if (!field_path_->back()->is_repeated()) {
+    ProtoFieldValue<const std::string&> proto_field_value =
+        GetValueFromProto<const std::string&>(message, *field_path_,
+                                              getter_);
+    return proto_field_value.is_set &&
+           matcher_->Matches(proto_field_value.value);
+  }
+  int size = GetSizeOfRepeatedProto(message, *field_path_);
+  for (int i = 0; i < size; ++i) {
+    if (matcher_->Matches(GetValueFromRepeatedProto<const std::string&>(
+            message, *field_path_, i))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void RegexpFilter::MatchSelected(
+    absl::Span<const google::protobuf::Message* const> messages,
+    absl::Span<const int> selection, std::vector<bool>* matches) const {
+  for (int i : selection) {
+    (*matches)[i] = RegexpFilter::IsMatch(*messages[i]);
+  }
+}
+
+void RegexpFilter::AppendReferencedFields(
+    std::vector<ReferencedField>* fields) const {
+  fields->push_back({field_path_, /*reads_value=*/true});
+}
+
+}  // namespace wfa_virtual_people
@@ -0,0 +1,90 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_REGEXP_FILTER_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_REGEXP_FILTER_H_
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_accessor.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
+#include "wfa/virtual_people/common/field_filter/utils/regexp_matcher.h"
+
+namespace wfa_virtual_people {
+
+// The implementation of field filter when op is REGEXP in @config.
+//
+// @config.value is a RE2 regular expression, which must match the whole
+// value of the field. It is compiled once when the filter is created.
+class RegexpFilter : public FieldFilter {
+ public:
+  // Always use FieldFilter::New.
+  // Users should never call RegexpFilter::New or any constructor directly.
+  //
+  // Returns error status if any of the following happens:
+  // * @config.op is not REGEXP.
+  // * @config.name is not set.
+  // * Except the last field, any other field of the path represented by
+  //   @config.name is repeated field.
+  // * The field represented by @config.name is not a string field.
+  // * @config.value is not set.
+  // * @config.value is not a valid RE2 regular expression.
+  static absl::StatusOr<std::unique_ptr<RegexpFilter>> New(
+      const google::protobuf::Descriptor* descriptor,
+      const FieldFilterProto& config);
+
+  explicit RegexpFilter(
+      std::shared_ptr<const FieldPath> field_path,
+      std::unique_ptr<RegexpMatcher> matcher)
+      : field_path_(std::move(field_path)),
+        matcher_(std::move(matcher)),
+        getter_(GetFieldGetter<const std::string&>(
+            FindFieldAccessor(*field_path_))) {}
+
+  RegexpFilter(const RegexpFilter&) = delete;
+  RegexpFilter& operator=(const RegexpFilter&) = delete;
+
+  // Returns true if any of the following is true
+  // * The field is not repeated, is set in @message, and its value matches
+  //   @config.value.
+  // * The field is repeated, and any of its values in @message matches
+  //   @config.value.
+  bool IsMatch(const google::protobuf::Message& message) const override;
+
+  void MatchSelected(
+      absl::Span<const google::protobuf::Message* const> messages,
+      absl::Span<const int> selection,
+      std::vector<bool>* matches) const override;
+
+  void AppendReferencedFields(
+      std::vector<ReferencedField>* fields) const override;
+
+ private:
+  std::shared_ptr<const FieldPath> field_path_;
+  std::unique_ptr<RegexpMatcher> matcher_;
+  FieldGetter<const std::string&> getter_;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_REGEXP_FILTER_H_
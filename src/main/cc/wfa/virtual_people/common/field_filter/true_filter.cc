@@ -15,10 +15,12 @@
 #include "wfa/virtual_people/common/field_filter/true_filter.h"
 
 #include <memory>
+#include <vector>
 
 #include "absl/memory/memory.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
 #include "google/protobuf/message.h"
 #include "wfa/virtual_people/common/field_filter.pb.h"
 #include "wfa/virtual_people/common/field_filter/field_filter.h"
@@ -41,6 +43,11 @@ absl::StatusOr<std::unique_ptr<TrueFilter>> TrueFilter::New(
         absl::StrCat("Value should not be set. Input FieldFilterProto: ",
                      config.DebugString()));
   }
+  if (config.has_value_file()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("value_file should not be set. Input FieldFilterProto: ",
+                     config.DebugString()));
+  }
   if (config.sub_filters_size() > 0) {
     return absl::InvalidArgumentError(
         absl::StrCat("sub_filters must be empty. Input FieldFilterProto: ",
@@ -53,4 +60,14 @@ bool TrueFilter::IsMatch(const google::protobuf::Message&) const {
   return true;
 }
 
+void TrueFilter::MatchSelected(
+    absl::Span<const google::protobuf::Message* const>,
+    absl::Span<const int> selection, std::vector<bool>* matches) const {
+  for (int i : selection) {
+    (*matches)[i] = true;
+  }
+}
+
+void TrueFilter::AppendReferencedFields(std::vector<ReferencedField>*) const {}
+
 }  // namespace wfa_virtual_people
@@ -0,0 +1,130 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/utils/adaptive_order.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+// A new order is only published when its expected cost is lower than this
+// ratio of the expected cost of the current order, so that the order does not
+// change with the noise of the measurements.
+constexpr double kMinCostRatioToReorder = 0.9;
+
+// Returns the expected cost of evaluating the sub filters in @order until one
+// decides the result.
+double GetExpectedCost(const std::vector<int>& order,
+                       const std::vector<double>& probabilities,
+                       const std::vector<double>& costs) {
+  double expected_cost = 0;
+  double undecided = 1;
+  for (int i : order) {
+    expected_cost += undecided * costs[i];
+    undecided *= 1 - probabilities[i];
+  }
+  return expected_cost;
+}
+
+}  // namespace
+
+void AdaptiveOrder::HalveStats(SubFilterStats& stats) {
+  // Subtracted instead of stored, so that concurrent samples are not lost.
+  for (std::atomic<int64_t>* counter :
+       {&stats.samples, &stats.decisive_samples, &stats.total_nanos}) {
+    counter->fetch_sub(counter->load(std::memory_order_relaxed) / 2,
+                       std::memory_order_relaxed);
+  }
+}
+
+AdaptiveOrder::AdaptiveOrder(const int size, const bool decisive_result)
+    : decisive_result_(decisive_result),
+      stats_(new SubFilterStats[size]),
+      size_(size) {
+  auto initial_order = std::make_unique<std::vector<int>>(size);
+  std::iota(initial_order->begin(), initial_order->end(), 0);
+  order_.store(initial_order.get(), std::memory_order_release);
+  absl::MutexLock lock(&mutex_);
+  orders_.push_back(std::move(initial_order));
+}
+
+uint32_t AdaptiveOrder::NextSampleCountdown() {
+  // A splitmix64 generator, seeded differently in each thread by the address
+  // of its state and the time the thread first samples.
+  thread_local uint64_t state =
+      reinterpret_cast<uintptr_t>(&state) ^
+      static_cast<uint64_t>(
+          std::chrono::steady_clock::now().time_since_epoch().count());
+  state += 0x9e3779b97f4a7c15;
+  uint64_t random = state;
+  random = (random ^ (random >> 30)) * 0xbf58476d1ce4e5b9;
+  random = (random ^ (random >> 27)) * 0x94d049bb133111eb;
+  random ^= random >> 31;
+  return 1 + static_cast<uint32_t>(random % (2 * kSampleInterval - 1));
+}
+
+void AdaptiveOrder::Reorder() const {
+  absl::MutexLock lock(&mutex_);
+  if (orders_.size() >= kMaxOrders) {
+    return;
+  }
+
+  // Both the probability of deciding the result and the average cost are
+  // smoothed, so that sub filters without samples are not ranked first or
+  // last.
+  std::vector<double> probabilities(size_);
+  std::vector<double> costs(size_);
+  for (int i = 0; i < size_; ++i) {
+    const SubFilterStats& stats = stats_[i];
+    double samples = stats.samples.load(std::memory_order_relaxed);
+    probabilities[i] =
+        (stats.decisive_samples.load(std::memory_order_relaxed) + 1) /
+        (samples + 2);
+    costs[i] =
+        (stats.total_nanos.load(std::memory_order_relaxed) + 1) / (samples + 1);
+  }
+  for (int i = 0; i < size_; ++i) {
+    HalveStats(stats_[i]);
+  }
+
+  const std::vector<int>& current_order = *orders_.back();
+  auto new_order = std::make_unique<std::vector<int>>(current_order);
+  std::stable_sort(new_order->begin(), new_order->end(),
+                   [&probabilities, &costs](int a, int b) {
+                     return costs[a] / probabilities[a] <
+                            costs[b] / probabilities[b];
+                   });
+  if (GetExpectedCost(*new_order, probabilities, costs) >=
+      kMinCostRatioToReorder *
+          GetExpectedCost(current_order, probabilities, costs)) {
+    return;
+  }
+  order_.store(new_order.get(), std::memory_order_release);
+  orders_.push_back(std::move(new_order));
+  if (orders_.size() >= kMaxOrders) {
+    adapting_.store(false, std::memory_order_relaxed);
+  }
+}
+
+}  // namespace wfa_virtual_people
@@ -0,0 +1,243 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_ADAPTIVE_ORDER_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_ADAPTIVE_ORDER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+
+namespace wfa_virtual_people {
+
+// Decides the order to evaluate the sub filters of an AND or OR filter, from
+// the pass rates and the costs of the sub filters observed on sampled
+// evaluations.
+//
+// A sub filter decides the result when it fails in AND, and when it passes in
+// OR. The sub filters are periodically reordered by
+//   average cost / probability of deciding the result
+// ascending, which minimizes the expected cost of the short circuit evaluation
+// when the sub filters are independent. The measurements are halved on each
+// reorder, so that the order follows changes in the distribution of the
+// evaluated messages, instead of being dominated by the earliest samples.
+//
+// This is thread-safe. Evaluate only updates relaxed atomic counters on
+// sampled evaluations, and one caller at a time computes a new order, which is
+// published atomically.
+class AdaptiveOrder {
+ public:
+  // About one in this many evaluations is sampled, and never more than
+  // 2 * kSampleInterval - 1 evaluations in a row are not sampled.
+  static constexpr int kSampleInterval = 64;
+  // The sub filters are reordered every this many sampled evaluations.
+  static constexpr int kSamplesPerReorder = 256;
+  // The maximum number of orders published. A published order is kept alive
+  // until destruction, as concurrent evaluations might still be using it, so
+  // the order is fixed after this many changes, and no evaluation is sampled
+  // anymore.
+  static constexpr int kMaxOrders = 32;
+
+  // @size is the number of the sub filters.
+  // @decisive_result is the result of a sub filter which decides the result,
+  // which is false for AND, and true for OR.
+  AdaptiveOrder(int size, bool decisive_result);
+
+  AdaptiveOrder(const AdaptiveOrder&) = delete;
+  AdaptiveOrder& operator=(const AdaptiveOrder&) = delete;
+
+  // Returns the indexes of the sub filters in the current order.
+  absl::Span<const int> order() const {
+    return *order_.load(std::memory_order_acquire);
+  }
+
+  // Evaluates the sub filters in the current order, where @is_match(i)
+  // returns the result of the sub filter at index i. Returns decisive_result
+  // if any sub filter returns decisive_result, otherwise returns
+  // !decisive_result.
+  //
+  // On sampled evaluations, all the sub filters are evaluated and measured,
+  // so that the sub filters late in the order are measured as well.
+  template <typename IsMatch>
+  bool Evaluate(IsMatch&& is_match) const;
+
+  // Same as Evaluate, for the rows in @selection at once. Sets (*matches)[row]
+  // to the result for each row in @selection.
+  //
+  // @match_selected(i, rows, matches) sets (*matches)[row] to the result of the
+  // sub filter at index i for each row in @rows, like
+  // FieldFilter::MatchSelected. Each sub filter is only applied to the rows
+  // not decided yet, except on sampled evaluations, where all the sub filters
+  // are applied to all the rows and measured.
+  template <typename MatchSelected>
+  void EvaluateSelected(absl::Span<const int> selection,
+                        std::vector<bool>* matches,
+                        MatchSelected&& match_selected) const;
+
+ private:
+  struct SubFilterStats {
+    std::atomic<int64_t> samples{0};
+    std::atomic<int64_t> decisive_samples{0};
+    std::atomic<int64_t> total_nanos{0};
+  };
+
+  // Each thread counts down the evaluations of all the instances to its next
+  // sampled evaluation, so no shared memory is written on the evaluations not
+  // sampled. The countdown restarts from a random number, so that instances
+  // evaluated in a fixed interleaving are all sampled. No evaluation is sampled
+  // once the order is fixed.
+  bool ShouldSample() const {
+    if (!adapting_.load(std::memory_order_relaxed)) {
+      return false;
+    }
+    thread_local uint32_t countdown = 0;
+    if (countdown > 1) {
+      --countdown;
+      return false;
+    }
+    // The countdown is 0 on the first evaluation in the thread, which is not
+    // sampled, so that the first sample is at a random offset.
+    const bool sample = countdown == 1;
+    countdown = NextSampleCountdown();
+    return sample;
+  }
+
+  // Returns a random number in [1, 2 * kSampleInterval - 1], from a random
+  // generator of the calling thread.
+  static uint32_t NextSampleCountdown();
+
+  // Records the measurements of the sub filter at index @i, evaluated on
+  // @samples rows in @nanos in total, which returned decisive_result on
+  // @decisive_samples of them.
+  void RecordSubFilter(int i, int64_t samples, int64_t decisive_samples,
+                       int64_t nanos) const {
+    SubFilterStats& stats = stats_[i];
+    stats.samples.fetch_add(samples, std::memory_order_relaxed);
+    stats.decisive_samples.fetch_add(decisive_samples,
+                                     std::memory_order_relaxed);
+    stats.total_nanos.fetch_add(nanos, std::memory_order_relaxed);
+  }
+
+  // Records @samples sampled evaluations, and reorders every
+  // kSamplesPerReorder of them.
+  void RecordSamples(int64_t samples) const {
+    int64_t previous = samples_.fetch_add(samples, std::memory_order_relaxed);
+    if (previous / kSamplesPerReorder !=
+        (previous + samples) / kSamplesPerReorder) {
+      Reorder();
+    }
+  }
+
+  // Halves the measurements in @stats, which decays the older samples.
+  static void HalveStats(SubFilterStats& stats);
+
+  // Publishes a new order from the current stats, if it is different, and
+  // halves the stats.
+  void Reorder() const;
+
+  const bool decisive_result_;
+  const std::unique_ptr<SubFilterStats[]> stats_;
+  const int size_;
+  mutable std::atomic<int64_t> samples_{0};
+  // False once kMaxOrders orders are published.
+  mutable std::atomic<bool> adapting_{true};
+  mutable std::atomic<const std::vector<int>*> order_;
+  mutable absl::Mutex mutex_;
+  mutable std::vector<std::unique_ptr<const std::vector<int>>> orders_
+      ABSL_GUARDED_BY(mutex_);
+};
+
+template <typename IsMatch>
+bool AdaptiveOrder::Evaluate(IsMatch&& is_match) const {
+  absl::Span<const int> current_order = order();
+  if (!ShouldSample()) {
+    for (int i : current_order) {
+      if (is_match(i) == decisive_result_) {
+        return decisive_result_;
+      }
+    }
+    return !decisive_result_;
+  }
+
+  bool decided = false;
+  for (int i : current_order) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    bool is_decisive = is_match(i) == decisive_result_;
+    int64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+    RecordSubFilter(i, 1, is_decisive, nanos);
+    decided |= is_decisive;
+  }
+  RecordSamples(1);
+  return decided ? decisive_result_ : !decisive_result_;
+}
+
+template <typename MatchSelected>
+void AdaptiveOrder::EvaluateSelected(absl::Span<const int> selection,
+                                     std::vector<bool>* matches,
+                                     MatchSelected&& match_selected) const {
+  absl::Span<const int> current_order = order();
+  if (!ShouldSample()) {
+    // The rows not decided by the sub filters applied so far.
+    std::vector<int> undecided(selection.begin(), selection.end());
+    for (int i : current_order) {
+      match_selected(i, absl::Span<const int>(undecided), matches);
+      undecided.erase(std::remove_if(undecided.begin(), undecided.end(),
+                                     [this, matches](int row) {
+                                       return (*matches)[row] ==
+                                              decisive_result_;
+                                     }),
+                      undecided.end());
+      if (undecided.empty()) {
+        return;
+      }
+    }
+    return;
+  }
+
+  for (int row : selection) {
+    (*matches)[row] = !decisive_result_;
+  }
+  std::vector<bool> sub_matches(matches->size());
+  for (int i : current_order) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    match_selected(i, selection, &sub_matches);
+    int64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+    int64_t decisive_samples = 0;
+    for (int row : selection) {
+      if (sub_matches[row] == decisive_result_) {
+        ++decisive_samples;
+        (*matches)[row] = decisive_result_;
+      }
+    }
+    RecordSubFilter(i, selection.size(), decisive_samples, nanos);
+  }
+  RecordSamples(selection.size());
+}
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_ADAPTIVE_ORDER_H_
@@ -0,0 +1,587 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/utils/external_value_set.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "common_cpp/macros/macros.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+// The first bytes of a set file. Read as another value on machines with the
+// other byte order.
+constexpr uint64_t kMagic = 0x3154455356414657;  // "WFAVSET1"
+
+// The beginning of a set file, followed by the Bloom filter, then the values.
+// The size is a multiple of 8, so that the arrays after it are aligned in the
+// mapped file.
+struct Header {
+  uint64_t magic;
+  ExternalValueKind kind;
+  // The number of bits set per value in the Bloom filter.
+  uint32_t bloom_hashes;
+  // The number of values.
+  uint64_t size;
+  // The number of 64-bit words of the Bloom filter.
+  uint64_t bloom_words;
+};
+static_assert(sizeof(Header) == 32);
+
+constexpr uint32_t kMaxBloomHashes = 16;
+
+// The number of values scanned linearly at the end of a search. The scan has
+// no branches, and the compiler vectorizes it.
+constexpr uint64_t kLinearScanSize = 16;
+
+// The hashes written in the Bloom filter of a file must be the same in the
+// processes reading it, unlike absl::Hash, which changes across builds.
+uint64_t MixHash(uint64_t value) {
+  value ^= value >> 30;
+  value *= 0xbf58476d1ce4e5b9;
+  value ^= value >> 27;
+  value *= 0x94d049bb133111eb;
+  value ^= value >> 31;
+  return value;
+}
+
+uint64_t HashString(absl::string_view value) {
+  // FNV-1a.
+  uint64_t hash = 0xcbf29ce484222325;
+  for (char c : value) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 0x100000001b3;
+  }
+  return MixHash(hash);
+}
+
+// Calls @set_bit with the Bloom filter bit of each of the @hash_count hashes
+// derived from @hash, in a filter of @bit_count bits.
+template <typename SetBit>
+void ForEachBloomBit(uint64_t hash, uint32_t hash_count, uint64_t bit_count,
+                     SetBit set_bit) {
+  // Double hashing. The step is odd, so that the bits differ.
+  uint64_t step = (hash >> 32) | (hash << 32) | 1;
+  for (uint32_t i = 0; i < hash_count; ++i) {
+    set_bit(hash % bit_count);
+    hash += step;
+  }
+}
+
+// Returns true if @value is in @values, which are sorted in ascending order.
+// The binary search has no branches on the values, so its comparisons do not
+// cause branch mispredictions.
+template <typename T>
+bool SortedContains(const T* values, uint64_t size, T value) {
+  const T* base = values;
+  uint64_t count = size;
+  // @value is in [base, base + count) if it is in @values.
+  while (count > kLinearScanSize) {
+    uint64_t half = count / 2;
+    base = base[half - 1] < value ? base + half : base;
+    count -= half;
+  }
+  bool found = false;
+  for (uint64_t i = 0; i < count; ++i) {
+    found |= base[i] == value;
+  }
+  return found;
+}
+
+absl::Status ErrnoError(absl::string_view message, const std::string& path) {
+  int error = errno;
+  // A write of 0 bytes fails without setting errno.
+  return absl::Status(
+      error == 0 ? absl::StatusCode::kInternal
+                 : absl::ErrnoToStatusCode(error),
+      absl::StrCat(message, path, ": ", std::strerror(error)));
+}
+
+// Returns the header, the Bloom filter of the values with @hashes, and @body.
+absl::StatusOr<std::string> EncodeSet(ExternalValueKind kind,
+                                      const std::vector<uint64_t>& hashes,
+                                      absl::string_view body,
+                                      const ExternalValueSetOptions& options) {
+  if (options.bloom_bits_per_value < 0) {
+    return absl::InvalidArgumentError(
+        "The Bloom filter bits per value must not be negative.");
+  }
+  Header header = {};
+  header.magic = kMagic;
+  header.kind = kind;
+  header.size = hashes.size();
+  std::vector<uint64_t> bloom;
+  if (options.bloom_bits_per_value > 0 && !hashes.empty()) {
+    uint64_t bit_count = hashes.size() * options.bloom_bits_per_value;
+    bloom.resize((bit_count + 63) / 64);
+    bit_count = bloom.size() * 64;
+    // The number of hashes minimizing the false positive rate.
+    header.bloom_hashes = std::clamp<uint32_t>(
+        static_cast<uint32_t>(
+            std::lround(options.bloom_bits_per_value * std::log(2.0))),
+        1, kMaxBloomHashes);
+    header.bloom_words = bloom.size();
+    for (uint64_t hash : hashes) {
+      ForEachBloomBit(hash, header.bloom_hashes, bit_count,
+                      [&bloom](uint64_t bit) {
+                        bloom[bit >> 6] |= uint64_t{1} << (bit & 63);
+                      });
+    }
+  }
+
+  std::string contents(reinterpret_cast<const char*>(&header), sizeof(header));
+  contents.reserve(sizeof(header) + bloom.size() * sizeof(uint64_t) +
+                   body.size());
+  contents.append(reinterpret_cast<const char*>(bloom.data()),
+                  bloom.size() * sizeof(uint64_t));
+  contents.append(body.data(), body.size());
+  return contents;
+}
+
+// Writes @contents to the file at @path.
+absl::Status WriteSetFile(const std::string& path,
+                          absl::string_view contents) {
+  // Written to another file, then renamed over @path, so that the sets mapping
+  // the previous file at @path are not modified. The file is created with a
+  // unique name, so that concurrent writers of @path, in any process, never
+  // write to the same file.
+  std::string temp_path = absl::StrCat(path, ".tmp.XXXXXX");
+  errno = 0;
+  int fd = mkstemp(temp_path.data());
+  if (fd < 0) {
+    return ErrnoError("Failed to create ", temp_path);
+  }
+  // mkstemp creates the file only readable by the owner.
+  bool written = fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) == 0;
+  while (written && !contents.empty()) {
+    ssize_t size = write(fd, contents.data(), contents.size());
+    if (size < 0 && errno == EINTR) {
+      continue;
+    }
+    written = size > 0;
+    if (written) {
+      contents.remove_prefix(static_cast<size_t>(size));
+    }
+  }
+  if (!written) {
+    absl::Status status = ErrnoError("Failed to write ", temp_path);
+    close(fd);
+    std::remove(temp_path.c_str());
+    return status;
+  }
+  if (close(fd) != 0) {
+    absl::Status status = ErrnoError("Failed to write ", temp_path);
+    std::remove(temp_path.c_str());
+    return status;
+  }
+  if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    absl::Status status = ErrnoError("Failed to rename to ", path);
+    std::remove(temp_path.c_str());
+    return status;
+  }
+  return absl::OkStatus();
+}
+
+template <typename T>
+absl::StatusOr<std::string> EncodeIntegers(
+    absl::Span<const T> values, ExternalValueKind kind,
+    const ExternalValueSetOptions& options) {
+  std::vector<T> sorted(values.begin(), values.end());
+  std::sort(sorted.begin(), sorted.end());
+  sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+  std::vector<uint64_t> hashes;
+  hashes.reserve(sorted.size());
+  for (T value : sorted) {
+    hashes.push_back(MixHash(static_cast<uint64_t>(value)));
+  }
+  return EncodeSet(
+      kind, hashes,
+      absl::string_view(reinterpret_cast<const char*>(sorted.data()),
+                        sorted.size() * sizeof(T)),
+      options);
+}
+
+}  // namespace
+
+struct ExternalValueSet::OpenSets {
+  absl::Mutex mutex;
+  // By path.
+  absl::flat_hash_map<std::string, std::weak_ptr<const ExternalValueSet>> sets
+      ABSL_GUARDED_BY(mutex);
+  absl::flat_hash_set<FileId> checked_ids ABSL_GUARDED_BY(mutex);
+};
+
+ExternalValueSet::FileId ExternalValueSet::FileId::FromStat(
+    const struct stat& file_stat) {
+  FileId id;
+  id.device = static_cast<uint64_t>(file_stat.st_dev);
+  id.inode = static_cast<uint64_t>(file_stat.st_ino);
+  id.size = static_cast<int64_t>(file_stat.st_size);
+  id.modification_time_ns =
+      static_cast<int64_t>(file_stat.st_mtim.tv_sec) * 1000000000 +
+      file_stat.st_mtim.tv_nsec;
+  return id;
+}
+
+ExternalValueSet::OpenSets& ExternalValueSet::GetOpenSets() {
+  static auto* const open_sets = new OpenSets();
+  return *open_sets;
+}
+
+absl::Status ExternalValueSet::Write(const std::string& path,
+                                     absl::Span<const int64_t> values,
+                                     const ExternalValueSetOptions& options) {
+  ASSIGN_OR_RETURN(std::string contents, Serialize(values, options));
+  return WriteSetFile(path, contents);
+}
+
+absl::Status ExternalValueSet::Write(const std::string& path,
+                                     absl::Span<const uint64_t> values,
+                                     const ExternalValueSetOptions& options) {
+  ASSIGN_OR_RETURN(std::string contents, Serialize(values, options));
+  return WriteSetFile(path, contents);
+}
+
+absl::Status ExternalValueSet::Write(
+    const std::string& path, absl::Span<const absl::string_view> values,
+    const ExternalValueSetOptions& options) {
+  ASSIGN_OR_RETURN(std::string contents, Serialize(values, options));
+  return WriteSetFile(path, contents);
+}
+
+absl::StatusOr<std::string> ExternalValueSet::Serialize(
+    absl::Span<const int64_t> values, const ExternalValueSetOptions& options) {
+  return EncodeIntegers(values, ExternalValueKind::kSigned, options);
+}
+
+absl::StatusOr<std::string> ExternalValueSet::Serialize(
+    absl::Span<const uint64_t> values, const ExternalValueSetOptions& options) {
+  return EncodeIntegers(values, ExternalValueKind::kUnsigned, options);
+}
+
+absl::StatusOr<std::string> ExternalValueSet::Serialize(
+    absl::Span<const absl::string_view> values,
+    const ExternalValueSetOptions& options) {
+  std::vector<absl::string_view> sorted(values.begin(), values.end());
+  std::sort(sorted.begin(), sorted.end());
+  sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+  std::vector<uint64_t> hashes;
+  hashes.reserve(sorted.size());
+  std::vector<uint64_t> offsets = {0};
+  offsets.reserve(sorted.size() + 1);
+  for (absl::string_view value : sorted) {
+    hashes.push_back(HashString(value));
+    offsets.push_back(offsets.back() + value.size());
+  }
+  std::string body(reinterpret_cast<const char*>(offsets.data()),
+                   offsets.size() * sizeof(uint64_t));
+  body.reserve(body.size() + offsets.back());
+  for (absl::string_view value : sorted) {
+    body.append(value.data(), value.size());
+  }
+  return EncodeSet(ExternalValueKind::kString, hashes, body, options);
+}
+
+absl::StatusOr<std::shared_ptr<const ExternalValueSet>> ExternalValueSet::Open(
+    const std::string& path) {
+  OpenSets& open_sets = GetOpenSets();
+  struct stat file_stat;
+  errno = 0;
+  if (stat(path.c_str(), &file_stat) != 0) {
+    return ErrnoError("Failed to stat ", path);
+  }
+  {
+    absl::MutexLock lock(&open_sets.mutex);
+    auto it = open_sets.sets.find(path);
+    if (it != open_sets.sets.end()) {
+      std::shared_ptr<const ExternalValueSet> set = it->second.lock();
+      if (set != nullptr && set->file_id_ == FileId::FromStat(file_stat)) {
+        return set;
+      }
+    }
+  }
+
+  // The file is mapped and checked without holding the lock, so that opening
+  // a large file does not block opening the others. Concurrent calls for the
+  // same path may both map the file, and the first one stored is kept.
+  std::shared_ptr<ExternalValueSet> set(new ExternalValueSet(path));
+  RETURN_IF_ERROR(set->Map());
+  bool checked;
+  {
+    absl::MutexLock lock(&open_sets.mutex);
+    checked = open_sets.checked_ids.contains(set->file_id_);
+  }
+  if (!checked) {
+    RETURN_IF_ERROR(set->CheckOrder());
+  }
+
+  absl::MutexLock lock(&open_sets.mutex);
+  open_sets.checked_ids.insert(set->file_id_);
+  std::weak_ptr<const ExternalValueSet>& stored = open_sets.sets[path];
+  std::shared_ptr<const ExternalValueSet> stored_set = stored.lock();
+  if (stored_set != nullptr && stored_set->file_id_ == set->file_id_) {
+    return stored_set;
+  }
+  stored = set;
+  return set;
+}
+
+absl::StatusOr<std::shared_ptr<const ExternalValueSet>>
+ExternalValueSet::FromMemory(absl::string_view data,
+                             std::shared_ptr<const void> owner) {
+  if (reinterpret_cast<std::uintptr_t>(data.data()) % alignof(uint64_t) != 0) {
+    return absl::InvalidArgumentError(
+        "The value set in memory is not aligned to 8 bytes.");
+  }
+  std::shared_ptr<ExternalValueSet> set(new ExternalValueSet(""));
+  set->owner_ = std::move(owner);
+  set->data_ = data;
+  RETURN_IF_ERROR(set->Parse());
+  return set;
+}
+
+ExternalValueSet::~ExternalValueSet() {
+  if (mapping_ != nullptr) {
+    munmap(mapping_, mapping_size_);
+  }
+}
+
+absl::Status ExternalValueSet::Map() {
+  if (absl::StartsWith(path_, "/")) {
+    absolute_path_ = path_;
+  } else {
+    errno = 0;
+    char* working_directory = getcwd(nullptr, 0);
+    if (working_directory == nullptr) {
+      return ErrnoError("Failed to get the working directory to open ", path_);
+    }
+    absolute_path_ = absl::StrCat(working_directory, "/", path_);
+    free(working_directory);
+  }
+
+  int fd = open(path_.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return ErrnoError("Failed to open ", path_);
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    absl::Status status = ErrnoError("Failed to stat ", path_);
+    close(fd);
+    return status;
+  }
+  if (static_cast<size_t>(file_stat.st_size) < sizeof(Header)) {
+    close(fd);
+    return absl::InvalidArgumentError(
+        absl::StrCat("The value set file is truncated: ", path_));
+  }
+  file_id_ = FileId::FromStat(file_stat);
+  mapping_size_ = static_cast<size_t>(file_stat.st_size);
+  // Shared, so that the processes mapping the same file share the pages.
+  void* mapping = mmap(nullptr, mapping_size_, PROT_READ, MAP_SHARED, fd, 0);
+  // The mapping stays valid after closing the file.
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return ErrnoError("Failed to map ", path_);
+  }
+  mapping_ = mapping;
+  data_ = absl::string_view(static_cast<const char*>(mapping_), mapping_size_);
+  return Parse();
+}
+
+absl::Status ExternalValueSet::Parse() {
+  auto invalid = [this](absl::string_view message) {
+    return absl::InvalidArgumentError(
+        path_.empty()
+            ? absl::StrCat("Invalid value set in memory: ", message)
+            : absl::StrCat("Invalid value set file ", path_, ": ", message));
+  };
+  if (data_.size() < sizeof(Header)) {
+    return invalid("truncated.");
+  }
+  Header header;
+  std::memcpy(&header, data_.data(), sizeof(Header));
+  if (header.magic != kMagic) {
+    return invalid("not a value set, or written with another byte order.");
+  }
+  if (header.kind != ExternalValueKind::kSigned &&
+      header.kind != ExternalValueKind::kUnsigned &&
+      header.kind != ExternalValueKind::kString) {
+    return invalid("unknown kind.");
+  }
+  if ((header.bloom_words == 0) != (header.bloom_hashes == 0) ||
+      header.bloom_hashes > kMaxBloomHashes) {
+    return invalid("invalid Bloom filter.");
+  }
+  // The data is aligned to 8 bytes, and the header and the arrays are
+  // multiples of 8 bytes, so the arrays are aligned.
+  const uint64_t* words =
+      reinterpret_cast<const uint64_t*>(data_.data() + sizeof(Header));
+  uint64_t word_count = (data_.size() - sizeof(Header)) / sizeof(uint64_t);
+  if (header.bloom_words > word_count) {
+    return invalid("truncated.");
+  }
+  kind_ = header.kind;
+  size_ = header.size;
+  bloom_hashes_ = header.bloom_hashes;
+  bloom_words_ = header.bloom_words;
+  bloom_ = words;
+  words += bloom_words_;
+  word_count -= bloom_words_;
+  uint64_t body_size =
+      data_.size() - sizeof(Header) - bloom_words_ * sizeof(uint64_t);
+
+  if (kind_ != ExternalValueKind::kString) {
+    if (size_ != word_count || body_size != size_ * sizeof(uint64_t)) {
+      return invalid("wrong size.");
+    }
+    values_ = words;
+    return absl::OkStatus();
+  }
+
+  if (size_ >= word_count) {
+    return invalid("truncated.");
+  }
+  string_offsets_ = words;
+  strings_ = reinterpret_cast<const char*>(words + size_ + 1);
+  strings_size_ = body_size - (size_ + 1) * sizeof(uint64_t);
+  if (string_offsets_[0] != 0 || string_offsets_[size_] != strings_size_) {
+    return invalid("wrong size.");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ExternalValueSet::CheckOrder() const {
+  auto unsorted = [this]() {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Invalid value set file ", path_, ": the values are not sorted."));
+  };
+  if (kind_ != ExternalValueKind::kString) {
+    for (uint64_t i = 1; i < size_; ++i) {
+      bool ascending =
+          kind_ == ExternalValueKind::kSigned
+              ? static_cast<int64_t>(values_[i - 1]) <
+                    static_cast<int64_t>(values_[i])
+              : values_[i - 1] < values_[i];
+      if (!ascending) {
+        return unsorted();
+      }
+    }
+    return absl::OkStatus();
+  }
+  // The offsets are checked before the strings are read with them.
+  for (uint64_t i = 0; i < size_; ++i) {
+    if (string_offsets_[i] > string_offsets_[i + 1]) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Invalid value set file ", path_, ": invalid string offsets."));
+    }
+  }
+  for (uint64_t i = 1; i < size_; ++i) {
+    absl::string_view previous(strings_ + string_offsets_[i - 1],
+                               string_offsets_[i] - string_offsets_[i - 1]);
+    absl::string_view current(strings_ + string_offsets_[i],
+                              string_offsets_[i + 1] - string_offsets_[i]);
+    if (!(previous < current)) {
+      return unsorted();
+    }
+  }
+  return absl::OkStatus();
+}
+
+bool ExternalValueSet::MayContain(uint64_t hash) const {
+  if (bloom_words_ == 0) {
+    return true;
+  }
+  bool may_contain = true;
+  ForEachBloomBit(hash, bloom_hashes_, bloom_words_ * 64,
+                  [this, &may_contain](uint64_t bit) {
+                    may_contain &= (bloom_[bit >> 6] >> (bit & 63)) & 1;
+                  });
+  return may_contain;
+}
+
+bool ExternalValueSet::contains(int64_t value) const {
+  if (kind_ != ExternalValueKind::kSigned ||
+      !MayContain(MixHash(static_cast<uint64_t>(value)))) {
+    return false;
+  }
+  // int64_t may alias the uint64_t array.
+  return SortedContains(reinterpret_cast<const int64_t*>(values_), size_,
+                        value);
+}
+
+bool ExternalValueSet::contains(uint64_t value) const {
+  if (kind_ != ExternalValueKind::kUnsigned || !MayContain(MixHash(value))) {
+    return false;
+  }
+  return SortedContains(values_, size_, value);
+}
+
+bool ExternalValueSet::contains(absl::string_view value) const {
+  if (kind_ != ExternalValueKind::kString || !MayContain(HashString(value))) {
+    return false;
+  }
+  // The strings have different lengths, so they are binary searched with
+  // branches.
+  uint64_t begin = 0;
+  uint64_t end = size_;
+  while (begin < end) {
+    uint64_t middle = begin + (end - begin) / 2;
+    uint64_t offset = string_offsets_[middle];
+    uint64_t next_offset = string_offsets_[middle + 1];
+    // The offsets are not checked by FromMemory.
+    if (offset > next_offset || next_offset > strings_size_) {
+      return false;
+    }
+    absl::string_view current(strings_ + offset, next_offset - offset);
+    int comparison = current.compare(value);
+    if (comparison == 0) {
+      return true;
+    }
+    if (comparison < 0) {
+      begin = middle + 1;
+    } else {
+      end = middle;
+    }
+  }
+  return false;
+}
+
+}  // namespace wfa_virtual_people
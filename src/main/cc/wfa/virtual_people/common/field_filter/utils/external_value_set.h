@@ -0,0 +1,223 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_EXTERNAL_VALUE_SET_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_EXTERNAL_VALUE_SET_H_
+
+#include <sys/stat.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+
+namespace wfa_virtual_people {
+
+// The type of the values in an ExternalValueSet.
+enum class ExternalValueKind : uint32_t {
+  // int64 values, for signed integer, bool and enum fields.
+  kSigned = 1,
+  // uint64 values, for unsigned integer fields.
+  kUnsigned = 2,
+  // Byte strings, for string fields.
+  kString = 3,
+};
+
+// The options to write an ExternalValueSet file.
+struct ExternalValueSetOptions {
+  // The number of bits per value of the Bloom filter stored in the file, which
+  // rejects most of the values not in the set before searching the values.
+  // No Bloom filter is stored when 0. About 10 bits per value reject 99% of
+  // the values not in the set.
+  int bloom_bits_per_value = 0;
+};
+
+// A large set of values to check the membership in IN and ANY_IN filters,
+// stored in a file instead of in FieldFilterProto.value.
+//
+// The file holds the values sorted in ascending order: an array of 64-bit
+// integers, or an array of string offsets followed by the bytes of the
+// strings. The file is memory mapped read-only and searched in place, so the
+// values are never parsed or copied, and the pages are shared by all the
+// processes mapping the same file. The values are checked to be sorted once
+// per file contents: opening a file again after its set is released only maps
+// it, unless the file is modified.
+//
+// The file uses the byte order of the machine writing it, and is rejected on
+// machines with the other byte order.
+//
+// The same format can be stored inside another file, like a snapshot of
+// compiled filters, and read in place with FromMemory.
+//
+// Example:
+//   RETURN_IF_ERROR(ExternalValueSet::Write(path, publisher_ids));
+//   ...
+//   ASSIGN_OR_RETURN(std::shared_ptr<const ExternalValueSet> set,
+//                    ExternalValueSet::Open(path));
+//   bool found = set->contains(int64_t{42});
+//
+// This class is thread-safe.
+class ExternalValueSet {
+ public:
+  // Writes the set of @values to the file at @path. @values can be in any
+  // order, and duplicates are removed. An existing file at @path is replaced,
+  // not modified, so the sets already opened from it are unchanged.
+  static absl::Status Write(
+      const std::string& path, absl::Span<const int64_t> values,
+      const ExternalValueSetOptions& options = ExternalValueSetOptions());
+  static absl::Status Write(
+      const std::string& path, absl::Span<const uint64_t> values,
+      const ExternalValueSetOptions& options = ExternalValueSetOptions());
+  static absl::Status Write(
+      const std::string& path, absl::Span<const absl::string_view> values,
+      const ExternalValueSetOptions& options = ExternalValueSetOptions());
+
+  // Returns the contents of the file Write writes for @values, to be stored
+  // inside another file and read with FromMemory.
+  static absl::StatusOr<std::string> Serialize(
+      absl::Span<const int64_t> values,
+      const ExternalValueSetOptions& options = ExternalValueSetOptions());
+  static absl::StatusOr<std::string> Serialize(
+      absl::Span<const uint64_t> values,
+      const ExternalValueSetOptions& options = ExternalValueSetOptions());
+  static absl::StatusOr<std::string> Serialize(
+      absl::Span<const absl::string_view> values,
+      const ExternalValueSetOptions& options = ExternalValueSetOptions());
+
+  // Returns the set stored in the file at @path.
+  //
+  // The sets are shared: while a set returned for @path is alive, and the file
+  // is not modified, Open returns the same set for @path without mapping the
+  // file again. Filters keep the sets they use alive.
+  //
+  // Returns error status if the file cannot be read, or is not a valid set.
+  static absl::StatusOr<std::shared_ptr<const ExternalValueSet>> Open(
+      const std::string& path);
+
+  // Returns the set stored in @data, in the format written by Serialize, which
+  // is searched in place. @data must be aligned to 8 bytes, and stay valid
+  // while @owner is alive. The set keeps @owner alive.
+  //
+  // Only the header and the sizes are checked, so the values are not read.
+  // Unlike Open, the order of the values is not checked: a set whose values
+  // are not sorted misses some of them, but lookups stay within @data.
+  //
+  // Returns error status if @data is not a valid set.
+  static absl::StatusOr<std::shared_ptr<const ExternalValueSet>> FromMemory(
+      absl::string_view data, std::shared_ptr<const void> owner);
+
+  ExternalValueSet(const ExternalValueSet&) = delete;
+  ExternalValueSet& operator=(const ExternalValueSet&) = delete;
+
+  ~ExternalValueSet();
+
+  // Returns true if @value is in the set. Always false if the kind of the set
+  // does not match the type of @value.
+  bool contains(int64_t value) const;
+  bool contains(uint64_t value) const;
+  bool contains(absl::string_view value) const;
+
+  ExternalValueKind kind() const { return kind_; }
+
+  // The number of values in the set.
+  uint64_t size() const { return size_; }
+
+  // The path the set is opened from. Empty for the sets from FromMemory.
+  const std::string& path() const { return path_; }
+
+  // The absolute path of the file, resolved from the working directory when
+  // the set is opened. Empty for the sets from FromMemory.
+  const std::string& absolute_path() const { return absolute_path_; }
+
+  // The contents of the set, in the format written by Serialize.
+  absl::string_view data() const { return data_; }
+
+ private:
+  // Identifies the contents of a file, assuming that a file is not modified
+  // without changing its modification time or size.
+  struct FileId {
+    uint64_t device = 0;
+    uint64_t inode = 0;
+    int64_t size = 0;
+    int64_t modification_time_ns = 0;
+
+    static FileId FromStat(const struct stat& file_stat);
+
+    bool operator==(const FileId& other) const {
+      return device == other.device && inode == other.inode &&
+             size == other.size &&
+             modification_time_ns == other.modification_time_ns;
+    }
+
+    template <typename H>
+    friend H AbslHashValue(H h, const FileId& id) {
+      return H::combine(std::move(h), id.device, id.inode, id.size,
+                        id.modification_time_ns);
+    }
+  };
+
+  // The sets opened by Open, and the FileIds checked by CheckOrder.
+  struct OpenSets;
+  static OpenSets& GetOpenSets();
+
+  explicit ExternalValueSet(std::string path) : path_(std::move(path)) {}
+
+  // Maps the file at @path_, sets @file_id_ and calls Parse.
+  absl::Status Map();
+
+  // Checks the header and the sizes of @data_, and points the arrays into it.
+  // Does not read the values.
+  absl::Status Parse();
+
+  // Checks that the values are sorted, which the searches rely on. Reads all
+  // the values, so it is only called once per FileId.
+  absl::Status CheckOrder() const;
+
+  // Returns false if the Bloom filter rejects the value with @hash.
+  bool MayContain(uint64_t hash) const;
+
+  std::string path_;
+  std::string absolute_path_;
+  FileId file_id_;
+  void* mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+  // Keeps @data_ alive for the sets from FromMemory.
+  std::shared_ptr<const void> owner_;
+  absl::string_view data_;
+
+  ExternalValueKind kind_ = ExternalValueKind::kSigned;
+  uint64_t size_ = 0;
+  // The Bloom filter, with @bloom_words_ 64-bit words and @bloom_hashes_ bits
+  // set per value. Empty when the file has no Bloom filter.
+  const uint64_t* bloom_ = nullptr;
+  uint64_t bloom_words_ = 0;
+  uint32_t bloom_hashes_ = 0;
+  // The values of kSigned and kUnsigned, in ascending order.
+  const uint64_t* values_ = nullptr;
+  // The strings of kString, in ascending order. The i-th string is
+  // strings_[string_offsets_[i], string_offsets_[i + 1]).
+  const uint64_t* string_offsets_ = nullptr;
+  const char* strings_ = nullptr;
+  uint64_t strings_size_ = 0;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_EXTERNAL_VALUE_SET_H_
@@ -0,0 +1,134 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/utils/field_accessor.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/node_hash_map.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "absl/synchronization/mutex.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+// The registered accessors, keyed by the message type and the field path.
+//
+// Accessors are registered during static initialization of the generated
+// libraries, and looked up when building filters.
+class FieldAccessorRegistry {
+ public:
+  static FieldAccessorRegistry& Get() {
+    static FieldAccessorRegistry* const registry = new FieldAccessorRegistry();
+    return *registry;
+  }
+
+  void Register(const google::protobuf::Descriptor* descriptor,
+                absl::string_view path, const FieldAccessor& accessor) {
+    absl::MutexLock lock(&mutex_);
+    accessors_.emplace(std::make_pair(descriptor, std::string(path)),
+                       accessor);
+  }
+
+  const FieldAccessor* Find(const google::protobuf::Descriptor* descriptor,
+                            const std::string& path) const {
+    absl::MutexLock lock(&mutex_);
+    auto it = accessors_.find(std::make_pair(descriptor, path));
+    if (it == accessors_.end()) {
+      return nullptr;
+    }
+    // Node hash map never moves its values, so the pointer stays valid while
+    // other accessors are registered.
+    return &it->second;
+  }
+
+ private:
+  mutable absl::Mutex mutex_;
+  absl::node_hash_map<
+      std::pair<const google::protobuf::Descriptor*, std::string>,
+      FieldAccessor>
+      accessors_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace
+
+void RegisterFieldAccessor(const google::protobuf::Descriptor* descriptor,
+                           absl::string_view path,
+                           const FieldAccessor& accessor) {
+  FieldAccessorRegistry::Get().Register(descriptor, path, accessor);
+}
+
+const FieldAccessor* FindFieldAccessor(
+    absl::Span<const google::protobuf::FieldDescriptor* const>
+        field_descriptors) {
+  if (field_descriptors.empty()) {
+    return nullptr;
+  }
+  std::string path = absl::StrJoin(
+      field_descriptors, ".",
+      [](std::string* out, const google::protobuf::FieldDescriptor* field) {
+        out->append(field->name());
+      });
+  return FieldAccessorRegistry::Get().Find(
+      field_descriptors.front()->containing_type(), path);
+}
+
+template <>
+FieldGetter<int32_t> GetFieldGetter<int32_t>(const FieldAccessor* accessor) {
+  return accessor == nullptr ? nullptr : accessor->get_int32;
+}
+
+template <>
+FieldGetter<int64_t> GetFieldGetter<int64_t>(const FieldAccessor* accessor) {
+  return accessor == nullptr ? nullptr : accessor->get_int64;
+}
+
+template <>
+FieldGetter<uint32_t> GetFieldGetter<uint32_t>(const FieldAccessor* accessor) {
+  return accessor == nullptr ? nullptr : accessor->get_uint32;
+}
+
+template <>
+FieldGetter<uint64_t> GetFieldGetter<uint64_t>(const FieldAccessor* accessor) {
+  return accessor == nullptr ? nullptr : accessor->get_uint64;
+}
+
+template <>
+FieldGetter<bool> GetFieldGetter<bool>(const FieldAccessor* accessor) {
+  return accessor == nullptr ? nullptr : accessor->get_bool;
+}
+
+template <>
+FieldGetter<const std::string&> GetFieldGetter<const std::string&>(
+    const FieldAccessor* accessor) {
+  return accessor == nullptr ? nullptr : accessor->get_string;
+}
+
+template <>
+FieldGetter<const google::protobuf::Message&>
+GetFieldGetter<const google::protobuf::Message&>(
+    const FieldAccessor* accessor) {
+  return accessor == nullptr ? nullptr : accessor->get_message;
+}
+
+}  // namespace wfa_virtual_people
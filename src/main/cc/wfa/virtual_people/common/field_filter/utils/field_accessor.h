@@ -0,0 +1,178 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_FIELD_ACCESSOR_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_FIELD_ACCESSOR_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_util.h"
+
+namespace wfa_virtual_people {
+
+// A getter of the field at a given path in a given message type, which reads
+// the field through the generated accessors instead of protobuf reflection.
+// The returned value is the same as GetValueFromProto<ValueType>.
+template <typename ValueType>
+using FieldGetter =
+    ProtoFieldValue<ValueType> (*)(const google::protobuf::Message& message);
+
+// The reflection-free accessors of a field path. The getter matching the C++
+// type of the field is set, all the other getters are nullptr. Enum fields use
+// @get_int32, which returns the enum number.
+//
+// Accessors are generated at build time by field_accessor_library (see
+// //src/main/cc/wfa/virtual_people/common/field_filter/accessors), and are
+// registered when the generated library is linked.
+struct FieldAccessor {
+  // Returns whether the field is set, which is the same as
+  // Reflection::HasField.
+  bool (*has)(const google::protobuf::Message& message) = nullptr;
+
+  FieldGetter<int32_t> get_int32 = nullptr;
+  FieldGetter<int64_t> get_int64 = nullptr;
+  FieldGetter<uint32_t> get_uint32 = nullptr;
+  FieldGetter<uint64_t> get_uint64 = nullptr;
+  FieldGetter<bool> get_bool = nullptr;
+  FieldGetter<const std::string&> get_string = nullptr;
+  FieldGetter<const google::protobuf::Message&> get_message = nullptr;
+};
+
+// Registers @accessor for the field path @path in the message type
+// @descriptor. @path is separated by ".".
+//
+// Only called by the generated accessor libraries. Registering the same path
+// twice keeps the first accessor.
+void RegisterFieldAccessor(const google::protobuf::Descriptor* descriptor,
+                           absl::string_view path,
+                           const FieldAccessor& accessor);
+
+// Returns the accessor of the field path represented by @field_descriptors.
+// The path starts from the message type containing the first entry of
+// @field_descriptors. Returns nullptr if no accessor is registered for the
+// path, in which case the field should be read with protobuf reflection.
+//
+// @field_descriptors is usually the output of GetFieldFromProto or
+// GetFieldPathFromProto.
+const FieldAccessor* FindFieldAccessor(
+    absl::Span<const google::protobuf::FieldDescriptor* const>
+        field_descriptors);
+
+// Returns the getter of @accessor which returns @ValueType, or nullptr if
+// @accessor is nullptr. The getter of enum fields is FieldGetter<int32_t>.
+//
+// The supported ValueTypes are
+//   int32_t
+//   int64_t
+//   uint32_t
+//   uint64_t
+//   bool
+//   const std::string&
+//   const google::protobuf::Message&
+template <typename ValueType>
+FieldGetter<ValueType> GetFieldGetter(const FieldAccessor* accessor);
+
+template <>
+FieldGetter<int32_t> GetFieldGetter<int32_t>(const FieldAccessor* accessor);
+template <>
+FieldGetter<int64_t> GetFieldGetter<int64_t>(const FieldAccessor* accessor);
+template <>
+FieldGetter<uint32_t> GetFieldGetter<uint32_t>(const FieldAccessor* accessor);
+template <>
+FieldGetter<uint64_t> GetFieldGetter<uint64_t>(const FieldAccessor* accessor);
+template <>
+FieldGetter<bool> GetFieldGetter<bool>(const FieldAccessor* accessor);
+template <>
+FieldGetter<const std::string&> GetFieldGetter<const std::string&>(
+    const FieldAccessor* accessor);
+template <>
+FieldGetter<const google::protobuf::Message&>
+GetFieldGetter<const google::protobuf::Message&>(
+    const FieldAccessor* accessor);
+
+// The type returned by the getter of a field, which is read as @ValueType by
+// GetValueFromProto. Enum fields are read as their numbers.
+template <typename ValueType>
+struct AccessorValue {
+  using type = ValueType;
+};
+
+template <>
+struct AccessorValue<const google::protobuf::EnumValueDescriptor*> {
+  using type = int32_t;
+};
+
+template <typename ValueType>
+using AccessorValueType = typename AccessorValue<ValueType>::type;
+
+// Same as GetValueFromProto, except that the value is read with @getter when
+// @getter is not nullptr.
+template <typename ValueType>
+ProtoFieldValue<ValueType> GetValueFromProto(
+    const google::protobuf::Message& message,
+    absl::Span<const google::protobuf::FieldDescriptor* const>
+        field_descriptors,
+    FieldGetter<ValueType> getter) {
+  if (getter != nullptr) {
+    return getter(message);
+  }
+  return GetValueFromProto<ValueType>(message, field_descriptors);
+}
+
+// Returns the number of an enum value, as read by the getter or by protobuf
+// reflection.
+inline int32_t GetEnumNumber(int32_t number) { return number; }
+inline int32_t GetEnumNumber(
+    const google::protobuf::EnumValueDescriptor* value) {
+  return value->number();
+}
+
+// Sets (*matches)[i] to @is_match of the value of the field at
+// @field_descriptors in *@messages[i], for each i in @selection, as in
+// FieldFilter::MatchSelected. The values are read with @getter when it is not
+// nullptr, and with protobuf reflection otherwise, which is decided once for
+// all the messages.
+//
+// @is_match takes ProtoFieldValue<AccessorValueType<ValueType>> for the values
+// read with @getter, and ProtoFieldValue<ValueType> for the others, which only
+// differ for enum fields, see GetEnumNumber.
+template <typename ValueType, typename IsMatch>
+void MatchSelectedValues(
+    absl::Span<const google::protobuf::Message* const> messages,
+    absl::Span<const int> selection,
+    absl::Span<const google::protobuf::FieldDescriptor* const>
+        field_descriptors,
+    FieldGetter<AccessorValueType<ValueType>> getter, IsMatch&& is_match,
+    std::vector<bool>* matches) {
+  if (getter != nullptr) {
+    for (int i : selection) {
+      (*matches)[i] = is_match(getter(*messages[i]));
+    }
+    return;
+  }
+  for (int i : selection) {
+    (*matches)[i] =
+        is_match(GetValueFromProto<ValueType>(*messages[i], field_descriptors));
+  }
+}
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_FIELD_ACCESSOR_H_
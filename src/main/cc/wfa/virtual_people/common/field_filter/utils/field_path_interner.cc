@@ -0,0 +1,132 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "google/protobuf/descriptor.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+absl::StatusOr<std::shared_ptr<const FieldPath>> ResolveFieldPath(
+    const google::protobuf::Descriptor* descriptor,
+    absl::string_view full_field_name) {
+  auto field_path = std::make_shared<FieldPath>();
+  std::vector<std::string> field_names = absl::StrSplit(full_field_name, ".");
+  for (const std::string& field_name : field_names) {
+    if (descriptor == nullptr) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("The field name is invalid: ", full_field_name));
+    }
+    const google::protobuf::FieldDescriptor* field_descriptor =
+        descriptor->FindFieldByName(field_name);
+    if (field_descriptor == nullptr) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("The field name is invalid: ", full_field_name));
+    }
+    field_path->push_back(field_descriptor);
+    descriptor = field_descriptor->message_type();
+  }
+  if (field_path->empty()) {
+    // This should never happen.
+    return absl::InternalError(
+        absl::StrCat("Get empty field descriptor from ", full_field_name));
+  }
+  return field_path;
+}
+
+// The interned paths of the message types in the generated descriptor pool.
+class FieldPathInterner {
+ public:
+  absl::StatusOr<std::shared_ptr<const FieldPath>> Intern(
+      const google::protobuf::Descriptor* descriptor,
+      absl::string_view full_field_name) {
+    {
+      absl::ReaderMutexLock lock(&mutex_);
+      auto paths = paths_.find(descriptor);
+      if (paths != paths_.end()) {
+        auto path = paths->second.find(full_field_name);
+        if (path != paths->second.end()) {
+          return path->second;
+        }
+      }
+    }
+    // Invalid names are not interned.
+    absl::StatusOr<std::shared_ptr<const FieldPath>> field_path =
+        ResolveFieldPath(descriptor, full_field_name);
+    if (!field_path.ok()) {
+      return field_path;
+    }
+    absl::MutexLock lock(&mutex_);
+    return paths_[descriptor]
+        .try_emplace(full_field_name, *std::move(field_path))
+        .first->second;
+  }
+
+ private:
+  absl::Mutex mutex_;
+  absl::flat_hash_map<
+      const google::protobuf::Descriptor*,
+      absl::flat_hash_map<std::string, std::shared_ptr<const FieldPath>>>
+      paths_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace
+
+absl::StatusOr<std::shared_ptr<const FieldPath>> InternFieldPath(
+    const google::protobuf::Descriptor* descriptor,
+    absl::string_view full_field_name) {
+  if (descriptor == nullptr ||
+      descriptor->file()->pool() !=
+          google::protobuf::DescriptorPool::generated_pool()) {
+    return ResolveFieldPath(descriptor, full_field_name);
+  }
+  static auto* const interner = new FieldPathInterner();
+  return interner->Intern(descriptor, full_field_name);
+}
+
+std::string GetFieldPathName(const FieldPath& field_path) {
+  return absl::StrJoin(
+      field_path, ".",
+      [](std::string* out, const google::protobuf::FieldDescriptor* field) {
+        out->append(field->name());
+      });
+}
+
+std::shared_ptr<const FieldPath> InternFieldPath(const FieldPath& field_path) {
+  absl::StatusOr<std::shared_ptr<const FieldPath>> interned =
+      InternFieldPath(field_path.front()->containing_type(),
+                      GetFieldPathName(field_path));
+  if (interned.ok()) {
+    return *std::move(interned);
+  }
+  // This should never happen, since the fields are resolved already.
+  return std::make_shared<const FieldPath>(field_path);
+}
+
+}  // namespace wfa_virtual_people
@@ -0,0 +1,68 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_FIELD_PATH_INTERNER_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_FIELD_PATH_INTERNER_H_
+
+#include <memory>
+#include <string>
+
+#include "absl/container/inlined_vector.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/descriptor.h"
+
+namespace wfa_virtual_people {
+
+// The number of fields stored inline in a FieldPath. Deeper paths are stored
+// on the heap.
+inline constexpr int kInlineFieldPathDepth = 6;
+
+// The field descriptors of a field path, in the order of the field names to
+// access the nested field.
+using FieldPath = absl::InlinedVector<const google::protobuf::FieldDescriptor*,
+                                      kInlineFieldPathDepth>;
+
+// Resolves the field path represented by @full_field_name, which is separated
+// by ".", in the protobuf message represented by @descriptor.
+//
+// The resolved paths are interned: all the calls with the same @descriptor and
+// @full_field_name share the same immutable FieldPath, and only the first call
+// splits the name and looks up the fields. Only the message types of the
+// generated descriptor pool are interned, since other pools, and the
+// descriptors in them, might be destroyed. The paths of other message types
+// are resolved on every call.
+//
+// Unlike GetFieldFromProto, repeated fields in the path are not checked.
+//
+// Returns error status if any field in the path does not exist.
+//
+// This function is thread-safe.
+absl::StatusOr<std::shared_ptr<const FieldPath>> InternFieldPath(
+    const google::protobuf::Descriptor* descriptor,
+    absl::string_view full_field_name);
+
+// Returns the names of the fields in @field_path joined by ".", which resolves
+// to @field_path in the message type containing its first field.
+std::string GetFieldPathName(const FieldPath& field_path);
+
+// Returns the interned path equal to @field_path, which is not empty, in the
+// message type containing its first field. Used for paths built from other
+// paths, like the paths of the sub filters of PARTIAL prefixed by the path of
+// the PARTIAL.
+std::shared_ptr<const FieldPath> InternFieldPath(const FieldPath& field_path);
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_FIELD_PATH_INTERNER_H_
@@ -14,6 +14,7 @@
 
 #include "wfa/virtual_people/common/field_filter/utils/field_util.h"
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -22,54 +23,47 @@
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
-#include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "common_cpp/macros/macros.h"
 #include "google/protobuf/descriptor.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
 #include "wfa/virtual_people/common/field_filter/utils/template_util.h"
 
 namespace wfa_virtual_people {
 
-absl::StatusOr<std::vector<const google::protobuf::FieldDescriptor*>>
-GetFieldFromProto(const google::protobuf::Descriptor* descriptor,
-                  absl::string_view full_field_name, bool allow_repeated) {
-  std::vector<const google::protobuf::FieldDescriptor*> field_descriptors;
-  std::vector<std::string> field_names = absl::StrSplit(full_field_name, ".");
-  for (const std::string& field_name : field_names) {
-    if (descriptor == nullptr) {
-      return absl::InvalidArgumentError(
-          absl::StrCat("The field name is invalid: ", full_field_name));
-    }
-    const google::protobuf::FieldDescriptor* field_descriptor =
-        descriptor->FindFieldByName(field_name);
-    if (field_descriptor == nullptr) {
-      return absl::InvalidArgumentError(
-          absl::StrCat("The field name is invalid: ", full_field_name));
-    }
-    field_descriptors.emplace_back(field_descriptor);
-    descriptor = field_descriptor->message_type();
-  }
-  if (field_descriptors.empty()) {
-    // This should never happen.
-    return absl::InternalError(
-        absl::StrCat("Get empty field descriptor from ", full_field_name));
-  }
-  for (auto it = field_descriptors.begin(), j = field_descriptors.end() - 1;
-       it != j; ++it) {
+absl::StatusOr<std::shared_ptr<const FieldPath>> GetFieldPathFromProto(
+    const google::protobuf::Descriptor* descriptor,
+    absl::string_view full_field_name, bool allow_repeated) {
+  ASSIGN_OR_RETURN(std::shared_ptr<const FieldPath> field_path,
+                   InternFieldPath(descriptor, full_field_name));
+  for (auto it = field_path->begin(), j = field_path->end() - 1; it != j;
+       ++it) {
     if ((*it)->is_repeated()) {
       return absl::InvalidArgumentError(absl::StrCat(
           "Repeated field is not allowed in the path: ", full_field_name));
     }
   }
-  if (!allow_repeated && field_descriptors.back()->is_repeated()) {
+  if (!allow_repeated && field_path->back()->is_repeated()) {
     return absl::InvalidArgumentError(absl::StrCat(
         "Repeated field is not allowed in the path: ", full_field_name));
   }
-  return field_descriptors;
+  return field_path;
+}
+
+absl::StatusOr<std::vector<const google::protobuf::FieldDescriptor*>>
+GetFieldFromProto(const google::protobuf::Descriptor* descriptor,
+                  absl::string_view full_field_name, bool allow_repeated) {
+  ASSIGN_OR_RETURN(
+      std::shared_ptr<const FieldPath> field_path,
+      GetFieldPathFromProto(descriptor, full_field_name, allow_repeated));
+  return std::vector<const google::protobuf::FieldDescriptor*>(
+      field_path->begin(), field_path->end());
 }
 
 const google::protobuf::Message& GetParentMessageFromProto(
     const google::protobuf::Message& message,
-    const std::vector<const google::protobuf::FieldDescriptor*>&
+    absl::Span<const google::protobuf::FieldDescriptor* const>
         field_descriptors) {
   const google::protobuf::Message* tmp_message = &message;
   // @field_descriptors refers to a field in @message. To get the parent message
@@ -84,7 +78,7 @@ const google::protobuf::Message& GetParentMessageFromProto(
 
 google::protobuf::Message& GetMutableParentMessageFromProto(
     google::protobuf::Message& message,
-    const std::vector<const google::protobuf::FieldDescriptor*>&
+    absl::Span<const google::protobuf::FieldDescriptor* const>
         field_descriptors) {
   google::protobuf::Message* tmp_message = &message;
   // @field_descriptors refers to a field in @message. To get the parent message
@@ -252,7 +246,7 @@ void SetImmediateValueToProto<const std::string&>(
 
 int GetSizeOfRepeatedProto(
     const google::protobuf::Message& message,
-    const std::vector<const google::protobuf::FieldDescriptor*>&
+    absl::Span<const google::protobuf::FieldDescriptor* const>
         field_descriptors) {
   const google::protobuf::Message& parent =
       GetParentMessageFromProto(message, field_descriptors);
@@ -15,13 +15,16 @@
 #ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_FIELD_UTIL_H_
 #define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_FIELD_UTIL_H_
 
+#include <memory>
 #include <vector>
 
 #include "absl/meta/type_traits.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/message.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
 #include "wfa/virtual_people/common/field_filter/utils/template_util.h"
 
 namespace wfa_virtual_people {
@@ -48,11 +51,22 @@ struct ProtoFieldValue {
 //
 // The returned FieldDescriptors is in the order of the field name to access the
 // nested field.
+//
+// The path is resolved by InternFieldPath, so resolving the same
+// @full_field_name in the same message type again is a hash lookup.
 absl::StatusOr<std::vector<const google::protobuf::FieldDescriptor*>>
 GetFieldFromProto(const google::protobuf::Descriptor* descriptor,
                   absl::string_view full_field_name,
                   bool allow_repeated = false);
 
+// Same as GetFieldFromProto, except that the interned FieldPath is returned
+// instead of a copy. The returned path is shared by all the callers resolving
+// the same @full_field_name in the same message type, so holding it costs no
+// allocation.
+absl::StatusOr<std::shared_ptr<const FieldPath>> GetFieldPathFromProto(
+    const google::protobuf::Descriptor* descriptor,
+    absl::string_view full_field_name, bool allow_repeated = false);
+
 // Gets the parent message of the field represented by @field_descriptors from
 // the @message.
 //
@@ -84,13 +98,13 @@ GetFieldFromProto(const google::protobuf::Descriptor* descriptor,
 //     GetParentMessageFromProto(obj_a, field_descriptors);
 const google::protobuf::Message& GetParentMessageFromProto(
     const google::protobuf::Message& message,
-    const std::vector<const google::protobuf::FieldDescriptor*>&
+    absl::Span<const google::protobuf::FieldDescriptor* const>
         field_descriptors);
 
 // Same as above, but returns a mutable message.
 google::protobuf::Message& GetMutableParentMessageFromProto(
     google::protobuf::Message& message,
-    const std::vector<const google::protobuf::FieldDescriptor*>&
+    absl::Span<const google::protobuf::FieldDescriptor* const>
         field_descriptors);
 
 // Gets the value from the @message, with field name represented by
@@ -161,7 +175,7 @@ void SetImmediateValueToProto(
 template <typename ValueType, EnableIfProtoType<ValueType> = true>
 ProtoFieldValue<ValueType> GetValueFromProto(
     const google::protobuf::Message& message,
-    const std::vector<const google::protobuf::FieldDescriptor*>&
+    absl::Span<const google::protobuf::FieldDescriptor* const>
         field_descriptors) {
   return GetImmediateValueFromProto<ValueType>(
       GetParentMessageFromProto(message, field_descriptors),
@@ -198,7 +212,7 @@ ProtoFieldValue<ValueType> GetValueFromProto(
 template <typename ValueType, EnableIfProtoValueType<ValueType> = true>
 void SetValueToProto(
     google::protobuf::Message& message,
-    const std::vector<const google::protobuf::FieldDescriptor*>&
+    absl::Span<const google::protobuf::FieldDescriptor* const>
         field_descriptors,
     ValueType value) {
   SetImmediateValueToProto<ValueType>(
@@ -210,7 +224,7 @@ void SetValueToProto(
 // @message.
 int GetSizeOfRepeatedProto(
     const google::protobuf::Message& message,
-    const std::vector<const google::protobuf::FieldDescriptor*>&
+    absl::Span<const google::protobuf::FieldDescriptor* const>
         field_descriptors);
 
 // Gets the value from the @message, with repeated field name represented by
@@ -269,7 +283,7 @@ ValueType GetImmediateValueFromRepeatedProto(
 template <typename ValueType, EnableIfProtoType<ValueType> = true>
 ValueType GetValueFromRepeatedProto(
     const google::protobuf::Message& message,
-    const std::vector<const google::protobuf::FieldDescriptor*>&
+    absl::Span<const google::protobuf::FieldDescriptor* const>
         field_descriptors,
     int index) {
   return GetImmediateValueFromRepeatedProto<ValueType>(
@@ -22,9 +22,12 @@
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "common_cpp/macros/macros.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/message.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_accessor.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
 #include "wfa/virtual_people/common/field_filter/utils/field_util.h"
 #include "wfa/virtual_people/common/field_filter/utils/template_util.h"
 #include "wfa/virtual_people/common/field_filter/utils/type_convert_util.h"
@@ -35,14 +38,33 @@ template <typename IntegerType, EnableIfIntegerType<IntegerType> = true>
 class IntegerComparatorImpl : public IntegerComparator {
  public:
   IntegerComparatorImpl(
-      std::vector<const google::protobuf::FieldDescriptor*>&& field_descriptors,
-      IntegerType value)
-      : IntegerComparator(std::move(field_descriptors)), value_(value) {}
+      std::shared_ptr<const FieldPath> field_path, IntegerType value)
+      : IntegerComparator(std::move(field_path)),
+        getter_(GetFieldGetter<IntegerType>(
+            FindFieldAccessor(*field_path_))),
+        value_(value) {}
 
   IntegerCompareResult Compare(
       const google::protobuf::Message& message) const override {
-    ProtoFieldValue<IntegerType> field_value =
-        GetValueFromProto<IntegerType>(message, field_descriptors_);
+    return CompareValue(
+        GetValueFromProto<IntegerType>(message, *field_path_, getter_));
+  }
+
+  void CompareSelected(
+      absl::Span<const google::protobuf::Message* const> messages,
+      absl::Span<const int> selection, IntegerCompareResult result,
+      std::vector<bool>* matches) const override {
+    MatchSelectedValues<IntegerType>(
+        messages, selection, *field_path_, getter_,
+        [this, result](const ProtoFieldValue<IntegerType>& field_value) {
+          return CompareValue(field_value) == result;
+        },
+        matches);
+  }
+
+ private:
+  IntegerCompareResult CompareValue(
+      const ProtoFieldValue<IntegerType>& field_value) const {
     if (!field_value.is_set) {
       return IntegerCompareResult::INVALID;
     }
@@ -55,32 +77,30 @@ class IntegerComparatorImpl : public IntegerComparator {
     return IntegerCompareResult::EQUAL;
   }
 
- private:
+  FieldGetter<IntegerType> getter_;
   IntegerType value_;
 };
 
 template <typename IntegerType, EnableIfIntegerType<IntegerType> = true>
 absl::StatusOr<std::unique_ptr<IntegerComparatorImpl<IntegerType>>>
 CreateComparator(
-    std::vector<const google::protobuf::FieldDescriptor*>&& field_descriptors,
-    absl::string_view value) {
+    std::shared_ptr<const FieldPath> field_path, absl::string_view value) {
   ASSIGN_OR_RETURN(IntegerType int_value, ConvertToNumeric<IntegerType>(value));
   return absl::make_unique<IntegerComparatorImpl<IntegerType>>(
-      std::move(field_descriptors), int_value);
+      std::move(field_path), int_value);
 }
 
 absl::StatusOr<std::unique_ptr<IntegerComparator>> IntegerComparator::New(
-    std::vector<const google::protobuf::FieldDescriptor*>&& field_descriptors,
-    absl::string_view value) {
-  switch (field_descriptors.back()->cpp_type()) {
+    std::shared_ptr<const FieldPath> field_path, absl::string_view value) {
+  switch (field_path->back()->cpp_type()) {
     case google::protobuf::FieldDescriptor::CppType::CPPTYPE_INT32:
-      return CreateComparator<int32_t>(std::move(field_descriptors), value);
+      return CreateComparator<int32_t>(std::move(field_path), value);
     case google::protobuf::FieldDescriptor::CppType::CPPTYPE_INT64:
-      return CreateComparator<int64_t>(std::move(field_descriptors), value);
+      return CreateComparator<int64_t>(std::move(field_path), value);
     case google::protobuf::FieldDescriptor::CppType::CPPTYPE_UINT32:
-      return CreateComparator<uint32_t>(std::move(field_descriptors), value);
+      return CreateComparator<uint32_t>(std::move(field_path), value);
     case google::protobuf::FieldDescriptor::CppType::CPPTYPE_UINT64:
-      return CreateComparator<uint64_t>(std::move(field_descriptors), value);
+      return CreateComparator<uint64_t>(std::move(field_path), value);
     default:
       return absl::InvalidArgumentError(
           "The given field is not integer when building IntegerComparator.");
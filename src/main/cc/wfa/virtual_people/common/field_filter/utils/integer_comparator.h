@@ -21,8 +21,10 @@
 
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/message.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
 
 namespace wfa_virtual_people {
 
@@ -40,7 +42,7 @@ enum IntegerCompareResult {
 //   uint32_t
 //   uint64_t
 //
-// The path represented by @field_descriptors must be a valid path to an integer
+// The path represented by @field_path must be a valid path to an integer
 // field in @message.
 //
 // Usage example:
@@ -52,16 +54,15 @@ enum IntegerCompareResult {
 //   optional B b = 1;
 // }
 //
-// To get the field_descriptors:
-// ASSIGN_OR_RETURN(
-//     std::vector<const google::protobuf::FieldDescriptor*> field_descriptors,
-//     GetFieldFromProto(A().GetDescriptor(), "b.c"));
+// To get the field_path:
+// ASSIGN_OR_RETURN(std::shared_ptr<const FieldPath> field_path,
+//                  GetFieldPathFromProto(A().GetDescriptor(), "b.c"));
 //
 // To build an IntegerComparator which compares the field b.c in message A with
 // value 10:
 // ASSIGN_OR_RETURN(
 //   std::unique_ptr<IntegerComparator> comparator,
-//   IntegerComparator::New(std::move(field_descriptors), "10"));
+//   IntegerComparator::New(std::move(field_path), "10"));
 //
 // Compare examples:
 // A a_1;
@@ -80,40 +81,50 @@ class IntegerComparator {
   // Always use IntegerComparator::New to get an IntegerComparator object.
   //
   // Returns error status if any of the following happens:
-  // * The last entry of @field_descriptors refers to a non-integer field.
+  // * The last entry of @field_path refers to a non-integer field.
   // * The type of @value does not match the type of the field represented by
-  //   the last entry of @field_descriptors.
+  //   the last entry of @field_path.
   //
-  // No repeated field is allowed in @field_descriptors. This will not be caught
+  // No repeated field is allowed in @field_path. This will not be caught
   // in this class. But when following the examples above, the repeated field
   // error will be caught before calling this library.
   static absl::StatusOr<std::unique_ptr<IntegerComparator>> New(
-      std::vector<const google::protobuf::FieldDescriptor*>&& field_descriptors,
-      absl::string_view value);
+      std::shared_ptr<const FieldPath> field_path, absl::string_view value);
 
   IntegerComparator(const IntegerComparator&) = delete;
   IntegerComparator& operator=(const IntegerComparator&) = delete;
 
   virtual ~IntegerComparator() = default;
 
-  // Compares the field represented by @field_descriptors in @message and
+  // Compares the field represented by @field_path in @message and
   // @value.
   // Returns GREATER_THAN if the field in @message is greater than @value.
   // Returns EQUAL if the field in @message is equal to @value.
   // Returns LESS_THAN if the field in @message is less than @value.
   // Returns INVALID if the field in @message is not set.
   //
-  // @field_descriptors must represent a valid path in @message to an integer
+  // @field_path must represent a valid path in @message to an integer
   // field.
   virtual IntegerCompareResult Compare(
       const google::protobuf::Message& message) const = 0;
 
+  // Sets (*matches)[i] to whether Compare(*@messages[i]) returns @result, for
+  // each i in @selection, as in FieldFilter::MatchSelected.
+  virtual void CompareSelected(
+      absl::Span<const google::protobuf::Message* const> messages,
+      absl::Span<const int> selection, IntegerCompareResult result,
+      std::vector<bool>* matches) const = 0;
+
+  // Returns the path of the compared field.
+  const std::shared_ptr<const FieldPath>& field_path() const {
+    return field_path_;
+  }
+
  protected:
-  IntegerComparator(
-      std::vector<const google::protobuf::FieldDescriptor*>&& field_descriptors)
-      : field_descriptors_(std::move(field_descriptors)) {}
+  IntegerComparator(std::shared_ptr<const FieldPath> field_path)
+      : field_path_(std::move(field_path)) {}
 
-  std::vector<const google::protobuf::FieldDescriptor*> field_descriptors_;
+  std::shared_ptr<const FieldPath> field_path_;
 };
 
 }  // namespace wfa_virtual_people
@@ -0,0 +1,182 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/utils/regexp_matcher.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+#include "re2/re2.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+// Older RE2 releases do not accept absl::string_view directly.
+re2::StringPiece ToStringPiece(absl::string_view text) {
+  return re2::StringPiece(text.data(), text.size());
+}
+
+// The result of matching a text against ".*".
+enum class DotStarMatch {
+  kMatch,
+  kNoMatch,
+  // The text has non-ASCII bytes, which must be decoded as UTF-8 by RE2.
+  kUnknown,
+};
+
+DotStarMatch MatchDotStar(absl::string_view text) {
+  DotStarMatch result = DotStarMatch::kMatch;
+  for (char c : text) {
+    if (c == '\n') {
+      return DotStarMatch::kNoMatch;
+    }
+    if (!absl::ascii_isascii(c)) {
+      result = DotStarMatch::kUnknown;
+    }
+  }
+  return result;
+}
+
+// Unescapes @pattern to @literal if @pattern only matches a literal string.
+// Only escaped punctuations are accepted, as escaped letters and digits have
+// special meanings.
+bool ParseLiteral(absl::string_view pattern, std::string& literal) {
+  literal.clear();
+  for (size_t i = 0; i < pattern.size(); ++i) {
+    char c = pattern[i];
+    if (c == '\\') {
+      if (i + 1 == pattern.size() || !absl::ascii_ispunct(pattern[i + 1])) {
+        return false;
+      }
+      literal.push_back(pattern[++i]);
+      continue;
+    }
+    if (absl::string_view("^$.|?*+()[]{}").find(c) != absl::string_view::npos) {
+      return false;
+    }
+    literal.push_back(c);
+  }
+  return true;
+}
+
+// Removes @suffix from the end of @pattern, unless its first character is
+// escaped by a backslash.
+bool ConsumeUnescapedSuffix(absl::string_view& pattern,
+                            absl::string_view suffix) {
+  if (!absl::EndsWith(pattern, suffix)) {
+    return false;
+  }
+  size_t end = pattern.size() - suffix.size();
+  size_t backslashes = 0;
+  while (backslashes < end && pattern[end - backslashes - 1] == '\\') {
+    ++backslashes;
+  }
+  if (backslashes % 2 == 1) {
+    return false;
+  }
+  pattern.remove_suffix(suffix.size());
+  return true;
+}
+
+// Returns the kind of @pattern, and sets the literal part to @literal.
+RegexpMatcherKind GetKind(absl::string_view pattern, std::string& literal) {
+  // The pattern always matches the whole value, so the anchors are no-ops.
+  absl::ConsumePrefix(&pattern, "^");
+  ConsumeUnescapedSuffix(pattern, "$");
+  bool leading = absl::ConsumePrefix(&pattern, ".*");
+  bool trailing = ConsumeUnescapedSuffix(pattern, ".*");
+  if (!ParseLiteral(pattern, literal)) {
+    return RegexpMatcherKind::kRegexp;
+  }
+  if (leading && trailing) {
+    // A newline in the literal can be matched, while the ".*" around it
+    // cannot, which MatchDotStar does not tell apart.
+    if (absl::StrContains(literal, '\n')) {
+      return RegexpMatcherKind::kRegexp;
+    }
+    return RegexpMatcherKind::kContains;
+  }
+  if (leading) {
+    return RegexpMatcherKind::kSuffix;
+  }
+  if (trailing) {
+    return RegexpMatcherKind::kPrefix;
+  }
+  return RegexpMatcherKind::kLiteral;
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<RegexpMatcher>> RegexpMatcher::New(
+    absl::string_view pattern) {
+  // The pattern is always compiled, to reject invalid patterns, and to match
+  // the values the fast paths cannot decide.
+  auto regexp = absl::make_unique<RE2>(ToStringPiece(pattern), RE2::Quiet);
+  if (!regexp->ok()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Invalid regular expression ", pattern, ": ", regexp->error()));
+  }
+  std::string literal;
+  RegexpMatcherKind kind = GetKind(pattern, literal);
+  return absl::WrapUnique(
+      new RegexpMatcher(kind, std::move(literal), std::move(regexp)));
+}
+
+RegexpMatcher::RegexpMatcher(RegexpMatcherKind kind, std::string literal,
+                             std::unique_ptr<RE2> regexp)
+    : kind_(kind), literal_(std::move(literal)), regexp_(std::move(regexp)) {}
+
+bool RegexpMatcher::Matches(absl::string_view value) const {
+  DotStarMatch dot_star;
+  switch (kind_) {
+    case RegexpMatcherKind::kLiteral:
+      return value == literal_;
+    case RegexpMatcherKind::kPrefix:
+      if (!absl::StartsWith(value, literal_)) {
+        return false;
+      }
+      dot_star = MatchDotStar(value.substr(literal_.size()));
+      break;
+    case RegexpMatcherKind::kSuffix:
+      if (!absl::EndsWith(value, literal_)) {
+        return false;
+      }
+      dot_star = MatchDotStar(value.substr(0, value.size() - literal_.size()));
+      break;
+    case RegexpMatcherKind::kContains:
+      if (!absl::StrContains(value, literal_)) {
+        return false;
+      }
+      dot_star = MatchDotStar(value);
+      break;
+    default:
+      return RE2::FullMatch(ToStringPiece(value), *regexp_);
+  }
+  if (dot_star == DotStarMatch::kUnknown) {
+    return RE2::FullMatch(ToStringPiece(value), *regexp_);
+  }
+  return dot_star == DotStarMatch::kMatch;
+}
+
+}  // namespace wfa_virtual_people
@@ -0,0 +1,80 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_REGEXP_MATCHER_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_REGEXP_MATCHER_H_
+
+#include <memory>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "re2/re2.h"
+
+namespace wfa_virtual_people {
+
+// How RegexpMatcher matches a value.
+enum class RegexpMatcherKind {
+  // The pattern is a literal, and the value must equal to it.
+  kLiteral,
+  // The pattern is "<literal>.*".
+  kPrefix,
+  // The pattern is ".*<literal>".
+  kSuffix,
+  // The pattern is ".*<literal>.*".
+  kContains,
+  // Any other pattern, which is matched by RE2.
+  kRegexp,
+};
+
+// Matches strings against a RE2 regular expression. The whole string must
+// match the pattern, the same as RE2::FullMatch.
+//
+// The pattern is compiled once when created. Literal, prefix, suffix and
+// contains patterns are matched by comparing string_views, and only fall back
+// to RE2 for values with non-ASCII bytes in the part matched by ".*", since
+// "." does not match invalid UTF-8.
+//
+// Matches is thread-safe. It does not allocate, except when RE2 grows its
+// DFA cache, which is shared by all the calls and bounded.
+class RegexpMatcher {
+ public:
+  // Returns error status if @pattern is not a valid RE2 regular expression.
+  static absl::StatusOr<std::unique_ptr<RegexpMatcher>> New(
+      absl::string_view pattern);
+
+  RegexpMatcher(const RegexpMatcher&) = delete;
+  RegexpMatcher& operator=(const RegexpMatcher&) = delete;
+
+  // Returns true if the whole @value matches the pattern.
+  bool Matches(absl::string_view value) const;
+
+  RegexpMatcherKind kind() const { return kind_; }
+
+  // The pattern the matcher is built from.
+  const std::string& pattern() const { return regexp_->pattern(); }
+
+ private:
+  RegexpMatcher(RegexpMatcherKind kind, std::string literal,
+                std::unique_ptr<RE2> regexp);
+
+  RegexpMatcherKind kind_;
+  // The literal part of the pattern, unused when @kind_ is kRegexp.
+  std::string literal_;
+  std::unique_ptr<RE2> regexp_;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_REGEXP_MATCHER_H_
@@ -0,0 +1,103 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/utils/value_set.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/hash/hash.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+
+namespace wfa_virtual_people {
+
+ValueSet<std::string>::ValueSet(
+    const absl::flat_hash_set<std::string>& values) {
+  Init(values);
+}
+
+ValueSet<std::string>::ValueSet(absl::Span<const absl::string_view> values) {
+  Init(values);
+}
+
+template <typename Values>
+void ValueSet<std::string>::Init(const Values& values) {
+  entries_.reserve(values.size());
+  for (absl::string_view value : values) {
+    entries_.push_back({absl::Hash<absl::string_view>()(value),
+                        static_cast<uint32_t>(buffer_.size()),
+                        static_cast<uint32_t>(value.size())});
+    buffer_.append(value.data(), value.size());
+  }
+  if (entries_.size() <= kMaxInlineValues) {
+    return;
+  }
+
+  // At most half of the slots are used.
+  size_t capacity = 1;
+  while (capacity < 2 * entries_.size()) {
+    capacity *= 2;
+  }
+  slots_.assign(capacity, -1);
+  for (int32_t i = 0; i < static_cast<int32_t>(entries_.size()); ++i) {
+    size_t slot = entries_[i].hash & (capacity - 1);
+    while (slots_[slot] != -1) {
+      slot = (slot + 1) & (capacity - 1);
+    }
+    slots_[slot] = i;
+  }
+}
+
+std::vector<absl::string_view> ValueSet<std::string>::GetValues() const {
+  std::vector<absl::string_view> values;
+  values.reserve(entries_.size());
+  for (const Entry& entry : entries_) {
+    values.push_back(GetString(entry));
+  }
+  std::sort(values.begin(), values.end());
+  return values;
+}
+
+bool ValueSet<std::string>::contains(absl::string_view value) const {
+  if (external_ != nullptr) {
+    return external_->contains(value);
+  }
+  if (slots_.empty()) {
+    for (const Entry& entry : entries_) {
+      if (MatchesStringLiteral(GetString(entry), value)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  size_t hash = absl::Hash<absl::string_view>()(value);
+  size_t mask = slots_.size() - 1;
+  for (size_t slot = hash & mask; slots_[slot] != -1;
+       slot = (slot + 1) & mask) {
+    const Entry& entry = entries_[slots_[slot]];
+    if (entry.hash == hash && MatchesStringLiteral(GetString(entry), value)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace wfa_virtual_people
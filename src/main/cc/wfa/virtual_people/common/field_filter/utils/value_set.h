@@ -0,0 +1,302 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_VALUE_SET_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_VALUE_SET_H_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "wfa/virtual_people/common/field_filter/utils/external_value_set.h"
+
+namespace wfa_virtual_people {
+
+// The representations of ValueSet.
+enum class ValueSetRepresentation {
+  // An inline array, which is scanned without branches.
+  kInline,
+  // A bitmap of the values minus the smallest value.
+  kBitmap,
+  // A sorted vector, which is binary searched.
+  kSorted,
+  // A hash set.
+  kHashSet,
+  // An ExternalValueSet, shared with the other sets built from the same file.
+  kExternal,
+};
+
+// The set of values to check the membership in IN and ANY_IN filters. T is an
+// integer type or bool.
+//
+// The representation is picked from the size and the density of the values
+// when the set is built:
+// * kBitmap if the values span at most kMaxBitmapBits, and at most
+//   kMaxBitmapBitsPerValue per value, e.g. a contiguous enum range.
+// * Otherwise, kInline for at most kMaxInlineValues values.
+// * Otherwise, kSorted for at most kMaxSortedValues values.
+// * Otherwise, kHashSet.
+// A set built from an ExternalValueSet is kExternal.
+template <typename T>
+class ValueSet {
+ public:
+  static_assert(std::is_integral_v<T>, "T must be an integer type or bool.");
+
+  static constexpr int kMaxInlineValues = 8;
+  static constexpr int kMaxSortedValues = 64;
+  static constexpr uint64_t kMaxBitmapBits = uint64_t{1} << 16;
+  static constexpr uint64_t kMaxBitmapBitsPerValue = 64;
+
+  // An empty set.
+  ValueSet() = default;
+
+  explicit ValueSet(const absl::flat_hash_set<T>& values) { Init(values); }
+
+  // Same as above, with distinct @values in any order.
+  explicit ValueSet(absl::Span<const T> values) { Init(values); }
+
+  // The values of @external, whose kind must be kSigned for signed T and
+  // bool, and kUnsigned for unsigned T.
+  explicit ValueSet(std::shared_ptr<const ExternalValueSet> external)
+      : representation_(ValueSetRepresentation::kExternal),
+        size_(static_cast<int>(std::min<uint64_t>(
+            external->size(), std::numeric_limits<int>::max()))),
+        external_(std::move(external)) {}
+
+  bool contains(T value) const {
+    switch (representation_) {
+      case ValueSetRepresentation::kInline: {
+        bool found = false;
+        for (int i = 0; i < kMaxInlineValues; ++i) {
+          found |= (i < size_) & (inline_values_[i] == value);
+        }
+        return found;
+      }
+      case ValueSetRepresentation::kBitmap: {
+        // Values less than min_ wrap around to large offsets.
+        uint64_t offset = static_cast<uint64_t>(value) - min_;
+        return offset < bitmap_bits_ &&
+               ((bitmap_[offset >> 6] >> (offset & 63)) & 1);
+      }
+      case ValueSetRepresentation::kSorted:
+        return std::binary_search(sorted_values_.begin(), sorted_values_.end(),
+                                  value);
+      case ValueSetRepresentation::kHashSet:
+        return hash_set_.contains(value);
+      case ValueSetRepresentation::kExternal:
+        if constexpr (std::is_signed_v<T> || std::is_same_v<T, bool>) {
+          return external_->contains(static_cast<int64_t>(value));
+        } else {
+          return external_->contains(static_cast<uint64_t>(value));
+        }
+    }
+    return false;
+  }
+
+  ValueSetRepresentation representation() const { return representation_; }
+
+  // Capped at the largest int for kExternal.
+  int size() const { return size_; }
+
+  // Returns the values of the set, in ascending order. Empty for kExternal,
+  // whose values stay in the file.
+  std::vector<T> GetValues() const;
+
+  // The ExternalValueSet of kExternal, or nullptr.
+  const std::shared_ptr<const ExternalValueSet>& external() const {
+    return external_;
+  }
+
+ private:
+  template <typename Values>
+  void Init(const Values& values);
+
+  ValueSetRepresentation representation_ = ValueSetRepresentation::kInline;
+  int size_ = 0;
+  std::array<T, kMaxInlineValues> inline_values_ = {};
+  // The smallest value, and the number of bits in @bitmap_.
+  uint64_t min_ = 0;
+  uint64_t bitmap_bits_ = 0;
+  std::vector<uint64_t> bitmap_;
+  std::vector<T> sorted_values_;
+  absl::flat_hash_set<T> hash_set_;
+  std::shared_ptr<const ExternalValueSet> external_;
+};
+
+template <typename T>
+template <typename Values>
+void ValueSet<T>::Init(const Values& values) {
+  size_ = static_cast<int>(values.size());
+  if (values.empty()) {
+    return;
+  }
+  auto [min_it, max_it] = std::minmax_element(values.begin(), values.end());
+  // The span fits in uint64_t even for the full range of int64_t.
+  uint64_t span =
+      static_cast<uint64_t>(*max_it) - static_cast<uint64_t>(*min_it);
+  if (span < kMaxBitmapBits && span < kMaxBitmapBitsPerValue * values.size()) {
+    representation_ = ValueSetRepresentation::kBitmap;
+    min_ = static_cast<uint64_t>(*min_it);
+    bitmap_bits_ = span + 1;
+    bitmap_.assign((bitmap_bits_ + 63) / 64, 0);
+    for (T value : values) {
+      uint64_t offset = static_cast<uint64_t>(value) - min_;
+      bitmap_[offset >> 6] |= uint64_t{1} << (offset & 63);
+    }
+  } else if (values.size() <= kMaxInlineValues) {
+    representation_ = ValueSetRepresentation::kInline;
+    std::copy(values.begin(), values.end(), inline_values_.begin());
+  } else if (values.size() <= kMaxSortedValues) {
+    representation_ = ValueSetRepresentation::kSorted;
+    sorted_values_.assign(values.begin(), values.end());
+    std::sort(sorted_values_.begin(), sorted_values_.end());
+  } else {
+    representation_ = ValueSetRepresentation::kHashSet;
+    hash_set_.insert(values.begin(), values.end());
+  }
+}
+
+template <typename T>
+std::vector<T> ValueSet<T>::GetValues() const {
+  std::vector<T> values;
+  if (representation_ == ValueSetRepresentation::kExternal) {
+    return values;
+  }
+  values.reserve(size_);
+  switch (representation_) {
+    case ValueSetRepresentation::kInline:
+      values.assign(inline_values_.begin(), inline_values_.begin() + size_);
+      break;
+    case ValueSetRepresentation::kBitmap:
+      for (uint64_t offset = 0; offset < bitmap_bits_; ++offset) {
+        if ((bitmap_[offset >> 6] >> (offset & 63)) & 1) {
+          values.push_back(static_cast<T>(min_ + offset));
+        }
+      }
+      return values;
+    case ValueSetRepresentation::kSorted:
+      return sorted_values_;
+    case ValueSetRepresentation::kHashSet:
+      values.assign(hash_set_.begin(), hash_set_.end());
+      break;
+    case ValueSetRepresentation::kExternal:
+      return values;
+  }
+  std::sort(values.begin(), values.end());
+  return values;
+}
+
+// Returns true if @value equals @literal. The lengths and the first bytes are
+// compared before the whole strings.
+inline bool MatchesStringLiteral(absl::string_view literal,
+                                 absl::string_view value) {
+  return literal.size() == value.size() &&
+         (literal.empty() ||
+          (literal.front() == value.front() &&
+           std::memcmp(literal.data(), value.data(), literal.size()) == 0));
+}
+
+// The set of strings to check the membership in IN and ANY_IN filters.
+//
+// The strings are stored in one contiguous buffer, with their lengths and
+// hashes computed when the set is built. Lookups take absl::string_view, so
+// no std::string is built from the input.
+// * kInline for at most kMaxInlineValues strings, which are scanned without
+//   hashing the input. See MatchesStringLiteral.
+// * Otherwise, kHashSet. The input is hashed once and looked up in an open
+//   addressing table, comparing the hashes and the lengths before the whole
+//   strings.
+// A set built from an ExternalValueSet is kExternal.
+template <>
+class ValueSet<std::string> {
+ public:
+  static constexpr int kMaxInlineValues = 8;
+
+  // An empty set.
+  ValueSet() = default;
+
+  explicit ValueSet(const absl::flat_hash_set<std::string>& values);
+
+  // Same as above, with distinct @values in any order.
+  explicit ValueSet(absl::Span<const absl::string_view> values);
+
+  // The values of @external, whose kind must be kString.
+  explicit ValueSet(std::shared_ptr<const ExternalValueSet> external)
+      : external_(std::move(external)) {}
+
+  bool contains(absl::string_view value) const;
+
+  ValueSetRepresentation representation() const {
+    if (external_ != nullptr) {
+      return ValueSetRepresentation::kExternal;
+    }
+    return slots_.empty() ? ValueSetRepresentation::kInline
+                          : ValueSetRepresentation::kHashSet;
+  }
+
+  // Capped at the largest int for kExternal.
+  int size() const {
+    if (external_ != nullptr) {
+      return static_cast<int>(std::min<uint64_t>(
+          external_->size(), std::numeric_limits<int>::max()));
+    }
+    return static_cast<int>(entries_.size());
+  }
+
+  // Returns the values of the set, in ascending order. The values point to
+  // the memory of the set. Empty for kExternal, whose values stay in the file.
+  std::vector<absl::string_view> GetValues() const;
+
+  // The ExternalValueSet of kExternal, or nullptr.
+  const std::shared_ptr<const ExternalValueSet>& external() const {
+    return external_;
+  }
+
+ private:
+  struct Entry {
+    size_t hash;
+    uint32_t offset;
+    uint32_t length;
+  };
+
+  absl::string_view GetString(const Entry& entry) const {
+    return absl::string_view(buffer_.data() + entry.offset, entry.length);
+  }
+
+  template <typename Values>
+  void Init(const Values& values);
+
+  // All the strings, concatenated.
+  std::string buffer_;
+  std::vector<Entry> entries_;
+  // The open addressing table of the indexes of @entries_, where -1 is an
+  // empty slot. The size is a power of 2. Empty when kInline.
+  std::vector<int32_t> slots_;
+  std::shared_ptr<const ExternalValueSet> external_;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_VALUE_SET_H_
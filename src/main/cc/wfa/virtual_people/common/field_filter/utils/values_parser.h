@@ -15,17 +15,24 @@
 #ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_VALUES_PARSER_H_
 #define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_VALUES_PARSER_H_
 
+#include <memory>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
 #include "common_cpp/macros/macros.h"
 #include "google/protobuf/descriptor.h"
+#include "wfa/virtual_people/common/field_filter/utils/external_value_set.h"
 #include "wfa/virtual_people/common/field_filter/utils/template_util.h"
 #include "wfa/virtual_people/common/field_filter/utils/type_convert_util.h"
+#include "wfa/virtual_people/common/field_filter/utils/value_set.h"
 
 namespace wfa_virtual_people {
 
@@ -44,6 +51,12 @@ struct ParsedValues<const std::string&> {
   absl::flat_hash_set<std::string> values;
 };
 
+// The ValueSet to check the membership of the field values of ValueType in
+// ParsedValues<ValueType>.
+template <typename ValueType>
+using ParsedValueSet =
+    ValueSet<typename decltype(ParsedValues<ValueType>::values)::key_type>;
+
 // A helper function to parse and store @values_str as a set of ValueType.
 // @values_str is a string represents a list of ValueType entities separated by
 // comma.
@@ -83,6 +96,53 @@ absl::StatusOr<ParsedValues<const google::protobuf::EnumValueDescriptor*>>
 ParseEnumValues(const google::protobuf::EnumDescriptor* descriptor,
                 absl::string_view values_str);
 
+// Same as ParseValues, or ParseEnumValues when ValueType is
+// const google::protobuf::EnumValueDescriptor*, returning the values as a
+// ParsedValueSet. @field is the field the values are compared with.
+template <typename ValueType>
+absl::StatusOr<ParsedValueSet<ValueType>> ParseValueSet(
+    const google::protobuf::FieldDescriptor* field,
+    absl::string_view values_str) {
+  if constexpr (std::is_same_v<ValueType,
+                               const google::protobuf::EnumValueDescriptor*>) {
+    ASSIGN_OR_RETURN(ParsedValues<ValueType> parsed_values,
+                     ParseEnumValues(field->enum_type(), values_str));
+    return ParsedValueSet<ValueType>(parsed_values.values);
+  } else {
+    ASSIGN_OR_RETURN(ParsedValues<ValueType> parsed_values,
+                     ParseValues<ValueType>(values_str));
+    return ParsedValueSet<ValueType>(parsed_values.values);
+  }
+}
+
+// Returns the ParsedValueSet of the values in the ExternalValueSet file at
+// @path, which is used instead of parsing the values of IN and ANY_IN from a
+// string when FieldFilterProto.value_file is set. Enums are stored as their
+// numbers.
+//
+// Returns error status if the file cannot be opened, or the kind of its
+// values does not match ValueType.
+template <typename ValueType>
+absl::StatusOr<ParsedValueSet<ValueType>> OpenValueSetFile(
+    const std::string& path) {
+  using SetValueType =
+      typename decltype(ParsedValues<ValueType>::values)::key_type;
+  ExternalValueKind kind = ExternalValueKind::kUnsigned;
+  if constexpr (std::is_same_v<SetValueType, std::string>) {
+    kind = ExternalValueKind::kString;
+  } else if constexpr (std::is_signed_v<SetValueType> ||
+                       std::is_same_v<SetValueType, bool>) {
+    kind = ExternalValueKind::kSigned;
+  }
+  ASSIGN_OR_RETURN(std::shared_ptr<const ExternalValueSet> external,
+                   ExternalValueSet::Open(path));
+  if (external->kind() != kind) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "The kind of the values in ", path, " does not match the field."));
+  }
+  return ParsedValueSet<ValueType>(std::move(external));
+}
+
 }  // namespace wfa_virtual_people
 
 #endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_VALUES_PARSER_H_
@@ -0,0 +1,136 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/utils/work_stealing_pool.h"
+
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include "absl/functional/function_ref.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/synchronization/mutex.h"
+
+namespace wfa_virtual_people {
+
+// The tasks of one Run call.
+struct WorkStealingPool::Job {
+  Job(absl::FunctionRef<void(int)> task, int task_count)
+      : task(task), remaining(task_count) {}
+
+  void RunTask(int index) {
+    task(index);
+    remaining.DecrementCount();
+  }
+
+  absl::FunctionRef<void(int)> task;
+  // Run waits on it, and returns once all the tasks have returned.
+  absl::BlockingCounter remaining;
+};
+
+WorkStealingPool::WorkStealingPool(int thread_count) {
+  for (int i = 0; i < thread_count; ++i) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+  // The queue at index 0 is used by the threads calling Run.
+  for (int i = 1; i < thread_count; ++i) {
+    workers_.emplace_back([this, i]() { RunWorker(i); });
+  }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  {
+    absl::MutexLock lock(&mutex_);
+    stopping_ = true;
+  }
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+void WorkStealingPool::Run(int task_count, absl::FunctionRef<void(int)> task) {
+  if (task_count <= 0) {
+    return;
+  }
+  Job job(task, task_count);
+  const int queue_count = thread_count();
+  for (int i = 0; i < queue_count; ++i) {
+    const int begin = static_cast<int64_t>(task_count) * i / queue_count;
+    const int end = static_cast<int64_t>(task_count) * (i + 1) / queue_count;
+    Queue& queue = *queues_[i];
+    absl::MutexLock lock(&queue.mutex);
+    for (int index = begin; index < end; ++index) {
+      queue.tasks.push_back({&job, index});
+    }
+  }
+  {
+    absl::MutexLock lock(&mutex_);
+    queued_count_ += task_count;
+  }
+
+  Task next;
+  while (PopTask(0, next)) {
+    next.job->RunTask(next.index);
+  }
+  // The last tasks might still be running in other threads.
+  job.remaining.Wait();
+}
+
+bool WorkStealingPool::PopTask(int queue_index, Task& task) {
+  bool found = false;
+  {
+    Queue& queue = *queues_[queue_index];
+    absl::MutexLock lock(&queue.mutex);
+    if (!queue.tasks.empty()) {
+      task = queue.tasks.front();
+      queue.tasks.pop_front();
+      found = true;
+    }
+  }
+  const int queue_count = thread_count();
+  for (int i = 1; !found && i < queue_count; ++i) {
+    Queue& queue = *queues_[(queue_index + i) % queue_count];
+    absl::MutexLock lock(&queue.mutex);
+    if (!queue.tasks.empty()) {
+      task = queue.tasks.back();
+      queue.tasks.pop_back();
+      found = true;
+    }
+  }
+  if (found) {
+    absl::MutexLock lock(&mutex_);
+    --queued_count_;
+  }
+  return found;
+}
+
+void WorkStealingPool::RunWorker(int queue_index) {
+  auto has_task_or_stopping = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return queued_count_ > 0 || stopping_;
+  };
+  while (true) {
+    Task next;
+    if (PopTask(queue_index, next)) {
+      next.job->RunTask(next.index);
+      continue;
+    }
+    absl::MutexLock lock(&mutex_);
+    mutex_.Await(absl::Condition(&has_task_or_stopping));
+    if (stopping_ && queued_count_ <= 0) {
+      return;
+    }
+  }
+}
+
+}  // namespace wfa_virtual_people
@@ -0,0 +1,91 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_WORK_STEALING_POOL_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_WORK_STEALING_POOL_H_
+
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/functional/function_ref.h"
+#include "absl/synchronization/mutex.h"
+
+namespace wfa_virtual_people {
+
+// A fixed set of threads running the tasks of Run calls.
+//
+// Each thread has its own queue of tasks. Run spreads the tasks over the
+// queues in contiguous ranges, so that each thread runs neighboring tasks in
+// order. A thread whose queue is empty steals the last task of another queue,
+// so that the threads stay busy when the tasks take uneven times.
+//
+// The thread calling Run runs tasks too, so a pool of 1 thread starts no
+// thread and runs all the tasks in the calling thread.
+//
+// This class is thread-safe. Concurrent Run calls share the threads.
+class WorkStealingPool {
+ public:
+  // Starts @thread_count - 1 threads. @thread_count must be positive.
+  explicit WorkStealingPool(int thread_count);
+
+  // Waits for the threads to finish. No Run call must be in progress.
+  ~WorkStealingPool();
+
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+  // Calls @task(i) for each i in [0, @task_count), possibly from different
+  // threads, and returns once all the calls have returned.
+  void Run(int task_count, absl::FunctionRef<void(int)> task);
+
+  // The number of threads running tasks, including the thread calling Run.
+  int thread_count() const { return static_cast<int>(queues_.size()); }
+
+ private:
+  struct Job;
+
+  struct Task {
+    Job* job;
+    int index;
+  };
+
+  // Aligned to a cache line, as each queue is mostly used by one thread.
+  struct alignas(64) Queue {
+    absl::Mutex mutex;
+    std::deque<Task> tasks ABSL_GUARDED_BY(mutex);
+  };
+
+  // Pops the first task of the queue at @queue_index, or steals the last task
+  // of another queue. Returns false if all the queues are empty.
+  bool PopTask(int queue_index, Task& task);
+
+  // Runs tasks from the queue at @queue_index until stopped.
+  void RunWorker(int queue_index);
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> workers_;
+
+  absl::Mutex mutex_;
+  // The number of tasks in all the queues. The workers wait on it when there
+  // is no task to run.
+  int queued_count_ ABSL_GUARDED_BY(mutex_) = 0;
+  bool stopping_ ABSL_GUARDED_BY(mutex_) = false;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_UTILS_WORK_STEALING_POOL_H_
@@ -0,0 +1,158 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/accessors/field_accessor_generator.h"
+
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::testing::HasSubstr;
+using ::testing::Not;
+using ::wfa_virtual_people::test::TestProto;
+
+TEST(FieldAccessorGeneratorTest, TestIncludes) {
+  std::string output = GenerateFieldAccessors({TestProto().GetDescriptor()});
+  EXPECT_THAT(output, HasSubstr("#include "
+                                "\"wfa/virtual_people/common/field_filter/"
+                                "test/test.pb.h\""));
+}
+
+TEST(FieldAccessorGeneratorTest, TestSingularFields) {
+  std::string output = GenerateFieldAccessors({TestProto().GetDescriptor()});
+  for (const char* path :
+       {"\"a\"", "\"a.b\"", "\"a.b.int32_value\"", "\"a.b.int64_value\"",
+        "\"a.b.uint32_value\"", "\"a.b.uint64_value\"", "\"a.b.bool_value\"",
+        "\"a.b.enum_value\"", "\"a.b.string_value\""}) {
+    EXPECT_THAT(output,
+                HasSubstr(absl::StrCat(
+                    "RegisterFieldAccessor(::wfa_virtual_people::test::"
+                    "TestProto::descriptor(), ",
+                    path)));
+  }
+  EXPECT_THAT(output, HasSubstr("parent.has_int32_value()"));
+  EXPECT_THAT(output, HasSubstr("static_cast<int32_t>(parent.enum_value())"));
+}
+
+TEST(FieldAccessorGeneratorTest, TestSkippedFields) {
+  std::string output = GenerateFieldAccessors({TestProto().GetDescriptor()});
+  // Repeated fields.
+  EXPECT_THAT(output, Not(HasSubstr("\"int32_values\"")));
+  EXPECT_THAT(output, Not(HasSubstr("repeated_proto_a")));
+  EXPECT_THAT(output, Not(HasSubstr("\"a.b.string_values\"")));
+  // Floating point fields.
+  EXPECT_THAT(output, Not(HasSubstr("\"a.b.float_value\"")));
+  EXPECT_THAT(output, Not(HasSubstr("\"a.b.double_value\"")));
+}
+
+TEST(FieldAccessorGeneratorTest, TestKeywordFieldNames) {
+  google::protobuf::FileDescriptorProto file_proto;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      R"pb(
+        name: "keyword_test.proto"
+        package: "keyword_test"
+        syntax: "proto2"
+        message_type {
+          name: "KeywordProto"
+          field {
+            name: "nullptr"
+            number: 1
+            label: LABEL_OPTIONAL
+            type: TYPE_INT32
+          }
+          field {
+            name: "char16_t"
+            number: 2
+            label: LABEL_OPTIONAL
+            type: TYPE_INT64
+          }
+          field {
+            name: "Requires"
+            number: 3
+            label: LABEL_OPTIONAL
+            type: TYPE_BOOL
+          }
+          field {
+            name: "value"
+            number: 4
+            label: LABEL_OPTIONAL
+            type: TYPE_STRING
+          }
+        }
+      )pb",
+      &file_proto));
+  google::protobuf::DescriptorPool pool;
+  const google::protobuf::FileDescriptor* file = pool.BuildFile(file_proto);
+  ASSERT_NE(file, nullptr);
+
+  std::string output = GenerateFieldAccessors({file->message_type(0)});
+  // protoc appends "_" to the accessors of the fields named as C++ keywords,
+  // after converting the names to lower case.
+  EXPECT_THAT(output, HasSubstr("parent.has_nullptr_()"));
+  EXPECT_THAT(output, HasSubstr("parent.nullptr_()"));
+  EXPECT_THAT(output, HasSubstr("parent.has_char16_t_()"));
+  EXPECT_THAT(output, HasSubstr("parent.requires_()"));
+  EXPECT_THAT(output, HasSubstr("parent.value()"));
+  EXPECT_THAT(output, Not(HasSubstr("parent.value_()")));
+}
+
+TEST(FieldAccessorGeneratorTest, TestNoPackage) {
+  google::protobuf::FileDescriptorProto file_proto;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      R"pb(
+        name: "no_package_test.proto"
+        syntax: "proto2"
+        message_type {
+          name: "NoPackageProto"
+          field {
+            name: "value"
+            number: 1
+            label: LABEL_OPTIONAL
+            type: TYPE_INT32
+          }
+          nested_type {
+            name: "Nested"
+            field {
+              name: "value"
+              number: 1
+              label: LABEL_OPTIONAL
+              type: TYPE_INT32
+            }
+          }
+        }
+      )pb",
+      &file_proto));
+  google::protobuf::DescriptorPool pool;
+  const google::protobuf::FileDescriptor* file = pool.BuildFile(file_proto);
+  ASSERT_NE(file, nullptr);
+
+  std::string output = GenerateFieldAccessors(
+      {file->message_type(0), file->message_type(0)->nested_type(0)});
+  EXPECT_THAT(output, HasSubstr("RegisterFieldAccessor(::NoPackageProto::"));
+  EXPECT_THAT(output,
+              HasSubstr("RegisterFieldAccessor(::NoPackageProto_Nested::"));
+  EXPECT_THAT(output, Not(HasSubstr("::::")));
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
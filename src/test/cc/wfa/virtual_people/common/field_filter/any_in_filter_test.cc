@@ -12,8 +12,13 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstdint>
+#include <string>
+#include <vector>
+
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "common_cpp/testing/status_macros.h"
 #include "common_cpp/testing/status_matchers.h"
 #include "gmock/gmock.h"
@@ -22,6 +27,7 @@
 #include "wfa/virtual_people/common/field_filter.pb.h"
 #include "wfa/virtual_people/common/field_filter/field_filter.h"
 #include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+#include "wfa/virtual_people/common/field_filter/utils/external_value_set.h"
 
 namespace wfa_virtual_people {
 namespace {
@@ -417,5 +423,42 @@ TEST(AnyInFilterTest, TestQuoteString) {
   EXPECT_FALSE(field_filter->IsMatch(test_proto_3));
 }
 
+TEST(AnyInFilterTest, TestValueFile) {
+  std::string path = testing::TempDir() + "/any_in_filter_test_uint64";
+  ASSERT_TRUE(
+      ExternalValueSet::Write(path, std::vector<uint64_t>{3, 1000}).ok());
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldFilter> field_filter,
+      FilterFromProtoText(absl::StrCat(
+          R"pb(name: "a.b.uint64_values" op: ANY_IN value_file: ")pb", path,
+          "\"")));
+
+  TestProto test_proto_1;
+  test_proto_1.mutable_a()->mutable_b()->add_uint64_values(1);
+  test_proto_1.mutable_a()->mutable_b()->add_uint64_values(1000);
+  EXPECT_TRUE(field_filter->IsMatch(test_proto_1));
+
+  TestProto test_proto_2;
+  test_proto_2.mutable_a()->mutable_b()->add_uint64_values(1);
+  test_proto_2.mutable_a()->mutable_b()->add_uint64_values(2);
+  EXPECT_FALSE(field_filter->IsMatch(test_proto_2));
+
+  TestProto test_proto_3;
+  EXPECT_FALSE(field_filter->IsMatch(test_proto_3));
+}
+
+TEST(AnyInFilterTest, TestValueAndValueFile) {
+  std::string path = testing::TempDir() + "/any_in_filter_test_both";
+  ASSERT_TRUE(ExternalValueSet::Write(path, std::vector<uint64_t>{1}).ok());
+  EXPECT_THAT(FilterFromProtoText(absl::StrCat(
+                                      R"pb(name: "a.b.uint64_values"
+                                           op: ANY_IN
+                                           value: "1"
+                                           value_file: ")pb",
+                                      path, "\""))
+                  .status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
 }  // namespace
 }  // namespace wfa_virtual_people
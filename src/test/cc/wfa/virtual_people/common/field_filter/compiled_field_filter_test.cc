@@ -0,0 +1,240 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/compiled_field_filter.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "common_cpp/testing/status_macros.h"
+#include "common_cpp/testing/status_matchers.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+#include "wfa/virtual_people/common/field_filter/test_util.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::wfa::StatusIs;
+using ::wfa_virtual_people::test::TestProto;
+
+// Checks that the CompiledFieldFilter built from @config_text matches the
+// same messages as the FieldFilter built from @config_text.
+void ExpectCompiledSameAsFieldFilter(const std::string& config_text) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<CompiledFieldFilter> compiled_filter,
+                       CompiledFieldFilter::New(TestProto().GetDescriptor(),
+                                                ParseConfig(config_text)));
+  ExpectSameAsFieldFilter(config_text, GetTestProtos(),
+                          [&](const TestProto& test_proto) {
+                            return compiled_filter->IsMatch(test_proto);
+                          });
+}
+
+TEST(CompiledFieldFilterTest, TestLeafFilters) {
+  for (const char* config : {
+           R"pb(op: TRUE)pb",
+           R"pb(name: "a.b" op: HAS)pb",
+           R"pb(name: "a.b.int32_value" op: HAS)pb",
+           R"pb(name: "a.b.string_values" op: HAS)pb",
+           R"pb(name: "a.b.int32_value" op: EQUAL value: "1")pb",
+           R"pb(name: "a.b.int64_value" op: EQUAL value: "30")pb",
+           R"pb(name: "a.b.uint32_value" op: EQUAL value: "3")pb",
+           R"pb(name: "a.b.uint64_value"
+                op: EQUAL
+                value: "18446744073709551615")pb",
+           R"pb(name: "a.b.bool_value" op: EQUAL value: "false")pb",
+           R"pb(name: "a.b.enum_value" op: EQUAL value: "TEST_ENUM_1")pb",
+           R"pb(name: "a.b.enum_value" op: EQUAL value: "3")pb",
+           R"pb(name: "a.b.string_value" op: EQUAL value: "string3")pb",
+           R"pb(name: "a.b.int32_value" op: GT value: "0")pb",
+           R"pb(name: "a.b.int32_value" op: LT value: "0")pb",
+           R"pb(name: "a.b.uint64_value" op: GT value: "2")pb",
+           R"pb(name: "a.b.int64_value" op: LT value: "30")pb",
+           R"pb(name: "a.b.int32_value" op: IN value: "-3,2")pb",
+           R"pb(name: "a.b.uint32_value" op: IN value: "1,2")pb",
+           R"pb(name: "a.b.bool_value" op: IN value: "true")pb",
+           R"pb(name: "a.b.enum_value" op: IN value: "TEST_ENUM_3,2")pb",
+           R"pb(name: "a.b.string_value" op: IN value: "string1,string2")pb",
+           R"pb(name: "int32_values" op: ANY_IN value: "1,3")pb",
+           R"pb(name: "a.b.int32_values" op: ANY_IN value: "2")pb",
+           R"pb(name: "a.b.uint64_values" op: ANY_IN value: "3")pb",
+           R"pb(name: "a.b.enum_values" op: ANY_IN value: "TEST_ENUM_2")pb",
+           R"pb(name: "a.b.string_values" op: ANY_IN value: "string2")pb",
+       }) {
+    ExpectCompiledSameAsFieldFilter(config);
+  }
+}
+
+TEST(CompiledFieldFilterTest, TestCompositeFilters) {
+  for (const char* config : {
+           R"pb(op: AND
+                sub_filters { name: "a.b.int32_value" op: EQUAL value: "1" }
+                sub_filters { name: "a.b.int64_value" op: EQUAL value: "1" }
+           )pb",
+           R"pb(op: OR
+                sub_filters { name: "a.b.int32_value" op: EQUAL value: "1" }
+                sub_filters { name: "a.b.int64_value" op: EQUAL value: "30" }
+           )pb",
+           R"pb(op: NOT
+                sub_filters { name: "a.b.int32_value" op: EQUAL value: "1" }
+                sub_filters { name: "a.b.int64_value" op: EQUAL value: "1" }
+           )pb",
+           R"pb(name: "a.b"
+                op: PARTIAL
+                sub_filters { name: "int32_value" op: GT value: "-5" }
+                sub_filters { name: "string_value" op: HAS })pb",
+           R"pb(op: OR
+                sub_filters {
+                  name: "a"
+                  op: PARTIAL
+                  sub_filters {
+                    name: "b"
+                    op: PARTIAL
+                    sub_filters { name: "int32_value" op: EQUAL value: "1" }
+                  }
+                }
+                sub_filters {
+                  op: NOT
+                  sub_filters { name: "a.b" op: HAS }
+                })pb",
+           R"pb(op: AND
+                sub_filters {
+                  op: OR
+                  sub_filters { name: "a.b.int32_value" op: LT value: "0" }
+                  sub_filters { name: "int32_values" op: ANY_IN value: "1" }
+                }
+                sub_filters {
+                  name: "a.b"
+                  op: PARTIAL
+                  sub_filters { name: "bool_value" op: HAS }
+                }
+                sub_filters { op: TRUE })pb",
+       }) {
+    ExpectCompiledSameAsFieldFilter(config);
+  }
+}
+
+TEST(CompiledFieldFilterTest, TestMatchBatch) {
+  FieldFilterProto config;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      R"pb(
+        op: OR
+        sub_filters { name: "a.b.int32_value" op: EQUAL value: "1" }
+        sub_filters { name: "a.b.int64_value" op: EQUAL value: "30" }
+      )pb",
+      &config));
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<CompiledFieldFilter> compiled_filter,
+      CompiledFieldFilter::New(TestProto().GetDescriptor(), config));
+
+  std::vector<TestProto> test_protos = GetTestProtos();
+  std::vector<const google::protobuf::Message*> messages;
+  for (const TestProto& test_proto : test_protos) {
+    messages.push_back(&test_proto);
+  }
+  std::vector<bool> matches;
+  compiled_filter->MatchBatch(messages, &matches);
+  EXPECT_THAT(matches, testing::ElementsAre(false, false, false, true, true));
+}
+
+TEST(CompiledFieldFilterTest, TestFieldFilterOption) {
+  constexpr char kConfig[] = R"pb(
+    op: AND
+    sub_filters { name: "a.b.int32_value" op: GT value: "0" }
+    sub_filters {
+      op: NOT
+      sub_filters { name: "a.b.string_value" op: IN value: "string1" }
+    }
+  )pb";
+  FieldFilterProto config = ParseConfig(kConfig);
+  FieldFilterOptions options;
+  options.compiled = true;
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldFilter> compiled_filter,
+      FieldFilter::New(TestProto().GetDescriptor(), config, options));
+  EXPECT_NE(dynamic_cast<CompiledFieldFilter*>(compiled_filter.get()),
+            nullptr);
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<FieldFilter> field_filter,
+                       FieldFilter::New(TestProto().GetDescriptor(), config));
+  EXPECT_EQ(dynamic_cast<CompiledFieldFilter*>(field_filter.get()), nullptr);
+  ExpectSameAsFieldFilter(kConfig, GetTestProtos(),
+                          [&](const TestProto& test_proto) {
+                            return compiled_filter->IsMatch(test_proto);
+                          });
+
+  config.set_op(FieldFilterProto::INVALID);
+  EXPECT_THAT(
+      FieldFilter::New(TestProto().GetDescriptor(), config, options).status(),
+      StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
+TEST(CompiledFieldFilterTest, TestInvalidConfigs) {
+  for (const char* config_text : {
+           R"pb(op: INVALID)pb",
+           R"pb(op: AND)pb",
+           R"pb(op: TRUE name: "a")pb",
+           R"pb(op: EQUAL value: "1")pb",
+           R"pb(name: "a.b.int32_value" op: EQUAL)pb",
+           R"pb(name: "a.b.int32_value" op: EQUAL value: "a")pb",
+           R"pb(name: "a.b.float_value" op: EQUAL value: "1")pb",
+           R"pb(name: "a.b.int32_values" op: EQUAL value: "1")pb",
+           R"pb(name: "a.b.bool_value" op: GT value: "true")pb",
+           R"pb(name: "a.b.int32_value" op: IN value: "1,a")pb",
+           R"pb(name: "a.b.int32_value" op: ANY_IN value: "1")pb",
+           R"pb(name: "a.b.int32_value" op: PARTIAL
+                sub_filters { op: TRUE })pb",
+           R"pb(op: OR
+                sub_filters { op: TRUE }
+                sub_filters { name: "a.c" op: HAS })pb",
+       }) {
+    FieldFilterProto config;
+    ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(config_text,
+                                                             &config));
+    EXPECT_THAT(
+        CompiledFieldFilter::New(TestProto().GetDescriptor(), config).status(),
+        StatusIs(absl::StatusCode::kInvalidArgument, ""))
+        << config_text;
+  }
+}
+
+TEST(CompiledFieldFilterTest, TestRegexp) {
+  for (const char* config : {
+           R"pb(name: "a.b.string_value" op: REGEXP value: "string1")pb",
+           R"pb(name: "a.b.string_value" op: REGEXP value: "str.*")pb",
+           R"pb(name: "a.b.string_value" op: REGEXP value: ".*3")pb",
+           R"pb(name: "a.b.string_value" op: REGEXP value: "[a-z]+[12]")pb",
+           R"pb(name: "a.b.string_values" op: REGEXP value: ".*2")pb",
+           R"pb(name: "a.b.string_values" op: REGEXP value: "x|string3")pb",
+       }) {
+    ExpectCompiledSameAsFieldFilter(config);
+  }
+
+  FieldFilterProto config;
+  config.set_name("a.b.string_value");
+  config.set_op(FieldFilterProto::REGEXP);
+  config.set_value("(a");
+  EXPECT_THAT(
+      CompiledFieldFilter::New(TestProto().GetDescriptor(), config).status(),
+      StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
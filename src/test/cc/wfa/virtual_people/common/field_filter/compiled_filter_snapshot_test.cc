@@ -0,0 +1,369 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/compiled_filter_snapshot.h"
+
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "common_cpp/testing/status_macros.h"
+#include "common_cpp/testing/status_matchers.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/compiled_field_filter.h"
+#include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+#include "wfa/virtual_people/common/field_filter/test_util.h"
+#include "wfa/virtual_people/common/field_filter/utils/external_value_set.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::wfa::StatusIs;
+using ::wfa_virtual_people::test::TestProto;
+using ::wfa_virtual_people::test::TestProtoA;
+
+// Returns the shared test messages, followed by messages spreading the values
+// over the large sets of the filters.
+std::vector<TestProto> GetSnapshotTestProtos() {
+  std::vector<TestProto> test_protos = GetTestProtos();
+  for (int i = 0; i < 200; ++i) {
+    TestProto& test_proto = test_protos.emplace_back();
+    if (i % 7 == 0) {
+      continue;
+    }
+    test_proto.add_int32_values(i % 5);
+    test_proto.mutable_a()->mutable_b()->set_int32_value(i - 100);
+    test_proto.mutable_a()->mutable_b()->set_uint64_value(i * 1000);
+    test_proto.mutable_a()->mutable_b()->set_enum_value(
+        static_cast<test::TestProtoB::TestEnum>(i % 4));
+    test_proto.mutable_a()->mutable_b()->set_string_value(
+        absl::StrCat("string", i));
+    test_proto.mutable_a()->mutable_b()->add_string_values(
+        absl::StrCat("value", i % 3));
+  }
+  return test_protos;
+}
+
+std::vector<std::string> GetConfigs() {
+  std::string large_set = "0";
+  for (int i = 1; i < 1000; i += 3) {
+    absl::StrAppend(&large_set, ",", i * 1000);
+  }
+  return {
+      R"pb(op: TRUE)pb",
+      R"pb(name: "a.b.int32_value" op: IN value: "-99,-50,3,7")pb",
+      absl::StrCat(R"pb(name: "a.b.uint64_value" op: IN value: ")pb",
+                   large_set, "\""),
+      R"pb(name: "a.b.enum_value" op: IN value: "TEST_ENUM_1,TEST_ENUM_3")pb",
+      R"pb(name: "a.b.string_value" op: IN value: "string1,string20")pb",
+      R"pb(name: "a.b.string_value" op: EQUAL value: "string5")pb",
+      R"pb(name: "a.b.string_value" op: REGEXP value: "string1.*")pb",
+      R"pb(name: "a.b.string_values" op: ANY_IN value: "value0,value2")pb",
+      R"pb(name: "int32_values" op: ANY_IN value: "1,4")pb",
+      R"pb(name: "a.b"
+           op: PARTIAL
+           sub_filters { name: "int32_value" op: GT value: "-20" }
+           sub_filters { name: "uint64_value" op: LT value: "150000" })pb",
+      R"pb(op: OR
+           sub_filters {
+             op: NOT
+             sub_filters { name: "a" op: HAS }
+           }
+           sub_filters {
+             name: "a"
+             op: PARTIAL
+             sub_filters {
+               name: "b"
+               op: PARTIAL
+               sub_filters { name: "enum_value" op: EQUAL value: "2" }
+             }
+           })pb",
+  };
+}
+
+std::vector<std::unique_ptr<CompiledFieldFilter>> GetFilters() {
+  std::vector<std::unique_ptr<CompiledFieldFilter>> filters;
+  for (const std::string& config_text : GetConfigs()) {
+    absl::StatusOr<std::unique_ptr<CompiledFieldFilter>> filter =
+        CompiledFieldFilter::New(TestProto().GetDescriptor(),
+                                 ParseConfig(config_text));
+    EXPECT_TRUE(filter.ok()) << filter.status();
+    filters.push_back(*std::move(filter));
+  }
+  return filters;
+}
+
+std::string GetSnapshot(
+    const std::vector<std::unique_ptr<CompiledFieldFilter>>& filters) {
+  std::vector<const CompiledFieldFilter*> pointers;
+  for (const std::unique_ptr<CompiledFieldFilter>& filter : filters) {
+    pointers.push_back(filter.get());
+  }
+  absl::StatusOr<std::string> snapshot =
+      CompiledFilterSnapshot::Serialize(TestProto().GetDescriptor(), pointers);
+  EXPECT_TRUE(snapshot.ok()) << snapshot.status();
+  return *std::move(snapshot);
+}
+
+void ExpectSameMatches(
+    const std::vector<std::unique_ptr<CompiledFieldFilter>>& expected,
+    const std::vector<std::unique_ptr<CompiledFieldFilter>>& actual) {
+  ASSERT_EQ(actual.size(), expected.size());
+  std::vector<TestProto> test_protos = GetSnapshotTestProtos();
+  for (size_t i = 0; i < expected.size(); ++i) {
+    for (const TestProto& test_proto : test_protos) {
+      EXPECT_EQ(actual[i]->IsMatch(test_proto),
+                expected[i]->IsMatch(test_proto))
+          << "Filter " << i << "\nMessage: " << test_proto.DebugString();
+    }
+  }
+}
+
+TEST(CompiledFilterSnapshotTest, TestDeserialize) {
+  std::vector<std::unique_ptr<CompiledFieldFilter>> filters = GetFilters();
+  ASSERT_OK_AND_ASSIGN(std::vector<std::unique_ptr<CompiledFieldFilter>> loaded,
+                       CompiledFilterSnapshot::Deserialize(
+                           TestProto().GetDescriptor(), GetSnapshot(filters)));
+  ExpectSameMatches(filters, loaded);
+}
+
+TEST(CompiledFilterSnapshotTest, TestSerializeLoadedFilters) {
+  std::vector<std::unique_ptr<CompiledFieldFilter>> filters = GetFilters();
+  std::string snapshot = GetSnapshot(filters);
+  ASSERT_OK_AND_ASSIGN(std::vector<std::unique_ptr<CompiledFieldFilter>> loaded,
+                       CompiledFilterSnapshot::Deserialize(
+                           TestProto().GetDescriptor(), snapshot));
+  EXPECT_EQ(GetSnapshot(loaded), snapshot);
+}
+
+TEST(CompiledFilterSnapshotTest, TestLoad) {
+  std::vector<std::unique_ptr<CompiledFieldFilter>> filters = GetFilters();
+  std::string path = testing::TempDir() + "/compiled_filter_snapshot_test";
+  {
+    std::ofstream file(path, std::ios::binary);
+    file << GetSnapshot(filters);
+  }
+  ASSERT_OK_AND_ASSIGN(
+      std::vector<std::unique_ptr<CompiledFieldFilter>> loaded,
+      CompiledFilterSnapshot::Load(TestProto().GetDescriptor(), path));
+  ExpectSameMatches(filters, loaded);
+}
+
+TEST(CompiledFilterSnapshotTest, TestLoadedFiltersOwnTheMapping) {
+  std::vector<std::unique_ptr<CompiledFieldFilter>> filters = GetFilters();
+  std::string path = testing::TempDir() + "/compiled_filter_snapshot_owned";
+  {
+    std::ofstream file(path, std::ios::binary);
+    file << GetSnapshot(filters);
+  }
+  ASSERT_OK_AND_ASSIGN(
+      std::vector<std::unique_ptr<CompiledFieldFilter>> loaded,
+      CompiledFilterSnapshot::Load(TestProto().GetDescriptor(), path));
+  // The mapping stays valid after the file is removed, until the last filter
+  // is destroyed.
+  ASSERT_EQ(std::remove(path.c_str()), 0);
+  loaded.erase(loaded.begin());
+  filters.erase(filters.begin());
+  ExpectSameMatches(filters, loaded);
+}
+
+TEST(CompiledFilterSnapshotTest, TestLargeSetsStoredInPlace) {
+  std::vector<std::unique_ptr<CompiledFieldFilter>> filters = GetFilters();
+  std::string snapshot = GetSnapshot(filters);
+  // The large set of uint64_value is stored in the format of
+  // ExternalValueSet, with its magic.
+  EXPECT_NE(snapshot.find("WFAVSET1"), std::string::npos);
+  // The small sets are stored as their values.
+  std::vector<std::unique_ptr<CompiledFieldFilter>> small_filters;
+  small_filters.push_back(std::move(filters[1]));
+  EXPECT_EQ(GetSnapshot(small_filters).find("WFAVSET1"), std::string::npos);
+}
+
+TEST(CompiledFilterSnapshotTest, TestLoadMissingFile) {
+  EXPECT_THAT(CompiledFilterSnapshot::Load(TestProto().GetDescriptor(),
+                                           testing::TempDir() + "/missing")
+                  .status(),
+              StatusIs(absl::StatusCode::kNotFound, ""));
+}
+
+TEST(CompiledFilterSnapshotTest, TestValueFile) {
+  std::string path = testing::TempDir() + "/compiled_filter_snapshot_values";
+  std::vector<int64_t> values;
+  for (int64_t i = -100; i < 100; i += 3) {
+    values.push_back(i);
+  }
+  ASSERT_TRUE(ExternalValueSet::Write(path, values).ok());
+  FieldFilterProto config;
+  config.set_name("a.b.int32_value");
+  config.set_op(FieldFilterProto::IN);
+  config.set_value_file(path);
+  std::vector<std::unique_ptr<CompiledFieldFilter>> filters;
+  ASSERT_OK_AND_ASSIGN(
+      filters.emplace_back(),
+      CompiledFieldFilter::New(TestProto().GetDescriptor(), config));
+
+  // The snapshot stores the path instead of the values.
+  std::string snapshot = GetSnapshot(filters);
+  EXPECT_NE(snapshot.find(path), std::string::npos);
+  EXPECT_LT(snapshot.size(), values.size() * sizeof(int64_t));
+
+  ASSERT_OK_AND_ASSIGN(std::vector<std::unique_ptr<CompiledFieldFilter>> loaded,
+                       CompiledFilterSnapshot::Deserialize(
+                           TestProto().GetDescriptor(), snapshot));
+  ExpectSameMatches(filters, loaded);
+  EXPECT_EQ(GetSnapshot(loaded), snapshot);
+}
+
+TEST(CompiledFilterSnapshotTest, TestRelativeValueFile) {
+  char* working_directory = getcwd(nullptr, 0);
+  ASSERT_NE(working_directory, nullptr);
+  ASSERT_EQ(chdir(testing::TempDir().c_str()), 0);
+  ASSERT_TRUE(ExternalValueSet::Write("compiled_filter_snapshot_relative",
+                                      std::vector<int64_t>{1, 3})
+                  .ok());
+  FieldFilterProto config;
+  config.set_name("a.b.int32_value");
+  config.set_op(FieldFilterProto::IN);
+  config.set_value_file("compiled_filter_snapshot_relative");
+  std::vector<std::unique_ptr<CompiledFieldFilter>> filters;
+  ASSERT_OK_AND_ASSIGN(
+      filters.emplace_back(),
+      CompiledFieldFilter::New(TestProto().GetDescriptor(), config));
+  std::string snapshot = GetSnapshot(filters);
+
+  // The snapshot is loaded from another working directory.
+  ASSERT_EQ(chdir("/"), 0);
+  absl::StatusOr<std::vector<std::unique_ptr<CompiledFieldFilter>>> loaded =
+      CompiledFilterSnapshot::Deserialize(TestProto().GetDescriptor(),
+                                          snapshot);
+  ASSERT_EQ(chdir(working_directory), 0);
+  free(working_directory);
+  ASSERT_TRUE(loaded.ok()) << loaded.status();
+  ExpectSameMatches(filters, *loaded);
+}
+
+TEST(CompiledFilterSnapshotTest, TestSerializeWrongDescriptor) {
+  std::vector<std::unique_ptr<CompiledFieldFilter>> filters = GetFilters();
+  EXPECT_THAT(CompiledFilterSnapshot::Serialize(TestProtoA().GetDescriptor(),
+                                                {filters[1].get()})
+                  .status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
+TEST(CompiledFilterSnapshotTest, TestDeserializeWrongDescriptor) {
+  EXPECT_THAT(CompiledFilterSnapshot::Deserialize(TestProtoA().GetDescriptor(),
+                                                  GetSnapshot(GetFilters()))
+                  .status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
+TEST(CompiledFilterSnapshotTest, TestDeserializeInvalidSnapshot) {
+  std::string snapshot = GetSnapshot(GetFilters());
+  EXPECT_THAT(
+      CompiledFilterSnapshot::Deserialize(TestProto().GetDescriptor(), "")
+          .status(),
+      StatusIs(absl::StatusCode::kInvalidArgument, ""));
+  EXPECT_THAT(CompiledFilterSnapshot::Deserialize(TestProto().GetDescriptor(),
+                                                  "not a snapshot")
+                  .status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+  EXPECT_THAT(CompiledFilterSnapshot::Deserialize(TestProto().GetDescriptor(),
+                                                  snapshot + "x")
+                  .status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+  // Every truncation is rejected.
+  for (size_t size = 0; size < snapshot.size(); ++size) {
+    EXPECT_FALSE(CompiledFilterSnapshot::Deserialize(
+                     TestProto().GetDescriptor(), snapshot.substr(0, size))
+                     .ok())
+        << "Size " << size;
+  }
+  // Corrupted bytes are rejected or ignored, but never crash, even when the
+  // filters read in place are evaluated.
+  std::vector<TestProto> test_protos = GetTestProtos();
+  for (size_t i = 0; i < snapshot.size(); ++i) {
+    std::string corrupted = snapshot;
+    corrupted[i] ^= 0x55;
+    absl::StatusOr<std::vector<std::unique_ptr<CompiledFieldFilter>>> loaded =
+        CompiledFilterSnapshot::Deserialize(TestProto().GetDescriptor(),
+                                            corrupted);
+    if (!loaded.ok()) {
+      continue;
+    }
+    for (const std::unique_ptr<CompiledFieldFilter>& filter : *loaded) {
+      for (const TestProto& test_proto : test_protos) {
+        filter->IsMatch(test_proto);
+      }
+    }
+  }
+}
+
+// Returns the descriptor of TestProto in @pool, after renaming
+// TestProtoB.int32_value to @int32_value_name.
+const google::protobuf::Descriptor* GetChangedDescriptor(
+    google::protobuf::DescriptorPool& pool,
+    const std::string& int32_value_name) {
+  google::protobuf::FileDescriptorProto file;
+  TestProto().GetDescriptor()->file()->CopyTo(&file);
+  for (google::protobuf::DescriptorProto& message :
+       *file.mutable_message_type()) {
+    for (google::protobuf::FieldDescriptorProto& field :
+         *message.mutable_field()) {
+      if (message.name() == "TestProtoB" && field.name() == "int32_value") {
+        field.set_name(int32_value_name);
+      }
+    }
+  }
+  EXPECT_NE(pool.BuildFile(file), nullptr);
+  return pool.FindMessageTypeByName(TestProto().GetDescriptor()->full_name());
+}
+
+TEST(CompiledFilterSnapshotTest, TestDeserializeSameSchema) {
+  google::protobuf::DescriptorPool pool;
+  const google::protobuf::Descriptor* descriptor =
+      GetChangedDescriptor(pool, "int32_value");
+  ASSERT_NE(descriptor, nullptr);
+  absl::StatusOr<std::vector<std::unique_ptr<CompiledFieldFilter>>> loaded =
+      CompiledFilterSnapshot::Deserialize(descriptor,
+                                          GetSnapshot(GetFilters()));
+  EXPECT_TRUE(loaded.ok()) << loaded.status();
+}
+
+TEST(CompiledFilterSnapshotTest, TestDeserializeChangedSchema) {
+  google::protobuf::DescriptorPool pool;
+  const google::protobuf::Descriptor* descriptor =
+      GetChangedDescriptor(pool, "renamed_value");
+  ASSERT_NE(descriptor, nullptr);
+  EXPECT_THAT(CompiledFilterSnapshot::Deserialize(descriptor,
+                                                  GetSnapshot(GetFilters()))
+                  .status(),
+              StatusIs(absl::StatusCode::kFailedPrecondition, ""));
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,206 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/equivalence_class_matcher.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "common_cpp/testing/status_macros.h"
+#include "common_cpp/testing/status_matchers.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+#include "wfa/virtual_people/common/field_filter/test_util.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::wfa::StatusIs;
+using ::wfa_virtual_people::test::TestProto;
+
+// Messages which are grouped into equivalence classes by the filters of the
+// tests. Fields not read by the filters differ between messages which are
+// otherwise the same.
+std::vector<TestProto> GetEquivalentTestProtos() {
+  std::vector<std::string> texts = {
+      "",
+      R"pb(a { b {} })pb",
+      R"pb(a { b { int32_value: 1 string_value: "string1" } })pb",
+      R"pb(a { b { int32_value: 1 string_value: "string1" double_value: 1 } }
+           repeated_proto_a {})pb",
+      R"pb(a { b { int32_value: 2 string_value: "string1" } })pb",
+      R"pb(a { b { int32_value: 2 string_value: "string2" } }
+           int32_values: [ 1, 2 ])pb",
+      R"pb(a { b { int32_value: 2 string_value: "string2" } }
+           int32_values: [ 1, 2 ]
+           repeated_proto_a {})pb",
+      R"pb(a { b { int32_value: 2 string_value: "string2" } }
+           int32_values: [ 2, 1 ])pb",
+      R"pb(a { b { int32_value: 3 string_values: [ "string1" ] } })pb",
+      R"pb(a { b { int32_value: 3 string_values: [ "string1" ] } }
+           int32_values: [ 3 ])pb",
+  };
+  std::vector<TestProto> test_protos(texts.size());
+  for (size_t i = 0; i < texts.size(); ++i) {
+    EXPECT_TRUE(google::protobuf::TextFormat::ParseFromString(texts[i],
+                                                             &test_protos[i]));
+  }
+  return test_protos;
+}
+
+std::shared_ptr<const FieldFilter> NewFilter(const std::string& config_text) {
+  absl::StatusOr<std::unique_ptr<FieldFilter>> filter =
+      FieldFilter::New(TestProto().GetDescriptor(), ParseConfig(config_text));
+  EXPECT_TRUE(filter.ok()) << filter.status();
+  return *std::move(filter);
+}
+
+// Checks that the matcher of the filter built from @config_text returns the
+// same results as the filter, and that MatchBatch finds @class_count distinct
+// keys among the equivalent test messages.
+void ExpectSameAsFilter(const std::string& config_text, int class_count) {
+  std::shared_ptr<const FieldFilter> filter = NewFilter(config_text);
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<EquivalenceClassMatcher> matcher,
+                       EquivalenceClassMatcher::New(filter));
+  std::vector<TestProto> test_protos = GetEquivalentTestProtos();
+  std::vector<const google::protobuf::Message*> messages;
+  for (const TestProto& test_proto : test_protos) {
+    messages.push_back(&test_proto);
+  }
+
+  std::vector<bool> matches;
+  EXPECT_EQ(matcher->MatchBatch(messages, &matches), class_count);
+  ASSERT_EQ(matches.size(), messages.size());
+  for (size_t i = 0; i < messages.size(); ++i) {
+    EXPECT_EQ(matches[i], filter->IsMatch(*messages[i]))
+        << "Message: " << messages[i]->DebugString();
+  }
+
+  auto is_match = [&](const TestProto& test_proto) {
+    return matcher->IsMatch(test_proto);
+  };
+  ExpectSameAsFieldFilter(config_text, test_protos, is_match);
+  ExpectSameAsFieldFilter(config_text, GetTestProtos(), is_match);
+}
+
+TEST(EquivalenceClassMatcherTest, TestScalarFields) {
+  ExpectSameAsFilter(R"pb(op: AND
+                          sub_filters {
+                            name: "a.b.int32_value"
+                            op: EQUAL
+                            value: "2"
+                          }
+                          sub_filters {
+                            name: "a.b.string_value"
+                            op: REGEXP
+                            value: "string[12]"
+                          })pb",
+                     // Unset a, unset fields in a.b, (1, string1),
+                     // (2, string1), (2, string2) and (3, unset).
+                     6);
+}
+
+TEST(EquivalenceClassMatcherTest, TestRepeatedFields) {
+  ExpectSameAsFilter(R"pb(op: OR
+                          sub_filters {
+                            name: "int32_values"
+                            op: ANY_IN
+                            value: "1,3"
+                          }
+                          sub_filters {
+                            name: "a.b.string_values"
+                            op: HAS
+                          })pb",
+                     // No values, [1, 2], [2, 1], [] with string_values and
+                     // [3] with string_values.
+                     5);
+}
+
+TEST(EquivalenceClassMatcherTest, TestPartialFilter) {
+  ExpectSameAsFilter(R"pb(name: "a.b"
+                          op: PARTIAL
+                          sub_filters {
+                            name: "int32_value"
+                            op: GT
+                            value: "1"
+                          })pb",
+                     // Unset a, unset a.b.int32_value, 1, 2 and 3.
+                     5);
+}
+
+TEST(EquivalenceClassMatcherTest, TestCacheIsBounded) {
+  std::shared_ptr<const FieldFilter> filter =
+      NewFilter(R"pb(name: "a.b.int32_value" op: GT value: "1")pb");
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<EquivalenceClassMatcher> matcher,
+                       EquivalenceClassMatcher::New(filter, 2));
+
+  TestProto test_proto;
+  for (int value : {1, 2, 1, 3, 4, 2, 1}) {
+    test_proto.mutable_a()->mutable_b()->set_int32_value(value);
+    EXPECT_EQ(matcher->IsMatch(test_proto), value > 1);
+    EXPECT_LE(matcher->cache_size(), 2);
+  }
+  EXPECT_EQ(matcher->cache_size(), 2);
+
+  ASSERT_OK_AND_ASSIGN(matcher, EquivalenceClassMatcher::New(filter, 0));
+  EXPECT_FALSE(matcher->IsMatch(test_proto));
+  EXPECT_EQ(matcher->cache_size(), 0);
+}
+
+TEST(EquivalenceClassMatcherTest, TestShardedCache) {
+  std::shared_ptr<const FieldFilter> filter =
+      NewFilter(R"pb(name: "a.b.int32_value" op: GT value: "100")pb");
+  // Large enough to be split into shards.
+  constexpr int kCapacity = 4096;
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<EquivalenceClassMatcher> matcher,
+                       EquivalenceClassMatcher::New(filter, kCapacity));
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&matcher]() {
+      TestProto test_proto;
+      for (int i = 0; i < 3 * kCapacity; ++i) {
+        int value = i % (2 * kCapacity);
+        test_proto.mutable_a()->mutable_b()->set_int32_value(value);
+        EXPECT_EQ(matcher->IsMatch(test_proto), value > 100);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_GT(matcher->cache_size(), 0);
+  EXPECT_LE(matcher->cache_size(), kCapacity);
+}
+
+TEST(EquivalenceClassMatcherTest, TestInvalidArguments) {
+  EXPECT_THAT(EquivalenceClassMatcher::New(nullptr).status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+  EXPECT_THAT(
+      EquivalenceClassMatcher::New(NewFilter(R"pb(op: TRUE)pb"), -1).status(),
+      StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,168 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/eval_context.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/status/statusor.h"
+#include "common_cpp/testing/status_macros.h"
+#include "common_cpp/testing/status_matchers.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/field_filter_cache.h"
+#include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_util.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::wfa_virtual_people::test::TestProto;
+
+std::unique_ptr<FieldFilter> NewFilter(const std::string& config_text) {
+  FieldFilterProto config;
+  EXPECT_TRUE(
+      google::protobuf::TextFormat::ParseFromString(config_text, &config));
+  absl::StatusOr<std::unique_ptr<FieldFilter>> filter =
+      FieldFilter::New(TestProto().GetDescriptor(), config);
+  EXPECT_TRUE(filter.ok()) << filter.status();
+  return *std::move(filter);
+}
+
+std::shared_ptr<const FieldPath> GetPath(const std::string& name) {
+  absl::StatusOr<std::shared_ptr<const FieldPath>> field_path =
+      GetFieldPathFromProto(TestProto().GetDescriptor(), name,
+                            /*allow_repeated=*/true);
+  EXPECT_TRUE(field_path.ok()) << field_path.status();
+  return *std::move(field_path);
+}
+
+TEST(EvalContextTest, TestResultIsMemoized) {
+  std::unique_ptr<FieldFilter> filter =
+      NewFilter(R"pb(name: "a.b.int32_value" op: EQUAL value: "1")pb");
+  TestProto event;
+  event.mutable_a()->mutable_b()->set_int32_value(1);
+
+  EvalContext context;
+  EXPECT_TRUE(filter->IsMatch(event, context));
+  EXPECT_TRUE(filter->IsMatch(event, context));
+  EXPECT_EQ(context.evaluation_count(), 1);
+
+  // The modification is not marked, so the memoized result is returned.
+  event.mutable_a()->mutable_b()->set_int32_value(2);
+  EXPECT_TRUE(filter->IsMatch(event, context));
+  EXPECT_EQ(context.evaluation_count(), 1);
+
+  context.Reset();
+  EXPECT_FALSE(filter->IsMatch(event, context));
+  EXPECT_EQ(context.evaluation_count(), 2);
+}
+
+TEST(EvalContextTest, TestModifiedFieldInvalidates) {
+  std::unique_ptr<FieldFilter> filter =
+      NewFilter(R"pb(name: "a.b.int32_value" op: EQUAL value: "1")pb");
+  TestProto event;
+
+  EvalContext context;
+  EXPECT_FALSE(filter->IsMatch(event, context));
+  SetValueToProto<int32_t>(event, *GetPath("a.b.int32_value"), 1, context);
+  EXPECT_TRUE(filter->IsMatch(event, context));
+  EXPECT_EQ(context.evaluation_count(), 2);
+
+  // Fields not read by the filter do not invalidate the result.
+  SetValueToProto<int64_t>(event, *GetPath("a.b.int64_value"), 1, context);
+  SetValueToProto<uint32_t>(event, *GetPath("a.b.uint32_value"), 1, context);
+  EXPECT_TRUE(filter->IsMatch(event, context));
+  EXPECT_EQ(context.evaluation_count(), 2);
+}
+
+TEST(EvalContextTest, TestOverlappingFieldInvalidates) {
+  std::unique_ptr<FieldFilter> has_filter =
+      NewFilter(R"pb(name: "a.b" op: HAS)pb");
+  std::unique_ptr<FieldFilter> partial_filter = NewFilter(R"pb(
+    name: "a.b"
+    op: PARTIAL
+    sub_filters { name: "string_value" op: EQUAL value: "string1" }
+  )pb");
+  TestProto event;
+
+  EvalContext context;
+  EXPECT_FALSE(has_filter->IsMatch(event, context));
+  EXPECT_FALSE(partial_filter->IsMatch(event, context));
+
+  // Setting a field inside a.b changes whether a.b is set.
+  SetValueToProto<bool>(event, *GetPath("a.b.bool_value"), true, context);
+  EXPECT_TRUE(has_filter->IsMatch(event, context));
+  EXPECT_FALSE(partial_filter->IsMatch(event, context));
+  EXPECT_EQ(context.evaluation_count(), 4);
+
+  // Replacing a changes the fields inside it.
+  event.mutable_a()->mutable_b()->set_string_value("string1");
+  context.MarkModified(*GetPath("a"));
+  EXPECT_TRUE(has_filter->IsMatch(event, context));
+  EXPECT_TRUE(partial_filter->IsMatch(event, context));
+  EXPECT_EQ(context.evaluation_count(), 6);
+}
+
+TEST(EvalContextTest, TestSharedFiltersShareResults) {
+  FieldFilterProto config;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      R"pb(name: "a.b.int32_value" op: GT value: "0")pb", &config));
+  FieldFilterCache cache;
+  ASSERT_OK_AND_ASSIGN(
+      std::shared_ptr<const FieldFilter> filter_1,
+      cache.GetOrCreate(TestProto().GetDescriptor(), config));
+  ASSERT_OK_AND_ASSIGN(
+      std::shared_ptr<const FieldFilter> filter_2,
+      cache.GetOrCreate(TestProto().GetDescriptor(), config));
+  TestProto event;
+  event.mutable_a()->mutable_b()->set_int32_value(1);
+
+  EvalContext context;
+  EXPECT_TRUE(filter_1->IsMatch(event, context));
+  EXPECT_TRUE(filter_2->IsMatch(event, context));
+  EXPECT_EQ(context.evaluation_count(), 1);
+}
+
+TEST(EvalContextTest, TestCompiledFilter) {
+  FieldFilterProto config;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      R"pb(op: OR
+           sub_filters { name: "a.b.int32_value" op: EQUAL value: "1" }
+           sub_filters { name: "int32_values" op: ANY_IN value: "2" })pb",
+      &config));
+  FieldFilterOptions options;
+  options.compiled = true;
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldFilter> filter,
+      FieldFilter::New(TestProto().GetDescriptor(), config, options));
+  TestProto event;
+
+  EvalContext context;
+  EXPECT_FALSE(filter->IsMatch(event, context));
+  event.add_int32_values(2);
+  context.MarkModified(*GetPath("int32_values"));
+  EXPECT_TRUE(filter->IsMatch(event, context));
+  EXPECT_EQ(context.evaluation_count(), 2);
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,293 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/field_extraction_plan.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "common_cpp/testing/status_macros.h"
+#include "common_cpp/testing/status_matchers.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/wire_format_lite.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+#include "wfa/virtual_people/common/field_filter/test_util.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::google::protobuf::internal::WireFormatLite;
+using ::wfa::IsOk;
+using ::wfa::StatusIs;
+using ::wfa_virtual_people::test::TestProto;
+
+// Checks that each filter of the plan built from @config_texts matches the
+// same messages as the FieldFilter built from the same config, both when
+// extracted from the message and from its serialization.
+void ExpectSameAsFieldFilters(const std::vector<std::string>& config_texts) {
+  std::vector<FieldFilterProto> configs = ParseConfigs(config_texts);
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldExtractionPlan> plan,
+      FieldExtractionPlan::New(TestProto().GetDescriptor(), configs));
+  ASSERT_EQ(plan->filter_count(), configs.size());
+
+  // The same ExtractedFields is reused for all the messages.
+  ExtractedFields fields;
+  for (size_t i = 0; i < configs.size(); ++i) {
+    ExpectSameAsFieldFilter(config_texts[i], GetTestProtos(),
+                            [&](const TestProto& test_proto) {
+                              plan->Extract(test_proto, &fields);
+                              return plan->IsMatch(i, fields);
+                            });
+    SCOPED_TRACE("Serialized");
+    ExpectSameAsFieldFilter(
+        config_texts[i], GetTestProtos(), [&](const TestProto& test_proto) {
+          EXPECT_THAT(plan->ExtractSerialized(test_proto.SerializeAsString(),
+                                              &fields),
+                      IsOk());
+          return plan->IsMatch(i, fields);
+        });
+  }
+}
+
+TEST(FieldExtractionPlanTest, TestLeafFilters) {
+  ExpectSameAsFieldFilters({
+         R"pb(op: TRUE)pb",
+         R"pb(name: "a.b" op: HAS)pb",
+         R"pb(name: "a.b.int32_value" op: HAS)pb",
+         R"pb(name: "a.b.string_values" op: HAS)pb",
+         R"pb(name: "a.b.int32_value" op: EQUAL value: "1")pb",
+         R"pb(name: "a.b.int64_value" op: EQUAL value: "30")pb",
+         R"pb(name: "a.b.uint32_value" op: EQUAL value: "3")pb",
+         R"pb(name: "a.b.uint64_value"
+              op: EQUAL
+              value: "18446744073709551615")pb",
+         R"pb(name: "a.b.bool_value" op: EQUAL value: "false")pb",
+         R"pb(name: "a.b.enum_value" op: EQUAL value: "TEST_ENUM_1")pb",
+         R"pb(name: "a.b.enum_value" op: EQUAL value: "3")pb",
+         R"pb(name: "a.b.string_value" op: EQUAL value: "string3")pb",
+         R"pb(name: "a.b.int32_value" op: GT value: "0")pb",
+         R"pb(name: "a.b.int32_value" op: LT value: "0")pb",
+         R"pb(name: "a.b.uint64_value" op: GT value: "2")pb",
+         R"pb(name: "a.b.int64_value" op: LT value: "30")pb",
+         R"pb(name: "a.b.int32_value" op: IN value: "-3,2")pb",
+         R"pb(name: "a.b.uint32_value" op: IN value: "1,2")pb",
+         R"pb(name: "a.b.bool_value" op: IN value: "true")pb",
+         R"pb(name: "a.b.enum_value" op: IN value: "TEST_ENUM_3,2")pb",
+         R"pb(name: "a.b.string_value" op: IN value: "string1,string2")pb",
+         R"pb(name: "int32_values" op: ANY_IN value: "1,3")pb",
+         R"pb(name: "a.b.int32_values" op: ANY_IN value: "2")pb",
+         R"pb(name: "a.b.uint64_values" op: ANY_IN value: "3")pb",
+         R"pb(name: "a.b.enum_values" op: ANY_IN value: "TEST_ENUM_2")pb",
+         R"pb(name: "a.b.string_values" op: ANY_IN value: "string2")pb",
+      R"pb(name: "a.b.float_value" op: HAS)pb",
+      R"pb(name: "a.b.string_value" op: REGEXP value: "str.*[13]")pb",
+      R"pb(name: "a.b.string_values" op: REGEXP value: ".*2")pb",
+  });
+}
+
+TEST(FieldExtractionPlanTest, TestCompositeFilters) {
+  ExpectSameAsFieldFilters({
+         R"pb(op: AND
+              sub_filters { name: "a.b.int32_value" op: EQUAL value: "1" }
+              sub_filters { name: "a.b.int64_value" op: EQUAL value: "1" }
+         )pb",
+         R"pb(op: OR
+              sub_filters { name: "a.b.int32_value" op: EQUAL value: "1" }
+              sub_filters { name: "a.b.int64_value" op: EQUAL value: "30" }
+         )pb",
+         R"pb(op: NOT
+              sub_filters { name: "a.b.int32_value" op: EQUAL value: "1" }
+              sub_filters { name: "a.b.int64_value" op: EQUAL value: "1" }
+         )pb",
+         R"pb(name: "a.b"
+              op: PARTIAL
+              sub_filters { name: "int32_value" op: GT value: "-5" }
+              sub_filters { name: "string_value" op: HAS })pb",
+         R"pb(op: OR
+              sub_filters {
+                name: "a"
+                op: PARTIAL
+                sub_filters {
+                  name: "b"
+                  op: PARTIAL
+                  sub_filters { name: "int32_value" op: EQUAL value: "1" }
+                }
+              }
+              sub_filters {
+                op: NOT
+                sub_filters { name: "a.b" op: HAS }
+              })pb",
+         R"pb(op: AND
+              sub_filters {
+                op: OR
+                sub_filters { name: "a.b.int32_value" op: LT value: "0" }
+                sub_filters { name: "int32_values" op: ANY_IN value: "1" }
+              }
+              sub_filters {
+                name: "a.b"
+                op: PARTIAL
+                sub_filters { name: "bool_value" op: HAS }
+              }
+              sub_filters { op: TRUE })pb",
+  });
+}
+
+TEST(FieldExtractionPlanTest, TestFieldsAreShared) {
+  std::vector<FieldFilterProto> configs = ParseConfigs({
+      R"pb(name: "a.b.int32_value" op: EQUAL value: "1")pb",
+      R"pb(name: "a.b.int32_value" op: GT value: "0")pb",
+      R"pb(name: "a.b"
+           op: PARTIAL
+           sub_filters { name: "int32_value" op: LT value: "5" })pb",
+      R"pb(name: "a.b.string_values" op: ANY_IN value: "string1")pb",
+      R"pb(name: "a.b.string_values" op: HAS)pb",
+  });
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldExtractionPlan> plan,
+      FieldExtractionPlan::New(TestProto().GetDescriptor(), configs));
+  EXPECT_EQ(plan->filter_count(), 5);
+  // a.b.int32_value, a.b and a.b.string_values.
+  EXPECT_EQ(plan->field_count(), 3);
+}
+
+// Returns the serialized TestProtoB, with values protobuf does not emit when
+// serializing a message: fields set twice, unpacked repeated fields, repeated
+// fields interleaved with each other, and an unknown field.
+std::string GetIrregularTestProtoB() {
+  std::string serialized;
+  {
+    google::protobuf::io::StringOutputStream stream(&serialized);
+    google::protobuf::io::CodedOutputStream output(&stream);
+    WireFormatLite::WriteInt32(1, 5, &output);
+    WireFormatLite::WriteInt32(10, 1, &output);
+    WireFormatLite::WriteString(18, "string1", &output);
+    WireFormatLite::WriteInt32(10, 2, &output);
+    WireFormatLite::WriteUInt64(100, 7, &output);
+    WireFormatLite::WriteString(18, "string2", &output);
+    WireFormatLite::WriteInt32(1, -3, &output);
+    WireFormatLite::WriteString(9, "string3", &output);
+  }
+  return serialized;
+}
+
+// Returns the serialized TestProto with @b as a.b, split into two
+// occurrences of a, which are merged when parsed.
+std::string GetSplitTestProto(absl::string_view b) {
+  std::string serialized;
+  {
+    google::protobuf::io::StringOutputStream stream(&serialized);
+    google::protobuf::io::CodedOutputStream output(&stream);
+    std::string a;
+    {
+      google::protobuf::io::StringOutputStream a_stream(&a);
+      google::protobuf::io::CodedOutputStream a_output(&a_stream);
+      WireFormatLite::WriteBytes(1, std::string(b), &a_output);
+    }
+    WireFormatLite::WriteBytes(1, a, &output);
+    WireFormatLite::WriteInt32(2, 1, &output);
+    WireFormatLite::WriteBytes(1, "", &output);
+  }
+  return serialized;
+}
+
+TEST(FieldExtractionPlanTest, TestExtractSerializedIrregularWireFormat) {
+  std::vector<std::string> config_texts = {
+      R"pb(name: "a.b.int32_value" op: EQUAL value: "-3")pb",
+      R"pb(name: "a.b.int32_value" op: EQUAL value: "5")pb",
+      R"pb(name: "a.b.int32_values" op: ANY_IN value: "2")pb",
+      R"pb(name: "a.b.string_values" op: ANY_IN value: "string1")pb",
+      R"pb(name: "a.b.string_values" op: REGEXP value: ".*2")pb",
+      R"pb(name: "a.b.string_value" op: IN value: "string3")pb",
+      R"pb(name: "a.b.enum_value" op: HAS)pb",
+      R"pb(name: "a.b"
+           op: PARTIAL
+           sub_filters { name: "int32_value" op: LT value: "0" }
+           sub_filters { name: "string_values" op: HAS })pb",
+      R"pb(name: "int32_values" op: ANY_IN value: "1")pb",
+  };
+  std::vector<FieldFilterProto> configs = ParseConfigs(config_texts);
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldExtractionPlan> plan,
+      FieldExtractionPlan::New(TestProto().GetDescriptor(), configs));
+
+  std::string unknown_enum;
+  {
+    google::protobuf::io::StringOutputStream stream(&unknown_enum);
+    google::protobuf::io::CodedOutputStream output(&stream);
+    WireFormatLite::WriteEnum(8, 100, &output);
+  }
+  std::vector<std::string> serialized_messages = {
+      GetSplitTestProto(GetIrregularTestProtoB()),
+      GetSplitTestProto(unknown_enum),
+  };
+
+  ExtractedFields fields;
+  for (const std::string& serialized : serialized_messages) {
+    TestProto test_proto;
+    ASSERT_TRUE(test_proto.ParseFromString(serialized));
+    EXPECT_THAT(plan->ExtractSerialized(serialized, &fields), IsOk());
+    for (size_t i = 0; i < configs.size(); ++i) {
+      ASSERT_OK_AND_ASSIGN(
+          std::unique_ptr<FieldFilter> field_filter,
+          FieldFilter::New(TestProto().GetDescriptor(), configs[i]));
+      EXPECT_EQ(plan->IsMatch(i, fields), field_filter->IsMatch(test_proto))
+          << "Config: " << config_texts[i]
+          << "\nMessage: " << test_proto.DebugString();
+    }
+  }
+}
+
+TEST(FieldExtractionPlanTest, TestExtractSerializedInvalidBytes) {
+  std::vector<FieldFilterProto> configs = ParseConfigs({
+      R"pb(name: "a.b.int32_value" op: EQUAL value: "1")pb",
+  });
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldExtractionPlan> plan,
+      FieldExtractionPlan::New(TestProto().GetDescriptor(), configs));
+  TestProto test_proto;
+  test_proto.mutable_a()->mutable_b()->set_int32_value(1);
+  std::string serialized = test_proto.SerializeAsString();
+
+  ExtractedFields fields;
+  EXPECT_THAT(plan->ExtractSerialized(
+                  absl::string_view(serialized).substr(
+                      0, serialized.size() - 1),
+                  &fields),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+  EXPECT_THAT(plan->ExtractSerialized(serialized, &fields), IsOk());
+  EXPECT_TRUE(plan->IsMatch(0, fields));
+}
+
+TEST(FieldExtractionPlanTest, TestInvalidConfig) {
+  std::vector<FieldFilterProto> configs = ParseConfigs({
+      R"pb(name: "a.b.int32_value" op: EQUAL value: "1")pb",
+      R"pb(name: "a.b.int32_value" op: EQUAL value: "a")pb",
+  });
+  EXPECT_THAT(
+      FieldExtractionPlan::New(TestProto().GetDescriptor(), configs).status(),
+      StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,229 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/field_filter_cache.h"
+
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "common_cpp/testing/status_macros.h"
+#include "common_cpp/testing/status_matchers.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+#include "wfa/virtual_people/common/field_filter/test_util.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::wfa::StatusIs;
+using ::wfa_virtual_people::test::TestProto;
+using ::wfa_virtual_people::test::TestProtoB;
+
+TEST(FieldFilterCacheTest, TestSameConfigIsShared) {
+  FieldFilterCache cache;
+  FieldFilterProto config =
+      ParseConfig(R"pb(name: "a.b.int32_value" op: EQUAL value: "1")pb");
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<const FieldFilter> filter_1,
+                       cache.GetOrCreate(TestProto().GetDescriptor(), config));
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<const FieldFilter> filter_2,
+                       cache.GetOrCreate(TestProto().GetDescriptor(), config));
+  EXPECT_EQ(filter_1, filter_2);
+  EXPECT_EQ(cache.size(), 1);
+
+  TestProto test_proto;
+  test_proto.mutable_a()->mutable_b()->set_int32_value(1);
+  EXPECT_TRUE(filter_1->IsMatch(test_proto));
+}
+
+TEST(FieldFilterCacheTest, TestSameNormalizedConfigIsShared) {
+  FieldFilterCache cache;
+  ASSERT_OK_AND_ASSIGN(
+      std::shared_ptr<const FieldFilter> filter_1,
+      cache.GetOrCreate(TestProto().GetDescriptor(), ParseConfig(R"pb(
+                          op: AND
+                          sub_filters {
+                            name: "a.b.int32_value"
+                            op: EQUAL
+                            value: "1"
+                          }
+                        )pb")));
+  ASSERT_OK_AND_ASSIGN(
+      std::shared_ptr<const FieldFilter> filter_2,
+      cache.GetOrCreate(
+          TestProto().GetDescriptor(),
+          ParseConfig(R"pb(name: "a.b.int32_value" op: EQUAL value: "1")pb")));
+  EXPECT_EQ(filter_1, filter_2);
+  // Both configs are kept as keys, but only one filter is built.
+  EXPECT_EQ(cache.size(), 1);
+}
+
+TEST(FieldFilterCacheTest, TestDifferentConfigsAreNotShared) {
+  FieldFilterCache cache;
+  ASSERT_OK_AND_ASSIGN(
+      std::shared_ptr<const FieldFilter> filter_1,
+      cache.GetOrCreate(
+          TestProto().GetDescriptor(),
+          ParseConfig(R"pb(name: "a.b.int32_value" op: EQUAL value: "1")pb")));
+  ASSERT_OK_AND_ASSIGN(
+      std::shared_ptr<const FieldFilter> filter_2,
+      cache.GetOrCreate(
+          TestProto().GetDescriptor(),
+          ParseConfig(R"pb(name: "a.b.int32_value" op: EQUAL value: "2")pb")));
+  EXPECT_NE(filter_1, filter_2);
+  EXPECT_EQ(cache.size(), 2);
+}
+
+TEST(FieldFilterCacheTest, TestDifferentDescriptorsAreNotShared) {
+  FieldFilterCache cache;
+  FieldFilterProto config =
+      ParseConfig(R"pb(name: "int32_value" op: EQUAL value: "1")pb");
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<const FieldFilter> filter_1,
+                       cache.GetOrCreate(TestProtoB().GetDescriptor(), config));
+  EXPECT_THAT(cache.GetOrCreate(TestProto().GetDescriptor(), config).status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+  EXPECT_EQ(cache.size(), 1);
+}
+
+// TestProtoB is used as the root, so that the sub filters are not grouped into
+// PARTIAL filters by the normalization.
+TEST(FieldFilterCacheTest, TestSubFiltersAreShared) {
+  FieldFilterCache cache;
+  ASSERT_OK_AND_ASSIGN(
+      std::shared_ptr<const FieldFilter> and_filter,
+      cache.GetOrCreate(TestProtoB().GetDescriptor(), ParseConfig(R"pb(
+                          op: AND
+                          sub_filters {
+                            name: "int32_value"
+                            op: EQUAL
+                            value: "1"
+                          }
+                          sub_filters { name: "int32_values" op: HAS }
+                        )pb")));
+  // AND and its 2 sub filters.
+  EXPECT_EQ(cache.size(), 3);
+
+  ASSERT_OK_AND_ASSIGN(
+      std::shared_ptr<const FieldFilter> or_filter,
+      cache.GetOrCreate(TestProtoB().GetDescriptor(), ParseConfig(R"pb(
+                          op: OR
+                          sub_filters {
+                            name: "int32_value"
+                            op: EQUAL
+                            value: "1"
+                          }
+                          sub_filters { name: "int64_values" op: HAS }
+                        )pb")));
+  // Only OR and the HAS on int64_values are added.
+  EXPECT_EQ(cache.size(), 5);
+
+  TestProtoB test_proto;
+  test_proto.set_int32_value(1);
+  EXPECT_FALSE(and_filter->IsMatch(test_proto));
+  EXPECT_TRUE(or_filter->IsMatch(test_proto));
+  test_proto.add_int32_values(1);
+  EXPECT_TRUE(and_filter->IsMatch(test_proto));
+}
+
+TEST(FieldFilterCacheTest, TestFiltersOutliveCache) {
+  std::shared_ptr<const FieldFilter> filter;
+  {
+    FieldFilterCache cache;
+    ASSERT_OK_AND_ASSIGN(
+        filter, cache.GetOrCreate(TestProto().GetDescriptor(), ParseConfig(R"pb(
+                                    op: NOT
+                                    sub_filters { name: "a.b" op: HAS }
+                                  )pb")));
+  }
+  EXPECT_TRUE(filter->IsMatch(TestProto()));
+}
+
+TEST(FieldFilterCacheTest, TestConcurrentGetOrCreate) {
+  FieldFilterCache cache;
+  FieldFilterProto config = ParseConfig(R"pb(
+    op: OR
+    sub_filters { name: "int32_value" op: EQUAL value: "1" }
+    sub_filters { name: "int64_value" op: EQUAL value: "1" }
+  )pb");
+  std::vector<std::shared_ptr<const FieldFilter>> filters(8);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < filters.size(); ++i) {
+    threads.emplace_back([&, i]() {
+      absl::StatusOr<std::shared_ptr<const FieldFilter>> filter =
+          cache.GetOrCreate(TestProtoB().GetDescriptor(), config);
+      EXPECT_TRUE(filter.ok());
+      filters[i] = *std::move(filter);
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (const std::shared_ptr<const FieldFilter>& filter : filters) {
+    EXPECT_EQ(filter, filters[0]);
+  }
+  EXPECT_EQ(cache.size(), 3);
+}
+
+TEST(FieldFilterCacheTest, TestFieldFilterOptions) {
+  FieldFilterCache cache;
+  FieldFilterOptions options;
+  options.cache = &cache;
+  FieldFilterProto config = ParseConfig(R"pb(
+    op: OR
+    sub_filters { name: "int32_value" op: EQUAL value: "1" }
+    sub_filters { name: "int64_value" op: EQUAL value: "1" }
+  )pb");
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldFilter> filter,
+      FieldFilter::New(TestProtoB().GetDescriptor(), config, options));
+  // Only the sub filters are added.
+  EXPECT_EQ(cache.size(), 2);
+}
+
+TEST(FieldFilterCacheTest, TestMixedFieldFilterOptions) {
+  FieldFilterProto config = ParseConfig(R"pb(
+    op: OR
+    sub_filters {
+      op: AND
+      sub_filters { name: "int32_value" op: EQUAL value: "1" }
+      sub_filters { name: "int64_value" op: EQUAL value: "1" }
+    }
+    sub_filters { name: "int64_value" op: EQUAL value: "2" }
+  )pb");
+  FieldFilterOptions options;
+  options.adaptive_order = true;
+
+  // The cache would build the nested AND without adaptive order.
+  FieldFilterCache default_cache;
+  options.cache = &default_cache;
+  EXPECT_THAT(
+      FieldFilter::New(TestProtoB().GetDescriptor(), config, options).status(),
+      StatusIs(absl::StatusCode::kInvalidArgument, ""));
+  EXPECT_EQ(default_cache.size(), 0);
+
+  FieldFilterCache adaptive_cache(options);
+  options.cache = &adaptive_cache;
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldFilter> filter,
+      FieldFilter::New(TestProtoB().GetDescriptor(), config, options));
+  EXPECT_EQ(adaptive_cache.size(), 4);
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,523 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/field_filter_normalizer.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "common_cpp/testing/common_matchers.h"
+#include "common_cpp/testing/status_macros.h"
+#include "common_cpp/testing/status_matchers.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::wfa::EqualsProto;
+using ::wfa::StatusIs;
+using ::wfa_virtual_people::test::TestProto;
+using ::wfa_virtual_people::test::TestProtoB;
+
+template <typename MessageType>
+std::vector<MessageType> GetTestMessages();
+
+template <>
+std::vector<TestProto> GetTestMessages<TestProto>() {
+  std::vector<std::string> texts = {
+      "",
+      R"pb(a { b {} })pb",
+      R"pb(a { b { int32_value: 1 int64_value: 1 string_value: "a" } })pb",
+      R"pb(a { b { int32_value: 2 int64_value: 5 string_value: "b" } })pb",
+      R"pb(a { b { int32_value: 3 int64_value: 9 string_value: "c" } })pb",
+      R"pb(a { b { int32_value: 4 int64_value: 30 bool_value: true } })pb",
+  };
+  std::vector<TestProto> test_protos(texts.size());
+  for (size_t i = 0; i < texts.size(); ++i) {
+    EXPECT_TRUE(google::protobuf::TextFormat::ParseFromString(texts[i],
+                                                             &test_protos[i]));
+  }
+  return test_protos;
+}
+
+template <>
+std::vector<TestProtoB> GetTestMessages<TestProtoB>() {
+  std::vector<TestProtoB> test_protos;
+  for (const TestProto& test_proto : GetTestMessages<TestProto>()) {
+    test_protos.push_back(test_proto.a().b());
+  }
+  return test_protos;
+}
+
+// Checks that @config_text on MessageType is normalized to @expected_text, and
+// that both match the same test messages.
+//
+// All the fields of TestProtoB are in the same message, so no PARTIAL is
+// added for shared parent messages when MessageType is TestProtoB.
+template <typename MessageType>
+void ExpectNormalized(const std::string& config_text,
+                      const std::string& expected_text) {
+  FieldFilterProto config;
+  ASSERT_TRUE(
+      google::protobuf::TextFormat::ParseFromString(config_text, &config));
+  FieldFilterProto expected;
+  ASSERT_TRUE(
+      google::protobuf::TextFormat::ParseFromString(expected_text, &expected));
+
+  const google::protobuf::Descriptor* descriptor =
+      MessageType().GetDescriptor();
+  FieldFilterProto normalized = NormalizeFieldFilterProto(descriptor, config);
+  EXPECT_THAT(normalized, EqualsProto(expected)) << config_text;
+
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldFilter> original_filter,
+      FieldFilter::NewWithoutNormalization(descriptor, config));
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldFilter> normalized_filter,
+      FieldFilter::NewWithoutNormalization(descriptor, normalized));
+  for (const MessageType& message : GetTestMessages<MessageType>()) {
+    EXPECT_EQ(normalized_filter->IsMatch(message),
+              original_filter->IsMatch(message))
+        << config_text << "\nMessage: " << message.DebugString();
+  }
+}
+
+TEST(FieldFilterNormalizerTest, TestFlatten) {
+  ExpectNormalized<TestProtoB>(
+      R"pb(
+        op: AND
+        sub_filters {
+          op: AND
+          sub_filters { name: "int32_value" op: EQUAL value: "1" }
+          sub_filters { name: "int64_value" op: EQUAL value: "1" }
+        }
+        sub_filters { name: "string_value" op: HAS }
+      )pb",
+      R"pb(
+        op: AND
+        sub_filters { name: "int32_value" op: EQUAL value: "1" }
+        sub_filters { name: "int64_value" op: EQUAL value: "1" }
+        sub_filters { name: "string_value" op: HAS }
+      )pb");
+  ExpectNormalized<TestProtoB>(
+      R"pb(
+        op: OR
+        sub_filters { name: "int32_value" op: GT value: "3" }
+        sub_filters {
+          op: OR
+          sub_filters { name: "int64_value" op: LT value: "2" }
+          sub_filters { name: "string_value" op: HAS }
+        }
+      )pb",
+      R"pb(
+        op: OR
+        sub_filters { name: "int32_value" op: GT value: "3" }
+        sub_filters { name: "int64_value" op: LT value: "2" }
+        sub_filters { name: "string_value" op: HAS }
+      )pb");
+}
+
+TEST(FieldFilterNormalizerTest, TestFoldTrue) {
+  ExpectNormalized<TestProtoB>(
+      R"pb(
+        op: AND
+        sub_filters { op: TRUE }
+        sub_filters { name: "int32_value" op: EQUAL value: "1" }
+        sub_filters { op: TRUE }
+      )pb",
+      R"pb(name: "int32_value" op: EQUAL value: "1")pb");
+  ExpectNormalized<TestProtoB>(
+      R"pb(
+        op: AND
+        sub_filters { op: TRUE }
+        sub_filters { op: AND sub_filters { op: TRUE } }
+      )pb",
+      R"pb(op: TRUE)pb");
+  ExpectNormalized<TestProtoB>(
+      R"pb(
+        op: OR
+        sub_filters { name: "int32_value" op: EQUAL value: "1" }
+        sub_filters { op: TRUE }
+      )pb",
+      R"pb(op: TRUE)pb");
+  ExpectNormalized<TestProto>(
+      R"pb(
+        name: "a.b"
+        op: PARTIAL
+        sub_filters { op: TRUE }
+      )pb",
+      R"pb(name: "a.b" op: HAS)pb");
+}
+
+TEST(FieldFilterNormalizerTest, TestMergeEqualIntoIn) {
+  ExpectNormalized<TestProtoB>(
+      R"pb(
+        op: OR
+        sub_filters { name: "int32_value" op: EQUAL value: "1" }
+        sub_filters { name: "string_value" op: EQUAL value: "c" }
+        sub_filters { name: "int32_value" op: EQUAL value: "3" }
+        sub_filters { name: "string_value" op: IN value: "a,x" }
+        sub_filters { name: "int64_value" op: EQUAL value: "30" }
+      )pb",
+      R"pb(
+        op: OR
+        sub_filters { name: "int32_value" op: IN value: "1,3" }
+        sub_filters { name: "string_value" op: IN value: "c,a,x" }
+        sub_filters { name: "int64_value" op: EQUAL value: "30" }
+      )pb");
+  // An EQUAL string value with comma is kept.
+  ExpectNormalized<TestProtoB>(
+      R"pb(
+        op: OR
+        sub_filters { name: "string_value" op: EQUAL value: "a,b" }
+        sub_filters { name: "string_value" op: EQUAL value: "c" }
+      )pb",
+      R"pb(
+        op: OR
+        sub_filters { name: "string_value" op: EQUAL value: "a,b" }
+        sub_filters { name: "string_value" op: EQUAL value: "c" }
+      )pb");
+}
+
+TEST(FieldFilterNormalizerTest, TestGroupRange) {
+  ExpectNormalized<TestProtoB>(
+      R"pb(
+        op: AND
+        sub_filters { name: "int64_value" op: LT value: "10" }
+        sub_filters { name: "string_value" op: HAS }
+        sub_filters { name: "int64_value" op: GT value: "1" }
+      )pb",
+      R"pb(
+        op: AND
+        sub_filters {
+          op: AND
+          sub_filters { name: "int64_value" op: GT value: "1" }
+          sub_filters { name: "int64_value" op: LT value: "10" }
+        }
+        sub_filters { name: "string_value" op: HAS }
+      )pb");
+  ExpectNormalized<TestProto>(
+      R"pb(
+        name: "a.b"
+        op: PARTIAL
+        sub_filters { name: "int32_value" op: GT value: "1" }
+        sub_filters { name: "int32_value" op: LT value: "4" }
+      )pb",
+      R"pb(
+        name: "a.b"
+        op: PARTIAL
+        sub_filters {
+          op: AND
+          sub_filters { name: "int32_value" op: GT value: "1" }
+          sub_filters { name: "int32_value" op: LT value: "4" }
+        }
+      )pb");
+}
+
+TEST(FieldFilterNormalizerTest, TestPushNotDown) {
+  ExpectNormalized<TestProtoB>(
+      R"pb(
+        op: NOT
+        sub_filters {
+          op: NOT
+          sub_filters { name: "int32_value" op: EQUAL value: "1" }
+        }
+      )pb",
+      R"pb(name: "int32_value" op: EQUAL value: "1")pb");
+  ExpectNormalized<TestProtoB>(
+      R"pb(
+        op: NOT
+        sub_filters {
+          op: OR
+          sub_filters {
+            op: NOT
+            sub_filters { name: "int32_value" op: GT value: "1" }
+          }
+          sub_filters {
+            op: NOT
+            sub_filters { name: "string_value" op: HAS }
+          }
+        }
+      )pb",
+      R"pb(
+        op: AND
+        sub_filters { name: "int32_value" op: GT value: "1" }
+        sub_filters { name: "string_value" op: HAS }
+      )pb");
+  // Pushing down does not remove nodes here.
+  ExpectNormalized<TestProtoB>(
+      R"pb(
+        op: NOT
+        sub_filters { name: "int32_value" op: EQUAL value: "1" }
+        sub_filters { name: "string_value" op: HAS }
+      )pb",
+      R"pb(
+        op: NOT
+        sub_filters { name: "int32_value" op: EQUAL value: "1" }
+        sub_filters { name: "string_value" op: HAS }
+      )pb");
+}
+
+TEST(FieldFilterNormalizerTest, TestGroupSharedParents) {
+  ExpectNormalized<TestProto>(
+      R"pb(
+        op: AND
+        sub_filters { name: "a.b.int32_value" op: EQUAL value: "1" }
+        sub_filters { name: "a.b.int64_value" op: GT value: "0" }
+        sub_filters { name: "a.b.string_value" op: HAS }
+      )pb",
+      R"pb(
+        name: "a.b"
+        op: PARTIAL
+        sub_filters { name: "int32_value" op: EQUAL value: "1" }
+        sub_filters { name: "int64_value" op: GT value: "0" }
+        sub_filters { name: "string_value" op: HAS }
+      )pb");
+  ExpectNormalized<TestProto>(
+      R"pb(
+        op: OR
+        sub_filters { name: "a.b.int32_value" op: EQUAL value: "1" }
+        sub_filters { name: "a.b.int64_value" op: LT value: "5" }
+      )pb",
+      R"pb(
+        name: "a.b"
+        op: PARTIAL
+        sub_filters {
+          op: OR
+          sub_filters { name: "int32_value" op: EQUAL value: "1" }
+          sub_filters { name: "int64_value" op: LT value: "5" }
+        }
+      )pb");
+  // The deepest message shared by all the sub filters.
+  ExpectNormalized<TestProto>(
+      R"pb(
+        op: AND
+        sub_filters { name: "a.b" op: HAS }
+        sub_filters { name: "a.b.int32_value" op: GT value: "1" }
+      )pb",
+      R"pb(
+        name: "a"
+        op: PARTIAL
+        sub_filters { name: "b" op: HAS }
+        sub_filters { name: "b.int32_value" op: GT value: "1" }
+      )pb");
+  // PARTIAL on the shared message is merged.
+  ExpectNormalized<TestProto>(
+      R"pb(
+        op: AND
+        sub_filters {
+          name: "a.b"
+          op: PARTIAL
+          sub_filters { name: "int32_value" op: GT value: "1" }
+        }
+        sub_filters { name: "a.b.int32_values" op: ANY_IN value: "2,3" }
+      )pb",
+      R"pb(
+        name: "a.b"
+        op: PARTIAL
+        sub_filters { name: "int32_value" op: GT value: "1" }
+        sub_filters { name: "int32_values" op: ANY_IN value: "2,3" }
+      )pb");
+  // Composite sub filters other than PARTIAL and range are not grouped.
+  ExpectNormalized<TestProto>(
+      R"pb(
+        op: AND
+        sub_filters {
+          op: NOT
+          sub_filters { name: "a.b.int32_value" op: GT value: "1" }
+        }
+        sub_filters { name: "a.b.string_value" op: HAS }
+      )pb",
+      R"pb(
+        op: AND
+        sub_filters {
+          op: NOT
+          sub_filters { name: "a.b.int32_value" op: GT value: "1" }
+        }
+        sub_filters { name: "a.b.string_value" op: HAS }
+      )pb");
+}
+
+TEST(FieldFilterNormalizerTest, TestNormalizedConfigsAreKept) {
+  std::vector<std::string> normalized_texts = {
+      R"pb(op: TRUE)pb",
+      R"pb(name: "a.b.int32_value" op: IN value: "1,2,3")pb",
+      R"pb(
+        op: AND
+        sub_filters { name: "a.b.int32_value" op: GT value: "1" }
+        sub_filters { name: "int32_values" op: ANY_IN value: "1" }
+      )pb",
+      R"pb(
+        op: OR
+        sub_filters { name: "a.b.int32_value" op: EQUAL value: "1" }
+        sub_filters { name: "int32_values" op: ANY_IN value: "1" }
+      )pb",
+      R"pb(
+        op: NOT
+        sub_filters { name: "a.b.int32_value" op: EQUAL value: "1" }
+      )pb",
+      R"pb(
+        name: "a.b"
+        op: PARTIAL
+        sub_filters { name: "int32_value" op: EQUAL value: "1" }
+        sub_filters { name: "int64_value" op: EQUAL value: "1" }
+      )pb",
+  };
+  for (const std::string& config_text : normalized_texts) {
+    FieldFilterProto config;
+    ASSERT_TRUE(
+        google::protobuf::TextFormat::ParseFromString(config_text, &config));
+    EXPECT_TRUE(IsFieldFilterProtoNormalized(config)) << config_text;
+    EXPECT_THAT(NormalizeFieldFilterProto(TestProto().GetDescriptor(), config),
+                EqualsProto(config))
+        << config_text;
+  }
+
+  std::vector<std::string> rewritten_texts = {
+      R"pb(op: AND)pb",
+      R"pb(
+        op: OR
+        sub_filters { name: "a.b.int32_value" op: EQUAL value: "1" }
+      )pb",
+      R"pb(
+        op: AND
+        sub_filters { name: "a.b.int32_value" op: GT value: "1" }
+        sub_filters { name: "a.b.int32_value" op: LT value: "5" }
+      )pb",
+      R"pb(
+        op: OR
+        sub_filters { name: "int32_values" op: ANY_IN value: "1" }
+        sub_filters { op: TRUE }
+      )pb",
+      R"pb(
+        op: OR
+        sub_filters { name: "a.b.int32_value" op: EQUAL value: "1" }
+        sub_filters { name: "a.b.int64_value" op: EQUAL value: "1" }
+      )pb",
+      R"pb(
+        op: NOT
+        sub_filters { op: NOT sub_filters { name: "a.c" op: HAS } }
+      )pb",
+  };
+  for (const std::string& config_text : rewritten_texts) {
+    FieldFilterProto config;
+    ASSERT_TRUE(
+        google::protobuf::TextFormat::ParseFromString(config_text, &config));
+    EXPECT_FALSE(IsFieldFilterProtoNormalized(config)) << config_text;
+  }
+}
+
+TEST(FieldFilterNormalizerTest, TestInvalidConfigsStayInvalid) {
+  std::vector<std::string> config_texts = {
+      R"pb(op: AND)pb",
+      R"pb(op: AND sub_filters { op: TRUE name: "a" })pb",
+      R"pb(
+        op: OR
+        sub_filters { op: TRUE }
+        sub_filters { name: "a.c" op: HAS }
+      )pb",
+      R"pb(
+        op: OR
+        sub_filters { name: "a.b.int32_value" op: EQUAL value: "1" }
+        sub_filters { name: "a.b.int32_value" op: EQUAL value: "a" }
+      )pb",
+      R"pb(
+        op: AND
+        sub_filters { name: "a.b.int32_value" op: GT value: "1" }
+        sub_filters { name: "a.b.int32_value" op: LT value: "a" }
+      )pb",
+      R"pb(
+        name: "repeated_proto_a"
+        op: PARTIAL
+        sub_filters { op: TRUE }
+      )pb",
+      R"pb(
+        op: NOT
+        sub_filters { op: NOT sub_filters { name: "a.c" op: HAS } }
+      )pb",
+      R"pb(
+        op: AND
+        sub_filters { name: "a.b.int32_value" op: HAS }
+        sub_filters { name: "a.b.int64_value" op: HAS }
+        sub_filters { name: "a.b.int32_value" op: EQUAL value: "a" }
+      )pb",
+      R"pb(
+        op: OR
+        sub_filters { op: TRUE }
+        sub_filters { name: "a.b.int32_value" op: IN value: "1,a" }
+      )pb",
+      R"pb(
+        op: OR
+        sub_filters { op: TRUE }
+        sub_filters { name: "a.b.string_value" op: REGEXP value: "(" }
+      )pb",
+  };
+  for (const std::string& config_text : config_texts) {
+    FieldFilterProto config;
+    ASSERT_TRUE(
+        google::protobuf::TextFormat::ParseFromString(config_text, &config));
+    EXPECT_THAT(FieldFilter::New(TestProto().GetDescriptor(), config).status(),
+                StatusIs(absl::StatusCode::kInvalidArgument, ""))
+        << config_text;
+    // Invalid configs are not rewritten.
+    EXPECT_THAT(NormalizeFieldFilterProto(TestProto().GetDescriptor(), config),
+                EqualsProto(config))
+        << config_text;
+  }
+}
+
+TEST(FieldFilterNormalizerTest, TestValueFilesAreKept) {
+  // The value file is not opened by the normalizer, so it is kept even though
+  // TRUE makes the OR always match.
+  FieldFilterProto config;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      R"pb(
+        op: OR
+        sub_filters { name: "int64_value" op: EQUAL value: "1" }
+        sub_filters { op: TRUE }
+        sub_filters {
+          name: "int32_value"
+          op: IN
+          value_file: "/nonexistent/value_set"
+        }
+      )pb",
+      &config));
+  FieldFilterProto expected;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      R"pb(
+        op: OR
+        sub_filters { op: TRUE }
+        sub_filters {
+          name: "int32_value"
+          op: IN
+          value_file: "/nonexistent/value_set"
+        }
+      )pb",
+      &expected));
+  EXPECT_THAT(NormalizeFieldFilterProto(TestProtoB().GetDescriptor(), config),
+              EqualsProto(expected));
+  EXPECT_THAT(FieldFilter::New(TestProtoB().GetDescriptor(), config).status(),
+              StatusIs(absl::StatusCode::kNotFound, ""));
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,245 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/field_filter_stats.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "common_cpp/testing/common_matchers.h"
+#include "common_cpp/testing/status_macros.h"
+#include "common_cpp/testing/status_matchers.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/field_filter_cache.h"
+#include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+#include "wfa/virtual_people/common/field_filter/test_util.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::Pair;
+using ::testing::UnorderedElementsAre;
+using ::wfa::EqualsProto;
+using ::wfa::StatusIs;
+using ::wfa_virtual_people::test::TestProto;
+
+constexpr char kAndConfig[] = R"pb(
+  op: AND
+  sub_filters { name: "int32_values" op: ANY_IN value: "1,2" }
+  sub_filters { name: "a.b.int32_value" op: HAS }
+)pb";
+
+constexpr char kOrConfig[] = R"pb(
+  op: OR
+  sub_filters { name: "a.b.int32_value" op: EQUAL value: "1" }
+  sub_filters { name: "int32_values" op: ANY_IN value: "5" }
+)pb";
+
+// The messages the counters of the tests are computed on. The first one
+// matches both kAndConfig and kOrConfig, and the others match neither.
+std::vector<TestProto> GetStatsTestProtos() {
+  std::vector<std::string> texts = {
+      R"pb(a { b { int32_value: 1 } } int32_values: 1)pb",
+      R"pb(int32_values: 3)pb",
+      R"pb(int32_values: 2)pb",
+  };
+  std::vector<TestProto> test_protos(texts.size());
+  for (size_t i = 0; i < texts.size(); ++i) {
+    EXPECT_TRUE(google::protobuf::TextFormat::ParseFromString(texts[i],
+                                                             &test_protos[i]));
+  }
+  return test_protos;
+}
+
+FieldFilterStatsProto::NodeStats GetNodeStats(
+    const std::string& node_stats_text) {
+  FieldFilterStatsProto::NodeStats node_stats;
+  EXPECT_TRUE(google::protobuf::TextFormat::ParseFromString(node_stats_text,
+                                                           &node_stats));
+  return node_stats;
+}
+
+TEST(FieldFilterStatsTest, TestIsMatch) {
+  FieldFilterStats stats;
+  FieldFilterOptions options;
+  options.stats = &stats;
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldFilter> filter,
+      FieldFilter::New(TestProto().GetDescriptor(), ParseConfig(kAndConfig),
+                       options));
+  std::vector<TestProto> test_protos = GetStatsTestProtos();
+  EXPECT_TRUE(filter->IsMatch(test_protos[0]));
+  EXPECT_FALSE(filter->IsMatch(test_protos[1]));
+  EXPECT_FALSE(filter->IsMatch(test_protos[2]));
+
+  EXPECT_THAT(
+      stats.Export().nodes(),
+      UnorderedElementsAre(
+          Pair("0", EqualsProto(GetNodeStats(
+                        R"pb(op: AND evaluations: 3 matches: 1)pb"))),
+          Pair("0.0", EqualsProto(GetNodeStats(
+                          R"pb(op: ANY_IN
+                               name: "int32_values"
+                               evaluations: 3
+                               matches: 2
+                               short_circuits: 0)pb"))),
+          Pair("0.1", EqualsProto(GetNodeStats(
+                          R"pb(op: HAS
+                               name: "a.b.int32_value"
+                               evaluations: 2
+                               matches: 1
+                               short_circuits: 1)pb")))));
+}
+
+TEST(FieldFilterStatsTest, TestSameAsFieldFilter) {
+  FieldFilterStats stats;
+  FieldFilterOptions options;
+  options.stats = &stats;
+  for (const char* config_text : {kAndConfig, kOrConfig}) {
+    ASSERT_OK_AND_ASSIGN(
+        std::unique_ptr<FieldFilter> filter,
+        FieldFilter::New(TestProto().GetDescriptor(), ParseConfig(config_text),
+                         options));
+    ExpectSameAsFieldFilter(config_text, GetTestProtos(),
+                            [&](const TestProto& test_proto) {
+                              return filter->IsMatch(test_proto);
+                            });
+  }
+}
+
+TEST(FieldFilterStatsTest, TestMatchBatch) {
+  FieldFilterStats stats;
+  FieldFilterOptions options;
+  options.stats = &stats;
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldFilter> filter,
+      FieldFilter::New(TestProto().GetDescriptor(), ParseConfig(kOrConfig),
+                       options));
+  std::vector<TestProto> test_protos = GetStatsTestProtos();
+  std::vector<const google::protobuf::Message*> messages;
+  for (const TestProto& test_proto : test_protos) {
+    messages.push_back(&test_proto);
+  }
+  std::vector<bool> matches;
+  filter->MatchBatch(messages, &matches);
+  EXPECT_THAT(matches, ElementsAre(true, false, false));
+
+  EXPECT_THAT(
+      stats.Export().nodes(),
+      UnorderedElementsAre(
+          Pair("0", EqualsProto(GetNodeStats(
+                        R"pb(op: OR evaluations: 3 matches: 1)pb"))),
+          Pair("0.0", EqualsProto(GetNodeStats(
+                          R"pb(op: EQUAL
+                               name: "a.b.int32_value"
+                               evaluations: 3
+                               matches: 1
+                               short_circuits: 0)pb"))),
+          Pair("0.1", EqualsProto(GetNodeStats(
+                          R"pb(op: ANY_IN
+                               name: "int32_values"
+                               evaluations: 2
+                               matches: 0
+                               short_circuits: 1)pb")))));
+}
+
+TEST(FieldFilterStatsTest, TestLatencySampling) {
+  FieldFilterStats stats(/*latency_sampling_period=*/2);
+  FieldFilterOptions options;
+  options.stats = &stats;
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldFilter> filter,
+      FieldFilter::New(TestProto().GetDescriptor(), ParseConfig(kAndConfig),
+                       options));
+  std::vector<TestProto> test_protos = GetStatsTestProtos();
+  for (int i = 0; i < 4; ++i) {
+    filter->IsMatch(test_protos[0]);
+  }
+
+  FieldFilterStatsProto stats_proto = stats.Export();
+  ASSERT_EQ(stats_proto.nodes().count("0"), 1);
+  EXPECT_EQ(stats_proto.nodes().at("0").evaluations(), 4);
+  EXPECT_EQ(stats_proto.nodes().at("0").sampled_evaluations(), 2);
+  EXPECT_GE(stats_proto.nodes().at("0").sampled_nanos(), 0);
+}
+
+TEST(FieldFilterStatsTest, TestRootPaths) {
+  FieldFilterStats stats;
+  FieldFilterOptions options;
+  options.stats = &stats;
+  FieldFilterCache cache(options);
+  options.cache = &cache;
+  const google::protobuf::Descriptor* descriptor = TestProto().GetDescriptor();
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldFilter> filter1,
+      FieldFilter::New(descriptor, ParseConfig(kAndConfig), options));
+  // Failed builds do not take a root path.
+  EXPECT_THAT(
+      FieldFilter::New(descriptor,
+                       ParseConfig(R"pb(op: AND
+                                        sub_filters {
+                                          name: "a.b.int32_value"
+                                          op: HAS
+                                        }
+                                        sub_filters {
+                                          name: "bad_field"
+                                          op: HAS
+                                        })pb"),
+                       options)
+          .status(),
+      StatusIs(absl::StatusCode::kInvalidArgument, ""));
+  // The same config gets its own nodes, as the cache is not used.
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldFilter> filter2,
+      FieldFilter::New(descriptor, ParseConfig(kAndConfig), options));
+  EXPECT_EQ(cache.size(), 0);
+
+  std::vector<TestProto> test_protos = GetStatsTestProtos();
+  filter2->IsMatch(test_protos[0]);
+
+  FieldFilterStatsProto stats_proto = stats.Export();
+  EXPECT_EQ(stats_proto.nodes_size(), 6);
+  ASSERT_EQ(stats_proto.nodes().count("0.1"), 1);
+  ASSERT_EQ(stats_proto.nodes().count("1.1"), 1);
+  EXPECT_EQ(stats_proto.nodes().at("0.1").evaluations(), 0);
+  EXPECT_EQ(stats_proto.nodes().at("1.1").evaluations(), 1);
+}
+
+TEST(FieldFilterStatsTest, TestCompiledFilterIsOneNode) {
+  FieldFilterStats stats;
+  FieldFilterOptions options;
+  options.stats = &stats;
+  options.compiled = true;
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldFilter> filter,
+      FieldFilter::New(TestProto().GetDescriptor(), ParseConfig(kAndConfig),
+                       options));
+  EXPECT_TRUE(filter->IsMatch(GetStatsTestProtos()[0]));
+
+  EXPECT_THAT(stats.Export().nodes(),
+              UnorderedElementsAre(Pair(
+                  "0", EqualsProto(GetNodeStats(
+                           R"pb(op: AND evaluations: 1 matches: 1)pb")))));
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
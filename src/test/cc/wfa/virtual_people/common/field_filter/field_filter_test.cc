@@ -14,20 +14,66 @@
 
 #include "wfa/virtual_people/common/field_filter/field_filter.h"
 
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "absl/status/status.h"
 #include "common_cpp/testing/status_macros.h"
 #include "common_cpp/testing/status_matchers.h"
 #include "gmock/gmock.h"
+#include "google/protobuf/field_mask.pb.h"
 #include "google/protobuf/text_format.h"
 #include "gtest/gtest.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
 #include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+#include "wfa/virtual_people/common/field_filter/test_util.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
 
 namespace wfa_virtual_people {
 namespace {
 
+using ::testing::ElementsAre;
+using ::testing::Pair;
+using ::testing::UnorderedElementsAre;
+using ::testing::UnorderedElementsAreArray;
 using ::wfa::StatusIs;
 using ::wfa_virtual_people::test::TestProto;
 
+constexpr char kReferencedFieldsConfig[] = R"pb(
+  op: OR
+  sub_filters {
+    op: AND
+    sub_filters { name: "a.b.int32_value" op: GT value: "1" }
+    sub_filters { name: "a.b.int32_value" op: LT value: "5" }
+  }
+  sub_filters {
+    name: "a.b"
+    op: PARTIAL
+    sub_filters { name: "string_value" op: REGEXP value: "string.*" }
+    sub_filters {
+      op: NOT
+      sub_filters { name: "enum_value" op: EQUAL value: "TEST_ENUM_1" }
+    }
+    sub_filters { name: "bool_value" op: HAS }
+  }
+  sub_filters { name: "int32_values" op: ANY_IN value: "1,2" }
+  sub_filters { name: "a.b.int64_value" op: IN value: "1,2" }
+  sub_filters { name: "repeated_proto_a" op: HAS }
+)pb";
+
+// Returns the names of the referenced fields of @filter, paired with
+// whether their values are read.
+std::vector<std::pair<std::string, bool>> GetReferencedFieldNames(
+    const FieldFilter& filter) {
+  std::vector<std::pair<std::string, bool>> names;
+  for (const ReferencedField& field : filter.GetReferencedFields()) {
+    names.emplace_back(GetFieldPathName(*field.field_path), field.reads_value);
+  }
+  return names;
+}
+
 TEST(FieldFilterTest, FromMessageFloatNotSupported) {
   TestProto filter_message;
   ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
@@ -124,5 +170,113 @@ TEST(FieldFilterTest, FromMessageSuccessful) {
   EXPECT_FALSE(filter->IsMatch(test_proto_2));
 }
 
+TEST(FieldFilterTest, LeafMatchBatchSameAsIsMatch) {
+  std::vector<std::string> config_texts = {
+      R"pb(name: "a.b.int32_value" op: EQUAL value: "1")pb",
+      R"pb(name: "a.b.enum_value" op: EQUAL value: "TEST_ENUM_1")pb",
+      R"pb(name: "a.b.string_value" op: EQUAL value: "string1")pb",
+      R"pb(name: "a.b.int64_value" op: IN value: "1,3")pb",
+      R"pb(name: "a.b.enum_value" op: IN value: "TEST_ENUM_1,TEST_ENUM_3")pb",
+      R"pb(name: "a.b.string_value" op: IN value: "string1,string3")pb",
+      R"pb(name: "a.b.uint64_value" op: GT value: "1")pb",
+      R"pb(name: "a.b.int32_value" op: LT value: "3")pb",
+      R"pb(
+        op: AND
+        sub_filters { name: "a.b.int64_value" op: GT value: "0" }
+        sub_filters { name: "a.b.int64_value" op: LT value: "3" }
+      )pb",
+  };
+  std::vector<TestProto> test_protos = GetTestProtos();
+  std::vector<const google::protobuf::Message*> messages;
+  for (const TestProto& test_proto : test_protos) {
+    messages.push_back(&test_proto);
+  }
+  for (const std::string& config_text : config_texts) {
+    ASSERT_OK_AND_ASSIGN(std::unique_ptr<FieldFilter> field_filter,
+                         FieldFilter::New(TestProto().GetDescriptor(),
+                                          ParseConfig(config_text)));
+    std::vector<bool> matches;
+    field_filter->MatchBatch(messages, &matches);
+    for (size_t i = 0; i < messages.size(); ++i) {
+      EXPECT_EQ(matches[i], field_filter->IsMatch(*messages[i]))
+          << config_text << "\nMessage: " << messages[i]->DebugString();
+    }
+  }
+}
+
+TEST(FieldFilterTest, GetReferencedFields) {
+  FieldFilterProto config;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      kReferencedFieldsConfig, &config));
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<FieldFilter> filter,
+                       FieldFilter::New(TestProto().GetDescriptor(), config));
+
+  EXPECT_THAT(GetReferencedFieldNames(*filter),
+              UnorderedElementsAre(
+                  Pair("a.b", false), Pair("a.b.int32_value", true),
+                  Pair("a.b.string_value", true), Pair("a.b.enum_value", true),
+                  Pair("a.b.bool_value", false), Pair("int32_values", true),
+                  Pair("a.b.int64_value", true),
+                  Pair("repeated_proto_a", false)));
+
+  // The paths are interned, so they are the same objects as the ones used by
+  // filters.
+  for (const ReferencedField& field : filter->GetReferencedFields()) {
+    ASSERT_OK_AND_ASSIGN(std::shared_ptr<const FieldPath> field_path,
+                         InternFieldPath(TestProto().GetDescriptor(),
+                                         GetFieldPathName(*field.field_path)));
+    EXPECT_EQ(field.field_path, field_path);
+  }
+}
+
+TEST(FieldFilterTest, GetReferencedFieldsCompiled) {
+  FieldFilterProto config;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      kReferencedFieldsConfig, &config));
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<FieldFilter> filter,
+                       FieldFilter::New(TestProto().GetDescriptor(), config));
+  FieldFilterOptions options;
+  options.compiled = true;
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldFilter> compiled_filter,
+      FieldFilter::New(TestProto().GetDescriptor(), config, options));
+
+  // The compiled filter may order the nodes differently, but reads the same
+  // fields.
+  EXPECT_THAT(GetReferencedFieldNames(*compiled_filter),
+              UnorderedElementsAreArray(GetReferencedFieldNames(*filter)));
+}
+
+TEST(FieldFilterTest, GetReferencedFieldsReadsValueWins) {
+  FieldFilterProto config;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      R"pb(op: AND
+           sub_filters { name: "int32_values" op: HAS }
+           sub_filters { name: "int32_values" op: ANY_IN value: "1" }
+      )pb",
+      &config));
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<FieldFilter> filter,
+                       FieldFilter::New(TestProto().GetDescriptor(), config));
+
+  EXPECT_THAT(GetReferencedFieldNames(*filter),
+              ElementsAre(Pair("int32_values", true)));
+}
+
+TEST(FieldFilterTest, GetReferencedFieldMask) {
+  FieldFilterProto config;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      kReferencedFieldsConfig, &config));
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<FieldFilter> filter,
+                       FieldFilter::New(TestProto().GetDescriptor(), config));
+
+  // "a.b" is implied by the fields inside it.
+  google::protobuf::FieldMask field_mask = filter->GetReferencedFieldMask();
+  EXPECT_THAT(field_mask.paths(),
+              UnorderedElementsAre("a.b.int32_value", "a.b.string_value",
+                                   "a.b.enum_value", "a.b.bool_value",
+                                   "int32_values", "a.b.int64_value",
+                                   "repeated_proto_a"));
+}
+
 }  // namespace
 }  // namespace wfa_virtual_people
@@ -0,0 +1,180 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/first_match_index.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "common_cpp/testing/status_macros.h"
+#include "common_cpp/testing/status_matchers.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+#include "wfa/virtual_people/common/field_filter/test_util.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::wfa::StatusIs;
+using ::wfa_virtual_people::test::TestProto;
+
+// The messages the conditions are evaluated against: the shared test messages,
+// and messages setting the same field values in other combinations, so that
+// different conditions are the first match.
+std::vector<TestProto> GetIndexTestProtos() {
+  std::vector<TestProto> test_protos = GetTestProtos();
+  for (const char* text : {
+           R"pb(a {
+                  b {
+                    int32_value: 2
+                    uint64_value: 2
+                    enum_value: TEST_ENUM_2
+                    string_value: "string2"
+                  }
+                })pb",
+           R"pb(a { b { enum_value: TEST_ENUM_3 string_value: "string1" } })pb",
+       }) {
+    EXPECT_TRUE(google::protobuf::TextFormat::ParseFromString(
+        text, &test_protos.emplace_back()));
+  }
+  return test_protos;
+}
+
+// Checks that the index built from @config_texts returns the same first match
+// as checking the FieldFilters one by one, and that @indexed_count of the
+// conditions are indexed.
+void ExpectSameAsLinearScan(const std::vector<std::string>& config_texts,
+                            int indexed_count) {
+  std::vector<FieldFilterProto> configs = ParseConfigs(config_texts);
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FirstMatchIndex> index,
+      FirstMatchIndex::New(TestProto().GetDescriptor(), configs));
+  EXPECT_EQ(index->indexed_count(), indexed_count);
+  std::vector<std::unique_ptr<FieldFilter>> field_filters;
+  for (const FieldFilterProto& config : configs) {
+    ASSERT_OK_AND_ASSIGN(field_filters.emplace_back(),
+                         FieldFilter::New(TestProto().GetDescriptor(), config));
+  }
+
+  for (const TestProto& test_proto : GetIndexTestProtos()) {
+    int expected = -1;
+    for (size_t i = 0; i < field_filters.size(); ++i) {
+      if (field_filters[i]->IsMatch(test_proto)) {
+        expected = i;
+        break;
+      }
+    }
+    EXPECT_EQ(index->FirstMatch(test_proto), expected)
+        << "Message: " << test_proto.DebugString();
+  }
+}
+
+TEST(FirstMatchIndexTest, TestEnumConditions) {
+  ExpectSameAsLinearScan(
+      {
+          R"pb(name: "a.b.enum_value" op: EQUAL value: "TEST_ENUM_3")pb",
+          R"pb(name: "a.b.int32_value" op: GT value: "0")pb",
+          R"pb(name: "a.b.enum_value" op: IN value: "TEST_ENUM_1,2")pb",
+          R"pb(name: "a.b.enum_value" op: EQUAL value: "1")pb",
+      },
+      3);
+}
+
+TEST(FirstMatchIndexTest, TestStringConditions) {
+  ExpectSameAsLinearScan(
+      {
+          R"pb(op: AND
+               sub_filters {
+                 name: "a.b.string_value"
+                 op: EQUAL
+                 value: "string1"
+               }
+               sub_filters { name: "a.b.bool_value" op: EQUAL value: "true" }
+          )pb",
+          R"pb(name: "a.b.string_value" op: IN value: "string2,string3")pb",
+          R"pb(name: "a.b"
+               op: PARTIAL
+               sub_filters { name: "string_value" op: EQUAL value: "string1" }
+          )pb",
+          R"pb(op: TRUE)pb",
+      },
+      3);
+}
+
+TEST(FirstMatchIndexTest, TestIntegerConditions) {
+  ExpectSameAsLinearScan(
+      {
+          R"pb(name: "a.b.uint64_value"
+               op: EQUAL
+               value: "18446744073709551615")pb",
+          R"pb(name: "a.b.int32_value" op: EQUAL value: "2")pb",
+          R"pb(name: "a.b.uint64_value" op: IN value: "1,2")pb",
+          R"pb(op: NOT
+               sub_filters { name: "a.b.uint64_value" op: EQUAL value: "1" }
+          )pb",
+          R"pb(name: "a.b.uint64_value" op: EQUAL value: "2")pb",
+      },
+      3);
+}
+
+TEST(FirstMatchIndexTest, TestOrOfEqualIsIndexed) {
+  // Normalization merges OR of EQUAL on the same field into IN.
+  ExpectSameAsLinearScan(
+      {
+          R"pb(op: OR
+               sub_filters { name: "a.b.int32_value" op: EQUAL value: "1" }
+               sub_filters { name: "a.b.int32_value" op: EQUAL value: "-3" }
+          )pb",
+          R"pb(name: "a.b.int32_value" op: EQUAL value: "2")pb",
+      },
+      2);
+}
+
+TEST(FirstMatchIndexTest, TestNoIndexedField) {
+  ExpectSameAsLinearScan(
+      {
+          R"pb(name: "a.b.int32_value" op: GT value: "1")pb",
+          R"pb(op: OR
+               sub_filters { name: "a.b.int32_value" op: EQUAL value: "1" }
+               sub_filters { name: "a.b.bool_value" op: HAS })pb",
+          R"pb(name: "a.b" op: HAS)pb",
+      },
+      0);
+}
+
+TEST(FirstMatchIndexTest, TestEmptyConditions) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<FirstMatchIndex> index,
+                       FirstMatchIndex::New(TestProto().GetDescriptor(), {}));
+  EXPECT_EQ(index->FirstMatch(TestProto()), -1);
+}
+
+TEST(FirstMatchIndexTest, TestInvalidCondition) {
+  std::vector<FieldFilterProto> configs = ParseConfigs({
+      R"pb(name: "a.b.int32_value" op: EQUAL value: "1")pb",
+      R"pb(name: "a.b.int32_value" op: EQUAL value: "a")pb",
+  });
+  EXPECT_THAT(
+      FirstMatchIndex::New(TestProto().GetDescriptor(), configs).status(),
+      StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
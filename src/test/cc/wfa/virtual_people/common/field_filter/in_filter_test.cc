@@ -12,8 +12,14 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstdint>
+#include <string>
+#include <vector>
+
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
 #include "common_cpp/testing/status_macros.h"
 #include "common_cpp/testing/status_matchers.h"
 #include "gmock/gmock.h"
@@ -22,6 +28,7 @@
 #include "wfa/virtual_people/common/field_filter.pb.h"
 #include "wfa/virtual_people/common/field_filter/field_filter.h"
 #include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+#include "wfa/virtual_people/common/field_filter/utils/external_value_set.h"
 
 namespace wfa_virtual_people {
 namespace {
@@ -422,5 +429,98 @@ TEST(InFilterTest, TestStringNotSet) {
   EXPECT_FALSE(field_filter->IsMatch(test_proto));
 }
 
+TEST(InFilterTest, TestValueFile) {
+  std::string path = testing::TempDir() + "/in_filter_test_int32";
+  ASSERT_TRUE(
+      ExternalValueSet::Write(path, std::vector<int64_t>{-1, 2, 5}).ok());
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldFilter> field_filter,
+      FilterFromProtoText(absl::StrCat(
+          R"pb(name: "a.b.int32_value" op: IN value_file: ")pb", path,
+          "\"")));
+
+  TestProto test_proto_1;
+  test_proto_1.mutable_a()->mutable_b()->set_int32_value(2);
+  EXPECT_TRUE(field_filter->IsMatch(test_proto_1));
+
+  TestProto test_proto_2;
+  test_proto_2.mutable_a()->mutable_b()->set_int32_value(3);
+  EXPECT_FALSE(field_filter->IsMatch(test_proto_2));
+
+  TestProto test_proto_3;
+  EXPECT_FALSE(field_filter->IsMatch(test_proto_3));
+}
+
+TEST(InFilterTest, TestEnumValueFile) {
+  std::string path = testing::TempDir() + "/in_filter_test_enum";
+  ASSERT_TRUE(ExternalValueSet::Write(path, std::vector<int64_t>{1}).ok());
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldFilter> field_filter,
+      FilterFromProtoText(absl::StrCat(
+          R"pb(name: "a.b.enum_value" op: IN value_file: ")pb", path, "\"")));
+
+  TestProto test_proto_1;
+  test_proto_1.mutable_a()->mutable_b()->set_enum_value(
+      TestProtoB::TEST_ENUM_1);
+  EXPECT_TRUE(field_filter->IsMatch(test_proto_1));
+
+  TestProto test_proto_2;
+  test_proto_2.mutable_a()->mutable_b()->set_enum_value(
+      TestProtoB::TEST_ENUM_2);
+  EXPECT_FALSE(field_filter->IsMatch(test_proto_2));
+}
+
+TEST(InFilterTest, TestStringValueFile) {
+  std::string path = testing::TempDir() + "/in_filter_test_string";
+  std::vector<absl::string_view> values = {"a", "b,c"};
+  ASSERT_TRUE(ExternalValueSet::Write(path, values).ok());
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldFilter> field_filter,
+      FilterFromProtoText(absl::StrCat(
+          R"pb(name: "a.b.string_value" op: IN value_file: ")pb", path,
+          "\"")));
+
+  TestProto test_proto_1;
+  test_proto_1.mutable_a()->mutable_b()->set_string_value("b,c");
+  EXPECT_TRUE(field_filter->IsMatch(test_proto_1));
+
+  TestProto test_proto_2;
+  test_proto_2.mutable_a()->mutable_b()->set_string_value("b");
+  EXPECT_FALSE(field_filter->IsMatch(test_proto_2));
+}
+
+TEST(InFilterTest, TestValueAndValueFile) {
+  std::string path = testing::TempDir() + "/in_filter_test_both";
+  ASSERT_TRUE(ExternalValueSet::Write(path, std::vector<int64_t>{1}).ok());
+  EXPECT_THAT(FilterFromProtoText(absl::StrCat(
+                                      R"pb(name: "a.b.int32_value"
+                                           op: IN
+                                           value: "1"
+                                           value_file: ")pb",
+                                      path, "\""))
+                  .status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
+TEST(InFilterTest, TestValueFileWrongKind) {
+  std::string path = testing::TempDir() + "/in_filter_test_wrong_kind";
+  ASSERT_TRUE(ExternalValueSet::Write(path, std::vector<uint64_t>{1}).ok());
+  EXPECT_THAT(FilterFromProtoText(
+                  absl::StrCat(
+                      R"pb(name: "a.b.int32_value" op: IN value_file: ")pb",
+                      path, "\""))
+                  .status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
+TEST(InFilterTest, TestValueFileMissing) {
+  EXPECT_THAT(FilterFromProtoText(
+                  absl::StrCat(
+                      R"pb(name: "a.b.int32_value" op: IN value_file: ")pb",
+                      testing::TempDir(), "/in_filter_test_missing\""))
+                  .status(),
+              StatusIs(absl::StatusCode::kNotFound, ""));
+}
+
 }  // namespace
 }  // namespace wfa_virtual_people
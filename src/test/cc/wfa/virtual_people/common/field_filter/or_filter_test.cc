@@ -12,6 +12,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstddef>
+#include <memory>
+#include <vector>
+
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "common_cpp/testing/status_macros.h"
@@ -26,6 +30,7 @@
 namespace wfa_virtual_people {
 namespace {
 
+using ::testing::ElementsAre;
 using ::wfa::StatusIs;
 using ::wfa_virtual_people::test::TestProto;
 
@@ -99,5 +104,90 @@ TEST(OrFilterTest, TestNotMatch) {
   EXPECT_FALSE(field_filter->IsMatch(test_proto_3));
 }
 
+TEST(OrFilterTest, TestMatchBatch) {
+  FieldFilterProto field_filter_proto;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      R"pb(
+        op: OR
+        sub_filters { name: "a.b.int32_value" op: EQUAL value: "1" }
+        sub_filters { name: "a.b.int64_value" op: EQUAL value: "1" }
+      )pb",
+      &field_filter_proto));
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldFilter> field_filter,
+      FieldFilter::New(TestProto().GetDescriptor(), field_filter_proto));
+
+  std::vector<TestProto> test_protos(4);
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      R"pb(
+        a { b { int32_value: 1 int64_value: 2 } }
+      )pb",
+      &test_protos[0]));
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      R"pb(
+        a { b { int32_value: 2 int64_value: 1 } }
+      )pb",
+      &test_protos[1]));
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      R"pb(
+        a { b { int32_value: 2 int64_value: 2 } }
+      )pb",
+      &test_protos[2]));
+  std::vector<const google::protobuf::Message*> messages;
+  for (const TestProto& test_proto : test_protos) {
+    messages.push_back(&test_proto);
+  }
+
+  std::vector<bool> matches;
+  field_filter->MatchBatch(messages, &matches);
+  EXPECT_THAT(matches, ElementsAre(true, true, false, false));
+  for (size_t i = 0; i < messages.size(); ++i) {
+    EXPECT_EQ(matches[i], field_filter->IsMatch(*messages[i]));
+  }
+}
+
+TEST(OrFilterTest, TestAdaptiveOrder) {
+  // The sub filters do not share a parent message, so they are not grouped
+  // into a PARTIAL.
+  FieldFilterProto field_filter_proto;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      R"pb(
+        op: OR
+        sub_filters { name: "int32_values" op: ANY_IN value: "1,2" }
+        sub_filters { name: "a.b.int32_value" op: EQUAL value: "1" }
+      )pb",
+      &field_filter_proto));
+  FieldFilterOptions options;
+  options.adaptive_order = true;
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<FieldFilter> adaptive_filter,
+                       FieldFilter::New(TestProto().GetDescriptor(),
+                                        field_filter_proto, options));
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldFilter> field_filter,
+      FieldFilter::New(TestProto().GetDescriptor(), field_filter_proto));
+
+  std::vector<TestProto> test_protos(4);
+  test_protos[1].add_int32_values(1);
+  test_protos[2].mutable_a()->mutable_b()->set_int32_value(1);
+  test_protos[3].add_int32_values(2);
+  test_protos[3].mutable_a()->mutable_b()->set_int32_value(1);
+  std::vector<const google::protobuf::Message*> messages;
+  for (const TestProto& test_proto : test_protos) {
+    messages.push_back(&test_proto);
+  }
+
+  // Evaluates enough times for the sub filters to be reordered.
+  for (int i = 0; i < 100000; ++i) {
+    const google::protobuf::Message& message = *messages[i % messages.size()];
+    EXPECT_EQ(adaptive_filter->IsMatch(message),
+              field_filter->IsMatch(message));
+  }
+  std::vector<bool> adaptive_matches;
+  adaptive_filter->MatchBatch(messages, &adaptive_matches);
+  std::vector<bool> matches;
+  field_filter->MatchBatch(messages, &matches);
+  EXPECT_EQ(adaptive_matches, matches);
+}
+
 }  // namespace
 }  // namespace wfa_virtual_people
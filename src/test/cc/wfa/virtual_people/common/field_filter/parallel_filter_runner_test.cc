@@ -0,0 +1,146 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/parallel_filter_runner.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "common_cpp/testing/status_macros.h"
+#include "common_cpp/testing/status_matchers.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::testing::IsEmpty;
+using ::wfa::StatusIs;
+using ::wfa_virtual_people::test::TestProto;
+
+std::shared_ptr<const FieldFilter> NewFilter(const std::string& config_text) {
+  FieldFilterProto config;
+  EXPECT_TRUE(
+      google::protobuf::TextFormat::ParseFromString(config_text, &config));
+  absl::StatusOr<std::unique_ptr<FieldFilter>> filter =
+      FieldFilter::New(TestProto().GetDescriptor(), config);
+  EXPECT_TRUE(filter.ok()) << filter.status();
+  return *std::move(filter);
+}
+
+std::vector<std::shared_ptr<const FieldFilter>> GetFilters() {
+  return {NewFilter(R"pb(name: "a.b.int32_value" op: GT value: "600")pb"),
+          NewFilter(R"pb(name: "a.b.int32_value" op: IN value: "3,5,7")pb"),
+          NewFilter(R"pb(name: "int32_values" op: ANY_IN value: "1")pb")};
+}
+
+// Messages where a.b.int32_value is the index, and int32_values contains 1
+// for every tenth message.
+std::vector<TestProto> GetTestProtos(int count) {
+  std::vector<TestProto> test_protos(count);
+  for (int i = 0; i < count; ++i) {
+    test_protos[i].mutable_a()->mutable_b()->set_int32_value(i);
+    if (i % 10 == 0) {
+      test_protos[i].add_int32_values(1);
+    }
+  }
+  return test_protos;
+}
+
+std::vector<const google::protobuf::Message*> GetMessages(
+    const std::vector<TestProto>& test_protos) {
+  std::vector<const google::protobuf::Message*> messages;
+  for (const TestProto& test_proto : test_protos) {
+    messages.push_back(&test_proto);
+  }
+  return messages;
+}
+
+TEST(ParallelFilterRunnerTest, TestSameAsSequential) {
+  std::vector<std::shared_ptr<const FieldFilter>> filters = GetFilters();
+  std::vector<TestProto> test_protos = GetTestProtos(1000);
+  std::vector<const google::protobuf::Message*> messages =
+      GetMessages(test_protos);
+
+  std::vector<int> expected_selection;
+  for (size_t i = 0; i < messages.size(); ++i) {
+    for (const std::shared_ptr<const FieldFilter>& filter : filters) {
+      if (filter->IsMatch(*messages[i])) {
+        expected_selection.push_back(i);
+        break;
+      }
+    }
+  }
+
+  for (int thread_count : {1, 4}) {
+    for (int chunk_size : {1, 7, 4096}) {
+      ParallelFilterRunnerOptions options;
+      options.thread_count = thread_count;
+      options.chunk_size = chunk_size;
+      ASSERT_OK_AND_ASSIGN(std::unique_ptr<ParallelFilterRunner> runner,
+                           ParallelFilterRunner::New(filters, options));
+      EXPECT_EQ(runner->thread_count(), thread_count);
+
+      std::vector<std::vector<bool>> matches;
+      runner->MatchBatch(messages, &matches);
+      ASSERT_EQ(matches.size(), filters.size());
+      for (size_t f = 0; f < filters.size(); ++f) {
+        ASSERT_EQ(matches[f].size(), messages.size());
+        for (size_t i = 0; i < messages.size(); ++i) {
+          EXPECT_EQ(matches[f][i], filters[f]->IsMatch(*messages[i]))
+              << "Filter " << f << ", message " << i;
+        }
+      }
+      EXPECT_EQ(runner->Select(messages), expected_selection);
+    }
+  }
+}
+
+TEST(ParallelFilterRunnerTest, TestNoMessages) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<ParallelFilterRunner> runner,
+                       ParallelFilterRunner::New(GetFilters()));
+  EXPECT_GE(runner->thread_count(), 1);
+  std::vector<std::vector<bool>> matches;
+  runner->MatchBatch({}, &matches);
+  ASSERT_EQ(matches.size(), 3);
+  EXPECT_THAT(matches[0], IsEmpty());
+  EXPECT_THAT(runner->Select({}), IsEmpty());
+}
+
+TEST(ParallelFilterRunnerTest, TestInvalidArguments) {
+  EXPECT_THAT(ParallelFilterRunner::New({}).status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+  EXPECT_THAT(ParallelFilterRunner::New({nullptr}).status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+  ParallelFilterRunnerOptions options;
+  options.thread_count = -1;
+  EXPECT_THAT(ParallelFilterRunner::New(GetFilters(), options).status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+  options.thread_count = 1;
+  options.chunk_size = 0;
+  EXPECT_THAT(ParallelFilterRunner::New(GetFilters(), options).status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
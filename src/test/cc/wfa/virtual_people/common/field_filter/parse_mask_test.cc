@@ -0,0 +1,317 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/parse_mask.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "common_cpp/testing/common_matchers.h"
+#include "common_cpp/testing/status_macros.h"
+#include "common_cpp/testing/status_matchers.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/field_mask.pb.h"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::wfa::EqualsProto;
+using ::wfa::IsOk;
+using ::wfa::StatusIs;
+using ::wfa_virtual_people::test::TestProto;
+using ::wfa_virtual_people::test::TestProtoB;
+using ::wfa_virtual_people::test::TestProtoOneof;
+using ::wfa_virtual_people::test::TestProtoOneofParent;
+
+constexpr char kTestProto[] = R"pb(
+  a {
+    b {
+      int32_value: 1
+      int64_value: 2
+      enum_value: TEST_ENUM_1
+      string_value: "string1"
+      int32_values: [ 1, 2 ]
+      string_values: [ "string1", "string2" ]
+    }
+  }
+  int32_values: [ 3, 4 ]
+  repeated_proto_a { b { int32_value: 5 string_value: "string5" } }
+  repeated_proto_a { b { int32_value: 6 } }
+)pb";
+
+TestProto ParseTestProto(absl::string_view text) {
+  TestProto test_proto;
+  EXPECT_TRUE(google::protobuf::TextFormat::ParseFromString(std::string(text),
+                                                           &test_proto));
+  return test_proto;
+}
+
+std::vector<FieldFilterProto> ParseConfigs(
+    const std::vector<std::string>& config_texts) {
+  std::vector<FieldFilterProto> configs(config_texts.size());
+  for (size_t i = 0; i < config_texts.size(); ++i) {
+    EXPECT_TRUE(google::protobuf::TextFormat::ParseFromString(config_texts[i],
+                                                             &configs[i]));
+  }
+  return configs;
+}
+
+TEST(ParseMaskTest, TestFilterFields) {
+  std::vector<FieldFilterProto> configs = ParseConfigs({
+      R"pb(name: "a.b"
+           op: PARTIAL
+           sub_filters { name: "int32_value" op: EQUAL value: "1" }
+           sub_filters { name: "string_values" op: HAS })pb",
+      R"pb(op: OR
+           sub_filters { name: "int32_values" op: ANY_IN value: "3" }
+           sub_filters {
+             op: NOT
+             sub_filters { name: "a.b.enum_value" op: EQUAL value: "2" }
+           })pb",
+  });
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<ParseMask> mask,
+                       ParseMask::New(TestProto().GetDescriptor(), configs));
+
+  TestProto test_proto;
+  ASSERT_THAT(
+      mask->Parse(ParseTestProto(kTestProto).SerializeAsString(), &test_proto),
+      IsOk());
+  EXPECT_THAT(test_proto, EqualsProto(ParseTestProto(R"pb(
+                a {
+                  b {
+                    int32_value: 1
+                    enum_value: TEST_ENUM_1
+                    string_values: [ "string1", "string2" ]
+                  }
+                }
+                int32_values: [ 3, 4 ]
+              )pb")));
+}
+
+TEST(ParseMaskTest, TestFiltersMatchTheSame) {
+  std::vector<FieldFilterProto> configs = ParseConfigs({
+      R"pb(name: "a.b.int32_value" op: GT value: "0")pb",
+      R"pb(name: "a.b" op: PARTIAL sub_filters { op: TRUE })pb",
+      R"pb(name: "a.b.string_value" op: REGEXP value: "string[12]")pb",
+      R"pb(name: "repeated_proto_a" op: HAS)pb",
+  });
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<ParseMask> mask,
+                       ParseMask::New(TestProto().GetDescriptor(), configs));
+
+  for (absl::string_view text :
+       {absl::string_view(kTestProto), absl::string_view(""),
+        absl::string_view(R"pb(a { b {} })pb"),
+        absl::string_view(R"pb(a { b { int64_value: 1 } })pb")}) {
+    TestProto full = ParseTestProto(text);
+    TestProto masked;
+    ASSERT_THAT(mask->Parse(full.SerializeAsString(), &masked), IsOk());
+    for (const FieldFilterProto& config : configs) {
+      ASSERT_OK_AND_ASSIGN(
+          std::unique_ptr<FieldFilter> filter,
+          FieldFilter::New(TestProto().GetDescriptor(), config));
+      EXPECT_EQ(filter->IsMatch(masked), filter->IsMatch(full))
+          << "Config: " << config.DebugString() << "\nMessage: " << text;
+    }
+  }
+}
+
+TEST(ParseMaskTest, TestFieldMask) {
+  google::protobuf::FieldMask field_mask;
+  field_mask.add_paths("repeated_proto_a.b.string_value");
+  field_mask.add_paths("a.b.int32_value");
+  field_mask.add_paths("a.b.int64_value");
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ParseMask> mask,
+      ParseMask::New(TestProto().GetDescriptor(), field_mask));
+
+  TestProto test_proto;
+  ASSERT_THAT(
+      mask->Parse(ParseTestProto(kTestProto).SerializeAsString(), &test_proto),
+      IsOk());
+  EXPECT_THAT(test_proto, EqualsProto(ParseTestProto(R"pb(
+                a { b { int32_value: 1 int64_value: 2 } }
+                repeated_proto_a { b { string_value: "string5" } }
+                repeated_proto_a { b {} }
+              )pb")));
+}
+
+TEST(ParseMaskTest, TestWholeFieldKeepsSubFields) {
+  google::protobuf::FieldMask field_mask;
+  field_mask.add_paths("a.b.int32_value");
+  field_mask.add_paths("a");
+  field_mask.add_paths("a.b.string_value");
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ParseMask> mask,
+      ParseMask::New(TestProto().GetDescriptor(), field_mask));
+
+  TestProto full = ParseTestProto(kTestProto);
+  TestProto test_proto;
+  ASSERT_THAT(mask->Parse(full.SerializeAsString(), &test_proto), IsOk());
+  TestProto expected;
+  *expected.mutable_a() = full.a();
+  EXPECT_THAT(test_proto, EqualsProto(expected));
+}
+
+TEST(ParseMaskTest, TestFilterKeepsWireFormat) {
+  google::protobuf::FieldMask field_mask;
+  field_mask.add_paths("int32_values");
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ParseMask> mask,
+      ParseMask::New(TestProto().GetDescriptor(), field_mask));
+
+  TestProto expected;
+  expected.add_int32_values(3);
+  expected.add_int32_values(4);
+  std::string filtered;
+  ASSERT_TRUE(
+      mask->Filter(ParseTestProto(kTestProto).SerializeAsString(), &filtered));
+  EXPECT_EQ(filtered, expected.SerializeAsString());
+}
+
+TEST(ParseMaskTest, TestOneofMemberClearedByOtherMember) {
+  google::protobuf::FieldMask field_mask;
+  field_mask.add_paths("int32_value");
+  field_mask.add_paths("b.int32_value");
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ParseMask> mask,
+      ParseMask::New(TestProtoOneof().GetDescriptor(), field_mask));
+
+  TestProtoOneof int32_member;
+  int32_member.set_int32_value(1);
+  TestProtoOneof string_member;
+  string_member.set_string_value("string1");
+  TestProtoOneof b_member;
+  b_member.mutable_b()->set_int32_value(2);
+  b_member.mutable_b()->set_string_value("string2");
+  TestProtoOneof b_member_2;
+  b_member_2.mutable_b()->set_int64_value(3);
+
+  // The serialized messages are concatenated, so the members are read in
+  // order, and each member read clears the ones before it.
+  std::vector<std::vector<const TestProtoOneof*>> inputs = {
+      {&int32_member},
+      {&int32_member, &string_member},
+      {&string_member, &int32_member},
+      {&b_member, &string_member},
+      {&string_member, &b_member},
+      {&b_member, &int32_member},
+      {&int32_member, &b_member},
+      {&b_member, &string_member, &b_member_2},
+  };
+  for (const std::vector<const TestProtoOneof*>& members : inputs) {
+    std::string serialized;
+    for (const TestProtoOneof* member : members) {
+      serialized.append(member->SerializeAsString());
+    }
+    // The same as parsing the whole message, then clearing the fields not in
+    // the mask.
+    TestProtoOneof expected;
+    ASSERT_TRUE(expected.ParsePartialFromString(serialized));
+    expected.clear_string_value();
+    if (expected.has_b()) {
+      TestProtoB b;
+      if (expected.b().has_int32_value()) {
+        b.set_int32_value(expected.b().int32_value());
+      }
+      *expected.mutable_b() = b;
+    }
+
+    TestProtoOneof test_proto;
+    ASSERT_THAT(mask->Parse(serialized, &test_proto), IsOk());
+    EXPECT_THAT(test_proto, EqualsProto(expected));
+  }
+}
+
+TEST(ParseMaskTest, TestOneofMemberClearedInOtherOccurrence) {
+  google::protobuf::FieldMask field_mask;
+  field_mask.add_paths("oneof_proto.int32_value");
+  field_mask.add_paths("repeated_oneof_proto.int32_value");
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ParseMask> mask,
+      ParseMask::New(TestProtoOneofParent().GetDescriptor(), field_mask));
+
+  TestProtoOneofParent int32_member;
+  int32_member.mutable_oneof_proto()->set_int32_value(1);
+  int32_member.add_repeated_oneof_proto()->set_int32_value(1);
+  TestProtoOneofParent string_member;
+  string_member.mutable_oneof_proto()->set_string_value("string1");
+  string_member.add_repeated_oneof_proto()->set_string_value("string1");
+
+  // The two occurrences of oneof_proto are merged by the parser, so the
+  // string member in the second one clears the int32 member in the first one.
+  // The elements of repeated_oneof_proto are not merged.
+  std::vector<std::vector<const TestProtoOneofParent*>> inputs = {
+      {&int32_member, &string_member},
+      {&string_member, &int32_member},
+      {&int32_member, &int32_member},
+  };
+  for (const std::vector<const TestProtoOneofParent*>& members : inputs) {
+    std::string serialized;
+    for (const TestProtoOneofParent* member : members) {
+      serialized.append(member->SerializeAsString());
+    }
+    TestProtoOneofParent expected;
+    ASSERT_TRUE(expected.ParsePartialFromString(serialized));
+    expected.mutable_oneof_proto()->clear_string_value();
+    for (TestProtoOneof& element : *expected.mutable_repeated_oneof_proto()) {
+      element.clear_string_value();
+    }
+
+    TestProtoOneofParent test_proto;
+    ASSERT_THAT(mask->Parse(serialized, &test_proto), IsOk());
+    EXPECT_THAT(test_proto, EqualsProto(expected));
+
+    std::string filtered;
+    ASSERT_TRUE(mask->Filter(serialized, &filtered));
+    TestProtoOneofParent filtered_proto;
+    ASSERT_TRUE(filtered_proto.ParsePartialFromString(filtered));
+    EXPECT_THAT(filtered_proto, EqualsProto(expected));
+  }
+}
+
+TEST(ParseMaskTest, TestInvalidInputs) {
+  google::protobuf::FieldMask field_mask;
+  field_mask.add_paths("a.c");
+  EXPECT_THAT(
+      ParseMask::New(TestProto().GetDescriptor(), field_mask).status(),
+      StatusIs(absl::StatusCode::kInvalidArgument, ""));
+
+  std::vector<FieldFilterProto> configs = ParseConfigs({
+      R"pb(name: "a.b.int32_value" op: EQUAL value: "a")pb",
+  });
+  EXPECT_THAT(ParseMask::New(TestProto().GetDescriptor(), configs).status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+
+  field_mask.set_paths(0, "a.b");
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ParseMask> mask,
+      ParseMask::New(TestProto().GetDescriptor(), field_mask));
+  std::string serialized = ParseTestProto(kTestProto).SerializeAsString();
+  TestProto test_proto;
+  EXPECT_THAT(mask->Parse(absl::string_view(serialized).substr(0, 5),
+                          &test_proto),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
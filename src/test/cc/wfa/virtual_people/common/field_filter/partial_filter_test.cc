@@ -12,6 +12,9 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstddef>
+#include <vector>
+
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "common_cpp/testing/status_macros.h"
@@ -26,6 +29,7 @@
 namespace wfa_virtual_people {
 namespace {
 
+using ::testing::ElementsAre;
 using ::wfa::StatusIs;
 using ::wfa_virtual_people::test::TestProto;
 
@@ -146,5 +150,48 @@ TEST(PartialFilterTest, TestFieldNotSet) {
   EXPECT_FALSE(field_filter->IsMatch(test_proto));
 }
 
+TEST(PartialFilterTest, TestMatchBatch) {
+  FieldFilterProto field_filter_proto;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      R"pb(
+        name: "a.b"
+        op: PARTIAL
+        sub_filters { name: "int32_value" op: EQUAL value: "1" }
+        sub_filters { name: "int64_value" op: EQUAL value: "1" }
+      )pb",
+      &field_filter_proto));
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldFilter> field_filter,
+      FieldFilter::New(TestProto().GetDescriptor(), field_filter_proto));
+
+  std::vector<TestProto> test_protos(4);
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      R"pb(
+        a { b { int32_value: 1 int64_value: 1 } }
+      )pb",
+      &test_protos[0]));
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      R"pb(
+        a { b { int32_value: 1 int64_value: 2 } }
+      )pb",
+      &test_protos[1]));
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      R"pb(
+        a {}
+      )pb",
+      &test_protos[2]));
+  std::vector<const google::protobuf::Message*> messages;
+  for (const TestProto& test_proto : test_protos) {
+    messages.push_back(&test_proto);
+  }
+
+  std::vector<bool> matches;
+  field_filter->MatchBatch(messages, &matches);
+  EXPECT_THAT(matches, ElementsAre(true, false, false, false));
+  for (size_t i = 0; i < messages.size(); ++i) {
+    EXPECT_EQ(matches[i], field_filter->IsMatch(*messages[i]));
+  }
+}
+
 }  // namespace
 }  // namespace wfa_virtual_people
@@ -0,0 +1,151 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/range_filter.h"
+
+#include <memory>
+
+#include "absl/status/status.h"
+#include "common_cpp/testing/status_macros.h"
+#include "common_cpp/testing/status_matchers.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+#include "wfa/virtual_people/common/field_filter/test_util.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::wfa::StatusIs;
+using ::wfa_virtual_people::test::TestProto;
+
+TEST(RangeFilterTest, TestIsRange) {
+  EXPECT_TRUE(RangeFilter::IsRange(ParseConfig(R"pb(
+    op: AND
+    sub_filters { name: "a.b.int32_value" op: GT value: "1" }
+    sub_filters { name: "a.b.int32_value" op: LT value: "5" }
+  )pb")));
+  // LT before GT.
+  EXPECT_FALSE(RangeFilter::IsRange(ParseConfig(R"pb(
+    op: AND
+    sub_filters { name: "a.b.int32_value" op: LT value: "5" }
+    sub_filters { name: "a.b.int32_value" op: GT value: "1" }
+  )pb")));
+  // Different fields.
+  EXPECT_FALSE(RangeFilter::IsRange(ParseConfig(R"pb(
+    op: AND
+    sub_filters { name: "a.b.int32_value" op: GT value: "1" }
+    sub_filters { name: "a.b.int64_value" op: LT value: "5" }
+  )pb")));
+  EXPECT_FALSE(RangeFilter::IsRange(ParseConfig(R"pb(
+    op: OR
+    sub_filters { name: "a.b.int32_value" op: GT value: "1" }
+    sub_filters { name: "a.b.int32_value" op: LT value: "5" }
+  )pb")));
+}
+
+TEST(RangeFilterTest, TestNotRange) {
+  FieldFilterProto config = ParseConfig(R"pb(
+    op: AND
+    sub_filters { name: "a.b.int32_value" op: GT value: "1" }
+  )pb");
+  EXPECT_THAT(RangeFilter::New(TestProto().GetDescriptor(), config).status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
+TEST(RangeFilterTest, TestInvalidBound) {
+  FieldFilterProto config = ParseConfig(R"pb(
+    op: AND
+    sub_filters { name: "a.b.int32_value" op: GT value: "1" }
+    sub_filters { name: "a.b.int32_value" op: LT value: "x" }
+  )pb");
+  EXPECT_THAT(RangeFilter::New(TestProto().GetDescriptor(), config).status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+  EXPECT_THAT(FieldFilter::New(TestProto().GetDescriptor(), config).status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
+TEST(RangeFilterTest, TestNotIntegerField) {
+  FieldFilterProto config = ParseConfig(R"pb(
+    op: AND
+    sub_filters { name: "a.b.float_value" op: GT value: "1" }
+    sub_filters { name: "a.b.float_value" op: LT value: "5" }
+  )pb");
+  EXPECT_THAT(RangeFilter::New(TestProto().GetDescriptor(), config).status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
+TEST(RangeFilterTest, TestInt32) {
+  FieldFilterProto config = ParseConfig(R"pb(
+    op: AND
+    sub_filters { name: "a.b.int32_value" op: GT value: "1" }
+    sub_filters { name: "a.b.int32_value" op: LT value: "5" }
+  )pb");
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<RangeFilter> field_filter,
+                       RangeFilter::New(TestProto().GetDescriptor(), config));
+
+  TestProto test_proto;
+  EXPECT_FALSE(field_filter->IsMatch(test_proto));
+  test_proto.mutable_a()->mutable_b()->set_int32_value(1);
+  EXPECT_FALSE(field_filter->IsMatch(test_proto));
+  test_proto.mutable_a()->mutable_b()->set_int32_value(2);
+  EXPECT_TRUE(field_filter->IsMatch(test_proto));
+  test_proto.mutable_a()->mutable_b()->set_int32_value(4);
+  EXPECT_TRUE(field_filter->IsMatch(test_proto));
+  test_proto.mutable_a()->mutable_b()->set_int32_value(5);
+  EXPECT_FALSE(field_filter->IsMatch(test_proto));
+}
+
+TEST(RangeFilterTest, TestUInt64) {
+  FieldFilterProto config = ParseConfig(R"pb(
+    op: AND
+    sub_filters { name: "a.b.uint64_value" op: GT value: "1" }
+    sub_filters {
+      name: "a.b.uint64_value"
+      op: LT
+      value: "18446744073709551615"
+    }
+  )pb");
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<RangeFilter> field_filter,
+                       RangeFilter::New(TestProto().GetDescriptor(), config));
+
+  TestProto test_proto;
+  test_proto.mutable_a()->mutable_b()->set_uint64_value(1);
+  EXPECT_FALSE(field_filter->IsMatch(test_proto));
+  test_proto.mutable_a()->mutable_b()->set_uint64_value(
+      18446744073709551614ULL);
+  EXPECT_TRUE(field_filter->IsMatch(test_proto));
+  test_proto.mutable_a()->mutable_b()->set_uint64_value(
+      18446744073709551615ULL);
+  EXPECT_FALSE(field_filter->IsMatch(test_proto));
+}
+
+TEST(RangeFilterTest, TestEmptyRange) {
+  FieldFilterProto config = ParseConfig(R"pb(
+    op: AND
+    sub_filters { name: "a.b.int64_value" op: GT value: "5" }
+    sub_filters { name: "a.b.int64_value" op: LT value: "5" }
+  )pb");
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<FieldFilter> field_filter,
+                       FieldFilter::New(TestProto().GetDescriptor(), config));
+
+  TestProto test_proto;
+  test_proto.mutable_a()->mutable_b()->set_int64_value(5);
+  EXPECT_FALSE(field_filter->IsMatch(test_proto));
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,202 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "common_cpp/testing/status_macros.h"
+#include "common_cpp/testing/status_matchers.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::wfa::StatusIs;
+using ::wfa_virtual_people::test::TestProto;
+
+// This function is required to test the FieldFilter still works when the
+// FieldFilterProto is out of scope.
+absl::StatusOr<std::unique_ptr<FieldFilter>> FilterFromProtoText(
+    absl::string_view proto_text) {
+  FieldFilterProto field_filter_proto;
+  EXPECT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      std::string(proto_text), &field_filter_proto));
+  return FieldFilter::New(TestProto().GetDescriptor(), field_filter_proto);
+}
+
+TestProto NewTestProto(absl::string_view string_value) {
+  TestProto test_proto;
+  test_proto.mutable_a()->mutable_b()->set_string_value(
+      std::string(string_value));
+  return test_proto;
+}
+
+TEST(RegexpFilterTest, TestNoName) {
+  EXPECT_THAT(FilterFromProtoText(R"pb(
+                op: REGEXP value: "a.*"
+              )pb")
+                  .status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
+TEST(RegexpFilterTest, TestNoValue) {
+  EXPECT_THAT(FilterFromProtoText(R"pb(
+                name: "a.b.string_value" op: REGEXP
+              )pb")
+                  .status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
+TEST(RegexpFilterTest, TestNotStringField) {
+  EXPECT_THAT(FilterFromProtoText(R"pb(
+                name: "a.b.int32_value" op: REGEXP value: "1.*"
+              )pb")
+                  .status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
+TEST(RegexpFilterTest, TestDisallowedRepeatedInThePath) {
+  EXPECT_THAT(FilterFromProtoText(R"pb(
+                name: "repeated_proto_a.b.string_value"
+                op: REGEXP
+                value: "a.*"
+              )pb")
+                  .status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
+TEST(RegexpFilterTest, TestInvalidRegexp) {
+  EXPECT_THAT(FilterFromProtoText(R"pb(
+                name: "a.b.string_value" op: REGEXP value: "[a"
+              )pb")
+                  .status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
+TEST(RegexpFilterTest, TestLiteral) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<FieldFilter> field_filter,
+                       FilterFromProtoText(R"pb(
+                         name: "a.b.string_value" op: REGEXP value: "a\\.b"
+                       )pb"));
+  EXPECT_TRUE(field_filter->IsMatch(NewTestProto("a.b")));
+  EXPECT_FALSE(field_filter->IsMatch(NewTestProto("axb")));
+  EXPECT_FALSE(field_filter->IsMatch(NewTestProto("a.bc")));
+  EXPECT_FALSE(field_filter->IsMatch(TestProto()));
+}
+
+TEST(RegexpFilterTest, TestPrefix) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<FieldFilter> field_filter,
+                       FilterFromProtoText(R"pb(
+                         name: "a.b.string_value" op: REGEXP value: "abc.*"
+                       )pb"));
+  EXPECT_TRUE(field_filter->IsMatch(NewTestProto("abc")));
+  EXPECT_TRUE(field_filter->IsMatch(NewTestProto("abcdef")));
+  EXPECT_FALSE(field_filter->IsMatch(NewTestProto("xabc")));
+  // "." does not match newlines.
+  EXPECT_FALSE(field_filter->IsMatch(NewTestProto("abc\n")));
+  EXPECT_FALSE(field_filter->IsMatch(TestProto()));
+}
+
+TEST(RegexpFilterTest, TestSuffix) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<FieldFilter> field_filter,
+                       FilterFromProtoText(R"pb(
+                         name: "a.b.string_value" op: REGEXP value: ".*abc"
+                       )pb"));
+  EXPECT_TRUE(field_filter->IsMatch(NewTestProto("abc")));
+  EXPECT_TRUE(field_filter->IsMatch(NewTestProto("xyzabc")));
+  EXPECT_FALSE(field_filter->IsMatch(NewTestProto("abcx")));
+}
+
+TEST(RegexpFilterTest, TestRegexp) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<FieldFilter> field_filter,
+                       FilterFromProtoText(R"pb(
+                         name: "a.b.string_value"
+                         op: REGEXP
+                         value: "string[0-9]+|other"
+                       )pb"));
+  EXPECT_TRUE(field_filter->IsMatch(NewTestProto("string1")));
+  EXPECT_TRUE(field_filter->IsMatch(NewTestProto("string123")));
+  EXPECT_TRUE(field_filter->IsMatch(NewTestProto("other")));
+  // The whole value must match.
+  EXPECT_FALSE(field_filter->IsMatch(NewTestProto("string1x")));
+  EXPECT_FALSE(field_filter->IsMatch(NewTestProto("string")));
+  EXPECT_FALSE(field_filter->IsMatch(TestProto()));
+}
+
+TEST(RegexpFilterTest, TestEmptyString) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<FieldFilter> field_filter,
+                       FilterFromProtoText(R"pb(
+                         name: "a.b.string_value" op: REGEXP value: ""
+                       )pb"));
+  EXPECT_TRUE(field_filter->IsMatch(NewTestProto("")));
+  EXPECT_FALSE(field_filter->IsMatch(NewTestProto("a")));
+  EXPECT_FALSE(field_filter->IsMatch(TestProto()));
+}
+
+TEST(RegexpFilterTest, TestRepeatedField) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<FieldFilter> field_filter,
+                       FilterFromProtoText(R"pb(
+                         name: "a.b.string_values" op: REGEXP value: "x[a-c]"
+                       )pb"));
+  TestProto test_proto_1;
+  test_proto_1.mutable_a()->mutable_b()->add_string_values("xd");
+  test_proto_1.mutable_a()->mutable_b()->add_string_values("xb");
+  EXPECT_TRUE(field_filter->IsMatch(test_proto_1));
+
+  TestProto test_proto_2;
+  test_proto_2.mutable_a()->mutable_b()->add_string_values("xd");
+  test_proto_2.mutable_a()->mutable_b()->add_string_values("xbb");
+  EXPECT_FALSE(field_filter->IsMatch(test_proto_2));
+
+  // Returns false for empty repeated field, the same as ANY_IN.
+  EXPECT_FALSE(field_filter->IsMatch(TestProto()));
+}
+
+TEST(RegexpFilterTest, TestConcurrentMatch) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<FieldFilter> field_filter,
+                       FilterFromProtoText(R"pb(
+                         name: "a.b.string_value" op: REGEXP value: "a+b*"
+                       )pb"));
+  TestProto matched = NewTestProto("aaabb");
+  TestProto unmatched = NewTestProto("aaaba");
+  std::vector<std::thread> threads;
+  std::vector<int> match_counts(4, 0);
+  for (size_t t = 0; t < match_counts.size(); ++t) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < 1000; ++i) {
+        match_counts[t] += field_filter->IsMatch(matched);
+        match_counts[t] += field_filter->IsMatch(unmatched);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (int match_count : match_counts) {
+    EXPECT_EQ(match_count, 1000);
+  }
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
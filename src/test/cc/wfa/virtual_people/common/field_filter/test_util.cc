@@ -0,0 +1,110 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/test_util.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/functional/function_ref.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "common_cpp/testing/status_macros.h"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+
+namespace wfa_virtual_people {
+
+using ::wfa_virtual_people::test::TestProto;
+
+std::vector<TestProto> GetTestProtos() {
+  std::vector<std::string> texts = {
+      "",
+      R"pb(a {})pb",
+      R"pb(a { b {} })pb",
+      R"pb(a {
+             b {
+               int32_value: 1
+               int64_value: 1
+               uint32_value: 1
+               uint64_value: 1
+               bool_value: true
+               enum_value: TEST_ENUM_1
+               string_value: "string1"
+               int32_values: [ 1, 2 ]
+               uint64_values: [ 1, 2 ]
+               enum_values: [ TEST_ENUM_1 ]
+               string_values: [ "string1", "string2" ]
+             }
+           }
+           int32_values: [ 1 ])pb",
+      R"pb(a {
+             b {
+               int32_value: -3
+               int64_value: 30
+               uint32_value: 3
+               uint64_value: 18446744073709551615
+               bool_value: false
+               enum_value: TEST_ENUM_3
+               string_value: "string3"
+               int32_values: [ 3 ]
+               uint64_values: [ 3 ]
+               enum_values: [ TEST_ENUM_2, TEST_ENUM_3 ]
+               string_values: [ "string3" ]
+             }
+           })pb",
+  };
+  std::vector<TestProto> test_protos(texts.size());
+  for (size_t i = 0; i < texts.size(); ++i) {
+    EXPECT_TRUE(google::protobuf::TextFormat::ParseFromString(texts[i],
+                                                             &test_protos[i]));
+  }
+  return test_protos;
+}
+
+FieldFilterProto ParseConfig(absl::string_view config_text) {
+  FieldFilterProto config;
+  EXPECT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      std::string(config_text), &config));
+  return config;
+}
+
+std::vector<FieldFilterProto> ParseConfigs(
+    const std::vector<std::string>& config_texts) {
+  std::vector<FieldFilterProto> configs;
+  configs.reserve(config_texts.size());
+  for (const std::string& config_text : config_texts) {
+    configs.push_back(ParseConfig(config_text));
+  }
+  return configs;
+}
+
+void ExpectSameAsFieldFilter(
+    absl::string_view config_text, absl::Span<const TestProto> test_protos,
+    absl::FunctionRef<bool(const TestProto&)> is_match) {
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<FieldFilter> field_filter,
+      FieldFilter::New(TestProto().GetDescriptor(), ParseConfig(config_text)));
+  for (const TestProto& test_proto : test_protos) {
+    EXPECT_EQ(is_match(test_proto), field_filter->IsMatch(test_proto))
+        << "Config: " << config_text
+        << "\nMessage: " << test_proto.DebugString();
+  }
+}
+
+}  // namespace wfa_virtual_people
@@ -0,0 +1,50 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_TEST_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_TEST_UTIL_H_
+#define SRC_TEST_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_TEST_UTIL_H_
+
+#include <string>
+#include <vector>
+
+#include "absl/functional/function_ref.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+
+namespace wfa_virtual_people {
+
+// Returns the messages the filters on TestProto are checked against: unset
+// and empty sub messages, and two messages setting all the scalar and repeated
+// fields of a.b with different values.
+std::vector<test::TestProto> GetTestProtos();
+
+// Returns the FieldFilterProto parsed from @config_text.
+FieldFilterProto ParseConfig(absl::string_view config_text);
+
+// Returns the FieldFilterProto parsed from each of @config_texts.
+std::vector<FieldFilterProto> ParseConfigs(
+    const std::vector<std::string>& config_texts);
+
+// Checks that @is_match returns the same result as the FieldFilter built from
+// @config_text with FieldFilter::New, for each of @test_protos.
+void ExpectSameAsFieldFilter(
+    absl::string_view config_text,
+    absl::Span<const test::TestProto> test_protos,
+    absl::FunctionRef<bool(const test::TestProto&)> is_match);
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_TEST_CC_WFA_VIRTUAL_PEOPLE_COMMON_FIELD_FILTER_TEST_UTIL_H_
@@ -76,6 +76,18 @@ TEST(TrueFilterTest, TestWithValue) {
               StatusIs(absl::StatusCode::kInvalidArgument, ""));
 }
 
+TEST(TrueFilterTest, TestWithValueFile) {
+  FieldFilterProto field_filter_proto;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      R"pb(
+        op: TRUE value_file: "values.set"
+      )pb",
+      &field_filter_proto));
+  EXPECT_THAT(FieldFilter::New(TestProto().GetDescriptor(), field_filter_proto)
+                  .status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
 TEST(TrueFilterTest, TestWithSubFilters) {
   FieldFilterProto field_filter_proto;
   ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
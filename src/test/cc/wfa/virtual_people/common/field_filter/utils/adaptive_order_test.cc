@@ -0,0 +1,218 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/utils/adaptive_order.h"
+
+#include <thread>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::testing::ElementsAre;
+
+// Enough evaluations for the sub filters to be reordered at least once.
+constexpr int kEvaluations =
+    2 * AdaptiveOrder::kSampleInterval * AdaptiveOrder::kSamplesPerReorder;
+
+TEST(AdaptiveOrderTest, TestInitialOrder) {
+  AdaptiveOrder adaptive_order(3, /* decisive_result = */ false);
+  EXPECT_THAT(adaptive_order.order(), ElementsAre(0, 1, 2));
+}
+
+TEST(AdaptiveOrderTest, TestAndDecidingSubFilterFirst) {
+  // The last sub filter always fails, which decides the result of AND.
+  std::vector<bool> results = {true, true, false};
+  AdaptiveOrder adaptive_order(results.size(), /* decisive_result = */ false);
+  for (int i = 0; i < kEvaluations; ++i) {
+    EXPECT_FALSE(adaptive_order.Evaluate(
+        [&results](int index) { return results[index]; }));
+  }
+  EXPECT_EQ(adaptive_order.order().front(), 2);
+}
+
+TEST(AdaptiveOrderTest, TestOrDecidingSubFilterFirst) {
+  // The last sub filter always passes, which decides the result of OR.
+  std::vector<bool> results = {false, false, true};
+  AdaptiveOrder adaptive_order(results.size(), /* decisive_result = */ true);
+  for (int i = 0; i < kEvaluations; ++i) {
+    EXPECT_TRUE(adaptive_order.Evaluate(
+        [&results](int index) { return results[index]; }));
+  }
+  EXPECT_EQ(adaptive_order.order().front(), 2);
+}
+
+TEST(AdaptiveOrderTest, TestOrderKeptWhenNotBetter) {
+  // All the sub filters are the same, so the order is never changed.
+  AdaptiveOrder adaptive_order(3, /* decisive_result = */ false);
+  for (int i = 0; i < kEvaluations; ++i) {
+    adaptive_order.Evaluate([](int index) { return true; });
+  }
+  EXPECT_THAT(adaptive_order.order(), ElementsAre(0, 1, 2));
+}
+
+TEST(AdaptiveOrderTest, TestFollowsDistributionChange) {
+  // The first sub filter decides the result of AND for a long time, then the
+  // second one. The old samples must not keep the first one first.
+  std::vector<bool> results = {false, true};
+  auto is_match = [&results](int index) { return results[index]; };
+  AdaptiveOrder adaptive_order(results.size(), /* decisive_result = */ false);
+  for (int i = 0; i < 16 * kEvaluations; ++i) {
+    adaptive_order.Evaluate(is_match);
+  }
+  EXPECT_EQ(adaptive_order.order().front(), 0);
+  results = {true, false};
+  for (int i = 0; i < 4 * kEvaluations; ++i) {
+    adaptive_order.Evaluate(is_match);
+  }
+  EXPECT_EQ(adaptive_order.order().front(), 1);
+}
+
+TEST(AdaptiveOrderTest, TestSamplingStopsAtMaxOrders) {
+  std::vector<bool> results;
+  int calls = 0;
+  auto is_match = [&results, &calls](int index) {
+    ++calls;
+    return results[index];
+  };
+  AdaptiveOrder adaptive_order(2, /* decisive_result = */ false);
+  // The sub filter deciding the result of AND alternates, until the order
+  // stops following it. The costs are measured, so a few more reorders might
+  // be needed when an evaluation is slowed down by the machine.
+  for (int change = 1; change <= 2 * AdaptiveOrder::kMaxOrders; ++change) {
+    results = {change % 2 == 1, change % 2 == 0};
+    for (int n = 0; n < 16 && adaptive_order.order().front() != change % 2;
+         ++n) {
+      for (int i = 0; i < kEvaluations; ++i) {
+        adaptive_order.Evaluate(is_match);
+      }
+    }
+    if (adaptive_order.order().front() != change % 2) {
+      break;
+    }
+  }
+
+  // Without sampled evaluations, the sub filter first in the order decides
+  // each evaluation alone.
+  const int first = adaptive_order.order().front();
+  results = {first != 0, first != 1};
+  calls = 0;
+  for (int i = 0; i < kEvaluations; ++i) {
+    adaptive_order.Evaluate(is_match);
+  }
+  EXPECT_EQ(calls, kEvaluations);
+}
+
+TEST(AdaptiveOrderTest, TestResult) {
+  AdaptiveOrder and_order(2, /* decisive_result = */ false);
+  AdaptiveOrder or_order(2, /* decisive_result = */ true);
+  for (int i = 0; i < kEvaluations; ++i) {
+    std::vector<bool> results = {i % 2 == 0, i % 3 == 0};
+    auto is_match = [&results](int index) { return results[index]; };
+    EXPECT_EQ(and_order.Evaluate(is_match), results[0] && results[1]);
+    EXPECT_EQ(or_order.Evaluate(is_match), results[0] || results[1]);
+  }
+}
+
+TEST(AdaptiveOrderTest, TestInstancesSampledSeparately) {
+  // The evaluations of the two instances alternate, which must not keep
+  // either of them from being sampled.
+  std::vector<bool> results = {true, true, false};
+  auto is_match = [&results](int index) { return results[index]; };
+  AdaptiveOrder adaptive_order_1(results.size(), /* decisive_result = */ false);
+  AdaptiveOrder adaptive_order_2(results.size(), /* decisive_result = */ false);
+  for (int i = 0; i < kEvaluations; ++i) {
+    adaptive_order_1.Evaluate(is_match);
+    adaptive_order_2.Evaluate(is_match);
+  }
+  EXPECT_EQ(adaptive_order_1.order().front(), 2);
+  EXPECT_EQ(adaptive_order_2.order().front(), 2);
+}
+
+TEST(AdaptiveOrderTest, TestEvaluateSelected) {
+  // Row r passes the sub filter i when (r >> i) & 1, and only the odd rows
+  // are selected.
+  constexpr int kRows = 64;
+  std::vector<int> selection;
+  for (int row = 1; row < kRows; row += 2) {
+    selection.push_back(row);
+  }
+  auto match_selected = [](int i, absl::Span<const int> rows,
+                           std::vector<bool>* matches) {
+    for (int row : rows) {
+      (*matches)[row] = (row >> i) & 1;
+    }
+  };
+  AdaptiveOrder and_order(3, /* decisive_result = */ false);
+  AdaptiveOrder or_order(3, /* decisive_result = */ true);
+  // Both the sampled and the other evaluations are checked.
+  for (int n = 0; n < 2 * AdaptiveOrder::kSampleInterval; ++n) {
+    std::vector<bool> and_matches(kRows);
+    std::vector<bool> or_matches(kRows);
+    and_order.EvaluateSelected(selection, &and_matches, match_selected);
+    or_order.EvaluateSelected(selection, &or_matches, match_selected);
+    for (int row : selection) {
+      EXPECT_EQ(and_matches[row], (row & 7) == 7) << "Row " << row;
+      EXPECT_EQ(or_matches[row], (row & 7) != 0) << "Row " << row;
+    }
+  }
+}
+
+TEST(AdaptiveOrderTest, TestEvaluateSelectedReorders) {
+  // The last sub filter fails on all the rows, which decides the result of
+  // AND.
+  constexpr int kRows = 64;
+  std::vector<int> selection;
+  for (int row = 0; row < kRows; ++row) {
+    selection.push_back(row);
+  }
+  auto match_selected = [](int i, absl::Span<const int> rows,
+                           std::vector<bool>* matches) {
+    for (int row : rows) {
+      (*matches)[row] = i != 2;
+    }
+  };
+  AdaptiveOrder adaptive_order(3, /* decisive_result = */ false);
+  // Each sampled evaluation samples all the rows.
+  for (int n = 0; n < kEvaluations / kRows; ++n) {
+    std::vector<bool> matches(kRows);
+    adaptive_order.EvaluateSelected(selection, &matches, match_selected);
+  }
+  EXPECT_EQ(adaptive_order.order().front(), 2);
+}
+
+TEST(AdaptiveOrderTest, TestConcurrentEvaluations) {
+  std::vector<bool> results = {true, true, false};
+  AdaptiveOrder adaptive_order(results.size(), /* decisive_result = */ false);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&adaptive_order, &results]() {
+      for (int i = 0; i < kEvaluations; ++i) {
+        EXPECT_FALSE(adaptive_order.Evaluate(
+            [&results](int index) { return results[index]; }));
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(adaptive_order.order().front(), 2);
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,366 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/utils/external_value_set.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "common_cpp/testing/status_macros.h"
+#include "common_cpp/testing/status_matchers.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/field_filter/utils/value_set.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::wfa::StatusIs;
+
+std::string GetPath(absl::string_view name) {
+  return absl::StrCat(testing::TempDir(), "/external_value_set_test_", name);
+}
+
+TEST(ExternalValueSetTest, TestSigned) {
+  std::string path = GetPath("signed");
+  std::vector<int64_t> values = {7, -3, 1000000000000, -3, 0, 7};
+  ASSERT_TRUE(ExternalValueSet::Write(path, values).ok());
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<const ExternalValueSet> value_set,
+                       ExternalValueSet::Open(path));
+  EXPECT_EQ(value_set->kind(), ExternalValueKind::kSigned);
+  EXPECT_EQ(value_set->size(), 4);
+  EXPECT_EQ(value_set->path(), path);
+  // The temporary directory is absolute.
+  EXPECT_EQ(value_set->absolute_path(), path);
+  EXPECT_TRUE(value_set->contains(int64_t{-3}));
+  EXPECT_TRUE(value_set->contains(int64_t{0}));
+  EXPECT_TRUE(value_set->contains(int64_t{7}));
+  EXPECT_TRUE(value_set->contains(int64_t{1000000000000}));
+  EXPECT_FALSE(value_set->contains(int64_t{1}));
+  EXPECT_FALSE(value_set->contains(int64_t{-1000000000000}));
+  // The kind does not match.
+  EXPECT_FALSE(value_set->contains(uint64_t{7}));
+  EXPECT_FALSE(value_set->contains(absl::string_view("7")));
+}
+
+TEST(ExternalValueSetTest, TestUnsigned) {
+  std::string path = GetPath("unsigned");
+  std::vector<uint64_t> values = {UINT64_MAX, 5, 0};
+  ASSERT_TRUE(ExternalValueSet::Write(path, values).ok());
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<const ExternalValueSet> value_set,
+                       ExternalValueSet::Open(path));
+  EXPECT_EQ(value_set->kind(), ExternalValueKind::kUnsigned);
+  EXPECT_EQ(value_set->size(), 3);
+  EXPECT_TRUE(value_set->contains(uint64_t{0}));
+  EXPECT_TRUE(value_set->contains(uint64_t{5}));
+  EXPECT_TRUE(value_set->contains(UINT64_MAX));
+  EXPECT_FALSE(value_set->contains(uint64_t{6}));
+  EXPECT_FALSE(value_set->contains(int64_t{5}));
+}
+
+TEST(ExternalValueSetTest, TestString) {
+  std::string path = GetPath("string");
+  std::vector<absl::string_view> values = {"b", "", "abc", "ab", "b"};
+  ASSERT_TRUE(ExternalValueSet::Write(path, values).ok());
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<const ExternalValueSet> value_set,
+                       ExternalValueSet::Open(path));
+  EXPECT_EQ(value_set->kind(), ExternalValueKind::kString);
+  EXPECT_EQ(value_set->size(), 4);
+  EXPECT_TRUE(value_set->contains(absl::string_view("")));
+  EXPECT_TRUE(value_set->contains(absl::string_view("ab")));
+  EXPECT_TRUE(value_set->contains(absl::string_view("abc")));
+  EXPECT_TRUE(value_set->contains(absl::string_view("b")));
+  EXPECT_FALSE(value_set->contains(absl::string_view("a")));
+  EXPECT_FALSE(value_set->contains(absl::string_view("abcd")));
+  EXPECT_FALSE(value_set->contains(absl::string_view("c")));
+  EXPECT_FALSE(value_set->contains(int64_t{0}));
+}
+
+TEST(ExternalValueSetTest, TestEmpty) {
+  std::string path = GetPath("empty");
+  ASSERT_TRUE(ExternalValueSet::Write(path, std::vector<int64_t>()).ok());
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<const ExternalValueSet> value_set,
+                       ExternalValueSet::Open(path));
+  EXPECT_EQ(value_set->size(), 0);
+  EXPECT_FALSE(value_set->contains(int64_t{0}));
+}
+
+TEST(ExternalValueSetTest, TestLargeSets) {
+  for (int bloom_bits_per_value : {0, 10}) {
+    ExternalValueSetOptions options;
+    options.bloom_bits_per_value = bloom_bits_per_value;
+
+    std::set<int64_t> expected_numbers;
+    std::vector<int64_t> numbers;
+    std::set<std::string> expected_strings;
+    std::vector<std::string> strings;
+    for (int64_t i = 0; i < 10000; ++i) {
+      int64_t value = (i * 7919) % 100003 - 50000;
+      expected_numbers.insert(value);
+      numbers.push_back(value);
+      strings.push_back(absl::StrCat("value", value));
+      expected_strings.insert(strings.back());
+    }
+    std::vector<absl::string_view> string_views(strings.begin(),
+                                                strings.end());
+
+    std::string numbers_path =
+        GetPath(absl::StrCat("large_numbers_", bloom_bits_per_value));
+    std::string strings_path =
+        GetPath(absl::StrCat("large_strings_", bloom_bits_per_value));
+    ASSERT_TRUE(ExternalValueSet::Write(numbers_path, numbers, options).ok());
+    ASSERT_TRUE(
+        ExternalValueSet::Write(strings_path, string_views, options).ok());
+    ASSERT_OK_AND_ASSIGN(std::shared_ptr<const ExternalValueSet> number_set,
+                         ExternalValueSet::Open(numbers_path));
+    ASSERT_OK_AND_ASSIGN(std::shared_ptr<const ExternalValueSet> string_set,
+                         ExternalValueSet::Open(strings_path));
+    EXPECT_EQ(number_set->size(), expected_numbers.size());
+    EXPECT_EQ(string_set->size(), expected_strings.size());
+
+    for (int64_t value = -50010; value <= 50010; ++value) {
+      EXPECT_EQ(number_set->contains(value), expected_numbers.count(value) > 0)
+          << "Value " << value;
+    }
+    for (int64_t value = -50010; value <= 50010; value += 3) {
+      std::string string_value = absl::StrCat("value", value);
+      EXPECT_EQ(string_set->contains(absl::string_view(string_value)),
+                expected_strings.count(string_value) > 0)
+          << "Value " << string_value;
+    }
+  }
+}
+
+TEST(ExternalValueSetTest, TestOpenShared) {
+  std::string path = GetPath("shared");
+  ASSERT_TRUE(ExternalValueSet::Write(path, std::vector<int64_t>{1, 2}).ok());
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<const ExternalValueSet> value_set_1,
+                       ExternalValueSet::Open(path));
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<const ExternalValueSet> value_set_2,
+                       ExternalValueSet::Open(path));
+  EXPECT_EQ(value_set_1, value_set_2);
+}
+
+TEST(ExternalValueSetTest, TestOpenModifiedFile) {
+  std::string path = GetPath("modified");
+  ASSERT_TRUE(ExternalValueSet::Write(path, std::vector<int64_t>{1, 2}).ok());
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<const ExternalValueSet> value_set_1,
+                       ExternalValueSet::Open(path));
+  // A different size, so the file is known to be modified even if the
+  // modification time has a coarse resolution.
+  ASSERT_TRUE(
+      ExternalValueSet::Write(path, std::vector<int64_t>{3, 4, 5}).ok());
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<const ExternalValueSet> value_set_2,
+                       ExternalValueSet::Open(path));
+  EXPECT_NE(value_set_1, value_set_2);
+  EXPECT_TRUE(value_set_1->contains(int64_t{1}));
+  EXPECT_EQ(value_set_2->size(), 3);
+  EXPECT_TRUE(value_set_2->contains(int64_t{5}));
+}
+
+TEST(ExternalValueSetTest, TestConcurrentWriters) {
+  // Each writer writes a set of a different size, so a file mixing the writes
+  // of several writers is detected.
+  std::string path = GetPath("concurrent_writers");
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&path, t]() {
+      std::vector<int64_t> values;
+      for (int64_t i = 0; i < (t + 1) * 1000; ++i) {
+        values.push_back(i);
+      }
+      for (int i = 0; i < 20; ++i) {
+        EXPECT_TRUE(ExternalValueSet::Write(path, values).ok());
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<const ExternalValueSet> value_set,
+                       ExternalValueSet::Open(path));
+  const int64_t size = static_cast<int64_t>(value_set->size());
+  EXPECT_EQ(size % 1000, 0);
+  EXPECT_TRUE(value_set->contains(int64_t{0}));
+  EXPECT_TRUE(value_set->contains(size - 1));
+  EXPECT_FALSE(value_set->contains(size));
+}
+
+TEST(ExternalValueSetTest, TestReopenReleasedSet) {
+  std::string path = GetPath("reopened");
+  ASSERT_TRUE(ExternalValueSet::Write(path, std::vector<int64_t>{-1, 8}).ok());
+  ASSERT_TRUE(ExternalValueSet::Open(path).ok());
+  // The first set is released, so the file is mapped again.
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<const ExternalValueSet> value_set,
+                       ExternalValueSet::Open(path));
+  EXPECT_EQ(value_set->size(), 2);
+  EXPECT_TRUE(value_set->contains(int64_t{-1}));
+  EXPECT_TRUE(value_set->contains(int64_t{8}));
+}
+
+TEST(ExternalValueSetTest, TestOpenMissingFile) {
+  EXPECT_THAT(ExternalValueSet::Open(GetPath("missing")).status(),
+              StatusIs(absl::StatusCode::kNotFound, ""));
+}
+
+TEST(ExternalValueSetTest, TestOpenInvalidFile) {
+  std::string path = GetPath("invalid");
+  {
+    std::ofstream file(path, std::ios::binary);
+    file << "not a value set file";
+  }
+  EXPECT_THAT(ExternalValueSet::Open(path).status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
+TEST(ExternalValueSetTest, TestOpenTruncatedFile) {
+  std::string path = GetPath("truncated_source");
+  ExternalValueSetOptions options;
+  options.bloom_bits_per_value = 10;
+  std::vector<absl::string_view> values = {"a", "bc", "def"};
+  ASSERT_TRUE(ExternalValueSet::Write(path, values, options).ok());
+  std::string contents;
+  {
+    std::ifstream file(path, std::ios::binary);
+    contents.assign(std::istreambuf_iterator<char>(file),
+                    std::istreambuf_iterator<char>());
+  }
+  // Every truncation is rejected. Each is written to a new path, since the
+  // sets are shared by path.
+  for (size_t size = 0; size < contents.size(); ++size) {
+    std::string truncated_path = GetPath(absl::StrCat("truncated_", size));
+    {
+      std::ofstream file(truncated_path, std::ios::binary);
+      file << contents.substr(0, size);
+    }
+    EXPECT_FALSE(ExternalValueSet::Open(truncated_path).ok())
+        << "Size " << size;
+  }
+}
+
+// Returns @contents in memory aligned to 8 bytes, which is owned by the
+// returned pointer.
+std::shared_ptr<const std::vector<uint64_t>> GetAlignedCopy(
+    absl::string_view contents) {
+  auto words = std::make_shared<std::vector<uint64_t>>(
+      (contents.size() + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+  std::memcpy(words->data(), contents.data(), contents.size());
+  return words;
+}
+
+absl::string_view GetData(const std::vector<uint64_t>& words, size_t size) {
+  return absl::string_view(reinterpret_cast<const char*>(words.data()), size);
+}
+
+TEST(ExternalValueSetTest, TestFromMemory) {
+  ExternalValueSetOptions options;
+  options.bloom_bits_per_value = 10;
+  std::vector<absl::string_view> values = {"b", "", "abc", "ab"};
+  ASSERT_OK_AND_ASSIGN(std::string contents,
+                       ExternalValueSet::Serialize(values, options));
+
+  // The same contents as the file written by Write.
+  std::string path = GetPath("from_memory");
+  ASSERT_TRUE(ExternalValueSet::Write(path, values, options).ok());
+  {
+    std::ifstream file(path, std::ios::binary);
+    EXPECT_EQ(std::string(std::istreambuf_iterator<char>(file),
+                          std::istreambuf_iterator<char>()),
+              contents);
+  }
+
+  std::shared_ptr<const std::vector<uint64_t>> words = GetAlignedCopy(contents);
+  absl::string_view data = GetData(*words, contents.size());
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<const ExternalValueSet> value_set,
+                       ExternalValueSet::FromMemory(data, words));
+  // The set keeps the memory alive.
+  words.reset();
+  EXPECT_EQ(value_set->kind(), ExternalValueKind::kString);
+  EXPECT_EQ(value_set->size(), 4);
+  EXPECT_EQ(value_set->path(), "");
+  EXPECT_EQ(value_set->data().data(), data.data());
+  for (absl::string_view value : values) {
+    EXPECT_TRUE(value_set->contains(value)) << value;
+  }
+  EXPECT_FALSE(value_set->contains(absl::string_view("a")));
+  EXPECT_FALSE(value_set->contains(absl::string_view("c")));
+}
+
+TEST(ExternalValueSetTest, TestFromMemoryInvalid) {
+  ASSERT_OK_AND_ASSIGN(std::string contents,
+                       ExternalValueSet::Serialize(
+                           std::vector<absl::string_view>{"a", "bc", "def"}));
+  std::shared_ptr<const std::vector<uint64_t>> words = GetAlignedCopy(contents);
+  absl::string_view data = GetData(*words, contents.size());
+  for (size_t size = 0; size < contents.size(); ++size) {
+    EXPECT_FALSE(ExternalValueSet::FromMemory(data.substr(0, size), words).ok())
+        << "Size " << size;
+  }
+  EXPECT_THAT(ExternalValueSet::FromMemory(
+                  GetData(*words, contents.size()).substr(1), words)
+                  .status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+
+  // The offsets of the strings are not checked by FromMemory, but lookups do
+  // not read past the data.
+  std::vector<uint64_t> corrupted(words->begin(), words->end());
+  // The header is 4 words, followed by the offsets.
+  corrupted[5] = uint64_t{1} << 40;
+  ASSERT_OK_AND_ASSIGN(
+      std::shared_ptr<const ExternalValueSet> value_set,
+      ExternalValueSet::FromMemory(GetData(corrupted, contents.size()),
+                                   nullptr));
+  EXPECT_FALSE(value_set->contains(absl::string_view("bc")));
+}
+
+TEST(ExternalValueSetTest, TestValueSet) {
+  std::string path = GetPath("value_set");
+  ASSERT_TRUE(
+      ExternalValueSet::Write(path, std::vector<int64_t>{-5, 3, 9}).ok());
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<const ExternalValueSet> external,
+                       ExternalValueSet::Open(path));
+  ValueSet<int32_t> value_set(external);
+  EXPECT_EQ(value_set.representation(), ValueSetRepresentation::kExternal);
+  EXPECT_EQ(value_set.size(), 3);
+  EXPECT_EQ(value_set.external(), external);
+  EXPECT_TRUE(value_set.contains(-5));
+  EXPECT_TRUE(value_set.contains(9));
+  EXPECT_FALSE(value_set.contains(4));
+}
+
+TEST(ExternalValueSetTest, TestStringValueSet) {
+  std::string path = GetPath("string_value_set");
+  std::vector<absl::string_view> values = {"x", "yz"};
+  ASSERT_TRUE(ExternalValueSet::Write(path, values).ok());
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<const ExternalValueSet> external,
+                       ExternalValueSet::Open(path));
+  ValueSet<std::string> value_set(external);
+  EXPECT_EQ(value_set.representation(), ValueSetRepresentation::kExternal);
+  EXPECT_TRUE(value_set.contains("yz"));
+  EXPECT_FALSE(value_set.contains("y"));
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
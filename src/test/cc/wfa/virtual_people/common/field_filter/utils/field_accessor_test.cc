@@ -0,0 +1,289 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/utils/field_accessor.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "common_cpp/testing/status_macros.h"
+#include "common_cpp/testing/status_matchers.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/field_filter.pb.h"
+#include "wfa/virtual_people/common/field_filter/field_extraction_plan.h"
+#include "wfa/virtual_people/common/field_filter/field_filter.h"
+#include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+#include "wfa/virtual_people/common/field_filter/test_util.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_util.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::wfa_virtual_people::test::TestProto;
+using ::wfa_virtual_people::test::TestProtoA;
+
+// The accessors of TestProto are registered by test_proto_field_accessors,
+// which is linked to this test.
+
+// The indexes in GetAccessorTestProtos of the message setting the fields of a.b
+// to their default values, which the getters must report as set, and of the
+// message setting them to other values.
+constexpr int kDefaultValuesIndex = 5;
+constexpr int kValuesIndex = 6;
+
+// Returns the shared test messages, followed by the messages above.
+std::vector<TestProto> GetAccessorTestProtos() {
+  std::vector<TestProto> test_protos = GetTestProtos();
+  for (const char* text : {
+           R"pb(a {
+                  b {
+                    int32_value: 0
+                    int64_value: 0
+                    uint32_value: 0
+                    uint64_value: 0
+                    bool_value: false
+                    enum_value: INVALID
+                    string_value: ""
+                  }
+                })pb",
+           R"pb(a {
+                  b {
+                    int32_value: -1
+                    int64_value: 2
+                    uint32_value: 3
+                    uint64_value: 18446744073709551615
+                    bool_value: true
+                    enum_value: TEST_ENUM_3
+                    string_value: "string1"
+                  }
+                })pb",
+       }) {
+    EXPECT_TRUE(google::protobuf::TextFormat::ParseFromString(
+        text, &test_protos.emplace_back()));
+  }
+  return test_protos;
+}
+
+const FieldAccessor* FindAccessor(
+    const google::protobuf::Descriptor* descriptor, absl::string_view name,
+    bool allow_repeated = false) {
+  absl::StatusOr<std::vector<const google::protobuf::FieldDescriptor*>>
+      field_descriptors = GetFieldFromProto(descriptor, name, allow_repeated);
+  EXPECT_TRUE(field_descriptors.ok()) << field_descriptors.status();
+  return FindFieldAccessor(*field_descriptors);
+}
+
+// Checks that the getter of @name returns the same as protobuf reflection for
+// all the test protos.
+template <typename ValueType>
+void ExpectSameAsReflection(absl::string_view name) {
+  ASSERT_OK_AND_ASSIGN(
+      std::vector<const google::protobuf::FieldDescriptor*> field_descriptors,
+      GetFieldFromProto(TestProto().GetDescriptor(), name));
+  const FieldAccessor* accessor = FindFieldAccessor(field_descriptors);
+  ASSERT_NE(accessor, nullptr) << name;
+  FieldGetter<ValueType> getter = GetFieldGetter<ValueType>(accessor);
+  ASSERT_NE(getter, nullptr) << name;
+  for (const TestProto& test_proto : GetAccessorTestProtos()) {
+    ProtoFieldValue<ValueType> expected =
+        GetValueFromProto<ValueType>(test_proto, field_descriptors);
+    ProtoFieldValue<ValueType> actual = getter(test_proto);
+    EXPECT_EQ(actual.is_set, expected.is_set) << name;
+    EXPECT_EQ(actual.value, expected.value) << name;
+    EXPECT_EQ(accessor->has(test_proto), expected.is_set) << name;
+  }
+}
+
+TEST(FieldAccessorTest, TestFindFieldAccessor) {
+  EXPECT_NE(FindAccessor(TestProto().GetDescriptor(), "a"), nullptr);
+  EXPECT_NE(FindAccessor(TestProto().GetDescriptor(), "a.b.int32_value"),
+            nullptr);
+  // Repeated fields are read with reflection.
+  EXPECT_EQ(FindAccessor(TestProto().GetDescriptor(), "int32_values",
+                         /* allow_repeated = */ true),
+            nullptr);
+  EXPECT_EQ(FindAccessor(TestProto().GetDescriptor(), "a.b.string_values",
+                         /* allow_repeated = */ true),
+            nullptr);
+  // Floating point fields are read with reflection.
+  EXPECT_EQ(FindAccessor(TestProto().GetDescriptor(), "a.b.float_value"),
+            nullptr);
+  // No accessor is generated with TestProtoA as the root.
+  EXPECT_EQ(FindAccessor(TestProtoA().GetDescriptor(), "b.int32_value"),
+            nullptr);
+}
+
+TEST(FieldAccessorTest, TestGetFieldGetter) {
+  const FieldAccessor* accessor =
+      FindAccessor(TestProto().GetDescriptor(), "a.b.int64_value");
+  ASSERT_NE(accessor, nullptr);
+  EXPECT_NE(GetFieldGetter<int64_t>(accessor), nullptr);
+  EXPECT_EQ(GetFieldGetter<int32_t>(accessor), nullptr);
+  EXPECT_EQ(GetFieldGetter<const std::string&>(accessor), nullptr);
+  EXPECT_EQ(GetFieldGetter<int64_t>(nullptr), nullptr);
+}
+
+TEST(FieldAccessorTest, TestSameAsReflection) {
+  ExpectSameAsReflection<int32_t>("a.b.int32_value");
+  ExpectSameAsReflection<int64_t>("a.b.int64_value");
+  ExpectSameAsReflection<uint32_t>("a.b.uint32_value");
+  ExpectSameAsReflection<uint64_t>("a.b.uint64_value");
+  ExpectSameAsReflection<bool>("a.b.bool_value");
+  ExpectSameAsReflection<const std::string&>("a.b.string_value");
+}
+
+TEST(FieldAccessorTest, TestEnumGetter) {
+  const FieldAccessor* accessor =
+      FindAccessor(TestProto().GetDescriptor(), "a.b.enum_value");
+  ASSERT_NE(accessor, nullptr);
+  FieldGetter<int32_t> getter = GetFieldGetter<int32_t>(accessor);
+  ASSERT_NE(getter, nullptr);
+  std::vector<TestProto> test_protos = GetAccessorTestProtos();
+  EXPECT_FALSE(getter(test_protos[2]).is_set);
+  EXPECT_TRUE(getter(test_protos[kDefaultValuesIndex]).is_set);
+  EXPECT_EQ(getter(test_protos[kDefaultValuesIndex]).value, 0);
+  EXPECT_TRUE(getter(test_protos[kValuesIndex]).is_set);
+  EXPECT_EQ(getter(test_protos[kValuesIndex]).value, 3);
+}
+
+TEST(FieldAccessorTest, TestMessageGetter) {
+  const FieldAccessor* accessor =
+      FindAccessor(TestProto().GetDescriptor(), "a.b");
+  ASSERT_NE(accessor, nullptr);
+  FieldGetter<const google::protobuf::Message&> getter =
+      GetFieldGetter<const google::protobuf::Message&>(accessor);
+  ASSERT_NE(getter, nullptr);
+  std::vector<TestProto> test_protos = GetAccessorTestProtos();
+  EXPECT_FALSE(getter(test_protos[1]).is_set);
+  ProtoFieldValue<const google::protobuf::Message&> value =
+      getter(test_protos[kValuesIndex]);
+  EXPECT_TRUE(value.is_set);
+  EXPECT_EQ(&value.value, &test_protos[kValuesIndex].a().b());
+}
+
+TEST(FieldAccessorTest, TestFieldFilterUsesAccessors) {
+  FieldFilterProto config;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      R"pb(
+        op: AND
+        sub_filters { name: "a.b.int32_value" op: LT value: "0" }
+        sub_filters { name: "a.b.enum_value" op: EQUAL value: "TEST_ENUM_3" }
+        sub_filters { name: "a.b.string_value" op: IN value: "string1,x" }
+        sub_filters {
+          name: "a.b"
+          op: PARTIAL
+          sub_filters { name: "bool_value" op: HAS }
+        }
+      )pb",
+      &config));
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<FieldFilter> filter,
+                       FieldFilter::New(TestProto().GetDescriptor(), config));
+  std::vector<TestProto> test_protos = GetAccessorTestProtos();
+  EXPECT_FALSE(filter->IsMatch(test_protos[0]));
+  EXPECT_FALSE(filter->IsMatch(test_protos[kDefaultValuesIndex]));
+  EXPECT_TRUE(filter->IsMatch(test_protos[kValuesIndex]));
+}
+
+TEST(FieldAccessorTest, TestMatchBatchUsesAccessors) {
+  std::vector<std::string> config_texts = {
+      R"pb(name: "a.b.int32_value" op: EQUAL value: "-1")pb",
+      R"pb(name: "a.b.enum_value" op: EQUAL value: "TEST_ENUM_3")pb",
+      R"pb(name: "a.b.string_value" op: IN value: "string1,x")pb",
+      R"pb(name: "a.b.enum_value" op: IN value: "INVALID,TEST_ENUM_1")pb",
+      R"pb(name: "a.b.uint64_value" op: GT value: "3")pb",
+      R"pb(
+        op: AND
+        sub_filters { name: "a.b.int64_value" op: GT value: "-1" }
+        sub_filters { name: "a.b.int64_value" op: LT value: "2" }
+      )pb",
+  };
+  std::vector<TestProto> test_protos = GetAccessorTestProtos();
+  std::vector<const google::protobuf::Message*> messages;
+  for (const TestProto& test_proto : test_protos) {
+    messages.push_back(&test_proto);
+  }
+  for (const std::string& config_text : config_texts) {
+    ASSERT_OK_AND_ASSIGN(std::unique_ptr<FieldFilter> filter,
+                         FieldFilter::New(TestProto().GetDescriptor(),
+                                          ParseConfig(config_text)));
+    std::vector<bool> matches;
+    filter->MatchBatch(messages, &matches);
+    for (size_t i = 0; i < messages.size(); ++i) {
+      EXPECT_EQ(matches[i], filter->IsMatch(*messages[i]))
+          << config_text << "\nMessage: " << messages[i]->DebugString();
+    }
+  }
+}
+
+TEST(FieldAccessorTest, TestDynamicMessage) {
+  // A DynamicMessage of the TestProto descriptor is not a TestProto, so the
+  // accessors must read it with protobuf reflection.
+  google::protobuf::DynamicMessageFactory factory;
+  const google::protobuf::Message* prototype =
+      factory.GetPrototype(TestProto().GetDescriptor());
+  ASSERT_NE(prototype, nullptr);
+  const FieldAccessor* int32_accessor =
+      FindAccessor(TestProto().GetDescriptor(), "a.b.int32_value");
+  ASSERT_NE(int32_accessor, nullptr);
+  const FieldAccessor* enum_accessor =
+      FindAccessor(TestProto().GetDescriptor(), "a.b.enum_value");
+  ASSERT_NE(enum_accessor, nullptr);
+
+  for (const TestProto& test_proto : GetAccessorTestProtos()) {
+    std::unique_ptr<google::protobuf::Message> message(prototype->New());
+    ASSERT_TRUE(message->ParseFromString(test_proto.SerializeAsString()));
+    EXPECT_EQ(int32_accessor->has(*message), int32_accessor->has(test_proto));
+    ProtoFieldValue<int32_t> expected = int32_accessor->get_int32(test_proto);
+    ProtoFieldValue<int32_t> actual = int32_accessor->get_int32(*message);
+    EXPECT_EQ(actual.is_set, expected.is_set);
+    EXPECT_EQ(actual.value, expected.value);
+    expected = enum_accessor->get_int32(test_proto);
+    actual = enum_accessor->get_int32(*message);
+    EXPECT_EQ(actual.is_set, expected.is_set);
+    EXPECT_EQ(actual.value, expected.value);
+  }
+}
+
+TEST(FieldAccessorTest, TestFieldExtractionPlanUsesAccessors) {
+  std::vector<std::string> config_texts = {
+      R"pb(name: "a.b.enum_value" op: IN value: "TEST_ENUM_3")pb",
+      R"pb(name: "a.b.uint64_value" op: GT value: "3")pb",
+      R"pb(name: "a.b"
+           op: PARTIAL
+           sub_filters { name: "string_value" op: EQUAL value: "string1" }
+           sub_filters { name: "bool_value" op: HAS })pb",
+  };
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<FieldExtractionPlan> plan,
+                       FieldExtractionPlan::New(TestProto().GetDescriptor(),
+                                                ParseConfigs(config_texts)));
+  ExtractedFields fields;
+  for (size_t i = 0; i < config_texts.size(); ++i) {
+    ExpectSameAsFieldFilter(config_texts[i], GetAccessorTestProtos(),
+                            [&](const TestProto& test_proto) {
+                              plan->Extract(test_proto, &fields);
+                              return plan->IsMatch(i, fields);
+                            });
+  }
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,117 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
+
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "common_cpp/testing/status_macros.h"
+#include "common_cpp/testing/status_matchers.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::testing::ElementsAre;
+using ::wfa::StatusIs;
+using ::wfa_virtual_people::test::TestProto;
+using ::wfa_virtual_people::test::TestProtoA;
+using ::wfa_virtual_people::test::TestProtoB;
+
+TEST(FieldPathInternerTest, TestResolve) {
+  ASSERT_OK_AND_ASSIGN(
+      std::shared_ptr<const FieldPath> field_path,
+      InternFieldPath(TestProto().GetDescriptor(), "a.b.int32_values"));
+  EXPECT_THAT(*field_path,
+              ElementsAre(TestProto().GetDescriptor()->FindFieldByName("a"),
+                          TestProtoA().GetDescriptor()->FindFieldByName("b"),
+                          TestProtoB().GetDescriptor()->FindFieldByName(
+                              "int32_values")));
+}
+
+TEST(FieldPathInternerTest, TestInvalidName) {
+  EXPECT_THAT(InternFieldPath(TestProto().GetDescriptor(), "a.c").status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+  EXPECT_THAT(
+      InternFieldPath(TestProto().GetDescriptor(), "a.b.int32_value.c")
+          .status(),
+      StatusIs(absl::StatusCode::kInvalidArgument, ""));
+  EXPECT_THAT(InternFieldPath(TestProto().GetDescriptor(), "").status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
+TEST(FieldPathInternerTest, TestSamePathIsShared) {
+  ASSERT_OK_AND_ASSIGN(
+      std::shared_ptr<const FieldPath> field_path_1,
+      InternFieldPath(TestProto().GetDescriptor(), "a.b.int64_value"));
+  ASSERT_OK_AND_ASSIGN(
+      std::shared_ptr<const FieldPath> field_path_2,
+      InternFieldPath(TestProto().GetDescriptor(), "a.b.int64_value"));
+  EXPECT_EQ(field_path_1, field_path_2);
+
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<const FieldPath> other_name,
+                       InternFieldPath(TestProto().GetDescriptor(), "a.b"));
+  EXPECT_NE(field_path_1, other_name);
+  ASSERT_OK_AND_ASSIGN(
+      std::shared_ptr<const FieldPath> other_descriptor,
+      InternFieldPath(TestProtoB().GetDescriptor(), "int64_value"));
+  EXPECT_NE(field_path_1, other_descriptor);
+}
+
+TEST(FieldPathInternerTest, TestOtherPoolIsNotInterned) {
+  google::protobuf::FileDescriptorProto file;
+  TestProto().GetDescriptor()->file()->CopyTo(&file);
+  google::protobuf::DescriptorPool pool;
+  ASSERT_NE(pool.BuildFile(file), nullptr);
+  const google::protobuf::Descriptor* descriptor =
+      pool.FindMessageTypeByName(TestProto().GetDescriptor()->full_name());
+  ASSERT_NE(descriptor, nullptr);
+
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<const FieldPath> field_path_1,
+                       InternFieldPath(descriptor, "a.b.int64_value"));
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<const FieldPath> field_path_2,
+                       InternFieldPath(descriptor, "a.b.int64_value"));
+  EXPECT_NE(field_path_1, field_path_2);
+  EXPECT_EQ(*field_path_1, *field_path_2);
+}
+
+TEST(FieldPathInternerTest, TestConcurrentIntern) {
+  std::vector<std::shared_ptr<const FieldPath>> field_paths(8);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < field_paths.size(); ++i) {
+    threads.emplace_back([&field_paths, i]() {
+      absl::StatusOr<std::shared_ptr<const FieldPath>> field_path =
+          InternFieldPath(TestProto().GetDescriptor(), "a.b.uint32_value");
+      EXPECT_TRUE(field_path.ok());
+      field_paths[i] = *std::move(field_path);
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (const std::shared_ptr<const FieldPath>& field_path : field_paths) {
+    EXPECT_EQ(field_path, field_paths[0]);
+  }
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
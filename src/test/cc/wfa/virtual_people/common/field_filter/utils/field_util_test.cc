@@ -14,6 +14,9 @@
 
 #include "wfa/virtual_people/common/field_filter/utils/field_util.h"
 
+#include <memory>
+#include <vector>
+
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "common_cpp/testing/common_matchers.h"
@@ -25,12 +28,14 @@
 #include "google/protobuf/text_format.h"
 #include "gtest/gtest.h"
 #include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
 
 namespace wfa_virtual_people {
 namespace {
 
 using ::google::protobuf::FieldDescriptor;
 using ::google::protobuf::Message;
+using ::testing::ElementsAreArray;
 using ::testing::FieldsAre;
 using ::wfa::EqualsProto;
 using ::wfa::IsOk;
@@ -527,6 +532,37 @@ TEST(FieldUtilTest, DisallowRepeatedField) {
               StatusIs(absl::StatusCode::kInvalidArgument, ""));
 }
 
+TEST(FieldUtilTest, GetFieldPathFromProto) {
+  ASSERT_OK_AND_ASSIGN(
+      std::shared_ptr<const FieldPath> field_path,
+      GetFieldPathFromProto(TestProto().GetDescriptor(), "a.b.int32_value"));
+  ASSERT_OK_AND_ASSIGN(
+      std::vector<const FieldDescriptor*> field_descriptors,
+      GetFieldFromProto(TestProto().GetDescriptor(), "a.b.int32_value"));
+  EXPECT_THAT(*field_path, ElementsAreArray(field_descriptors));
+  // Resolving the same name again returns the same path.
+  ASSERT_OK_AND_ASSIGN(
+      std::shared_ptr<const FieldPath> field_path_2,
+      GetFieldPathFromProto(TestProto().GetDescriptor(), "a.b.int32_value"));
+  EXPECT_EQ(field_path.get(), field_path_2.get());
+
+  // The repeated fields are checked the same as GetFieldFromProto.
+  EXPECT_THAT(GetFieldPathFromProto(TestProto().GetDescriptor(),
+                                    "repeated_proto_a.b.int32_value",
+                                    /* allow_repeated = */ true)
+                  .status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+  EXPECT_THAT(
+      GetFieldPathFromProto(TestProto().GetDescriptor(), "a.b.int32_values")
+          .status(),
+      StatusIs(absl::StatusCode::kInvalidArgument, ""));
+  EXPECT_THAT(GetFieldPathFromProto(TestProto().GetDescriptor(),
+                                    "a.b.int32_values",
+                                    /* allow_repeated = */ true)
+                  .status(),
+              IsOk());
+}
+
 TEST(FieldUtilTest, TestAllowRepeatedAndGetParentMessage) {
   ASSERT_OK_AND_ASSIGN(
       std::vector<const google::protobuf::FieldDescriptor*> field_descriptors,
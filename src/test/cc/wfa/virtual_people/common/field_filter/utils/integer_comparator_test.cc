@@ -14,6 +14,9 @@
 
 #include "wfa/virtual_people/common/field_filter/utils/integer_comparator.h"
 
+#include <memory>
+#include <utility>
+
 #include "absl/status/status.h"
 #include "common_cpp/testing/status_macros.h"
 #include "common_cpp/testing/status_matchers.h"
@@ -21,6 +24,7 @@
 #include "google/protobuf/descriptor.h"
 #include "gtest/gtest.h"
 #include "wfa/virtual_people/common/field_filter/test/test.pb.h"
+#include "wfa/virtual_people/common/field_filter/utils/field_path_interner.h"
 #include "wfa/virtual_people/common/field_filter/utils/field_util.h"
 
 namespace wfa_virtual_people {
@@ -32,50 +36,50 @@ using ::wfa_virtual_people::test::TestProto;
 TEST(IntegerComparatorTest, FieldNotInteger) {
   // This is a float field.
   ASSERT_OK_AND_ASSIGN(
-      std::vector<const google::protobuf::FieldDescriptor*> field_descriptors,
-      GetFieldFromProto(TestProto().GetDescriptor(), "a.b.float_value"));
+      std::shared_ptr<const FieldPath> field_path,
+      GetFieldPathFromProto(TestProto().GetDescriptor(), "a.b.float_value"));
   EXPECT_THAT(
-      IntegerComparator::New(std::move(field_descriptors), "1").status(),
+      IntegerComparator::New(std::move(field_path), "1").status(),
       StatusIs(absl::StatusCode::kInvalidArgument, ""));
 }
 
 TEST(IntegerComparatorTest, InvalidValue) {
   // "a" is not a valid integer.
   ASSERT_OK_AND_ASSIGN(
-      std::vector<const google::protobuf::FieldDescriptor*> field_descriptors,
-      GetFieldFromProto(TestProto().GetDescriptor(), "a.b.int32_value"));
+      std::shared_ptr<const FieldPath> field_path,
+      GetFieldPathFromProto(TestProto().GetDescriptor(), "a.b.int32_value"));
   EXPECT_THAT(
-      IntegerComparator::New(std::move(field_descriptors), "a").status(),
+      IntegerComparator::New(std::move(field_path), "a").status(),
       StatusIs(absl::StatusCode::kInvalidArgument, ""));
 }
 
 TEST(IntegerComparatorTest, ValueTypeNotMatch) {
   // "-1" is not a valid uint32.
   ASSERT_OK_AND_ASSIGN(
-      std::vector<const google::protobuf::FieldDescriptor*> field_descriptors,
-      GetFieldFromProto(TestProto().GetDescriptor(), "a.b.uint32_value"));
+      std::shared_ptr<const FieldPath> field_path,
+      GetFieldPathFromProto(TestProto().GetDescriptor(), "a.b.uint32_value"));
   EXPECT_THAT(
-      IntegerComparator::New(std::move(field_descriptors), "-1").status(),
+      IntegerComparator::New(std::move(field_path), "-1").status(),
       StatusIs(absl::StatusCode::kInvalidArgument, ""));
 }
 
 TEST(IntegerComparatorTest, FloatValue) {
   // "10.5" is not a valid uint32.
   ASSERT_OK_AND_ASSIGN(
-      std::vector<const google::protobuf::FieldDescriptor*> field_descriptors,
-      GetFieldFromProto(TestProto().GetDescriptor(), "a.b.int32_value"));
+      std::shared_ptr<const FieldPath> field_path,
+      GetFieldPathFromProto(TestProto().GetDescriptor(), "a.b.int32_value"));
   EXPECT_THAT(
-      IntegerComparator::New(std::move(field_descriptors), "10.5").status(),
+      IntegerComparator::New(std::move(field_path), "10.5").status(),
       StatusIs(absl::StatusCode::kInvalidArgument, ""));
 }
 
 TEST(IntegerComparatorTest, TestInt32) {
   ASSERT_OK_AND_ASSIGN(
-      std::vector<const google::protobuf::FieldDescriptor*> field_descriptors,
-      GetFieldFromProto(TestProto().GetDescriptor(), "a.b.int32_value"));
+      std::shared_ptr<const FieldPath> field_path,
+      GetFieldPathFromProto(TestProto().GetDescriptor(), "a.b.int32_value"));
   ASSERT_OK_AND_ASSIGN(
       std::unique_ptr<IntegerComparator> comparator,
-      IntegerComparator::New(std::move(field_descriptors), "10"));
+      IntegerComparator::New(std::move(field_path), "10"));
 
   TestProto test_1;
   test_1.mutable_a()->mutable_b()->set_int32_value(11);
@@ -96,11 +100,11 @@ TEST(IntegerComparatorTest, TestInt32) {
 
 TEST(IntegerComparatorTest, TestInt64) {
   ASSERT_OK_AND_ASSIGN(
-      std::vector<const google::protobuf::FieldDescriptor*> field_descriptors,
-      GetFieldFromProto(TestProto().GetDescriptor(), "a.b.int64_value"));
+      std::shared_ptr<const FieldPath> field_path,
+      GetFieldPathFromProto(TestProto().GetDescriptor(), "a.b.int64_value"));
   ASSERT_OK_AND_ASSIGN(
       std::unique_ptr<IntegerComparator> comparator,
-      IntegerComparator::New(std::move(field_descriptors), "10"));
+      IntegerComparator::New(std::move(field_path), "10"));
 
   TestProto test_1;
   test_1.mutable_a()->mutable_b()->set_int64_value(11);
@@ -121,11 +125,11 @@ TEST(IntegerComparatorTest, TestInt64) {
 
 TEST(IntegerComparatorTest, TestUInt32) {
   ASSERT_OK_AND_ASSIGN(
-      std::vector<const google::protobuf::FieldDescriptor*> field_descriptors,
-      GetFieldFromProto(TestProto().GetDescriptor(), "a.b.uint32_value"));
+      std::shared_ptr<const FieldPath> field_path,
+      GetFieldPathFromProto(TestProto().GetDescriptor(), "a.b.uint32_value"));
   ASSERT_OK_AND_ASSIGN(
       std::unique_ptr<IntegerComparator> comparator,
-      IntegerComparator::New(std::move(field_descriptors), "10"));
+      IntegerComparator::New(std::move(field_path), "10"));
 
   TestProto test_1;
   test_1.mutable_a()->mutable_b()->set_uint32_value(11);
@@ -146,11 +150,11 @@ TEST(IntegerComparatorTest, TestUInt32) {
 
 TEST(IntegerComparatorTest, TestUInt64) {
   ASSERT_OK_AND_ASSIGN(
-      std::vector<const google::protobuf::FieldDescriptor*> field_descriptors,
-      GetFieldFromProto(TestProto().GetDescriptor(), "a.b.uint64_value"));
+      std::shared_ptr<const FieldPath> field_path,
+      GetFieldPathFromProto(TestProto().GetDescriptor(), "a.b.uint64_value"));
   ASSERT_OK_AND_ASSIGN(
       std::unique_ptr<IntegerComparator> comparator,
-      IntegerComparator::New(std::move(field_descriptors), "10"));
+      IntegerComparator::New(std::move(field_path), "10"));
 
   TestProto test_1;
   test_1.mutable_a()->mutable_b()->set_uint64_value(11);
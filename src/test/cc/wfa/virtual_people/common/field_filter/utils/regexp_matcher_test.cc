@@ -0,0 +1,96 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/utils/regexp_matcher.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "common_cpp/testing/status_macros.h"
+#include "common_cpp/testing/status_matchers.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "re2/re2.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::wfa::StatusIs;
+
+// Checks that @pattern is matched as @kind, and matches the same values as
+// RE2::FullMatch.
+void ExpectSameAsRe2(const std::string& pattern, RegexpMatcherKind kind) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<RegexpMatcher> matcher,
+                       RegexpMatcher::New(pattern));
+  EXPECT_EQ(matcher->kind(), kind) << pattern;
+  RE2 regexp(pattern);
+  // Newlines and invalid UTF-8 are not matched by ".".
+  std::vector<std::string> values = {
+      "",         "abc",         "abcdef",       "xyzabc",
+      "xabcx",    "ab",          "a.c",          "a$",
+      "a\\",      "abc\n",       "\nabc",        "abc\ndef",
+      "abc\xff",  "\xff" "abc",  "abc\xc3\xa9",  "\xc3\xa9" "abc",
+  };
+  for (const std::string& value : values) {
+    EXPECT_EQ(matcher->Matches(value), RE2::FullMatch(value, regexp))
+        << "Pattern: " << pattern << " Value: " << value;
+  }
+}
+
+TEST(RegexpMatcherTest, TestInvalidPattern) {
+  EXPECT_THAT(RegexpMatcher::New("[a").status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+  EXPECT_THAT(RegexpMatcher::New("a**").status(),
+              StatusIs(absl::StatusCode::kInvalidArgument, ""));
+}
+
+TEST(RegexpMatcherTest, TestLiteral) {
+  ExpectSameAsRe2("abc", RegexpMatcherKind::kLiteral);
+  ExpectSameAsRe2("^abc$", RegexpMatcherKind::kLiteral);
+  ExpectSameAsRe2("a\\.c", RegexpMatcherKind::kLiteral);
+  ExpectSameAsRe2("a\\$", RegexpMatcherKind::kLiteral);
+  ExpectSameAsRe2("a\\\\", RegexpMatcherKind::kLiteral);
+  ExpectSameAsRe2("", RegexpMatcherKind::kLiteral);
+}
+
+TEST(RegexpMatcherTest, TestPrefix) {
+  ExpectSameAsRe2("abc.*", RegexpMatcherKind::kPrefix);
+  ExpectSameAsRe2("^abc.*$", RegexpMatcherKind::kPrefix);
+}
+
+TEST(RegexpMatcherTest, TestSuffix) {
+  ExpectSameAsRe2(".*abc", RegexpMatcherKind::kSuffix);
+  ExpectSameAsRe2(".*", RegexpMatcherKind::kSuffix);
+}
+
+TEST(RegexpMatcherTest, TestContains) {
+  ExpectSameAsRe2(".*abc.*", RegexpMatcherKind::kContains);
+  ExpectSameAsRe2(".*\\..*", RegexpMatcherKind::kContains);
+}
+
+TEST(RegexpMatcherTest, TestRegexp) {
+  ExpectSameAsRe2("a.c", RegexpMatcherKind::kRegexp);
+  ExpectSameAsRe2("abc\\.*", RegexpMatcherKind::kRegexp);
+  ExpectSameAsRe2("ab[a-z]", RegexpMatcherKind::kRegexp);
+  ExpectSameAsRe2("(?i)ABC", RegexpMatcherKind::kRegexp);
+  ExpectSameAsRe2("abc|xyzabc", RegexpMatcherKind::kRegexp);
+  ExpectSameAsRe2(".*?abc", RegexpMatcherKind::kRegexp);
+  ExpectSameAsRe2("\\x61bc", RegexpMatcherKind::kRegexp);
+  ExpectSameAsRe2(".*c\nd.*", RegexpMatcherKind::kRegexp);
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,181 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/utils/value_set.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::ElementsAreArray;
+
+TEST(ValueSetTest, TestEmpty) {
+  ValueSet<int32_t> empty_set;
+  EXPECT_EQ(empty_set.size(), 0);
+  EXPECT_FALSE(empty_set.contains(0));
+
+  ValueSet<int32_t> parsed_empty_set(absl::flat_hash_set<int32_t>{});
+  EXPECT_FALSE(parsed_empty_set.contains(0));
+}
+
+TEST(ValueSetTest, TestInline) {
+  ValueSet<int64_t> value_set(
+      absl::flat_hash_set<int64_t>({-1000000, 7, 123456789}));
+  EXPECT_EQ(value_set.representation(), ValueSetRepresentation::kInline);
+  EXPECT_EQ(value_set.size(), 3);
+  EXPECT_TRUE(value_set.contains(-1000000));
+  EXPECT_TRUE(value_set.contains(7));
+  EXPECT_TRUE(value_set.contains(123456789));
+  EXPECT_FALSE(value_set.contains(0));
+  EXPECT_FALSE(value_set.contains(8));
+}
+
+TEST(ValueSetTest, TestBitmap) {
+  ValueSet<int32_t> value_set(absl::flat_hash_set<int32_t>({-2, 0, 1, 2, 70}));
+  EXPECT_EQ(value_set.representation(), ValueSetRepresentation::kBitmap);
+  for (int32_t value = -100; value <= 100; ++value) {
+    EXPECT_EQ(value_set.contains(value),
+              value == -2 || value == 0 || value == 1 || value == 2 ||
+                  value == 70)
+        << value;
+  }
+  EXPECT_FALSE(value_set.contains(std::numeric_limits<int32_t>::min()));
+  EXPECT_FALSE(value_set.contains(std::numeric_limits<int32_t>::max()));
+}
+
+TEST(ValueSetTest, TestBitmapUnsignedExtremes) {
+  uint64_t max = std::numeric_limits<uint64_t>::max();
+  ValueSet<uint64_t> value_set(
+      absl::flat_hash_set<uint64_t>({max, max - 1, max - 3}));
+  EXPECT_EQ(value_set.representation(), ValueSetRepresentation::kBitmap);
+  EXPECT_TRUE(value_set.contains(max));
+  EXPECT_TRUE(value_set.contains(max - 1));
+  EXPECT_FALSE(value_set.contains(max - 2));
+  EXPECT_TRUE(value_set.contains(max - 3));
+  EXPECT_FALSE(value_set.contains(0));
+}
+
+TEST(ValueSetTest, TestBool) {
+  ValueSet<bool> value_set(absl::flat_hash_set<bool>({true}));
+  EXPECT_TRUE(value_set.contains(true));
+  EXPECT_FALSE(value_set.contains(false));
+}
+
+TEST(ValueSetTest, TestSorted) {
+  absl::flat_hash_set<uint32_t> values;
+  for (uint32_t i = 0; i < 20; ++i) {
+    values.insert(i * 100000);
+  }
+  ValueSet<uint32_t> value_set(values);
+  EXPECT_EQ(value_set.representation(), ValueSetRepresentation::kSorted);
+  for (uint32_t i = 0; i < 20; ++i) {
+    EXPECT_TRUE(value_set.contains(i * 100000));
+    EXPECT_FALSE(value_set.contains(i * 100000 + 1));
+  }
+}
+
+TEST(ValueSetTest, TestHashSet) {
+  absl::flat_hash_set<int64_t> values;
+  for (int64_t i = 0; i < 1000; ++i) {
+    values.insert(i * 1000003);
+  }
+  ValueSet<int64_t> value_set(values);
+  EXPECT_EQ(value_set.representation(), ValueSetRepresentation::kHashSet);
+  for (int64_t i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(value_set.contains(i * 1000003));
+    EXPECT_FALSE(value_set.contains(i * 1000003 + 1));
+  }
+}
+
+TEST(ValueSetTest, TestString) {
+  ValueSet<std::string> small_set(
+      absl::flat_hash_set<std::string>({"a", "bc", ""}));
+  EXPECT_EQ(small_set.representation(), ValueSetRepresentation::kInline);
+  EXPECT_TRUE(small_set.contains("a"));
+  EXPECT_TRUE(small_set.contains("bc"));
+  EXPECT_TRUE(small_set.contains(""));
+  EXPECT_FALSE(small_set.contains("b"));
+
+  absl::flat_hash_set<std::string> values;
+  for (int i = 0; i < 100; ++i) {
+    values.insert(std::to_string(i));
+  }
+  ValueSet<std::string> large_set(values);
+  EXPECT_EQ(large_set.representation(), ValueSetRepresentation::kHashSet);
+  EXPECT_EQ(large_set.size(), 100);
+  EXPECT_TRUE(large_set.contains("99"));
+  EXPECT_FALSE(large_set.contains("100"));
+  EXPECT_FALSE(large_set.contains("99x"));
+  EXPECT_FALSE(large_set.contains(""));
+
+  values.insert("");
+  values.insert("999");
+  ValueSet<std::string> large_set_with_empty(values);
+  EXPECT_TRUE(large_set_with_empty.contains(""));
+  EXPECT_TRUE(large_set_with_empty.contains("999"));
+  EXPECT_FALSE(large_set_with_empty.contains("99 "));
+}
+
+TEST(ValueSetTest, TestGetValues) {
+  // Inline, bitmap, sorted and hash set.
+  for (std::vector<int64_t> values : std::vector<std::vector<int64_t>>{
+           {5, -3, 1},
+           {30, 10, 20, 11, 12, 13, 14, 15, 16, 17},
+           {1000000, -1000000, 0, 1, 2, 3, 4, 5, 6, 7},
+           {}}) {
+    ValueSet<int64_t> set(absl::MakeConstSpan(values));
+    std::sort(values.begin(), values.end());
+    EXPECT_THAT(set.GetValues(), ElementsAreArray(values));
+    EXPECT_EQ(ValueSet<int64_t>(absl::MakeConstSpan(set.GetValues())).size(),
+              set.size());
+  }
+  std::vector<uint64_t> large_values;
+  for (uint64_t i = 0; i < 100; ++i) {
+    large_values.push_back(i * 1000000007);
+  }
+  ValueSet<uint64_t> large_set(absl::MakeConstSpan(large_values));
+  EXPECT_EQ(large_set.representation(), ValueSetRepresentation::kHashSet);
+  EXPECT_THAT(large_set.GetValues(), ElementsAreArray(large_values));
+
+  std::vector<absl::string_view> strings = {"b", "", "a"};
+  ValueSet<std::string> string_set(absl::MakeConstSpan(strings));
+  EXPECT_TRUE(string_set.contains(""));
+  EXPECT_TRUE(string_set.contains("b"));
+  EXPECT_FALSE(string_set.contains("c"));
+  EXPECT_THAT(string_set.GetValues(), ElementsAre("", "a", "b"));
+}
+
+TEST(ValueSetTest, TestMatchesStringLiteral) {
+  EXPECT_TRUE(MatchesStringLiteral("", ""));
+  EXPECT_TRUE(MatchesStringLiteral("abc", std::string("abc")));
+  EXPECT_FALSE(MatchesStringLiteral("abc", "ab"));
+  EXPECT_FALSE(MatchesStringLiteral("abc", "xbc"));
+  EXPECT_FALSE(MatchesStringLiteral("abc", "abx"));
+  EXPECT_FALSE(MatchesStringLiteral("", "a"));
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
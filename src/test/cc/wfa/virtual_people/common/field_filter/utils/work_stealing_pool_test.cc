@@ -0,0 +1,94 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/common/field_filter/utils/work_stealing_pool.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::testing::Each;
+
+TEST(WorkStealingPoolTest, TestEachTaskRunsOnce) {
+  for (int thread_count : {1, 2, 8}) {
+    WorkStealingPool pool(thread_count);
+    EXPECT_EQ(pool.thread_count(), thread_count);
+    for (int task_count : {0, 1, 7, 1000}) {
+      std::vector<std::atomic<int>> runs(task_count);
+      pool.Run(task_count, [&runs](int index) { ++runs[index]; });
+      for (const std::atomic<int>& run : runs) {
+        EXPECT_EQ(run.load(), 1);
+      }
+    }
+  }
+}
+
+TEST(WorkStealingPoolTest, TestSingleThreadRunsInCallingThread) {
+  WorkStealingPool pool(1);
+  std::vector<std::thread::id> thread_ids(10);
+  pool.Run(thread_ids.size(), [&thread_ids](int index) {
+    thread_ids[index] = std::this_thread::get_id();
+  });
+  EXPECT_THAT(thread_ids, Each(std::this_thread::get_id()));
+}
+
+TEST(WorkStealingPoolTest, TestTasksAreStolen) {
+  WorkStealingPool pool(2);
+  absl::Mutex mutex;
+  int done_count = 0;
+  bool all_done = false;
+  // Tasks 0 and 1 are in the queue of the calling thread. Task 0 waits for
+  // all the other tasks, so task 1 must be stolen by the other thread.
+  pool.Run(4, [&](int index) {
+    absl::MutexLock lock(&mutex);
+    if (index == 0) {
+      all_done = mutex.AwaitWithTimeout(
+          absl::Condition(
+              +[](int* done_count) { return *done_count == 3; }, &done_count),
+          absl::Seconds(10));
+    } else {
+      ++done_count;
+    }
+  });
+  EXPECT_TRUE(all_done);
+}
+
+TEST(WorkStealingPoolTest, TestConcurrentRuns) {
+  WorkStealingPool pool(4);
+  std::atomic<int> total(0);
+  std::vector<std::thread> callers;
+  for (int i = 0; i < 4; ++i) {
+    callers.emplace_back([&pool, &total]() {
+      for (int j = 0; j < 100; ++j) {
+        pool.Run(10, [&total](int index) { total += index; });
+      }
+    });
+  }
+  for (std::thread& caller : callers) {
+    caller.join();
+  }
+  // Each Run adds 0 + 1 + ... + 9.
+  EXPECT_EQ(total.load(), 4 * 100 * 45);
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people